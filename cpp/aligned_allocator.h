@@ -0,0 +1,72 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_ALIGNEDALLOCATOR_H
+#define SPHERICAL_VOLUME_RENDERING_ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace svr {
+
+// The size of a cache line on the targeted architectures.
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+// A minimal allocator that returns memory aligned to Alignment bytes, where
+// Alignment is a power of two. This allows precomputed tables to be read with
+// aligned vector loads and to begin on a cache line boundary. Since aligned
+// operator new is unavailable in C++11, this over-allocates and stores the
+// address of the original allocation just before the aligned block.
+template <class T, std::size_t Alignment = CACHE_LINE_SIZE>
+struct AlignedAllocator {
+  static_assert((Alignment & (Alignment - 1)) == 0,
+                "Alignment must be a power of two.");
+  static_assert(Alignment >= alignof(void *),
+                "Alignment must be at least that of a pointer.");
+
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() noexcept = default;
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  inline T *allocate(std::size_t n) {
+    void *const raw =
+        ::operator new(n * sizeof(T) + Alignment + sizeof(void *));
+    const std::uintptr_t first =
+        reinterpret_cast<std::uintptr_t>(raw) + sizeof(void *);
+    const std::uintptr_t aligned =
+        (first + Alignment - 1) & ~static_cast<std::uintptr_t>(Alignment - 1);
+    reinterpret_cast<void **>(aligned)[-1] = raw;
+    return reinterpret_cast<T *>(aligned);
+  }
+
+  inline void deallocate(T *p, std::size_t) noexcept {
+    ::operator delete(reinterpret_cast<void **>(p)[-1]);
+  }
+};
+
+template <class T, class U, std::size_t Alignment>
+inline bool operator==(const AlignedAllocator<T, Alignment> &,
+                       const AlignedAllocator<U, Alignment> &) noexcept {
+  return true;
+}
+
+template <class T, class U, std::size_t Alignment>
+inline bool operator!=(const AlignedAllocator<T, Alignment> &,
+                       const AlignedAllocator<U, Alignment> &) noexcept {
+  return false;
+}
+
+// A std::vector whose data begins on a cache line boundary.
+template <class T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_ALIGNEDALLOCATOR_H
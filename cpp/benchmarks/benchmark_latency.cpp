@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../spherical_volume_rendering_util.h"
+#include "benchmark_rays.h"
+
+// Measures the distribution of per-ray traversal latency, rather than the mean
+// over a whole set of rays as benchmark_svr does, so that a change that slows
+// a small fraction of rays, e.g. those that graze a boundary, is visible. The
+// results are written as JSON, and may be compared against a stored baseline:
+//
+//  >    ./bin/benchmark_latency_svr --output=baseline.json
+//  >    ./bin/benchmark_latency_svr --baseline=baseline.json
+//
+// The second run exits with status 1 if a category regressed by more than the
+// threshold, i.e. if a percentile latency grew, or the voxels per second fell,
+// by more than 10%. The baseline should be recorded on the same machine, and
+// with the same --rays, --repetitions, and --sections: the run exits with
+// status 3, without comparing, if they differ. Status 2 is a usage or I/O
+// error.
+//
+// Flags:
+//   --rays=N         The number of rays of each category. Defaults to 16384.
+//   --repetitions=N  The number of times each ray is timed. Defaults to 5.
+//   --sections=N     The number of radial, polar, and azimuthal sections of
+//                    the grid. Defaults to 64.
+//   --output=PATH    Writes the results to PATH rather than stdout.
+//   --baseline=PATH  Compares the results against those of PATH.
+//   --threshold=T    The relative regression that fails the comparison.
+//                    Defaults to 0.1.
+namespace {
+
+// The categories of rays, which take different paths through the traversal.
+struct RayCategory {
+  const char *name;
+  RayDistribution distribution;
+};
+
+constexpr RayCategory RAY_CATEGORIES[] = {
+    // Rays from outside the sphere, which find their entrance voxel on its
+    // boundary.
+    {"outside_entry", RANDOM_OUTSIDE},
+    // Rays from within the sphere, which find their entrance voxel from the
+    // ray origin.
+    {"inside_origin", RANDOM_INSIDE},
+    // Rays tangent to the radial voxel boundaries.
+    {"tangential", TANGENTIAL},
+    // Rays through the center, where every angular boundary meets.
+    {"center_crossing", CENTER_CROSSING}};
+
+// The metrics of a category, in the order they are written to the JSON. The
+// latencies are higher when worse, and voxels_per_second is lower when worse.
+struct LatencyMetrics {
+  double p50_ns;
+  double p99_ns;
+  double p999_ns;
+  double mean_ns;
+  double voxels_per_second;
+  double voxels_per_ray;
+};
+
+struct Flags {
+  std::size_t num_rays = 16384;
+  std::size_t num_repetitions = 5;
+  std::size_t num_sections = 64;
+  std::string output;
+  std::string baseline;
+  double threshold = 0.1;
+};
+
+// Parses flags of the form --name=value. Returns false with a message if a
+// flag is not recognized.
+bool parseFlags(int argc, char **argv, Flags &flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const std::size_t equals = arg.find('=');
+    const std::string name = arg.substr(0, equals);
+    const std::string value =
+        equals == std::string::npos ? "" : arg.substr(equals + 1);
+    if (name == "--rays") {
+      flags.num_rays = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "--repetitions") {
+      flags.num_repetitions = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "--sections") {
+      flags.num_sections = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "--output") {
+      flags.output = value;
+    } else if (name == "--baseline") {
+      flags.baseline = value;
+    } else if (name == "--threshold") {
+      flags.threshold = std::strtod(value.c_str(), nullptr);
+    } else {
+      std::fprintf(stderr, "Unknown flag '%s'.\n", arg.c_str());
+      return false;
+    }
+  }
+  if (flags.num_rays == 0 || flags.num_repetitions == 0 ||
+      flags.num_sections == 0) {
+    std::fprintf(stderr, "--rays, --repetitions, and --sections must be "
+                         "positive.\n");
+    return false;
+  }
+  return true;
+}
+
+// Returns the latency of the given percentile of the sorted latencies.
+double percentile(const std::vector<double> &sorted, double fraction) {
+  const std::size_t i = std::min(
+      sorted.size() - 1, static_cast<std::size_t>(fraction * sorted.size()));
+  return sorted[i];
+}
+
+// Times each ray individually with a counting visitor. The latency of a ray is
+// the least of its repetitions, which removes the noise of interrupts and
+// preemption while keeping the variation in cost between rays.
+LatencyMetrics measureLatency(const svr::SphericalVoxelGrid &grid,
+                              const std::vector<Ray> &rays,
+                              std::size_t num_repetitions) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<double> latencies(rays.size(),
+                                std::numeric_limits<double>::infinity());
+  std::size_t num_voxels = 0;
+  for (std::size_t repetition = 0; repetition < num_repetitions;
+       ++repetition) {
+    num_voxels = 0;
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      const Clock::time_point begin = Clock::now();
+      svr::walkSphericalVolume(
+          rays[i], grid, /*max_t=*/1.0,
+          [&](int, int, int, double, double) { ++num_voxels; });
+      const Clock::time_point end = Clock::now();
+      latencies[i] = std::min(
+          latencies[i],
+          std::chrono::duration<double, std::nano>(end - begin).count());
+    }
+  }
+  double total_ns = 0.0;
+  for (const double latency : latencies) total_ns += latency;
+  std::sort(latencies.begin(), latencies.end());
+  return {.p50_ns = percentile(latencies, 0.5),
+          .p99_ns = percentile(latencies, 0.99),
+          .p999_ns = percentile(latencies, 0.999),
+          .mean_ns = total_ns / rays.size(),
+          .voxels_per_second = num_voxels / (total_ns * 1e-9),
+          .voxels_per_ray = static_cast<double>(num_voxels) / rays.size()};
+}
+
+std::string toJson(const Flags &flags,
+                   const std::vector<LatencyMetrics> &metrics) {
+  std::ostringstream json;
+  json.precision(6);
+  json << std::fixed;
+  json << "{\n"
+       << "  \"num_rays\": " << flags.num_rays << ",\n"
+       << "  \"num_repetitions\": " << flags.num_repetitions << ",\n"
+       << "  \"num_sections\": " << flags.num_sections << ",\n"
+       << "  \"categories\": {\n";
+  for (std::size_t i = 0; i < metrics.size(); ++i) {
+    const LatencyMetrics &m = metrics[i];
+    json << "    \"" << RAY_CATEGORIES[i].name << "\": {"
+         << "\"p50_ns\": " << m.p50_ns << ", \"p99_ns\": " << m.p99_ns
+         << ", \"p999_ns\": " << m.p999_ns << ", \"mean_ns\": " << m.mean_ns
+         << ", \"voxels_per_second\": " << m.voxels_per_second
+         << ", \"voxels_per_ray\": " << m.voxels_per_ray << "}"
+         << (i + 1 < metrics.size() ? ",\n" : "\n");
+  }
+  json << "  }\n}\n";
+  return json.str();
+}
+
+// A JSON object of the baseline, as the range [begin, end) of its text from
+// its opening brace to one past its closing brace.
+struct JsonObject {
+  std::size_t begin;
+  std::size_t end;
+};
+
+// Returns the position of the value of the key that is a direct member of the
+// object, or std::string::npos if the object has no such member. This reads
+// only the subset of JSON written by toJson(): strings have no escapes.
+std::size_t memberValue(const std::string &json, const JsonObject &object,
+                        const std::string &key) {
+  int depth = 0;
+  for (std::size_t i = object.begin; i < object.end; ++i) {
+    if (json[i] == '{') {
+      ++depth;
+    } else if (json[i] == '}') {
+      --depth;
+    } else if (json[i] == '"') {
+      const std::size_t close = json.find('"', i + 1);
+      if (close == std::string::npos || close >= object.end) break;
+      const std::size_t colon = json.find_first_not_of(" \n\t", close + 1);
+      if (depth == 1 && colon < object.end && json[colon] == ':' &&
+          json.compare(i + 1, close - i - 1, key) == 0) {
+        return json.find_first_not_of(" \n\t", colon + 1);
+      }
+      i = close;
+    }
+  }
+  return std::string::npos;
+}
+
+// Reads the object that is the member of the parent with the given key.
+// Returns false if there is no such member, or it is not an object.
+bool memberObject(const std::string &json, const JsonObject &parent,
+                  const std::string &key, JsonObject &object) {
+  const std::size_t begin = memberValue(json, parent, key);
+  if (begin >= parent.end || json[begin] != '{') return false;
+  int depth = 0;
+  for (std::size_t i = begin; i < parent.end; ++i) {
+    if (json[i] == '{') ++depth;
+    if (json[i] == '}' && --depth == 0) {
+      object = {.begin = begin, .end = i + 1};
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads the number that is the member of the object with the given key.
+// Returns false if there is no such member, or it is not a number.
+bool memberNumber(const std::string &json, const JsonObject &object,
+                  const std::string &key, double &value) {
+  const std::size_t begin = memberValue(json, object, key);
+  if (begin >= object.end) return false;
+  char *end;
+  value = std::strtod(json.c_str() + begin, &end);
+  return end != json.c_str() + begin;
+}
+
+// Returns true if the baseline was recorded with the same rays, repetitions,
+// and sections as this run, since otherwise its metrics are not comparable.
+// Prints each difference to stderr.
+bool isComparableBaseline(const std::string &json, const Flags &flags) {
+  const JsonObject root = {.begin = json.find('{'), .end = json.size()};
+  if (root.begin == std::string::npos) {
+    std::fprintf(stderr, "The baseline is not a JSON object.\n");
+    return false;
+  }
+  const struct {
+    const char *name;
+    std::size_t value;
+  } parameters[] = {{"num_rays", flags.num_rays},
+                    {"num_repetitions", flags.num_repetitions},
+                    {"num_sections", flags.num_sections}};
+  bool is_comparable = true;
+  for (const auto &parameter : parameters) {
+    double expected;
+    if (!memberNumber(json, root, parameter.name, expected)) {
+      std::fprintf(stderr, "%s is missing from the baseline.\n",
+                   parameter.name);
+      is_comparable = false;
+    } else if (expected != static_cast<double>(parameter.value)) {
+      std::fprintf(stderr,
+                   "The baseline was recorded with %s=%.0f, but this run "
+                   "has %s=%zu.\n",
+                   parameter.name, expected, parameter.name, parameter.value);
+      is_comparable = false;
+    }
+  }
+  return is_comparable;
+}
+
+// Reads the metric of the category from JSON written by toJson(). Returns
+// false if the baseline has no such category or metric.
+bool baselineMetric(const std::string &json, const std::string &category,
+                    const std::string &metric, double &value) {
+  const JsonObject root = {.begin = json.find('{'), .end = json.size()};
+  JsonObject categories, object;
+  return root.begin != std::string::npos &&
+         memberObject(json, root, "categories", categories) &&
+         memberObject(json, categories, category, object) &&
+         memberNumber(json, object, metric, value);
+}
+
+// Compares the metrics against the baseline, printing each comparison to
+// stderr. Returns false if any metric regressed by more than the threshold.
+bool compareWithBaseline(const std::string &baseline,
+                         const std::vector<LatencyMetrics> &metrics,
+                         double threshold) {
+  bool passed = true;
+  for (std::size_t i = 0; i < metrics.size(); ++i) {
+    const char *const category = RAY_CATEGORIES[i].name;
+    const struct {
+      const char *name;
+      double value;
+      bool is_higher_worse;
+    } compared[] = {{"p50_ns", metrics[i].p50_ns, true},
+                    {"p99_ns", metrics[i].p99_ns, true},
+                    {"p999_ns", metrics[i].p999_ns, true},
+                    {"voxels_per_second", metrics[i].voxels_per_second,
+                     false}};
+    for (const auto &metric : compared) {
+      double expected;
+      if (!baselineMetric(baseline, category, metric.name, expected) ||
+          expected <= 0.0) {
+        std::fprintf(stderr, "%-16s %-18s missing from the baseline\n",
+                     category, metric.name);
+        continue;
+      }
+      const double change = metric.value / expected - 1.0;
+      const bool regressed =
+          metric.is_higher_worse ? change > threshold : -change > threshold;
+      passed &= !regressed;
+      std::fprintf(stderr, "%-16s %-18s %14.1f -> %14.1f (%+6.1f%%)%s\n",
+                   category, metric.name, expected, metric.value,
+                   100.0 * change, regressed ? "  REGRESSED" : "");
+    }
+  }
+  return passed;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Flags flags;
+  if (!parseFlags(argc, argv, flags)) return 2;
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      flags.num_sections, flags.num_sections, flags.num_sections,
+      BoundVec3(0.0, 0.0, 0.0));
+  std::vector<LatencyMetrics> metrics;
+  for (const RayCategory &category : RAY_CATEGORIES) {
+    const std::vector<Ray> rays =
+        distributedRays(category.distribution, flags.num_rays,
+                        sphere_max_radius, flags.num_sections);
+    metrics.push_back(measureLatency(grid, rays, flags.num_repetitions));
+  }
+
+  const std::string json = toJson(flags, metrics);
+  if (flags.output.empty()) {
+    std::fputs(json.c_str(), stdout);
+  } else {
+    std::ofstream output(flags.output);
+    output << json;
+    if (!output) {
+      std::fprintf(stderr, "Unable to write '%s'.\n", flags.output.c_str());
+      return 2;
+    }
+  }
+
+  if (flags.baseline.empty()) return 0;
+  std::ifstream input(flags.baseline);
+  if (!input) {
+    std::fprintf(stderr, "Unable to read '%s'.\n", flags.baseline.c_str());
+    return 2;
+  }
+  const std::string baseline((std::istreambuf_iterator<char>(input)),
+                             std::istreambuf_iterator<char>());
+  if (!isComparableBaseline(baseline, flags)) {
+    std::fprintf(stderr, "Not comparing against '%s'; rerun with the flags "
+                         "of the baseline, or record a new one.\n",
+                 flags.baseline.c_str());
+    return 3;
+  }
+  return compareWithBaseline(baseline, metrics, flags.threshold) ? 0 : 1;
+}
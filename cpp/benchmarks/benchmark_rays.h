@@ -0,0 +1,146 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_BENCHMARK_RAYS_H
+#define SPHERICAL_VOLUME_RENDERING_BENCHMARK_RAYS_H
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "../ray.h"
+#include "../renderer.h"
+
+// The ray sets traversed by the benchmarks, which are shared by benchmark_svr
+// and benchmark_latency so that both measure the same rays.
+
+// Returns X^2 orthographic rays along +Z, whose origins are spaced evenly over
+// [-1,000.0, 1,000.0] in X and Y, and lie outside a sphere at the origin with
+// the given radius. See orthographicTraverseXSquaredRaysinYCubedVoxels in
+// benchmark_svr.cpp.
+inline std::vector<Ray> orthographicRays(
+    const std::size_t X, const double sphere_max_radius) noexcept {
+  std::vector<Ray> rays;
+  rays.reserve(X * X);
+  const UnitVec3 ray_direction(0.0, 0.0, 1.0);
+  double ray_origin_x = -1000.0;
+  double ray_origin_y = -1000.0;
+  const double ray_origin_z = -(sphere_max_radius + 1.0);
+
+  const double ray_origin_plane_movement = 2000.0 / X;
+  for (std::size_t i = 0; i < X; ++i) {
+    for (std::size_t j = 0; j < X; ++j) {
+      rays.emplace_back(BoundVec3(ray_origin_x, ray_origin_y, ray_origin_z),
+                        ray_direction);
+      ray_origin_y =
+          (j == X - 1) ? -1000.0 : ray_origin_y + ray_origin_plane_movement;
+    }
+    ray_origin_x += ray_origin_plane_movement;
+  }
+  return rays;
+}
+
+// The distributions of rays used to measure the traversal beyond orthographic
+// rays entering from outside of the sphere.
+enum RayDistribution {
+  // Orthographic rays along +Z, as in
+  // orthographicTraverseXSquaredRaysinYCubedVoxels.
+  ORTHOGRAPHIC = 0,
+  // Rays of a perspective camera outside of the sphere that views all of it.
+  PERSPECTIVE = 1,
+  // Rays from random points outside of the sphere towards random points
+  // within it.
+  RANDOM_OUTSIDE = 2,
+  // Rays from random points within the sphere in random directions. These
+  // find their entrance voxel from the ray origin rather than the sphere
+  // boundary.
+  RANDOM_INSIDE = 3,
+  // Rays along +Z that are tangent to the radial voxel boundaries.
+  TANGENTIAL = 4,
+  // Rays in random directions through the sphere center, where every polar
+  // and azimuthal boundary meets.
+  CENTER_CROSSING = 5
+};
+
+// Returns num_rays rays of the given distribution for a sphere centered at
+// the origin with the given radius and num_radial_sections radial sections.
+// Random rays use a fixed seed, so that each run traverses the same rays.
+inline std::vector<Ray> distributedRays(
+    const RayDistribution distribution, const std::size_t num_rays,
+    const double sphere_max_radius, const std::size_t num_radial_sections) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  // Returns a random point within the unit ball.
+  const auto randomPointInBall = [&]() -> FreeVec3 {
+    while (true) {
+      const FreeVec3 p(uniform(generator), uniform(generator),
+                       uniform(generator));
+      if (p.squared_length() <= 1.0 && p.squared_length() > 0.0) return p;
+    }
+  };
+  std::vector<Ray> rays;
+  rays.reserve(num_rays);
+  switch (distribution) {
+    case ORTHOGRAPHIC: {
+      const std::size_t X = std::sqrt(num_rays);
+      rays = orthographicRays(X, sphere_max_radius);
+      break;
+    }
+    case PERSPECTIVE: {
+      const std::size_t X = std::sqrt(num_rays);
+      const auto camera = svr::Camera::perspective(
+          BoundVec3(0.0, 0.0, -3.0 * sphere_max_radius),
+          FreeVec3(0.0, 0.0, 1.0), FreeVec3(0.0, 1.0, 0.0), X, X,
+          /*field_of_view=*/0.7);
+      for (std::size_t y = 0; y < X; ++y) {
+        for (std::size_t x = 0; x < X; ++x) {
+          BoundVec3 origin;
+          FreeVec3 direction;
+          camera.generateRay(x, y, origin, direction);
+          rays.emplace_back(origin, UnitVec3(direction));
+        }
+      }
+      break;
+    }
+    case RANDOM_OUTSIDE: {
+      for (std::size_t i = 0; i < num_rays; ++i) {
+        FreeVec3 origin = randomPointInBall();
+        origin *= 1.5 * sphere_max_radius / origin.length();
+        const FreeVec3 target = randomPointInBall() * sphere_max_radius;
+        rays.emplace_back(BoundVec3(origin.x(), origin.y(), origin.z()),
+                          UnitVec3(target - origin));
+      }
+      break;
+    }
+    case RANDOM_INSIDE: {
+      for (std::size_t i = 0; i < num_rays; ++i) {
+        const FreeVec3 origin = randomPointInBall() * sphere_max_radius;
+        rays.emplace_back(BoundVec3(origin.x(), origin.y(), origin.z()),
+                          UnitVec3(randomPointInBall()));
+      }
+      break;
+    }
+    case TANGENTIAL: {
+      const double delta_radius = sphere_max_radius / num_radial_sections;
+      for (std::size_t i = 0; i < num_rays; ++i) {
+        const double radius = delta_radius * (1 + i % num_radial_sections);
+        const double angle = 2 * M_PI * i / num_rays;
+        rays.emplace_back(BoundVec3(radius * std::cos(angle),
+                                    radius * std::sin(angle),
+                                    -(sphere_max_radius + 1.0)),
+                          UnitVec3(0.0, 0.0, 1.0));
+      }
+      break;
+    }
+    case CENTER_CROSSING: {
+      for (std::size_t i = 0; i < num_rays; ++i) {
+        const FreeVec3 direction = randomPointInBall();
+        const FreeVec3 origin =
+            direction * (-1.5 * sphere_max_radius / direction.length());
+        rays.emplace_back(BoundVec3(origin.x(), origin.y(), origin.z()),
+                          UnitVec3(direction));
+      }
+      break;
+    }
+  }
+  return rays;
+}
+
+#endif  // SPHERICAL_VOLUME_RENDERING_BENCHMARK_RAYS_H
@@ -1,6 +1,20 @@
 #include <benchmark/benchmark.h>
 
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+#include "../compact_voxel.h"
+#include "../level_of_detail.h"
+#include "../occupancy_grid.h"
+#include "../pipeline.h"
+#include "../ray_order.h"
+#include "../renderer.h"
+#include "../sector_decomposition.h"
 #include "../spherical_volume_rendering_util.h"
+#include "../spherical_voxel_grid_file.h"
+#include "benchmark_rays.h"
 
 // Benchmarking for the spherical coordinate voxel traversal algorithm.
 // Utilises the Google Benchmark library.
@@ -61,6 +75,771 @@ void inline orthographicTraverseXSquaredRaysinYCubedVoxels(
   }
 }
 
+// Traverses the rays of orthographicTraverseXSquaredRaysinYCubedVoxels with
+// walkSphericalVolumeBatch(), using state.range(0) threads. This is used to
+// measure the scaling of the batch traversal from 1 to N threads.
+void inline orthographicBatchTraverseXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  const std::vector<Ray> rays = orthographicRays(X, sphere_max_radius);
+  const std::size_t num_threads = state.range(0);
+  for (auto _ : state) {
+    const auto batch = svr::walkSphericalVolumeBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, num_threads);
+    benchmark::DoNotOptimize(batch.voxels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Similar to orthographicBatchTraverseXSquaredRaysinYCubedVoxels, but with the
+// two-pass countSphericalVoxelBatch() and fillSphericalVoxelBatch(). The
+// output is allocated once and reused across iterations, as a caller would
+// for successive frames.
+void inline orthographicTwoPassBatchTraverseXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  const std::vector<Ray> rays = orthographicRays(X, sphere_max_radius);
+  const std::size_t num_threads = state.range(0);
+  std::vector<std::size_t> offsets(rays.size() + 1);
+  std::vector<svr::SphericalVoxel> voxels;
+  for (auto _ : state) {
+    voxels.resize(svr::countSphericalVoxelBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, offsets.data(),
+        svr::ThreadPool::global(), num_threads));
+    svr::fillSphericalVoxelBatch(rays.data(), rays.size(), grid,
+                                 /*max_t=*/1.0, offsets.data(), voxels.data(),
+                                 svr::ThreadPool::global(), num_threads);
+    benchmark::DoNotOptimize(voxels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Traverses the rays of orthographicTraverseXSquaredRaysinYCubedVoxels with
+// walkSphericalVolumeCompactBatch(), with the CompactVoxelEncoding
+// state.range(0). Reports the bytes per voxel of the compact batch, versus the
+// sizeof(svr::SphericalVoxel) bytes of walkSphericalVolumeBatch().
+void inline orthographicCompactBatchTraverseXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  const std::vector<Ray> rays = orthographicRays(X, sphere_max_radius);
+  const auto encoding = static_cast<svr::CompactVoxelEncoding>(state.range(0));
+  std::size_t num_bytes = 0, num_voxels = 0;
+  for (auto _ : state) {
+    const svr::CompactVoxelBatch batch = svr::walkSphericalVolumeCompactBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, encoding);
+    num_bytes = batch.sizeInBytes();
+    num_voxels = batch.exit_offsets.size();
+    benchmark::DoNotOptimize(batch.exit_offsets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+  state.counters["bytes_per_voxel"] = benchmark::Counter(
+      static_cast<double>(num_bytes) / std::max<std::size_t>(num_voxels, 1));
+}
+
+// Traverses the rays of orthographicTraverseXSquaredRaysinYCubedVoxels with a
+// counting visitor. If state.range(0) is 1, the rays are traversed in packets
+// of svr::RAY_PACKET_SIZE with walkSphericalVolumePacket(); otherwise, each ray
+// is traversed individually. This compares the packet and scalar traversals
+// without the cost of allocating the voxels.
+void inline orthographicPacketTraverseXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  const std::vector<Ray> rays = orthographicRays(X, sphere_max_radius);
+  const bool use_packets = state.range(0) == 1;
+  std::size_t num_voxels = 0;
+  for (auto _ : state) {
+    if (use_packets) {
+      for (std::size_t i = 0; i < rays.size(); i += svr::RAY_PACKET_SIZE) {
+        svr::walkSphericalVolumePacket(
+            &rays[i], rays.size() - i, grid, /*max_t=*/1.0,
+            [&](std::size_t, int, int, int, double, double) { ++num_voxels; });
+      }
+    } else {
+      for (const Ray &ray : rays) {
+        svr::walkSphericalVolume(
+            ray, grid, /*max_t=*/1.0,
+            [&](int, int, int, double, double) { ++num_voxels; });
+      }
+    }
+  }
+  benchmark::DoNotOptimize(num_voxels);
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Traverses the rays of orthographicTraverseXSquaredRaysinYCubedVoxels in the
+// floating point type T. This compares single and double precision
+// traversals, including the cost of returning the voxels.
+template <class T>
+void inline orthographicPrecisionTraverseXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BasicBoundVec3<T> sphere_center(T(0), T(0), T(0));
+  const T sphere_max_radius = T(10e4);
+  const svr::BasicSphereBound<T> min_bound = {
+      .radial = T(0), .polar = T(0), .azimuthal = T(0)};
+  const svr::BasicSphereBound<T> max_bound = {.radial = sphere_max_radius,
+                                              .polar = T(2 * M_PI),
+                                              .azimuthal = T(2 * M_PI)};
+  const svr::BasicSphericalVoxelGrid<T> grid(min_bound, max_bound, Y, Y, Y,
+                                             sphere_center);
+  std::vector<BasicRay<T>> rays;
+  rays.reserve(X * X);
+  for (const Ray &ray : orthographicRays(X, sphere_max_radius)) {
+    rays.emplace_back(
+        BasicBoundVec3<T>(T(ray.origin().x()), T(ray.origin().y()),
+                               T(ray.origin().z())),
+        BasicUnitVec3<T>(T(ray.direction().x()), T(ray.direction().y()),
+                              T(ray.direction().z())));
+  }
+  for (auto _ : state) {
+    for (const BasicRay<T> &ray : rays) {
+      const auto voxels = svr::walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+      benchmark::DoNotOptimize(voxels.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Traverses with Engine, counting the voxels of each ray.
+template <class Engine>
+std::size_t countEngineVoxels(const std::vector<Ray> &rays,
+                              const svr::SphericalVoxelGrid &grid) {
+  std::size_t num_voxels = 0;
+  const auto count = [&](int, int, int, double, double) { ++num_voxels; };
+  for (const Ray &ray : rays) {
+    svr::walkSphericalVolume<Engine>(ray, grid, /*max_t=*/1.0, count);
+  }
+  return num_voxels;
+}
+
+// Traverses the rays of orthographicTraverseXSquaredRaysinYCubedVoxels with a
+// counting visitor. If state.range(0) is 1, the polar and azimuthal hits are
+// calculated with svr::PlaneEngine; otherwise, with svr::SegmentEngine. If
+// state.range(1) is 1, the fast comparisons of svr::FastPlaneEngine or
+// svr::FastSegmentEngine are used instead, and the relative difference in the
+// number of voxels traversed is reported as voxel_count_error.
+void inline orthographicEngineTraverseXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  const std::vector<Ray> rays = orthographicRays(X, sphere_max_radius);
+  const bool use_plane_engine = state.range(0) == 1;
+  const bool use_fast_comparison = state.range(1) == 1;
+  std::size_t num_voxels = 0;
+  for (auto _ : state) {
+    if (use_plane_engine) {
+      num_voxels = use_fast_comparison
+                       ? countEngineVoxels<svr::FastPlaneEngine>(rays, grid)
+                       : countEngineVoxels<svr::PlaneEngine>(rays, grid);
+    } else {
+      num_voxels = use_fast_comparison
+                       ? countEngineVoxels<svr::FastSegmentEngine>(rays, grid)
+                       : countEngineVoxels<svr::SegmentEngine>(rays, grid);
+    }
+    benchmark::DoNotOptimize(num_voxels);
+  }
+  const std::size_t num_robust_voxels =
+      use_plane_engine ? countEngineVoxels<svr::PlaneEngine>(rays, grid)
+                       : countEngineVoxels<svr::SegmentEngine>(rays, grid);
+  state.counters["voxel_count_error"] =
+      (static_cast<double>(num_voxels) - num_robust_voxels) /
+      num_robust_voxels;
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Composites a field along the rays of
+// orthographicTraverseXSquaredRaysinYCubedVoxels. If state.range(0) is 1, the
+// voxels are composited during the traversal with integrateSphericalVolume();
+// otherwise, the voxels are first returned by walkSphericalVolume() and then
+// composited. No ray is terminated early, so both composite the same voxels.
+void inline orthographicIntegrateXSquaredRaysinYCubedVoxels(
+    benchmark::State &state, const std::size_t X, const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  const std::vector<Ray> rays = orthographicRays(X, sphere_max_radius);
+  std::vector<float> field(Y * Y * Y);
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    field[i] = static_cast<float>(i % Y) / Y;
+  }
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = value, .blue = value, .extinction = 1e-9};
+  };
+  const bool use_fused = state.range(0) == 1;
+  double opacity = 0.0;
+  for (auto _ : state) {
+    for (const Ray &ray : rays) {
+      if (use_fused) {
+        opacity += svr::integrateSphericalVolume(ray, grid, field.data(),
+                                                 transfer_function,
+                                                 /*max_t=*/1.0)
+                       .opacity;
+        continue;
+      }
+      svr::RayIntegral integral = {};
+      for (const svr::SphericalVoxel &voxel :
+           walkSphericalVolume(ray, grid, /*max_t=*/1.0)) {
+        const svr::TransferSample sample = transfer_function(
+            field[((voxel.radial - 1) * Y + voxel.polar) * Y +
+                  voxel.azimuthal]);
+        const double weight =
+            (1.0 - integral.opacity) *
+            (1.0 - std::exp(-sample.extinction *
+                            (voxel.exit_t - voxel.enter_t)));
+        integral.red += weight * sample.red;
+        integral.opacity += weight;
+      }
+      opacity += integral.opacity;
+    }
+  }
+  benchmark::DoNotOptimize(opacity);
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Renders an X^2 pixel image of a Y^3 voxel sphere with maximum radius 10e4
+// with renderSphericalVolume(), using all threads. state.range(0) selects the
+// projection: 0 is orthographic, 1 is perspective, and 2 is an all-sky
+// fisheye from the sphere center. The orthographic and perspective cameras
+// are outside of the sphere, and view all of it.
+void inline renderXSquaredPixelsYCubedVoxels(benchmark::State &state,
+                                             const std::size_t X,
+                                             const std::size_t Y) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound, Y, Y, Y,
+                                     sphere_center);
+  std::vector<float> field(Y * Y * Y);
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    field[i] = static_cast<float>(i % Y) / Y;
+  }
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = value, .blue = value, .extinction = 1e-6};
+  };
+  const FreeVec3 forward(0.0, 0.0, 1.0);
+  const FreeVec3 up(0.0, 1.0, 0.0);
+  const BoundVec3 outside(0.0, 0.0, -3.0 * sphere_max_radius);
+  const svr::Camera camera =
+      state.range(0) == 0
+          ? svr::Camera::orthographic(outside, forward, up, X, X,
+                                      2.0 * sphere_max_radius)
+          : state.range(0) == 1
+                ? svr::Camera::perspective(outside, forward, up, X, X,
+                                           /*field_of_view=*/0.7)
+                : svr::Camera::fisheye(sphere_center, forward, up, X, X,
+                                       /*field_of_view=*/2 * M_PI);
+  std::vector<svr::RayIntegral> image(X * X);
+  for (auto _ : state) {
+    svr::renderSphericalVolume(camera, grid, field.data(), transfer_function,
+                               image.data());
+    benchmark::DoNotOptimize(image.data());
+  }
+  state.SetItemsProcessed(state.iterations() * image.size());
+}
+
+// Renders an X^2 pixel perspective image of a Y^3 voxel sphere as above.
+// state.range(0) selects the levels of detail: 0 renders the grid itself, 1
+// renders the levels of a MultiResolutionGrid with the footprint of each
+// pixel, and 2 renders a preview of level 2 alone.
+void inline renderLevelsXSquaredPixelsYCubedVoxels(benchmark::State &state,
+                                                   const std::size_t X,
+                                                   const std::size_t Y) {
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      Y, Y, Y, BoundVec3(0.0, 0.0, 0.0));
+  std::vector<float> field(Y * Y * Y);
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    field[i] = static_cast<float>(i % Y) / Y;
+  }
+  const svr::MultiResolutionGrid levels(grid, /*max_levels=*/4);
+  const svr::MultiResolutionField<float> field_levels(levels, field.data());
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = value, .blue = value, .extinction = 1e-6};
+  };
+  const svr::Camera camera = svr::Camera::perspective(
+      BoundVec3(0.0, 0.0, -3.0 * sphere_max_radius), FreeVec3(0.0, 0.0, 1.0),
+      FreeVec3(0.0, 1.0, 0.0), X, X, /*field_of_view=*/0.7);
+  std::vector<svr::RayIntegral> image(X * X);
+  std::size_t num_voxels = 0;
+  for (auto _ : state) {
+    switch (state.range(0)) {
+      case 0:
+        svr::renderSphericalVolume(camera, grid, field.data(),
+                                   transfer_function, image.data());
+        break;
+      case 1:
+        svr::renderSphericalVolume(camera, field_levels, transfer_function,
+                                   image.data());
+        break;
+      default:
+        svr::renderSphericalVolume(camera, levels.level(2),
+                                   field_levels.level(2), transfer_function,
+                                   image.data());
+    }
+    benchmark::DoNotOptimize(image.data());
+  }
+  for (const svr::RayIntegral &pixel : image) num_voxels += pixel.num_voxels;
+  state.counters["voxels_per_pixel"] =
+      static_cast<double>(num_voxels) / image.size();
+  state.SetItemsProcessed(state.iterations() * image.size());
+}
+
+// Measures the per-ray setup cost of the traversal with state.range(0) polar
+// and azimuthal sections. Rays are placed both inside and outside of the
+// sphere, and travel for a negligible max_t so that the cost is dominated by
+// finding the entrance voxel rather than by stepping through the grid.
+static void RaySetup_AngularSections(benchmark::State &state) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10e4;
+  const std::size_t num_angular_sections = state.range(0);
+  const svr::SphereBound min_bound = {
+      .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid(min_bound, max_bound,
+                                     /*num_radial_sections=*/64,
+                                     num_angular_sections, num_angular_sections,
+                                     sphere_center);
+  std::vector<Ray> rays = orthographicRays(64, sphere_max_radius);
+  for (std::size_t i = 0; i < 64 * 64; ++i) {
+    const double angle = 2 * M_PI * i / (64 * 64);
+    rays.emplace_back(BoundVec3(500.0 * std::cos(angle),
+                                500.0 * std::sin(angle), 100.0 * angle),
+                      UnitVec3(std::sin(angle), 1.0, std::cos(angle)));
+  }
+  std::size_t num_voxels = 0;
+  for (auto _ : state) {
+    for (const Ray &ray : rays) {
+      svr::walkSphericalVolume(ray, grid, /*max_t=*/1e-12,
+                               [&](int, int, int, double, double) {
+                                 ++num_voxels;
+                               });
+    }
+  }
+  benchmark::DoNotOptimize(num_voxels);
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Traverses each of the rays with a counting visitor, and reports the
+// throughput both as rays per second and as voxels per second. Since the
+// number of voxels traversed per ray differs greatly between ray
+// distributions and grids, the latter allows their costs to be compared.
+void traverseRays(benchmark::State &state, const svr::SphericalVoxelGrid &grid,
+                  const std::vector<Ray> &rays) {
+  std::size_t num_voxels = 0;
+  svr::resetTraversalStatistics();
+  for (auto _ : state) {
+    for (const Ray &ray : rays) {
+      svr::walkSphericalVolume(
+          ray, grid, /*max_t=*/1.0,
+          [&](int, int, int, double, double) { ++num_voxels; });
+    }
+    benchmark::DoNotOptimize(num_voxels);
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+  state.counters["rays"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * rays.size()),
+      benchmark::Counter::kIsRate);
+  state.counters["voxels"] = benchmark::Counter(
+      static_cast<double>(num_voxels), benchmark::Counter::kIsRate);
+  state.counters["voxels_per_ray"] = benchmark::Counter(
+      static_cast<double>(num_voxels) / (state.iterations() * rays.size()));
+  // With SVR_ENABLE_STATISTICS, also reports where the traversal time goes.
+  if (svr::traversalStatisticsEnabled()) {
+    const svr::TraversalStatistics statistics = svr::traversalStatistics();
+    const double num_rays = std::max<double>(statistics.num_rays, 1.0);
+    state.counters["steps_per_ray"] =
+        benchmark::Counter(statistics.num_iterations / num_rays);
+    state.counters["no_progress_per_ray"] =
+        benchmark::Counter(statistics.num_no_progress_steps / num_rays);
+    state.counters["perturbations_per_ray"] =
+        benchmark::Counter(statistics.num_angular_perturbations / num_rays);
+    state.counters["setup_fraction"] = benchmark::Counter(
+        statistics.setup_nanoseconds /
+        std::max<double>(statistics.setup_nanoseconds +
+                             statistics.stepping_nanoseconds,
+                         1.0));
+  }
+}
+
+// Traverses 128^2 rays of the RayDistribution state.range(0) through a 64^3
+// voxel sphere with maximum radius 10e4.
+static void RayDistribution_128SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      64, 64, 64, BoundVec3(0.0, 0.0, 0.0));
+  traverseRays(state, grid,
+               distributedRays(static_cast<RayDistribution>(state.range(0)),
+                               128 * 128, sphere_max_radius, 64));
+}
+
+// Traverses 128^2 RANDOM_OUTSIDE rays through a sectored 64^3 voxel sphere
+// with maximum radius 10e4, given by its maximum polar and azimuthal bounds
+// state.range(0) / 4 * pi and state.range(1) / 4 * pi. Bounds of 8 / 4 * pi
+// are the full sphere, for which the sectored bounds checks are skipped.
+static void SectoredGrid_128SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius,
+       .polar = state.range(0) * M_PI / 4,
+       .azimuthal = state.range(1) * M_PI / 4},
+      64, 64, 64, BoundVec3(0.0, 0.0, 0.0));
+  traverseRays(state, grid,
+               distributedRays(RANDOM_OUTSIDE, 128 * 128, sphere_max_radius,
+                               64));
+}
+
+// Traverses 128^2 RANDOM_OUTSIDE rays through a full sphere with maximum
+// radius 10e4 with state.range(0) radial, state.range(1) polar, and
+// state.range(2) azimuthal sections.
+static void AnisotropicGrid_128SquaredRays(benchmark::State &state) {
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      state.range(0), state.range(1), state.range(2),
+      BoundVec3(0.0, 0.0, 0.0));
+  traverseRays(state, grid,
+               distributedRays(RANDOM_OUTSIDE, 128 * 128, sphere_max_radius,
+                               state.range(0)));
+}
+
+// Traverses 128^2 rays of the RayDistribution state.range(1) through a full
+// sphere with maximum radius 10e4 and 64 radial sections, which are uniform if
+// state.range(0) is 0 and logarithmic from a radius of 10 otherwise. Rays that
+// begin within a logarithmic grid find their entrance voxel by binary search.
+static void RadialSpacing_128SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  const double sphere_max_radius = 10e4;
+  const svr::SphereBound min_bound = {
+      .radial = state.range(0) ? 10.0 : 0.0, .polar = 0.0, .azimuthal = 0.0};
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI};
+  const svr::SphericalVoxelGrid grid =
+      state.range(0) ? svr::SphericalVoxelGrid::logarithmic(
+                           min_bound, max_bound, 64, 64, 64,
+                           BoundVec3(0.0, 0.0, 0.0))
+                     : svr::SphericalVoxelGrid(min_bound, max_bound, 64, 64,
+                                               64, BoundVec3(0.0, 0.0, 0.0));
+  traverseRays(state, grid,
+               distributedRays(static_cast<RayDistribution>(state.range(1)),
+                               128 * 128, sphere_max_radius, 64));
+}
+
+// Integrates 128^2 orthographic rays through a full sphere with maximum radius
+// 10e4 and 64^3 voxels, in which only the inner quarter of the radius holds a
+// non-zero field, e.g. a star in vacuum. If state.range(0) is 1, the empty
+// space is skipped with an occupancy grid of 4^3 voxel bricks.
+static void OccupancySkipping_128SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  const std::size_t Y = 64;
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      Y, Y, Y, BoundVec3(0.0, 0.0, 0.0));
+  std::vector<float> field(Y * Y * Y, 0.0f);
+  for (std::size_t i = (Y - Y / 4) * Y * Y; i < field.size(); ++i) {
+    field[i] = static_cast<float>(i % Y + 1) / Y;
+  }
+  svr::OccupancyGrid occupancy(grid, {.radial = 4, .polar = 4, .azimuthal = 4});
+  occupancy.build(field.data());
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = value, .blue = value,
+            .extinction = 1e-9 * value};
+  };
+  const std::vector<Ray> rays =
+      distributedRays(ORTHOGRAPHIC, 128 * 128, sphere_max_radius, Y);
+  const bool use_occupancy = state.range(0) == 1;
+  double opacity = 0.0;
+  for (auto _ : state) {
+    for (const Ray &ray : rays) {
+      opacity += use_occupancy
+                     ? svr::integrateSphericalVolume(ray, occupancy,
+                                                     field.data(),
+                                                     transfer_function,
+                                                     /*max_t=*/1.0)
+                           .opacity
+                     : svr::integrateSphericalVolume(ray, grid, field.data(),
+                                                     transfer_function,
+                                                     /*max_t=*/1.0)
+                           .opacity;
+    }
+  }
+  benchmark::DoNotOptimize(opacity);
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Measures the integration of 128^2 orthographic rays over the sector of a
+// single rank of a grid of 64^3 voxels split into state.range(0) sectors along
+// each dimension, i.e. the share of the work of each rank of a distributed
+// integration before the segments are exchanged.
+static void SectorIntegration_128SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  const std::size_t Y = 64;
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      Y, Y, Y, BoundVec3(0.0, 0.0, 0.0));
+  const std::size_t num_sectors = state.range(0);
+  const svr::SectorDecomposition decomposition(
+      grid,
+      {.radial = num_sectors, .polar = num_sectors, .azimuthal = num_sectors},
+      /*sector=*/0);
+  const std::vector<float> sector_field(decomposition.numSectorVoxels(), 1.0f);
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = value, .blue = value,
+            .extinction = 1e-9 * value};
+  };
+  const std::vector<Ray> rays =
+      distributedRays(ORTHOGRAPHIC, 128 * 128, sphere_max_radius, Y);
+  std::vector<svr::RaySegment> segments;
+  for (auto _ : state) {
+    segments.clear();
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      svr::integrateSphericalVolumeSegments(
+          rays[i], i, decomposition, sector_field.data(), transfer_function,
+          /*max_t=*/1.0, segments);
+    }
+    benchmark::DoNotOptimize(segments.data());
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Measures the construction of a full sphere grid with state.range(0) radial,
+// polar, and azimuthal sections.
+static void GridConstruction_Sections(benchmark::State &state) {
+  const std::size_t num_sections = state.range(0);
+  for (auto _ : state) {
+    const svr::SphericalVoxelGrid grid(
+        {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+        {.radial = 10e4, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+        num_sections, num_sections, num_sections, BoundVec3(0.0, 0.0, 0.0));
+    benchmark::DoNotOptimize(&grid);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Measures the start up of a process with a grid of state.range(0) radial,
+// polar, and azimuthal sections written by writeSphericalVoxelGrid(), either
+// by mapping the file or by reading a copy of its tables. Compare with
+// GridConstruction_Sections.
+static void GridFile_Sections(benchmark::State &state) {
+  const std::size_t num_sections = state.range(0);
+  const bool copy = state.range(1) != 0;
+  const std::string path = "/tmp/benchmark_spherical_voxel_grid.svr";
+  if (!svr::writeSphericalVoxelGrid(
+          svr::SphericalVoxelGrid(
+              {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+              {.radial = 10e4, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+              num_sections, num_sections, num_sections,
+              BoundVec3(0.0, 0.0, 0.0)),
+          path)) {
+    state.SkipWithError("Unable to write the grid.");
+    return;
+  }
+  for (auto _ : state) {
+    if (copy) {
+      const svr::SharedSphericalVoxelGrid grid =
+          svr::readSphericalVoxelGrid(path);
+      benchmark::DoNotOptimize(grid.get());
+    } else {
+      const svr::MappedSphericalVoxelGrid grid(path);
+      benchmark::DoNotOptimize(&grid);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  std::remove(path.c_str());
+}
+
+// Traverses 128^2 rays in batches of 1024, where each batch is then passed to a
+// sink that takes 20 ms, standing in for a write to slow storage. If
+// state.range(0) is 1, the batches are run through a RayPipeline, so that the
+// traversal of each batch overlaps with the sink of the previous batch;
+// otherwise each batch is traversed on every thread and then sunk.
+static void Pipeline_128SquaredRays_64CubedVoxels(benchmark::State &state) {
+  const std::size_t Y = 64;
+  const std::size_t batch_size = 1024;
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      Y, Y, Y, BoundVec3(0.0, 0.0, 0.0));
+  const std::vector<Ray> rays =
+      distributedRays(ORTHOGRAPHIC, 128 * 128, sphere_max_radius, Y);
+  const auto sink = [](const svr::CompactVoxelBatch &batch) {
+    benchmark::DoNotOptimize(batch.indices.data());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  };
+  const bool pipelined = state.range(0) != 0;
+  svr::RayPipeline pipeline;
+  pipeline
+      .addStage(svr::compactTraversalStage(grid, /*max_t=*/1.0,
+                                           svr::CompactVoxelEncoding::STEPS),
+                /*num_threads=*/0)
+      .addOrderedStage([&](svr::RayBatch &batch, svr::ThreadPool &) {
+        sink(batch.compact_voxels);
+      });
+  for (auto _ : state) {
+    if (pipelined) {
+      std::size_t next_ray = 0;
+      pipeline.run([&](svr::RayBatch &batch) {
+        if (next_ray == rays.size()) return false;
+        const std::size_t end = std::min(rays.size(), next_ray + batch_size);
+        for (; next_ray < end; ++next_ray) batch.rays.push_back(rays[next_ray]);
+        return true;
+      });
+    } else {
+      for (std::size_t i = 0; i < rays.size(); i += batch_size) {
+        sink(svr::walkSphericalVolumeCompactBatch(
+            rays.data() + i, std::min(batch_size, rays.size() - i), grid,
+            /*max_t=*/1.0, svr::CompactVoxelEncoding::STEPS));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Traverses 128^2 RANDOM_OUTSIDE rays, given in no particular order, as a
+// batch through a 256^3 voxel sphere with maximum radius 10e4. If
+// state.range(0) is 1 or 2, the rays are first sorted into a Morton or Hilbert
+// RayOrder respectively, which is included in the time; otherwise they are
+// traversed as given.
+static void OrderedBatch_128SquaredRays_256CubedVoxels(
+    benchmark::State &state) {
+  const std::size_t Y = 256;
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      Y, Y, Y, BoundVec3(0.0, 0.0, 0.0));
+  const std::vector<Ray> rays =
+      distributedRays(RANDOM_OUTSIDE, 128 * 128, sphere_max_radius, Y);
+  svr::ThreadPool pool(1);
+  for (auto _ : state) {
+    if (state.range(0) == 0) {
+      benchmark::DoNotOptimize(svr::walkSphericalVolumeBatch(
+          rays.data(), rays.size(), grid, /*max_t=*/1.0, pool));
+    } else {
+      const svr::RayOrder order(rays.data(), rays.size(), grid,
+                                state.range(0) == 1
+                                    ? svr::RayOrdering::MORTON
+                                    : svr::RayOrdering::HILBERT);
+      benchmark::DoNotOptimize(svr::walkSphericalVolumeBatch(
+          rays.data(), rays.size(), grid, /*max_t=*/1.0, order, pool));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+// Finds the entrance voxels of 16 frames of 128^2 orthographic rays through a
+// 64^3 voxel sphere with maximum radius 10e4, where the camera moves one tenth
+// of a voxel along the image plane between frames. Each traversal stops at its
+// entrance voxel, so this measures the setup of the traversal alone. If
+// state.range(0) is 1, each ray is given the entrance voxel of the same ray in
+// the previous frame as a hint.
+static void WarmStart_16Frames_128SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  const std::size_t Y = 64;
+  const std::size_t num_frames = 16;
+  const double sphere_max_radius = 10e4;
+  const svr::SphericalVoxelGrid grid(
+      {.radial = 0.0, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = sphere_max_radius, .polar = 2 * M_PI, .azimuthal = 2 * M_PI},
+      Y, Y, Y, BoundVec3(0.0, 0.0, 0.0));
+  const std::vector<Ray> rays =
+      distributedRays(ORTHOGRAPHIC, 128 * 128, sphere_max_radius, Y);
+  const double step = 0.1 * sphere_max_radius / Y;
+  std::vector<std::vector<Ray>> frames(num_frames);
+  for (std::size_t frame = 0; frame < num_frames; ++frame) {
+    for (const Ray &ray : rays) {
+      frames[frame].emplace_back(
+          BoundVec3(ray.origin().x() + frame * step,
+                    ray.origin().y() + frame * step, ray.origin().z()),
+          ray.direction());
+    }
+  }
+  const bool warm_start = state.range(0) != 0;
+  const auto visitor = [](int radial, int polar, int azimuthal, double,
+                          double) {
+    benchmark::DoNotOptimize(radial + polar + azimuthal);
+    return false;
+  };
+  std::vector<svr::EntryVoxel> hints(rays.size());
+  for (auto _ : state) {
+    std::fill(hints.begin(), hints.end(), svr::EntryVoxel());
+    for (const std::vector<Ray> &frame : frames) {
+      for (std::size_t i = 0; i < frame.size(); ++i) {
+        if (warm_start) {
+          hints[i] = svr::walkSphericalVolume(frame[i], grid, /*max_t=*/1.0,
+                                              hints[i], visitor);
+        } else {
+          svr::walkSphericalVolume(frame[i], grid, /*max_t=*/1.0, visitor);
+        }
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_frames * rays.size());
+}
+
+// Thread counts 1, 2, 4, ..., N, where N is the number of hardware threads.
+void threadScaling(benchmark::internal::Benchmark *benchmark) {
+  const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int num_threads = 1; num_threads < max_threads; num_threads *= 2) {
+    benchmark->Arg(num_threads);
+  }
+  benchmark->Arg(max_threads);
+}
+
 static void Orthographic_128SquaredRays_64CubedVoxels(benchmark::State &state) {
   for (auto _ : state) {
     orthographicTraverseXSquaredRaysinYCubedVoxels(128, 64);
@@ -100,6 +879,81 @@ static void Orthographic_512SquaredRays_128CubedVoxels(
   }
 }
 
+static void OrthographicBatch_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicBatchTraverseXSquaredRaysinYCubedVoxels(state, 512, 64);
+}
+
+static void OrthographicBatch_512SquaredRays_128CubedVoxels(
+    benchmark::State &state) {
+  orthographicBatchTraverseXSquaredRaysinYCubedVoxels(state, 512, 128);
+}
+
+static void OrthographicTwoPassBatch_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicTwoPassBatchTraverseXSquaredRaysinYCubedVoxels(state, 512, 64);
+}
+
+static void OrthographicCompactBatch_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicCompactBatchTraverseXSquaredRaysinYCubedVoxels(state, 512, 64);
+}
+
+static void OrthographicPacket_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicPacketTraverseXSquaredRaysinYCubedVoxels(state, 512, 64);
+}
+
+static void OrthographicPacket_512SquaredRays_128CubedVoxels(
+    benchmark::State &state) {
+  orthographicPacketTraverseXSquaredRaysinYCubedVoxels(state, 512, 128);
+}
+
+template <class T>
+static void OrthographicPrecision_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicPrecisionTraverseXSquaredRaysinYCubedVoxels<T>(state, 512, 64);
+}
+
+template <class T>
+static void OrthographicPrecision_512SquaredRays_128CubedVoxels(
+    benchmark::State &state) {
+  orthographicPrecisionTraverseXSquaredRaysinYCubedVoxels<T>(state, 512, 128);
+}
+
+static void OrthographicEngine_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicEngineTraverseXSquaredRaysinYCubedVoxels(state, 512, 64);
+}
+
+static void OrthographicEngine_512SquaredRays_128CubedVoxels(
+    benchmark::State &state) {
+  orthographicEngineTraverseXSquaredRaysinYCubedVoxels(state, 512, 128);
+}
+
+static void OrthographicIntegrate_512SquaredRays_64CubedVoxels(
+    benchmark::State &state) {
+  orthographicIntegrateXSquaredRaysinYCubedVoxels(state, 512, 64);
+}
+
+static void OrthographicIntegrate_512SquaredRays_128CubedVoxels(
+    benchmark::State &state) {
+  orthographicIntegrateXSquaredRaysinYCubedVoxels(state, 512, 128);
+}
+
+static void Render_512SquaredPixels_64CubedVoxels(benchmark::State &state) {
+  renderXSquaredPixelsYCubedVoxels(state, 512, 64);
+}
+
+static void Render_1024SquaredPixels_64CubedVoxels(benchmark::State &state) {
+  renderXSquaredPixelsYCubedVoxels(state, 1024, 64);
+}
+
+static void RenderLevels_64SquaredPixels_256CubedVoxels(
+    benchmark::State &state) {
+  renderLevelsXSquaredPixelsYCubedVoxels(state, 64, 256);
+}
+
 constexpr std::size_t NUM_ITERATIONS = 10;
 BENCHMARK(Orthographic_128SquaredRays_64CubedVoxels)
     ->Unit(benchmark::kMillisecond)
@@ -119,6 +973,137 @@ BENCHMARK(Orthographic_256SquaredRays_128CubedVoxels)
 BENCHMARK(Orthographic_512SquaredRays_128CubedVoxels)
     ->Unit(benchmark::kMillisecond)
     ->Repetitions(NUM_ITERATIONS);
+BENCHMARK(RaySetup_AngularSections)
+    ->Unit(benchmark::kMicrosecond)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096);
+BENCHMARK(OrthographicBatch_512SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Apply(threadScaling);
+BENCHMARK(OrthographicBatch_512SquaredRays_128CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Apply(threadScaling);
+BENCHMARK(OrthographicTwoPassBatch_512SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Apply(threadScaling);
+BENCHMARK(OrthographicCompactBatch_512SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->ArgName("encoding")
+    ->DenseRange(0, 1);
+BENCHMARK(OrthographicPacket_512SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("packet")
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK(OrthographicPacket_512SquaredRays_128CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("packet")
+    ->Arg(0)
+    ->Arg(1);
+
+BENCHMARK(OrthographicEngine_512SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"plane", "fast"})
+    ->ArgsProduct({{0, 1}, {0, 1}});
+BENCHMARK(OrthographicEngine_512SquaredRays_128CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"plane", "fast"})
+    ->ArgsProduct({{0, 1}, {0, 1}});
+BENCHMARK_TEMPLATE(OrthographicPrecision_512SquaredRays_64CubedVoxels, float)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(OrthographicPrecision_512SquaredRays_64CubedVoxels, double)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(OrthographicPrecision_512SquaredRays_128CubedVoxels, float)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(OrthographicPrecision_512SquaredRays_128CubedVoxels, double)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(OrthographicIntegrate_512SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("fused")
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK(OrthographicIntegrate_512SquaredRays_128CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("fused")
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK(Render_512SquaredPixels_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->ArgName("projection")
+    ->DenseRange(0, 2);
+BENCHMARK(Render_1024SquaredPixels_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->ArgName("projection")
+    ->DenseRange(0, 2);
+BENCHMARK(RenderLevels_64SquaredPixels_256CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->ArgName("levels")
+    ->DenseRange(0, 2);
+BENCHMARK(RayDistribution_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("distribution")
+    ->DenseRange(ORTHOGRAPHIC, CENTER_CROSSING);
+BENCHMARK(SectoredGrid_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"polar_quarter_pi", "azimuthal_quarter_pi"})
+    ->Args({8, 8})
+    ->Args({8, 4})
+    ->Args({4, 4})
+    ->Args({2, 8})
+    ->Args({1, 1});
+BENCHMARK(AnisotropicGrid_128SquaredRays)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"radial", "polar", "azimuthal"})
+    ->Args({64, 64, 64})
+    ->Args({512, 8, 8})
+    ->Args({8, 512, 8})
+    ->Args({8, 8, 512})
+    ->Args({8, 512, 512});
+BENCHMARK(RadialSpacing_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"logarithmic", "distribution"})
+    ->ArgsProduct({{0, 1}, {RANDOM_OUTSIDE, RANDOM_INSIDE}});
+BENCHMARK(OccupancySkipping_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("occupancy")
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK(SectorIntegration_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("sectors")
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4);
+BENCHMARK(GridConstruction_Sections)
+    ->Unit(benchmark::kMicrosecond)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096);
+BENCHMARK(GridFile_Sections)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"sections", "copy"})
+    ->ArgsProduct({{16, 256, 4096}, {0, 1}});
+BENCHMARK(Pipeline_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->ArgName("pipelined")
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK(OrderedBatch_128SquaredRays_256CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("ordering")
+    ->DenseRange(0, 2);
+BENCHMARK(WarmStart_16Frames_128SquaredRays_64CubedVoxels)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("warm_start")
+    ->Arg(0)
+    ->Arg(1);
 
 }  // namespace
 
@@ -0,0 +1,317 @@
+#include "compact_voxel.h"
+
+#include <utility>
+
+#include "ray_order.h"
+
+namespace svr {
+
+namespace {
+
+// The number of rays assigned to each chunk of a compact batch. See
+// BATCH_RAYS_PER_CHUNK.
+constexpr std::size_t COMPACT_RAYS_PER_CHUNK = 64;
+
+// The 2-bit delta of a single ID within a step byte.
+constexpr std::uint8_t NO_STEP = 0;
+constexpr std::uint8_t PLUS_STEP = 1;
+constexpr std::uint8_t MINUS_STEP = 2;
+constexpr std::uint8_t FULL_STEP = 3;
+
+// The number of bits required to hold the values 0 through max_value.
+std::uint32_t bitsFor(std::size_t max_value) noexcept {
+  std::uint32_t bits = 0;
+  while (bits < 64 && (std::uint64_t(1) << bits) <= max_value) ++bits;
+  return bits;
+}
+
+inline std::uint8_t radialStep(int previous, int current) noexcept {
+  if (current == previous) return NO_STEP;
+  if (current == previous + 1) return PLUS_STEP;
+  if (current == previous - 1) return MINUS_STEP;
+  return FULL_STEP;
+}
+
+// Similar to radialStep(), but the IDs wrap around num_sections.
+inline std::uint8_t angularStep(int previous, int current,
+                                int num_sections) noexcept {
+  if (current == previous) return NO_STEP;
+  if (current == (previous + 1) % num_sections) return PLUS_STEP;
+  if (current == (previous + num_sections - 1) % num_sections) {
+    return MINUS_STEP;
+  }
+  return FULL_STEP;
+}
+
+inline int stepDelta(std::uint8_t step) noexcept {
+  return step == PLUS_STEP ? 1 : step == MINUS_STEP ? -1 : 0;
+}
+
+// A traversal visitor that encodes the voxels of a single ray. If the output
+// pointers are null, the voxels and the packed IDs they require are only
+// counted. See CompactVoxelBatch for the format.
+class RayEncoder {
+ public:
+  inline RayEncoder(const CompactVoxelCodec &codec,
+                    CompactVoxelEncoding encoding, double *enter_time,
+                    float *exit_offsets, std::uint32_t *indices,
+                    std::uint8_t *steps) noexcept
+      : codec_(codec),
+        encoding_(encoding),
+        enter_time_(enter_time),
+        exit_offsets_(exit_offsets),
+        indices_(indices),
+        steps_(steps) {}
+
+  inline void operator()(int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) noexcept {
+    if (this->num_voxels_ == 0) {
+      this->ray_enter_t_ = enter_t;
+      if (this->enter_time_ != nullptr) *this->enter_time_ = enter_t;
+    }
+    std::uint8_t step = CompactVoxelCodec::FULL_INDEX_STEP;
+    if (this->encoding_ == CompactVoxelEncoding::STEPS &&
+        this->num_voxels_ != 0) {
+      step = this->codec_.step(this->radial_, this->polar_, this->azimuthal_,
+                               radial, polar, azimuthal);
+    }
+    if (step == CompactVoxelCodec::FULL_INDEX_STEP) {
+      if (this->indices_ != nullptr) {
+        this->indices_[this->num_indices_] =
+            this->codec_.pack(radial, polar, azimuthal);
+      }
+      ++this->num_indices_;
+    }
+    if (this->steps_ != nullptr) this->steps_[this->num_voxels_] = step;
+    if (this->exit_offsets_ != nullptr) {
+      this->exit_offsets_[this->num_voxels_] =
+          static_cast<float>(exit_t - this->ray_enter_t_);
+    }
+    ++this->num_voxels_;
+    this->radial_ = radial;
+    this->polar_ = polar;
+    this->azimuthal_ = azimuthal;
+  }
+
+  inline std::size_t numVoxels() const noexcept { return this->num_voxels_; }
+
+  inline std::size_t numIndices() const noexcept { return this->num_indices_; }
+
+ private:
+  const CompactVoxelCodec &codec_;
+  const CompactVoxelEncoding encoding_;
+  double *const enter_time_;
+  float *const exit_offsets_;
+  std::uint32_t *const indices_;
+  std::uint8_t *const steps_;
+  std::size_t num_voxels_ = 0;
+  std::size_t num_indices_ = 0;
+  double ray_enter_t_ = 0.0;
+
+  // The IDs of the previous voxel.
+  int radial_ = 0;
+  int polar_ = 0;
+  int azimuthal_ = 0;
+};
+
+// Encodes num_rays rays in two passes, where traverse(i, encoder) calls the
+// RayEncoder encoder with each voxel of ray i in order. The first pass counts
+// the voxels and packed IDs of each ray, and the second writes them to their
+// place in the batch. The rays are traversed in the given order, e.g. a
+// RayOrder.
+template <class Traverse, class Order = internal::GivenRayOrder>
+CompactVoxelBatch encodeBatch(std::size_t num_rays,
+                              const SphericalVoxelGrid &grid,
+                              CompactVoxelEncoding encoding,
+                              const Traverse &traverse, ThreadPool &pool,
+                              std::size_t num_threads,
+                              const Order &order = Order()) {
+  CompactVoxelBatch batch;
+  batch.encoding = encoding;
+  batch.codec = CompactVoxelCodec(grid);
+  batch.offsets.assign(num_rays + 1, 0);
+  batch.enter_times.assign(num_rays, 0.0);
+  const bool steps = encoding == CompactVoxelEncoding::STEPS;
+  std::vector<std::size_t> index_offsets(num_rays + 1, 0);
+  pool.parallelFor(
+      num_rays, COMPACT_RAYS_PER_CHUNK,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (std::size_t k = begin; k < end; ++k) {
+          const std::size_t i = order[k];
+          RayEncoder counter(batch.codec, encoding, nullptr, nullptr, nullptr,
+                             nullptr);
+          traverse(i, counter);
+          batch.offsets[i + 1] = counter.numVoxels();
+          index_offsets[i + 1] = counter.numIndices();
+        }
+      },
+      num_threads);
+  for (std::size_t i = 0; i < num_rays; ++i) {
+    batch.offsets[i + 1] += batch.offsets[i];
+    index_offsets[i + 1] += index_offsets[i];
+  }
+  const std::size_t num_voxels = batch.offsets[num_rays];
+  batch.exit_offsets.resize(num_voxels);
+  batch.indices.resize(index_offsets[num_rays]);
+  if (steps) batch.steps.resize(num_voxels);
+  pool.parallelFor(
+      num_rays, COMPACT_RAYS_PER_CHUNK,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (std::size_t k = begin; k < end; ++k) {
+          const std::size_t i = order[k];
+          RayEncoder encoder(
+              batch.codec, encoding, &batch.enter_times[i],
+              batch.exit_offsets.data() + batch.offsets[i],
+              batch.indices.data() + index_offsets[i],
+              steps ? batch.steps.data() + batch.offsets[i] : nullptr);
+          traverse(i, encoder);
+        }
+      },
+      num_threads);
+  if (steps) batch.index_offsets = std::move(index_offsets);
+  return batch;
+}
+
+}  // namespace
+
+constexpr std::uint8_t CompactVoxelCodec::FULL_INDEX_STEP;
+
+CompactVoxelCodec::CompactVoxelCodec(const SphericalVoxelGrid &grid) noexcept
+    : CompactVoxelCodec(grid.numRadialSections(), grid.numPolarSections(),
+                        grid.numAzimuthalSections()) {}
+
+CompactVoxelCodec::CompactVoxelCodec(
+    std::size_t num_radial_sections, std::size_t num_polar_sections,
+    std::size_t num_azimuthal_sections) noexcept
+    : radial_bits_(bitsFor(num_radial_sections)),
+      polar_bits_(bitsFor(num_polar_sections - 1)),
+      azimuthal_bits_(bitsFor(num_azimuthal_sections - 1)),
+      num_polar_sections_(static_cast<int>(num_polar_sections)),
+      num_azimuthal_sections_(static_cast<int>(num_azimuthal_sections)) {}
+
+std::uint8_t CompactVoxelCodec::step(int previous_radial, int previous_polar,
+                                     int previous_azimuthal, int radial,
+                                     int polar, int azimuthal) const noexcept {
+  const std::uint8_t radial_step = radialStep(previous_radial, radial);
+  const std::uint8_t polar_step =
+      angularStep(previous_polar, polar, this->num_polar_sections_);
+  const std::uint8_t azimuthal_step = angularStep(
+      previous_azimuthal, azimuthal, this->num_azimuthal_sections_);
+  if (radial_step == FULL_STEP || polar_step == FULL_STEP ||
+      azimuthal_step == FULL_STEP) {
+    return FULL_INDEX_STEP;
+  }
+  return radial_step | polar_step << 2 | azimuthal_step << 4;
+}
+
+void CompactVoxelCodec::applyStep(std::uint8_t step, int &radial, int &polar,
+                                  int &azimuthal) const noexcept {
+  radial += stepDelta(step & 3);
+  polar = (polar + stepDelta((step >> 2) & 3) + this->num_polar_sections_) %
+          this->num_polar_sections_;
+  azimuthal = (azimuthal + stepDelta((step >> 4) & 3) +
+               this->num_azimuthal_sections_) %
+              this->num_azimuthal_sections_;
+}
+
+std::size_t CompactVoxelBatch::sizeInBytes() const noexcept {
+  return this->offsets.size() * sizeof(std::size_t) +
+         this->enter_times.size() * sizeof(double) +
+         this->exit_offsets.size() * sizeof(float) +
+         this->indices.size() * sizeof(std::uint32_t) +
+         this->steps.size() * sizeof(std::uint8_t) +
+         this->index_offsets.size() * sizeof(std::size_t);
+}
+
+CompactVoxelView CompactVoxelBatch::view() const noexcept {
+  const bool steps = this->encoding == CompactVoxelEncoding::STEPS;
+  return {.encoding = this->encoding,
+          .codec = this->codec,
+          .num_rays = this->numRays(),
+          .offsets = this->offsets.data(),
+          .enter_times = this->enter_times.data(),
+          .exit_offsets = this->exit_offsets.data(),
+          .indices = this->indices.data(),
+          .steps = steps ? this->steps.data() : nullptr,
+          .index_offsets = steps ? this->index_offsets.data() : nullptr};
+}
+
+CompactVoxelBatch compactSphericalVoxelBatch(const SphericalVoxelBatch &batch,
+                                             const SphericalVoxelGrid &grid,
+                                             CompactVoxelEncoding encoding) {
+  return encodeBatch(
+      batch.offsets.size() - 1, grid, encoding,
+      [&](std::size_t i, RayEncoder &encoder) {
+        for (std::size_t j = batch.offsets[i]; j < batch.offsets[i + 1]; ++j) {
+          const SphericalVoxel &voxel = batch.voxels[j];
+          encoder(voxel.radial, voxel.polar, voxel.azimuthal, voxel.enter_t,
+                  voxel.exit_t);
+        }
+      },
+      ThreadPool::global(), /*num_threads=*/0);
+}
+
+CompactVoxelBatch walkSphericalVolumeCompactBatch(
+    const Ray *rays, std::size_t num_rays, const SphericalVoxelGrid &grid,
+    double max_t, CompactVoxelEncoding encoding, ThreadPool &pool,
+    std::size_t num_threads) {
+  return encodeBatch(
+      num_rays, grid, encoding,
+      [&](std::size_t i, RayEncoder &encoder) {
+        walkSphericalVolume(rays[i], grid, max_t, encoder);
+      },
+      pool, num_threads);
+}
+
+CompactVoxelBatch walkSphericalVolumeCompactBatch(
+    const Ray *rays, std::size_t num_rays, const SphericalVoxelGrid &grid,
+    double max_t, CompactVoxelEncoding encoding, const RayOrder &order,
+    ThreadPool &pool, std::size_t num_threads) {
+  return encodeBatch(
+      num_rays, grid, encoding,
+      [&](std::size_t i, RayEncoder &encoder) {
+        walkSphericalVolume(rays[i], grid, max_t, encoder);
+      },
+      pool, num_threads, order);
+}
+
+void decodeCompactVoxels(const CompactVoxelView &batch, std::size_t i,
+                         std::vector<SphericalVoxel> &voxels) {
+  const std::size_t begin = batch.offsets[i];
+  const std::size_t end = batch.offsets[i + 1];
+  const bool steps = batch.encoding == CompactVoxelEncoding::STEPS;
+  const double ray_enter_t = batch.enter_times[i];
+  std::size_t index = steps ? batch.index_offsets[i] : begin;
+  const std::size_t index_end = steps ? batch.index_offsets[i + 1] : end;
+  double enter_t = ray_enter_t;
+  int radial = 0, polar = 0, azimuthal = 0;
+  voxels.reserve(voxels.size() + (end - begin));
+  for (std::size_t j = begin; j < end; ++j) {
+    if (!steps || batch.steps[j] == CompactVoxelCodec::FULL_INDEX_STEP) {
+      if (index == index_end) break;
+      batch.codec.unpack(batch.indices[index++], radial, polar, azimuthal);
+    } else {
+      batch.codec.applyStep(batch.steps[j], radial, polar, azimuthal);
+    }
+    const double exit_t = ray_enter_t + batch.exit_offsets[j];
+    voxels.push_back({.radial = radial,
+                      .polar = polar,
+                      .azimuthal = azimuthal,
+                      .enter_t = enter_t,
+                      .exit_t = exit_t});
+    enter_t = exit_t;
+  }
+}
+
+SphericalVoxelBatch decodeCompactVoxelBatch(const CompactVoxelBatch &batch) {
+  SphericalVoxelBatch decoded;
+  decoded.offsets = batch.offsets;
+  decoded.voxels.reserve(batch.offsets.back());
+  const CompactVoxelView view = batch.view();
+  for (std::size_t i = 0; i < view.num_rays; ++i) {
+    decodeCompactVoxels(view, i, decoded.voxels);
+  }
+  return decoded;
+}
+
+}  // namespace svr
@@ -0,0 +1,201 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_COMPACT_VOXEL_H
+#define SPHERICAL_VOLUME_RENDERING_COMPACT_VOXEL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "ray.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+
+namespace svr {
+
+// Packs the radial, polar, and azimuthal IDs of a voxel into 32 bits, with
+// each ID given the fewest bits that hold every ID of the grid. The radial ID
+// occupies the lowest bits, followed by the polar and azimuthal IDs. Also
+// encodes the step between consecutive voxels of a ray. Since a step crosses
+// at most one boundary per axis, each ID changes by at most 1, modulo the
+// number of sections for the polar and azimuthal IDs, so a step is held in a
+// single byte of three 2-bit deltas.
+class CompactVoxelCodec {
+ public:
+  // The step byte of a voxel whose IDs are not within one of the previous
+  // voxel's, e.g. the first voxel of a ray. Its IDs are stored in full.
+  static constexpr std::uint8_t FULL_INDEX_STEP = 0xFF;
+
+  CompactVoxelCodec() = default;
+
+  explicit CompactVoxelCodec(const SphericalVoxelGrid &grid) noexcept;
+
+  // The codec of a grid with the given numbers of sections.
+  CompactVoxelCodec(std::size_t num_radial_sections,
+                    std::size_t num_polar_sections,
+                    std::size_t num_azimuthal_sections) noexcept;
+
+  // Returns true if the IDs of every voxel of the grid fit within 32 bits,
+  // i.e. the grid has fewer than about 2^32 voxels. The encoding functions
+  // below require this.
+  inline bool isValid() const noexcept {
+    return this->radial_bits_ + this->polar_bits_ + this->azimuthal_bits_ <=
+           32;
+  }
+
+  // Returns true if the codecs pack and step the IDs of voxels identically.
+  inline bool operator==(const CompactVoxelCodec &other) const noexcept {
+    return this->radial_bits_ == other.radial_bits_ &&
+           this->polar_bits_ == other.polar_bits_ &&
+           this->azimuthal_bits_ == other.azimuthal_bits_ &&
+           this->num_polar_sections_ == other.num_polar_sections_ &&
+           this->num_azimuthal_sections_ == other.num_azimuthal_sections_;
+  }
+
+  inline std::uint32_t pack(int radial, int polar,
+                            int azimuthal) const noexcept {
+    return static_cast<std::uint32_t>(
+        static_cast<std::uint64_t>(radial) |
+        static_cast<std::uint64_t>(polar) << this->radial_bits_ |
+        static_cast<std::uint64_t>(azimuthal)
+            << (this->radial_bits_ + this->polar_bits_));
+  }
+
+  inline void unpack(std::uint32_t index, int &radial, int &polar,
+                     int &azimuthal) const noexcept {
+    const std::uint64_t bits = index;
+    radial = static_cast<int>(bits & mask(this->radial_bits_));
+    polar = static_cast<int>((bits >> this->radial_bits_) &
+                             mask(this->polar_bits_));
+    azimuthal = static_cast<int>(
+        (bits >> (this->radial_bits_ + this->polar_bits_)) &
+        mask(this->azimuthal_bits_));
+  }
+
+  // Returns the step byte from the voxel with the previous IDs to the voxel
+  // with the given IDs, or FULL_INDEX_STEP if they are more than one apart.
+  std::uint8_t step(int previous_radial, int previous_polar,
+                    int previous_azimuthal, int radial, int polar,
+                    int azimuthal) const noexcept;
+
+  // Applies the step byte to the IDs of the previous voxel. step must not be
+  // FULL_INDEX_STEP.
+  void applyStep(std::uint8_t step, int &radial, int &polar,
+                 int &azimuthal) const noexcept;
+
+ private:
+  static inline std::uint64_t mask(std::uint32_t bits) noexcept {
+    return (std::uint64_t(1) << bits) - 1;
+  }
+
+  std::uint32_t radial_bits_ = 0;
+  std::uint32_t polar_bits_ = 0;
+  std::uint32_t azimuthal_bits_ = 0;
+  int num_polar_sections_ = 1;
+  int num_azimuthal_sections_ = 1;
+};
+
+// The encoding of the voxel IDs of a CompactVoxelBatch.
+enum class CompactVoxelEncoding {
+  // Every voxel's IDs are packed into 32 bits. Each voxel takes 8 bytes,
+  // versus the 32 bytes of SphericalVoxel.
+  PACKED,
+  // Each voxel is the step from the previous voxel of its ray, in one byte.
+  // Only the first voxel of each ray, and the rare voxels more than one ID
+  // apart from their predecessors, have their IDs packed into 32 bits. Each
+  // voxel takes about 5 bytes, but the voxels of a ray must be decoded in
+  // order.
+  STEPS
+};
+
+// A read-only view of the arrays of a CompactVoxelBatch, which may instead be
+// stored elsewhere, e.g. in a memory-mapped file. See CompactVoxelBatch for a
+// description of the arrays. index_offsets and steps are null for PACKED.
+struct CompactVoxelView {
+  CompactVoxelEncoding encoding;
+  CompactVoxelCodec codec;
+  std::size_t num_rays;
+  const std::size_t *offsets;
+  const double *enter_times;
+  const float *exit_offsets;
+  const std::uint32_t *indices;
+  const std::uint8_t *steps;
+  const std::size_t *index_offsets;
+};
+
+// The voxels traversed by a batch of rays, stored in a compact form. As with
+// SphericalVoxelBatch, the voxels of ray i are voxels offsets[i] up to, but
+// not including, offsets[i + 1].
+//
+// Since each voxel is entered when the previous voxel is exited, only the
+// time at which each ray enters its first voxel is stored in full, in
+// enter_times[i]. The exit time of each voxel is stored as a float offset from
+// the enter time of its ray, and the enter time of each subsequent voxel is
+// the exit time of the previous voxel. The times of a decoded voxel thus have
+// an absolute error of about 2^-24 of the ray's traversal length, and do not
+// accumulate error along the ray.
+struct CompactVoxelBatch {
+  CompactVoxelEncoding encoding;
+  CompactVoxelCodec codec;
+  std::vector<std::size_t> offsets;
+  std::vector<double> enter_times;
+  std::vector<float> exit_offsets;
+
+  // For PACKED, the packed IDs of each voxel. For STEPS, the packed IDs of the
+  // voxels whose step is CompactVoxelCodec::FULL_INDEX_STEP, in order; those
+  // of ray i begin at indices[index_offsets[i]].
+  std::vector<std::uint32_t> indices;
+
+  // For STEPS only, the step byte of each voxel and the offsets of each ray
+  // into indices, of size num_rays + 1.
+  std::vector<std::uint8_t> steps;
+  std::vector<std::size_t> index_offsets;
+
+  inline std::size_t numRays() const noexcept {
+    return this->offsets.size() - 1;
+  }
+
+  // The number of bytes held by the batch's vectors.
+  std::size_t sizeInBytes() const noexcept;
+
+  CompactVoxelView view() const noexcept;
+};
+
+// Encodes the batch traversed through grid.
+// CompactVoxelCodec(grid).isValid() must hold.
+CompactVoxelBatch compactSphericalVoxelBatch(const SphericalVoxelBatch &batch,
+                                             const SphericalVoxelGrid &grid,
+                                             CompactVoxelEncoding encoding);
+
+// Similar to walkSphericalVolumeBatch(), but writes each ray's voxels directly
+// in the compact form, so that the full-size voxels are never held in memory.
+// As with countSphericalVoxelBatch() and fillSphericalVoxelBatch(), the voxels
+// of each ray are first counted and then written to their place in the batch,
+// so each ray is traversed twice. CompactVoxelCodec(grid).isValid() must hold.
+CompactVoxelBatch walkSphericalVolumeCompactBatch(
+    const Ray *rays, std::size_t num_rays, const SphericalVoxelGrid &grid,
+    double max_t, CompactVoxelEncoding encoding,
+    ThreadPool &pool = ThreadPool::global(), std::size_t num_threads = 0);
+
+// Similar to above, but traverses the rays in the given order, e.g. a RayOrder
+// of the same rays. The batch is identical to that of the rays as given.
+CompactVoxelBatch walkSphericalVolumeCompactBatch(
+    const Ray *rays, std::size_t num_rays, const SphericalVoxelGrid &grid,
+    double max_t, CompactVoxelEncoding encoding, const RayOrder &order,
+    ThreadPool &pool = ThreadPool::global(), std::size_t num_threads = 0);
+
+// Decodes the voxels of ray i of the batch, which are appended to voxels. For
+// STEPS, a ray whose steps call for more packed IDs than it holds, which only
+// a corrupted voxel stream has, is decoded up to the voxel lacking its IDs.
+void decodeCompactVoxels(const CompactVoxelView &batch, std::size_t i,
+                         std::vector<SphericalVoxel> &voxels);
+
+inline void decodeCompactVoxels(const CompactVoxelBatch &batch, std::size_t i,
+                                std::vector<SphericalVoxel> &voxels) {
+  decodeCompactVoxels(batch.view(), i, voxels);
+}
+
+// Decodes every ray of the batch.
+SphericalVoxelBatch decodeCompactVoxelBatch(const CompactVoxelBatch &batch);
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_COMPACT_VOXEL_H
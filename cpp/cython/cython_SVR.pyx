@@ -3,6 +3,7 @@
 import numpy as np
 cimport numpy as np
 cimport cython
+from libcpp.string cimport string
 from libcpp.vector cimport vector
 
 cdef extern from "../spherical_volume_rendering_util.h" namespace "svr":
@@ -17,6 +18,92 @@ cdef extern from "../spherical_volume_rendering_util.h" namespace "svr":
                                                size_t num_azimuthal_voxels, double *sphere_center,
                                                double max_t)
 
+cdef extern from "../traversal_statistics.h" namespace "svr" nogil:
+    cdef struct TraversalStatistics:
+        np.uint64_t num_rays, num_iterations
+        np.uint64_t num_radial_steps, num_polar_steps, num_azimuthal_steps
+        np.uint64_t num_radial_polar_steps, num_radial_azimuthal_steps, num_polar_azimuthal_steps
+        np.uint64_t num_radial_polar_azimuthal_steps
+        np.uint64_t num_no_progress_steps, num_angular_perturbations
+        np.uint64_t num_polar_exits, num_azimuthal_exits
+        np.uint64_t num_entry_hints
+        np.uint64_t setup_nanoseconds, stepping_nanoseconds
+
+    bint traversalStatisticsEnabled()
+    TraversalStatistics traversalStatistics()
+    void resetTraversalStatistics()
+
+cdef extern from "../vec3.h":
+    cdef cppclass BoundVec3:
+        BoundVec3(double x, double y, double z)
+
+# Named _SphericalVoxelGrid to avoid a clash with the SphericalVoxelGrid extension type below.
+cdef extern from "../spherical_voxel_grid.h":
+    cdef cppclass _SphericalVoxelGrid "svr::SphericalVoxelGrid":
+        _SphericalVoxelGrid(const SphereBound &min_bound, const SphereBound &max_bound,
+                            size_t num_radial_sections, size_t num_polar_sections,
+                            size_t num_azimuthal_sections, const BoundVec3 &sphere_center) except +
+        _SphericalVoxelGrid(const SphereBound &min_bound, const SphereBound &max_bound,
+                            const vector[double] &radial_edges, size_t num_polar_sections,
+                            size_t num_azimuthal_sections, const BoundVec3 &sphere_center) except +
+        size_t numRadialSections() const
+        size_t numPolarSections() const
+        size_t numAzimuthalSections() const
+
+cdef extern from "../spherical_voxel_grid_file.h" namespace "svr":
+    # A std::shared_ptr<const svr::SphericalVoxelGrid>.
+    cdef cppclass SharedSphericalVoxelGrid:
+        SharedSphericalVoxelGrid()
+        SharedSphericalVoxelGrid(const _SphericalVoxelGrid *grid)
+        const _SphericalVoxelGrid *get()
+    bint writeSphericalVoxelGrid(const _SphericalVoxelGrid &grid, const string &path) nogil
+    SharedSphericalVoxelGrid readSphericalVoxelGrid(const string &path) nogil
+
+cdef extern from "../spherical_volume_rendering_util.h" namespace "svr" nogil:
+    vector[SphericalVoxel] walkSphericalVolume(const double *ray_origin, const double *ray_direction,
+                                               const _SphericalVoxelGrid &grid, double max_t)
+    size_t countSphericalVoxelBatch(const double *ray_origins, const double *ray_directions,
+                                    size_t num_rays, const _SphericalVoxelGrid &grid, double max_t,
+                                    np.int64_t *offsets, size_t num_threads) except +
+    void fillSphericalVoxelBatch(const double *ray_origins, const double *ray_directions,
+                                 size_t num_rays, const _SphericalVoxelGrid &grid, double max_t,
+                                 const np.int64_t *offsets, np.int32_t *indices, double *times,
+                                 size_t num_threads) except +
+    void orderSphericalRays(const double *ray_origins, const double *ray_directions,
+                            size_t num_rays, const _SphericalVoxelGrid &grid, int ordering,
+                            np.uint32_t *order) except +
+    size_t countSphericalVoxelBatch(const double *ray_origins, const double *ray_directions,
+                                    size_t num_rays, const _SphericalVoxelGrid &grid, double max_t,
+                                    np.int64_t *offsets, const np.uint32_t *order,
+                                    size_t num_threads) except +
+    void fillSphericalVoxelBatch(const double *ray_origins, const double *ray_directions,
+                                 size_t num_rays, const _SphericalVoxelGrid &grid, double max_t,
+                                 const np.int64_t *offsets, np.int32_t *indices, double *times,
+                                 const np.uint32_t *order, size_t num_threads) except +
+
+cdef extern from "../compact_voxel.h":
+    cdef enum CompactVoxelEncoding "svr::CompactVoxelEncoding":
+        PACKED "svr::CompactVoxelEncoding::PACKED"
+        STEPS "svr::CompactVoxelEncoding::STEPS"
+
+# The values of svr::RayOrdering, by the name of the ordering argument of walk_batch().
+RAY_ORDERINGS = {'morton': 0, 'hilbert': 1}
+
+cdef extern from "../voxel_stream.h" namespace "svr":
+    cdef cppclass _VoxelStreamWriter "svr::VoxelStreamWriter":
+        _VoxelStreamWriter(const string &path, const _SphericalVoxelGrid &grid,
+                           CompactVoxelEncoding encoding)
+        bint isOpen()
+        size_t numRays()
+        bint write(const double *ray_origins, const double *ray_directions, size_t num_rays,
+                   double max_t, size_t num_threads) nogil
+        bint close()
+
+cdef extern from "../pipeline.h" namespace "svr":
+    bint writeVoxelStreamPipelined(_VoxelStreamWriter &writer, const double *ray_origins,
+                                   const double *ray_directions, size_t num_rays, double max_t,
+                                   size_t batch_size, size_t num_threads) nogil
+
 @cython.boundscheck(False)
 @cython.wraparound(False)
 @cython.cdivision(True)
@@ -69,4 +156,310 @@ def walk_spherical_volume(np.ndarray[np.float64_t, ndim=1, mode="c"] ray_origin,
         cyVoxels[i,0] = voxels[i].radial
         cyVoxels[i,1] = voxels[i].polar
         cyVoxels[i,2] = voxels[i].azimuthal
-    return cyVoxels
\ No newline at end of file
+    return cyVoxels
+
+
+cdef walk_batch(const _SphericalVoxelGrid *grid, np.ndarray[np.float64_t, ndim=2, mode="c"] ray_origins,
+                np.ndarray[np.float64_t, ndim=2, mode="c"] ray_directions, double max_t, int num_threads,
+                str ordering = None):
+    '''
+    Returns the (offsets, indices, times) numpy arrays of the rays traversed through grid. See
+    walk_spherical_volume_batch(). The voxels are first counted, and then written directly to the
+    numpy arrays, so that no intermediate buffers are allocated or copied. If ordering is given, the
+    rays are traversed in the order of that space-filling curve, but written as given.
+    '''
+    assert(ray_origins.shape[1] == 3)
+    assert(ray_directions.shape[0] == ray_origins.shape[0] and ray_directions.shape[1] == 3)
+    assert(num_threads >= 0)
+    assert(ordering is None or ordering in RAY_ORDERINGS)
+    cdef size_t num_rays = ray_origins.shape[0]
+    cdef double *origins = <double *> ray_origins.data
+    cdef double *directions = <double *> ray_directions.data
+    cdef np.ndarray[np.uint32_t, ndim=1, mode="c"] order
+    cdef np.uint32_t *order_data = NULL
+    cdef int ordering_value
+    if ordering is not None:
+        order = np.empty(num_rays, dtype=np.uint32)
+        order_data = <np.uint32_t *> order.data
+        ordering_value = RAY_ORDERINGS[ordering]
+        with nogil:
+            orderSphericalRays(origins, directions, num_rays, grid[0], ordering_value, order_data)
+    cdef np.ndarray[np.int64_t, ndim=1, mode="c"] offsets = np.empty(num_rays + 1, dtype=np.int64)
+    cdef np.int64_t *offsets_data = <np.int64_t *> offsets.data
+    cdef size_t num_voxels
+    with nogil:
+        num_voxels = countSphericalVoxelBatch(origins, directions, num_rays, grid[0], max_t,
+                                              offsets_data, order_data, num_threads)
+    cdef np.ndarray[np.int32_t, ndim=2, mode="c"] indices = np.empty((num_voxels, 3), dtype=np.int32)
+    cdef np.ndarray[np.float64_t, ndim=2, mode="c"] times = np.empty((num_voxels, 2), dtype=np.float64)
+    cdef np.int32_t *indices_data = <np.int32_t *> indices.data
+    cdef double *times_data = <double *> times.data
+    with nogil:
+        fillSphericalVoxelBatch(origins, directions, num_rays, grid[0], max_t, offsets_data,
+                                indices_data, times_data, order_data, num_threads)
+    return offsets, indices, times
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+def walk_spherical_volume_batch(np.ndarray[np.float64_t, ndim=2, mode="c"] ray_origins,
+                                np.ndarray[np.float64_t, ndim=2, mode="c"] ray_directions,
+                                np.ndarray[np.float64_t, ndim=1, mode="c"] min_bound,
+                                np.ndarray[np.float64_t, ndim=1, mode="c"] max_bound,
+                                int num_radial_voxels, int num_polar_voxels, int num_azimuthal_voxels,
+                                np.ndarray[np.float64_t, ndim=1, mode="c"] sphere_center,
+                                np.float64_t max_t = 1.0, int num_threads = 0, str ordering = None):
+    '''
+    Batched Spherical Coordinate Voxel Traversal Algorithm
+    Traverses many rays with a single call. The GIL is released while the rays are traversed in
+    parallel. The voxels of each ray are counted in a first pass, and then written directly to the
+    returned numpy arrays in a second, so the arrays are the only allocation of the batch.
+    Arguments:
+           ray_origins: An N x 3 array of the (x,y,z) origins of the rays.
+           ray_directions: An N x 3 array of the (x,y,z) unit directions of the rays.
+           min_bound, max_bound, num_radial_voxels, num_polar_voxels, num_azimuthal_voxels,
+           sphere_center, max_t: See walk_spherical_volume().
+           num_threads: The maximum number of threads used. Defaulted to 0, i.e. all threads.
+           ordering: If 'morton' or 'hilbert', the rays are sorted along that curve by where they
+                     enter the sphere and their direction, and traversed in that order, so that
+                     nearby rays are traversed together. The results are in the order given.
+                     Defaulted to None, i.e. the rays are traversed as given.
+    Returns:
+           A tuple (offsets, indices, times) of numpy arrays. The voxels traversed by ray i are
+           rows offsets[i] up to, but not including, offsets[i + 1] of indices and times.
+             offsets: An int64 array of size N + 1.
+             indices: An M x 3 int32 array of the (radial, polar, azimuthal) voxel coordinates,
+                      where M is the total number of voxels traversed.
+             times: An M x 2 float64 array of the (enter, exit) times of each voxel.
+           The voxel coordinates of each ray are identical to those returned by
+           walk_spherical_volume().
+    '''
+    grid = SphericalVoxelGrid(min_bound, max_bound, num_radial_voxels, num_polar_voxels,
+                              num_azimuthal_voxels, sphere_center)
+    return grid.walk_spherical_volume_batch(ray_origins, ray_directions, max_t, num_threads, ordering)
+
+
+cdef class SphericalVoxelGrid:
+    '''
+    A spherical voxel grid that is constructed once and reused across traversals. Constructing a grid
+    computes its voxel boundaries, which otherwise dominates the cost of walk_spherical_volume() and
+    walk_spherical_volume_batch() for a single ray. The grid is immutable, and is shared rather than
+    copied by the objects that hold it, e.g. a VoxelStreamWriter.
+    Arguments:
+           min_bound, max_bound, num_radial_voxels, num_polar_voxels, num_azimuthal_voxels,
+           sphere_center: See walk_spherical_volume().
+           radial_edges: Optionally, the N + 1 strictly increasing radii that bound N non-uniform
+                         radial voxels, e.g. np.geomspace() for finer voxels near the center. Radial
+                         voxel 1 remains the outermost. Replaces num_radial_voxels and the radial
+                         bounds.
+           path: Optionally, a file written by save(), from which the grid is read rather than
+                 computed. Replaces every other argument.
+    '''
+    cdef SharedSphericalVoxelGrid shared_grid
+    cdef const _SphericalVoxelGrid *grid
+
+    def __cinit__(self, np.ndarray[np.float64_t, ndim=1, mode="c"] min_bound = None,
+                  np.ndarray[np.float64_t, ndim=1, mode="c"] max_bound = None,
+                  int num_radial_voxels = 0, int num_polar_voxels = 0, int num_azimuthal_voxels = 0,
+                  np.ndarray[np.float64_t, ndim=1, mode="c"] sphere_center = None, radial_edges=None,
+                  str path = None):
+        if path is not None:
+            self.shared_grid = readSphericalVoxelGrid(path.encode())
+            if self.shared_grid.get() == NULL:
+                raise IOError("Unable to read the spherical voxel grid '%s'." % path)
+            self.grid = self.shared_grid.get()
+            return
+        assert(min_bound is not None and min_bound.size == 3)
+        assert(max_bound is not None and max_bound.size == 3)
+        assert(sphere_center is not None and sphere_center.size == 3)
+        assert((num_radial_voxels > 0 or radial_edges is not None) and num_polar_voxels > 0 and
+               num_azimuthal_voxels > 0)
+        cdef SphereBound min_sphere_bound, max_sphere_bound
+        min_sphere_bound.radial = min_bound[0]
+        min_sphere_bound.polar = min_bound[1]
+        min_sphere_bound.azimuthal = min_bound[2]
+        max_sphere_bound.radial = max_bound[0]
+        max_sphere_bound.polar = max_bound[1]
+        max_sphere_bound.azimuthal = max_bound[2]
+        cdef vector[double] edges
+        if radial_edges is not None:
+            edges = np.asarray(radial_edges, dtype=np.float64)
+            assert(edges.size() >= 2 and edges[0] >= 0 and np.all(np.diff(radial_edges) > 0))
+            self.shared_grid = SharedSphericalVoxelGrid(new _SphericalVoxelGrid(
+                min_sphere_bound, max_sphere_bound, edges, num_polar_voxels, num_azimuthal_voxels,
+                BoundVec3(sphere_center[0], sphere_center[1], sphere_center[2])))
+        else:
+            self.shared_grid = SharedSphericalVoxelGrid(new _SphericalVoxelGrid(
+                min_sphere_bound, max_sphere_bound, num_radial_voxels, num_polar_voxels,
+                num_azimuthal_voxels, BoundVec3(sphere_center[0], sphere_center[1], sphere_center[2])))
+        self.grid = self.shared_grid.get()
+
+    def save(self, str path):
+        '''
+        Writes the precomputed tables of this grid to the file at path, which is truncated if it
+        exists, so that the grid may be read with SphericalVoxelGrid(path=path) rather than
+        computed. See spherical_voxel_grid_file.h for the file layout.
+        '''
+        if not writeSphericalVoxelGrid(self.grid[0], path.encode()):
+            raise IOError("Unable to write the spherical voxel grid '%s'." % path)
+
+    @property
+    def num_radial_voxels(self):
+        return self.grid.numRadialSections()
+
+    @property
+    def num_polar_voxels(self):
+        return self.grid.numPolarSections()
+
+    @property
+    def num_azimuthal_voxels(self):
+        return self.grid.numAzimuthalSections()
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def walk_spherical_volume(self, np.ndarray[np.float64_t, ndim=1, mode="c"] ray_origin,
+                              np.ndarray[np.float64_t, ndim=1, mode="c"] ray_direction,
+                              np.float64_t max_t = 1.0):
+        '''
+        Traverses a single ray through this grid. See walk_spherical_volume().
+        '''
+        assert(ray_origin.size == 3)
+        assert(ray_direction.size == 3)
+        cdef vector[SphericalVoxel] voxels
+        with nogil:
+            voxels = walkSphericalVolume(&ray_origin[0], &ray_direction[0], self.grid[0], max_t)
+        cdef np.ndarray[np.int64_t, ndim=2, mode="c"] cyVoxels = np.empty((voxels.size(), 3), dtype=np.int64)
+        cdef size_t i
+        for i in range(voxels.size()):
+            cyVoxels[i, 0] = voxels[i].radial
+            cyVoxels[i, 1] = voxels[i].polar
+            cyVoxels[i, 2] = voxels[i].azimuthal
+        return cyVoxels
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def walk_spherical_volume_batch(self, np.ndarray[np.float64_t, ndim=2, mode="c"] ray_origins,
+                                    np.ndarray[np.float64_t, ndim=2, mode="c"] ray_directions,
+                                    np.float64_t max_t = 1.0, int num_threads = 0,
+                                    str ordering = None):
+        '''
+        Traverses many rays through this grid with the GIL released. See walk_spherical_volume_batch().
+        '''
+        return walk_batch(self.grid, ray_origins, ray_directions, max_t, num_threads, ordering)
+
+
+
+cdef class VoxelStreamWriter:
+    '''
+    Writes the voxels traversed by a set of rays too large to hold in memory to a file, in chunks of
+    consecutive rays. Ray IDs are assigned in the order the rays are written. The file is read with
+    voxel_stream.VoxelStream, which maps it with np.memmap. See voxel_stream.h for the file layout.
+    Arguments:
+           path: The path of the file, which is truncated if it exists.
+           grid: The SphericalVoxelGrid the rays are traversed through.
+           encoding: 'packed' to store the IDs of every voxel in 32 bits, or 'steps' to store each
+                     voxel as the step from its predecessor in a single byte. See compact_voxel.h.
+    The file can only be read once close() is called, or the writer is used as a context manager.
+    '''
+    cdef _VoxelStreamWriter *writer
+    cdef SphericalVoxelGrid grid
+
+    def __cinit__(self, str path, SphericalVoxelGrid grid, str encoding = 'packed'):
+        assert(encoding in ('packed', 'steps'))
+        # Holds a reference to the grid, which must outlive the C++ writer.
+        self.grid = grid
+        self.writer = new _VoxelStreamWriter(path.encode(), grid.grid[0],
+                                             PACKED if encoding == 'packed' else STEPS)
+        if not self.writer.isOpen():
+            raise IOError("Unable to create the voxel stream '%s'." % path)
+
+    def __dealloc__(self):
+        del self.writer
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    @property
+    def num_rays(self):
+        return self.writer.numRays()
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def write(self, np.ndarray[np.float64_t, ndim=2, mode="c"] ray_origins,
+              np.ndarray[np.float64_t, ndim=2, mode="c"] ray_directions,
+              np.float64_t max_t = 1.0, int num_threads = 0):
+        '''
+        Traverses the rays with the GIL released and appends their voxels to the file as one chunk.
+        The arguments are as with walk_spherical_volume_batch(). Only this chunk is held in memory.
+        '''
+        assert(ray_origins.shape[1] == 3 and ray_directions.shape[1] == 3)
+        assert(ray_origins.shape[0] == ray_directions.shape[0])
+        assert(num_threads >= 0)
+        cdef size_t num_rays = ray_origins.shape[0]
+        if num_rays == 0:
+            return
+        cdef bint written
+        with nogil:
+            written = self.writer.write(&ray_origins[0, 0], &ray_directions[0, 0], num_rays,
+                                        max_t, num_threads)
+        if not written:
+            raise IOError("Unable to write to the voxel stream.")
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def write_pipelined(self, np.ndarray[np.float64_t, ndim=2, mode="c"] ray_origins,
+                        np.ndarray[np.float64_t, ndim=2, mode="c"] ray_directions,
+                        np.float64_t max_t = 1.0, int batch_size = 65536, int num_threads = 0):
+        '''
+        Similar to write(), but appends the rays as chunks of batch_size rays, where the traversal of
+        each chunk on num_threads threads overlaps with the writing of the previous chunks. Only the
+        chunks in flight are held in memory. See svr::RayPipeline in pipeline.h.
+        '''
+        assert(ray_origins.shape[1] == 3 and ray_directions.shape[1] == 3)
+        assert(ray_origins.shape[0] == ray_directions.shape[0])
+        assert(batch_size > 0 and num_threads >= 0)
+        cdef size_t num_rays = ray_origins.shape[0]
+        if num_rays == 0:
+            return
+        cdef bint written
+        with nogil:
+            written = writeVoxelStreamPipelined(self.writer[0], &ray_origins[0, 0],
+                                                &ray_directions[0, 0], num_rays, max_t,
+                                                batch_size, num_threads)
+        if not written:
+            raise IOError("Unable to write to the voxel stream.")
+
+    def close(self):
+        '''
+        Writes the index of the chunks and closes the file. Closing a closed writer has no effect.
+        '''
+        if self.writer.isOpen() and not self.writer.close():
+            raise IOError("Unable to close the voxel stream.")
+
+
+def traversal_statistics_enabled():
+    '''
+    Returns True if this module was compiled with SVR_ENABLE_STATISTICS, and so collects traversal
+    statistics. See cython_SVR_setup.py.
+    '''
+    return traversalStatisticsEnabled()
+
+def traversal_statistics():
+    '''
+    Returns a dict of the statistics collected by the traversals of all threads since the last call
+    to reset_traversal_statistics(), e.g. the number of rays traversed ('num_rays'), the number of
+    steps taken ('num_iterations'), the number of steps of each type ('num_radial_steps', ...,
+    'num_radial_polar_azimuthal_steps'), and the time spent initializing rays and stepping through
+    voxels ('setup_nanoseconds', 'stepping_nanoseconds'). See traversal_statistics.h.
+    The counts are all zero unless traversal_statistics_enabled() is True.
+    '''
+    return traversalStatistics()
+
+def reset_traversal_statistics():
+    '''
+    Resets the statistics returned by traversal_statistics() to zero.
+    '''
+    resetTraversalStatistics()
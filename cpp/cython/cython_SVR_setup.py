@@ -8,19 +8,33 @@ Dependencies:
 
 Code must be compiled before use:
   > python3 cython_SVR_setup.py build_ext --inplace
+To collect traversal statistics, see traversal_statistics(), compile with:
+  > SVR_ENABLE_STATISTICS=1 python3 cython_SVR_setup.py build_ext --inplace
+To traverse with the fast comparisons by default, compile with:
+  > SVR_ENABLE_FAST_COMPARISON=1 python3 cython_SVR_setup.py build_ext --inplace
 '''
 
+import os
 import numpy
 from distutils.core import setup
 from distutils.extension import Extension
 from Cython.Distutils import build_ext
 
+define_macros = [('NPY_NO_DEPRECATED_API', 'NPY_1_7_API_VERSION')] # Hides deprecated Numpy warning.
+if os.environ.get('SVR_ENABLE_STATISTICS', '0') != '0':
+    define_macros.append(('SVR_ENABLE_STATISTICS', None))
+if os.environ.get('SVR_ENABLE_FAST_COMPARISON', '0') != '0':
+    define_macros.append(('SVR_ENABLE_FAST_COMPARISON', None))
+
 ext_modules = [Extension(
     name="cython_SVR",
-    sources=["cython_SVR.pyx", "../spherical_volume_rendering_util.cpp"],
+    sources=["cython_SVR.pyx", "../spherical_volume_rendering_util.cpp", "../thread_pool.cpp", "../traversal_statistics.cpp",
+             "../compact_voxel.cpp", "../voxel_stream.cpp", "../spherical_voxel_grid_file.cpp",
+             "../pipeline.cpp"],
     language="c++",
-    extra_compile_args=["-std=c++11", "-O3", "-march=native", "-flto", "-fno-signed-zeros", "-funroll-loops"],
-    define_macros = [('NPY_NO_DEPRECATED_API', 'NPY_1_7_API_VERSION')], # Hides deprecated Numpy warning.
+    extra_compile_args=["-std=c++11", "-O3", "-march=native", "-flto", "-fno-signed-zeros", "-funroll-loops", "-pthread"],
+    extra_link_args=["-pthread"],
+    define_macros = define_macros,
     include_dirs = [numpy.get_include()],
 )]
 
@@ -4,9 +4,12 @@ To compile SVR code:
     python3 cython_SVR_setup.py build_ext --inplace
 '''
 
+import os
+import tempfile
 import unittest
 import numpy as np
 import cython_SVR
+import voxel_stream
 
 
 class TestWalkSphericalVolume(unittest.TestCase):
@@ -809,6 +812,122 @@ class TestWalkSphericalVolume(unittest.TestCase):
         last_radial_voxel = voxels[voxels[0].size - 1][0]
         assert (last_radial_voxel != 0)
 
+    def test_batch_matches_single_ray(self):
+        sphere_center = np.array([0.0, 0.0, 0.0])
+        sphere_max_radius = 10.0
+        num_radial_sections = 4
+        num_polar_sections = 8
+        num_azimuthal_sections = 4
+        min_bound = np.array([0.0, 0.0, 0.0])
+        max_bound = np.array([sphere_max_radius, 2 * np.pi, 2 * np.pi])
+        ray_origins = np.array([[i, j, -15.0] for i in range(-12, 13) for j in range(-12, 13)])
+        ray_directions = np.tile(np.array([0.1, -0.2, 1.0]), (ray_origins.shape[0], 1))
+        offsets, indices, times = cython_SVR.walk_spherical_volume_batch(ray_origins, ray_directions,
+                                                                         min_bound, max_bound,
+                                                                         num_radial_sections, num_polar_sections,
+                                                                         num_azimuthal_sections, sphere_center)
+        assert offsets.shape == (ray_origins.shape[0] + 1,)
+        assert indices.shape == (offsets[-1], 3)
+        assert times.shape == (offsets[-1], 2)
+        for i in range(ray_origins.shape[0]):
+            voxels = cython_SVR.walk_spherical_volume(ray_origins[i], ray_directions[i], min_bound, max_bound,
+                                                      num_radial_sections, num_polar_sections,
+                                                      num_azimuthal_sections, sphere_center)
+            np.testing.assert_array_equal(indices[offsets[i]:offsets[i + 1]], voxels)
+            assert np.all(times[offsets[i]:offsets[i + 1], 0] <= times[offsets[i]:offsets[i + 1], 1])
+
+    def test_batch_no_rays(self):
+        min_bound = np.array([0.0, 0.0, 0.0])
+        max_bound = np.array([10.0, 2 * np.pi, 2 * np.pi])
+        offsets, indices, times = cython_SVR.walk_spherical_volume_batch(np.empty((0, 3)), np.empty((0, 3)),
+                                                                         min_bound, max_bound, 4, 4, 4,
+                                                                         np.array([0.0, 0.0, 0.0]))
+        assert offsets.tolist() == [0]
+        assert indices.shape == (0, 3)
+        assert times.shape == (0, 2)
+
+    def test_grid_matches_walk_spherical_volume(self):
+        sphere_center = np.array([0.0, 0.0, 0.0])
+        sphere_max_radius = 10.0
+        num_radial_sections = 4
+        num_polar_sections = 8
+        num_azimuthal_sections = 4
+        min_bound = np.array([0.0, 0.0, 0.0])
+        max_bound = np.array([sphere_max_radius, 2 * np.pi, 2 * np.pi])
+        grid = cython_SVR.SphericalVoxelGrid(min_bound, max_bound, num_radial_sections, num_polar_sections,
+                                             num_azimuthal_sections, sphere_center)
+        assert grid.num_radial_voxels == num_radial_sections
+        assert grid.num_polar_voxels == num_polar_sections
+        assert grid.num_azimuthal_voxels == num_azimuthal_sections
+        ray_origins = np.array([[i, j, -15.0] for i in range(-12, 13) for j in range(-12, 13)])
+        ray_directions = np.tile(np.array([0.1, -0.2, 1.0]), (ray_origins.shape[0], 1))
+        offsets, indices, times = grid.walk_spherical_volume_batch(ray_origins, ray_directions)
+        for i in range(ray_origins.shape[0]):
+            expected_voxels = cython_SVR.walk_spherical_volume(ray_origins[i], ray_directions[i], min_bound,
+                                                               max_bound, num_radial_sections, num_polar_sections,
+                                                               num_azimuthal_sections, sphere_center)
+            voxels = grid.walk_spherical_volume(ray_origins[i], ray_directions[i])
+            np.testing.assert_array_equal(voxels, expected_voxels)
+            np.testing.assert_array_equal(indices[offsets[i]:offsets[i + 1]], expected_voxels)
+
+    def test_traversal_statistics(self):
+        min_bound = np.array([0.0, 0.0, 0.0])
+        max_bound = np.array([10.0, 2 * np.pi, 2 * np.pi])
+        ray_origins = np.array([[i, j, -15.0] for i in range(-12, 13) for j in range(-12, 13)])
+        ray_directions = np.tile(np.array([0.1, -0.2, 1.0]), (ray_origins.shape[0], 1))
+        cython_SVR.reset_traversal_statistics()
+        offsets, indices, times = cython_SVR.walk_spherical_volume_batch(ray_origins, ray_directions,
+                                                                         min_bound, max_bound, 4, 8, 4,
+                                                                         np.array([0.0, 0.0, 0.0]))
+        statistics = cython_SVR.traversal_statistics()
+        if not cython_SVR.traversal_statistics_enabled():
+            assert all(count == 0 for count in statistics.values())
+            return
+        assert statistics['num_rays'] == np.count_nonzero(np.diff(offsets))
+        assert statistics['num_iterations'] == indices.shape[0] + statistics['num_no_progress_steps']
+        cython_SVR.reset_traversal_statistics()
+        assert cython_SVR.traversal_statistics()['num_iterations'] == 0
+
+    def test_voxel_stream_matches_batch(self):
+        min_bound = np.array([0.0, 0.0, 0.0])
+        max_bound = np.array([10.0, 2 * np.pi, 2 * np.pi])
+        grid = cython_SVR.SphericalVoxelGrid(min_bound, max_bound, 4, 8, 4, np.array([0.0, 0.0, 0.0]))
+        ray_origins = np.array([[i, j, -15.0] for i in range(-12, 13) for j in range(-12, 13)])
+        ray_directions = np.tile(np.array([0.1, -0.2, 1.0]), (ray_origins.shape[0], 1))
+        offsets, indices, times = grid.walk_spherical_volume_batch(ray_origins, ray_directions)
+        split = ray_origins.shape[0] // 3
+        for encoding in ('packed', 'steps'):
+            with tempfile.TemporaryDirectory() as directory:
+                path = os.path.join(directory, 'voxels.svr')
+                with cython_SVR.VoxelStreamWriter(path, grid, encoding) as writer:
+                    writer.write(ray_origins[:split], ray_directions[:split])
+                    writer.write(ray_origins[split:], ray_directions[split:])
+                    assert writer.num_rays == ray_origins.shape[0]
+                stream = voxel_stream.VoxelStream(path)
+                assert stream.num_rays == ray_origins.shape[0]
+                assert stream.num_voxels == offsets[-1]
+                assert stream.num_chunks == 2
+                for i in range(ray_origins.shape[0]):
+                    stream_indices, stream_times = stream.ray(i)
+                    np.testing.assert_array_equal(stream_indices, indices[offsets[i]:offsets[i + 1]])
+                    np.testing.assert_allclose(stream_times, times[offsets[i]:offsets[i + 1]], atol=1e-5)
+                del stream
+
+    def test_radial_edges_match_uniform_grid(self):
+        min_bound = np.array([0.0, 0.0, 0.0])
+        max_bound = np.array([10.0, 2 * np.pi, 2 * np.pi])
+        sphere_center = np.array([0.0, 0.0, 0.0])
+        uniform = cython_SVR.SphericalVoxelGrid(min_bound, max_bound, 4, 8, 4, sphere_center)
+        edges = cython_SVR.SphericalVoxelGrid(min_bound, max_bound, 0, 8, 4, sphere_center,
+                                              radial_edges=np.linspace(0.0, 10.0, 5))
+        assert edges.num_radial_voxels == 4
+        ray_origins = np.array([[i, j, -15.0] for i in range(-12, 13) for j in range(-12, 13)])
+        ray_directions = np.tile(np.array([0.1, -0.2, 1.0]), (ray_origins.shape[0], 1))
+        expected = uniform.walk_spherical_volume_batch(ray_origins, ray_directions)
+        actual = edges.walk_spherical_volume_batch(ray_origins, ray_directions)
+        for e, a in zip(expected, actual):
+            np.testing.assert_array_equal(e, a)
+
 
 if __name__ == '__main__':
     unittest.main()
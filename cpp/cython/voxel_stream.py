@@ -0,0 +1,141 @@
+'''
+Zero-copy reader of the voxel streams written by cython_SVR.VoxelStreamWriter and
+svr::VoxelStreamWriter. The file is mapped with np.memmap, so only the pages of the rays read are
+loaded from disk. Requires only Numpy; see voxel_stream.h for the file layout.
+'''
+
+import numpy as np
+
+MAGIC = b'SVRVOXEL'
+VERSION = 1
+PACKED = 0
+STEPS = 1
+
+# Matches svr::VoxelStreamHeader and svr::VoxelStreamChunk, in the native byte order as written by
+# svr::VoxelStreamWriter.
+HEADER_DTYPE = np.dtype([('magic', 'S8'), ('version', '=u4'), ('encoding', '=u4'),
+                         ('num_radial_sections', '=u8'), ('num_polar_sections', '=u8'),
+                         ('num_azimuthal_sections', '=u8'), ('num_rays', '=u8'), ('num_voxels', '=u8'),
+                         ('num_chunks', '=u8'), ('chunk_table_offset', '=u8'), ('reserved', '=u8', 7)])
+CHUNK_DTYPE = np.dtype([('first_ray', '=u8'), ('num_rays', '=u8'), ('num_voxels', '=u8'),
+                        ('num_indices', '=u8'), ('file_offset', '=u8')])
+FULL_INDEX_STEP = 0xFF
+
+
+def _aligned(size):
+    return (size + 7) & ~7
+
+
+class VoxelStreamChunk:
+    '''
+    The arrays of a single chunk of a voxel stream, each a view of the mapped file. As with
+    walk_spherical_volume_batch(), the voxels of ray i of the chunk are offsets[i] up to, but not
+    including, offsets[i + 1]. See svr::CompactVoxelBatch for the meaning of each array.
+    '''
+
+    def __init__(self, data, info, encoding):
+        num_rays = int(info['num_rays'])
+        num_voxels = int(info['num_voxels'])
+        num_indices = int(info['num_indices'])
+        offset = int(info['file_offset'])
+
+        def take(dtype, count):
+            nonlocal offset
+            array = np.frombuffer(data, dtype=dtype, count=count, offset=offset)
+            offset += _aligned(count * np.dtype(dtype).itemsize)
+            return array
+
+        self.first_ray = int(info['first_ray'])
+        self.offsets = take('=u8', num_rays + 1)
+        self.enter_times = take('=f8', num_rays)
+        self.index_offsets = take('=u8', num_rays + 1) if encoding == STEPS else None
+        self.exit_offsets = take('=f4', num_voxels)
+        self.indices = take('=u4', num_indices)
+        self.steps = take('u1', num_voxels) if encoding == STEPS else None
+
+
+class VoxelStream:
+    '''
+    Maps the voxel stream at path. Raises ValueError if the file is not a closed voxel stream.
+    '''
+
+    def __init__(self, path):
+        self.data = np.memmap(path, dtype=np.uint8, mode='r')
+        if self.data.size < HEADER_DTYPE.itemsize:
+            raise ValueError("'%s' is not a voxel stream." % path)
+        self.header = np.frombuffer(self.data, dtype=HEADER_DTYPE, count=1)[0]
+        if self.header['magic'] != MAGIC or self.header['version'] != VERSION:
+            raise ValueError("'%s' is not a closed voxel stream." % path)
+        self.encoding = int(self.header['encoding'])
+        self.chunk_table = np.frombuffer(self.data, dtype=CHUNK_DTYPE, count=int(self.header['num_chunks']),
+                                         offset=int(self.header['chunk_table_offset']))
+        # The bit widths of svr::CompactVoxelCodec.
+        self.radial_bits = int(self.header['num_radial_sections']).bit_length()
+        self.polar_bits = int(self.header['num_polar_sections'] - 1).bit_length()
+        self.azimuthal_bits = int(self.header['num_azimuthal_sections'] - 1).bit_length()
+
+    @property
+    def num_rays(self):
+        return int(self.header['num_rays'])
+
+    @property
+    def num_voxels(self):
+        return int(self.header['num_voxels'])
+
+    @property
+    def num_chunks(self):
+        return self.chunk_table.size
+
+    def chunk(self, c):
+        return VoxelStreamChunk(self.data, self.chunk_table[c], self.encoding)
+
+    def chunk_of_ray(self, ray):
+        return int(np.searchsorted(self.chunk_table['first_ray'], ray, side='right')) - 1
+
+    def unpack(self, indices):
+        '''
+        Returns the M x 3 int32 array of the (radial, polar, azimuthal) IDs of the packed indices.
+        '''
+        indices = indices.astype(np.uint32)
+        radial = indices & ((1 << self.radial_bits) - 1)
+        polar = (indices >> self.radial_bits) & ((1 << self.polar_bits) - 1)
+        azimuthal = (indices >> (self.radial_bits + self.polar_bits)) & ((1 << self.azimuthal_bits) - 1)
+        return np.stack((radial, polar, azimuthal), axis=1).astype(np.int32)
+
+    def ray(self, ray):
+        '''
+        Returns a tuple (indices, times) of the voxels of the given ray, as with the rows of
+        walk_spherical_volume_batch() for that ray.
+        '''
+        c = self.chunk_of_ray(ray)
+        chunk = self.chunk(c)
+        i = ray - chunk.first_ray
+        begin, end = int(chunk.offsets[i]), int(chunk.offsets[i + 1])
+        exit_times = chunk.enter_times[i] + chunk.exit_offsets[begin:end].astype(np.float64)
+        times = np.empty((end - begin, 2))
+        times[:, 1] = exit_times
+        if end > begin:
+            times[0, 0] = chunk.enter_times[i]
+            times[1:, 0] = exit_times[:-1]
+        if self.encoding == PACKED:
+            return self.unpack(chunk.indices[begin:end]), times
+
+        steps = chunk.steps[begin:end]
+        index_begin = int(chunk.index_offsets[i])
+        full = self.unpack(chunk.indices[index_begin:int(chunk.index_offsets[i + 1])])
+        num_sections = (None, int(self.header['num_polar_sections']), int(self.header['num_azimuthal_sections']))
+        indices = np.empty((end - begin, 3), dtype=np.int32)
+        previous = np.zeros(3, dtype=np.int64)
+        index = 0
+        for j in range(end - begin):
+            if steps[j] == FULL_INDEX_STEP:
+                previous[:] = full[index]
+                index += 1
+            else:
+                for axis in range(3):
+                    delta = (int(steps[j]) >> (2 * axis)) & 3
+                    previous[axis] += 1 if delta == 1 else -1 if delta == 2 else 0
+                    if num_sections[axis] is not None:
+                        previous[axis] %= num_sections[axis]
+            indices[j] = previous
+        return indices, times
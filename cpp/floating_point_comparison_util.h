@@ -3,16 +3,36 @@
 
 #include <algorithm>
 #include <cmath>
+#include <type_traits>
 
+#include "host_device.h"
 #include "vec3.h"
 
 // A number of floating point comparison algorithms written for the spherical
 // volume rendering algorithm.
 
 namespace svr {
-// Epsilons used for floating point comparisons in Knuth's algorithm.
-constexpr double ABS_EPSILON = 1e-12;
-constexpr double REL_EPSILON = 1e-8;
+// Epsilons used for floating point comparisons in Knuth's algorithm, for each
+// floating point type T of the traversal. Epsilon<float> is wider to account
+// for the larger rounding error of single precision.
+template <class T>
+struct Epsilon;
+
+template <>
+struct Epsilon<double> {
+  static constexpr double ABS = 1e-12;
+  static constexpr double REL = 1e-8;
+};
+
+template <>
+struct Epsilon<float> {
+  static constexpr float ABS = 1e-5f;
+  static constexpr float REL = 1e-4f;
+};
+
+// The epsilons for double precision.
+constexpr double ABS_EPSILON = Epsilon<double>::ABS;
+constexpr double REL_EPSILON = Epsilon<double>::REL;
 
 // Determines equality between two floating point numbers using a defaulted
 // absolute and relative epsilon. Related Boost document:
@@ -23,32 +43,104 @@ constexpr double REL_EPSILON = 1e-8;
 //        Donald. E. Knuth, 1998, Addison-Wesley Longman, Inc., ISBN
 //        0-201-89684-2, Addison-Wesley Professional; 3rd edition. (The relevant
 //        equations are in §4.2.2, Eq. 36 and 37.)
-inline bool isEqual(double a, double b) noexcept {
-  const double diff = std::abs(a - b);
-  return diff <= ABS_EPSILON
+template <class T>
+SVR_HOST_DEVICE inline
+    typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+    isEqual(T a, T b) noexcept {
+  const T diff = std::abs(a - b);
+  return diff <= Epsilon<T>::ABS
              ? true
-             : diff <= std::max(std::abs(a), std::abs(b)) * REL_EPSILON;
+             : diff <= std::max(std::abs(a), std::abs(b)) * Epsilon<T>::REL;
 }
 
 // Overloaded version that checks for Knuth equality with vector cartesian
 // coordinates.
-inline bool isEqual(const Vec3 &a, const Vec3 &b) noexcept {
-  const double diff_x = std::abs(a.x() - b.x());
-  const double diff_y = std::abs(a.y() - b.y());
-  const double diff_z = std::abs(a.z() - b.z());
-  if (diff_x <= ABS_EPSILON && diff_y <= ABS_EPSILON && diff_z <= ABS_EPSILON) {
+template <class T>
+SVR_HOST_DEVICE inline bool isEqual(const BasicVec3<T> &a,
+                                    const BasicVec3<T> &b) noexcept {
+  const T diff_x = std::abs(a.x() - b.x());
+  const T diff_y = std::abs(a.y() - b.y());
+  const T diff_z = std::abs(a.z() - b.z());
+  if (diff_x <= Epsilon<T>::ABS && diff_y <= Epsilon<T>::ABS &&
+      diff_z <= Epsilon<T>::ABS) {
     return true;
   }
-  return diff_x <= std::max(std::abs(a.x()), std::abs(b.x())) * REL_EPSILON &&
-         diff_y <= std::max(std::abs(a.y()), std::abs(b.y())) * REL_EPSILON &&
-         diff_z <= std::max(std::abs(a.z()), std::abs(b.z())) * REL_EPSILON;
+  return diff_x <= std::max(std::abs(a.x()), std::abs(b.x())) *
+                       Epsilon<T>::REL &&
+         diff_y <= std::max(std::abs(a.y()), std::abs(b.y())) *
+                       Epsilon<T>::REL &&
+         diff_z <= std::max(std::abs(a.z()), std::abs(b.z())) *
+                       Epsilon<T>::REL;
 }
 
 // Checks to see if a is strictly less than b using Knuth's algorithm.
-inline bool lessThan(double a, double b) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline bool lessThan(T a, T b) noexcept {
   return a < b && !isEqual(a, b);
 }
 
+// The comparison policies of the traversal, which compare the times and
+// perpendicular products of each step. A policy provides isEqual(a, b),
+// lessThan(a, b), and the comparisons with zero isZero(a) and lessThanZero(a).
+
+// Compares with Knuth's algorithm above. This is the default.
+struct RobustComparison {
+  template <class T>
+  SVR_HOST_DEVICE static inline bool isEqual(T a, T b) noexcept {
+    return svr::isEqual(a, b);
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool lessThan(T a, T b) noexcept {
+    return svr::lessThan(a, b);
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool isZero(T a) noexcept {
+    return svr::isEqual(a, T(0));
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool lessThanZero(T a) noexcept {
+    return svr::lessThan(a, T(0));
+  }
+};
+
+// Compares with the sum of the absolute and relative epsilons as a single
+// tolerance, i.e. |a - b| <= ABS + REL * max(|a|, |b|), rather than testing
+// each in turn. Each comparison is then a few branchless operations that
+// contract to a multiply-add. The tolerance is at most twice that of Knuth's
+// algorithm, and at least as wide, so values within rounding of a boundary may
+// be classified differently. A comparison with zero reduces to the absolute
+// epsilon.
+struct FastComparison {
+  template <class T>
+  SVR_HOST_DEVICE static inline T tolerance(T a, T b) noexcept {
+    return Epsilon<T>::ABS +
+           Epsilon<T>::REL * std::max(std::abs(a), std::abs(b));
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool isEqual(T a, T b) noexcept {
+    return std::abs(a - b) <= tolerance(a, b);
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool lessThan(T a, T b) noexcept {
+    return b - a > tolerance(a, b);
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool isZero(T a) noexcept {
+    return std::abs(a) <= Epsilon<T>::ABS;
+  }
+
+  template <class T>
+  SVR_HOST_DEVICE static inline bool lessThanZero(T a) noexcept {
+    return a < -Epsilon<T>::ABS;
+  }
+};
+
 }  // namespace svr
 
 #endif  // SVR_FLOATING_POINT_COMPARISON_UTIL_H
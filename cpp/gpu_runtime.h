@@ -0,0 +1,126 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_GPU_RUNTIME_H
+#define SPHERICAL_VOLUME_RENDERING_GPU_RUNTIME_H
+
+#include <cstddef>
+
+// The subset of the CUDA and HIP runtimes used by the GPU traversal, so that
+// gpu_traversal.cu is compiled unchanged by either nvcc or hipcc. This is only
+// included by GPU translation units.
+#if defined(__HIPCC__)
+#include <hip/hip_runtime.h>
+#else
+#include <cuda_runtime.h>
+#endif
+
+namespace svr {
+
+namespace internal {
+
+// The number of threads of each block of the traversal kernels, i.e. rays
+// traversed per block.
+constexpr unsigned int GPU_BLOCK_SIZE = 128;
+
+inline unsigned int gpuNumBlocks(std::size_t num_rays) noexcept {
+  return static_cast<unsigned int>((num_rays + GPU_BLOCK_SIZE - 1) /
+                                   GPU_BLOCK_SIZE);
+}
+
+#if defined(__HIPCC__)
+inline bool gpuMalloc(void **memory, std::size_t size) noexcept {
+  return hipMalloc(memory, size) == hipSuccess;
+}
+
+inline void gpuFree(void *memory) noexcept { hipFree(memory); }
+
+inline bool gpuCopyToDevice(void *device, const void *host,
+                            std::size_t size) noexcept {
+  return hipMemcpy(device, host, size, hipMemcpyHostToDevice) == hipSuccess;
+}
+
+inline bool gpuCopyToHost(void *host, const void *device,
+                          std::size_t size) noexcept {
+  return hipMemcpy(host, device, size, hipMemcpyDeviceToHost) == hipSuccess;
+}
+
+// Returns whether the last kernel launched, and all work before it, succeeded.
+inline bool gpuSynchronize() noexcept {
+  return hipGetLastError() == hipSuccess &&
+         hipDeviceSynchronize() == hipSuccess;
+}
+#else
+inline bool gpuMalloc(void **memory, std::size_t size) noexcept {
+  return cudaMalloc(memory, size) == cudaSuccess;
+}
+
+inline void gpuFree(void *memory) noexcept { cudaFree(memory); }
+
+inline bool gpuCopyToDevice(void *device, const void *host,
+                            std::size_t size) noexcept {
+  return cudaMemcpy(device, host, size, cudaMemcpyHostToDevice) ==
+         cudaSuccess;
+}
+
+inline bool gpuCopyToHost(void *host, const void *device,
+                          std::size_t size) noexcept {
+  return cudaMemcpy(host, device, size, cudaMemcpyDeviceToHost) ==
+         cudaSuccess;
+}
+
+// Returns whether the last kernel launched, and all work before it, succeeded.
+inline bool gpuSynchronize() noexcept {
+  return cudaGetLastError() == cudaSuccess &&
+         cudaDeviceSynchronize() == cudaSuccess;
+}
+#endif
+
+// An array of size elements of type T in device memory, which is freed upon
+// destruction. Check isValid() for whether the memory was allocated.
+template <class T>
+class GpuArray {
+ public:
+  explicit GpuArray(std::size_t size) noexcept : size_(size) {
+    void *memory = nullptr;
+    // Allocates at least one element, so that an empty array is valid.
+    if (gpuMalloc(&memory, (size == 0 ? 1 : size) * sizeof(T))) {
+      this->data_ = static_cast<T *>(memory);
+    }
+  }
+
+  // Allocates and uploads the size elements of host.
+  GpuArray(const T *host, std::size_t size) noexcept : GpuArray(size) {
+    if (this->isValid() && size != 0 &&
+        !gpuCopyToDevice(this->data_, host, size * sizeof(T))) {
+      gpuFree(this->data_);
+      this->data_ = nullptr;
+    }
+  }
+
+  ~GpuArray() {
+    if (this->data_ != nullptr) gpuFree(this->data_);
+  }
+
+  GpuArray(const GpuArray &) = delete;
+  GpuArray &operator=(const GpuArray &) = delete;
+
+  inline bool isValid() const noexcept { return this->data_ != nullptr; }
+
+  inline T *data() const noexcept { return this->data_; }
+
+  inline std::size_t size() const noexcept { return this->size_; }
+
+  // Downloads the array to host, which must hold size() elements.
+  inline bool copyToHost(T *host) const noexcept {
+    return this->size_ == 0 ||
+           gpuCopyToHost(host, this->data_, this->size_ * sizeof(T));
+  }
+
+ private:
+  T *data_ = nullptr;
+  const std::size_t size_;
+};
+
+}  // namespace internal
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_GPU_RUNTIME_H
@@ -0,0 +1,149 @@
+#include "gpu_traversal.cuh"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace svr {
+
+namespace {
+
+// The alignment of each table in the device allocation of a grid, which is
+// that of the packed angular boundaries.
+constexpr std::size_t TABLE_ALIGNMENT = alignof(AngularBoundary);
+
+inline std::size_t aligned(std::size_t size) noexcept {
+  return (size + TABLE_ALIGNMENT - 1) & ~(TABLE_ALIGNMENT - 1);
+}
+
+// A table of a grid to upload, and its offset in the device allocation.
+struct Table {
+  const void *host;
+  std::size_t size;
+  std::size_t offset;
+};
+
+}  // namespace
+
+namespace internal {
+
+__global__ void countVoxelsKernel(const Ray *rays, std::size_t num_rays,
+                                  SphericalVoxelGridView grid, double max_t,
+                                  std::size_t *counts) {
+  const std::size_t i =
+      static_cast<std::size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= num_rays) return;
+  GpuVoxelCounter counter{0};
+  svr::walkSphericalVolume(rays[i], grid, max_t, counter);
+  counts[i] = counter.count;
+}
+
+__global__ void fillVoxelsKernel(const Ray *rays, std::size_t num_rays,
+                                 SphericalVoxelGridView grid, double max_t,
+                                 const std::size_t *offsets,
+                                 SphericalVoxel *voxels) {
+  const std::size_t i =
+      static_cast<std::size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= num_rays) return;
+  svr::walkSphericalVolume(
+      rays[i], grid, max_t,
+      GpuVoxelWriter{voxels + offsets[i], voxels + offsets[i + 1]});
+}
+
+}  // namespace internal
+
+DeviceSphericalVoxelGrid::DeviceSphericalVoxelGrid(
+    const SphericalVoxelGrid &grid)
+    : view_(grid, upload(grid, this->memory_)) {}
+
+DeviceSphericalVoxelGrid::~DeviceSphericalVoxelGrid() {
+  if (this->memory_ != nullptr) internal::gpuFree(this->memory_);
+}
+
+SphericalVoxelGridTables DeviceSphericalVoxelGrid::upload(
+    const SphericalVoxelGrid &grid, void *&memory) {
+  // The tables are uploaded to a single allocation, in the order of
+  // SphericalVoxelGridTables.
+  Table tables[] = {
+      {grid.deltaRadiiSquared().data(),
+       grid.deltaRadiiSquared().size() * sizeof(double), 0},
+      {grid.polarTrigValues().data(),
+       grid.polarTrigValues().size() * sizeof(TrigonometricValues), 0},
+      {grid.azimuthalTrigValues().data(),
+       grid.azimuthalTrigValues().size() * sizeof(TrigonometricValues), 0},
+      {&grid.polarBoundary(0),
+       (grid.numPolarSections() + 1) * sizeof(AngularBoundary), 0},
+      {&grid.azimuthalBoundary(0),
+       (grid.numAzimuthalSections() + 1) * sizeof(AngularBoundary), 0}};
+  std::size_t size = 0;
+  for (Table &table : tables) {
+    table.offset = size;
+    size += aligned(table.size);
+  }
+  std::vector<char> host(size);
+  for (const Table &table : tables) {
+    std::copy_n(static_cast<const char *>(table.host), table.size,
+                host.data() + table.offset);
+  }
+  if (!internal::gpuMalloc(&memory, size)) {
+    memory = nullptr;
+  } else if (!internal::gpuCopyToDevice(memory, host.data(), size)) {
+    internal::gpuFree(memory);
+    memory = nullptr;
+  }
+  const char *const device = static_cast<const char *>(memory);
+  if (device == nullptr) return {};
+  return {
+      .delta_radii_sq =
+          reinterpret_cast<const double *>(device + tables[0].offset),
+      .polar_trig_values = reinterpret_cast<const TrigonometricValues *>(
+          device + tables[1].offset),
+      .azimuthal_trig_values = reinterpret_cast<const TrigonometricValues *>(
+          device + tables[2].offset),
+      .polar_boundaries =
+          reinterpret_cast<const AngularBoundary *>(device + tables[3].offset),
+      .azimuthal_boundaries = reinterpret_cast<const AngularBoundary *>(
+          device + tables[4].offset)};
+}
+
+bool walkSphericalVolumeBatchGPU(const Ray *rays, std::size_t num_rays,
+                                 const DeviceSphericalVoxelGrid &grid,
+                                 double max_t, SphericalVoxelBatch &batch) {
+  if (!grid.isValid()) return false;
+  batch.offsets.assign(num_rays + 1, 0);
+  batch.voxels.clear();
+  if (num_rays == 0) return true;
+  const internal::GpuArray<Ray> device_rays(rays, num_rays);
+  // The counts of the first kernel, and then the offsets of the second.
+  internal::GpuArray<std::size_t> device_offsets(num_rays + 1);
+  if (!device_rays.isValid() || !device_offsets.isValid()) return false;
+  const unsigned int num_blocks = internal::gpuNumBlocks(num_rays);
+  internal::countVoxelsKernel<<<num_blocks, internal::GPU_BLOCK_SIZE>>>(
+      device_rays.data(), num_rays, grid.view(), max_t,
+      device_offsets.data() + 1);
+  if (!internal::gpuSynchronize() ||
+      !internal::gpuCopyToHost(batch.offsets.data() + 1,
+                               device_offsets.data() + 1,
+                               num_rays * sizeof(std::size_t))) {
+    return false;
+  }
+  // A prefix sum of the counts, as with countSphericalVoxelBatch(). The
+  // transfer of the counts is small relative to that of the voxels.
+  for (std::size_t i = 0; i < num_rays; ++i) {
+    batch.offsets[i + 1] += batch.offsets[i];
+  }
+  const std::size_t num_voxels = batch.offsets[num_rays];
+  const internal::GpuArray<SphericalVoxel> device_voxels(num_voxels);
+  if (!device_voxels.isValid() ||
+      !internal::gpuCopyToDevice(device_offsets.data(), batch.offsets.data(),
+                                 (num_rays + 1) * sizeof(std::size_t))) {
+    return false;
+  }
+  internal::fillVoxelsKernel<<<num_blocks, internal::GPU_BLOCK_SIZE>>>(
+      device_rays.data(), num_rays, grid.view(), max_t, device_offsets.data(),
+      device_voxels.data());
+  batch.voxels.resize(num_voxels);
+  return internal::gpuSynchronize() &&
+         device_voxels.copyToHost(batch.voxels.data());
+}
+
+}  // namespace svr
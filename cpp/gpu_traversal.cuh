@@ -0,0 +1,120 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_GPU_TRAVERSAL_CUH
+#define SPHERICAL_VOLUME_RENDERING_GPU_TRAVERSAL_CUH
+
+#include <cstddef>
+#include <vector>
+
+#include "gpu_runtime.h"
+#include "gpu_traversal.h"
+#include "ray.h"
+#include "ray_integral.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+
+// The kernels of the GPU traversal, and the fused integration of
+// integrateSphericalVolume() on the GPU. This header is only included by
+// translation units compiled with nvcc or hipcc. See gpu_traversal.h.
+
+namespace svr {
+
+namespace internal {
+
+// A traversal visitor that counts the voxels traversed. See VoxelCounter of
+// spherical_volume_rendering_util.cpp.
+struct GpuVoxelCounter {
+  std::size_t count;
+
+  SVR_HOST_DEVICE inline void operator()(int, int, int, double,
+                                         double) noexcept {
+    ++this->count;
+  }
+};
+
+// A traversal visitor that writes each voxel to the range [next, end). Stops
+// the traversal once the range is full. See VoxelWriter of
+// spherical_volume_rendering_util.cpp.
+struct GpuVoxelWriter {
+  SphericalVoxel *next;
+  const SphericalVoxel *const end;
+
+  SVR_HOST_DEVICE inline bool operator()(int radial, int polar, int azimuthal,
+                                         double enter_t,
+                                         double exit_t) noexcept {
+    if (this->next == this->end) return false;
+    *this->next++ = {.radial = radial,
+                     .polar = polar,
+                     .azimuthal = azimuthal,
+                     .enter_t = enter_t,
+                     .exit_t = exit_t};
+    return true;
+  }
+};
+
+// Writes the number of voxels traversed by ray i to counts[i].
+__global__ void countVoxelsKernel(const Ray *rays, std::size_t num_rays,
+                                  SphericalVoxelGridView grid, double max_t,
+                                  std::size_t *counts);
+
+// Writes the voxels traversed by ray i to voxels[offsets[i]] up to, but not
+// including, voxels[offsets[i + 1]].
+__global__ void fillVoxelsKernel(const Ray *rays, std::size_t num_rays,
+                                 SphericalVoxelGridView grid, double max_t,
+                                 const std::size_t *offsets,
+                                 SphericalVoxel *voxels);
+
+// Writes the integral of ray i to integrals[i]. See
+// integrateSphericalVolumeBatchGPU().
+template <class Value, class TransferFunction>
+__global__ void integrateKernel(const Ray *rays, std::size_t num_rays,
+                                SphericalVoxelGridView grid, const Value *field,
+                                TransferFunction transfer_function,
+                                double max_t, double opacity_threshold,
+                                RayIntegral *integrals) {
+  const std::size_t i =
+      static_cast<std::size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= num_rays) return;
+  RayCompositor<double, Value, TransferFunction> compositor(
+      field, transfer_function, grid.numPolarSections(),
+      grid.numAzimuthalSections(), opacity_threshold);
+  svr::walkSphericalVolume(rays[i], grid, max_t, compositor);
+  integrals[i] = compositor.integral();
+}
+
+}  // namespace internal
+
+// Integrates num_rays rays through the grid on the GPU, one thread per ray,
+// and writes the integral of ray i to integrals[i], which must hold num_rays
+// elements. The parameters are otherwise those of integrateSphericalVolume():
+// field is in host memory, and holds grid.numVoxels() values, which are
+// uploaded once for the batch. transfer_function is copied to each thread, and
+// thus must be a trivially copyable function object callable on the device,
+// e.g. a __device__ lambda with nvcc's --extended-lambda. The integral of each
+// ray is identical to that of integrateSphericalVolume() up to the rounding of
+// std::exp() on the device. Returns false if a GPU error occurred, in which
+// case integrals are unspecified.
+template <class Value, class TransferFunction>
+bool integrateSphericalVolumeBatchGPU(const Ray *rays, std::size_t num_rays,
+                                      const DeviceSphericalVoxelGrid &grid,
+                                      const Value *field,
+                                      TransferFunction transfer_function,
+                                      double max_t, RayIntegral *integrals,
+                                      double opacity_threshold = 0.99) {
+  if (!grid.isValid()) return false;
+  if (num_rays == 0) return true;
+  const internal::GpuArray<Ray> device_rays(rays, num_rays);
+  const internal::GpuArray<Value> device_field(field, grid.numVoxels());
+  const internal::GpuArray<RayIntegral> device_integrals(num_rays);
+  if (!device_rays.isValid() || !device_field.isValid() ||
+      !device_integrals.isValid()) {
+    return false;
+  }
+  internal::integrateKernel<<<internal::gpuNumBlocks(num_rays),
+                              internal::GPU_BLOCK_SIZE>>>(
+      device_rays.data(), num_rays, grid.view(), device_field.data(),
+      transfer_function, max_t, opacity_threshold, device_integrals.data());
+  return internal::gpuSynchronize() && device_integrals.copyToHost(integrals);
+}
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_GPU_TRAVERSAL_CUH
@@ -0,0 +1,74 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_GPU_TRAVERSAL_H
+#define SPHERICAL_VOLUME_RENDERING_GPU_TRAVERSAL_H
+
+#include <cstddef>
+
+#include "ray.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+
+// The GPU backend of the batched traversal, built with
+// cmake -DSVR_ENABLE_GPU=ON, which compiles gpu_traversal.cu with nvcc, or
+// with hipcc when CMAKE_CUDA_COMPILER is hipcc. Each GPU thread traverses a
+// single ray with the same traversal as the CPU, through a
+// SphericalVoxelGridView of the grid's tables in device memory, so the voxels
+// are identical to those of walkSphericalVolume(). This header may be
+// included by translation units that are not compiled for the GPU; the fused
+// integration, which is templated on the transfer function, is declared in
+// gpu_traversal.cuh.
+
+namespace svr {
+
+// A copy of the tables of a grid in device memory. The tables are uploaded
+// once upon construction, and are shared by every traversal of the grid on
+// the GPU. Check isValid() for whether the upload succeeded.
+class DeviceSphericalVoxelGrid {
+ public:
+  explicit DeviceSphericalVoxelGrid(const SphericalVoxelGrid &grid);
+
+  ~DeviceSphericalVoxelGrid();
+
+  DeviceSphericalVoxelGrid(const DeviceSphericalVoxelGrid &) = delete;
+  DeviceSphericalVoxelGrid &operator=(const DeviceSphericalVoxelGrid &) =
+      delete;
+
+  inline bool isValid() const noexcept { return this->memory_ != nullptr; }
+
+  // A view of the grid whose tables are in device memory. It may be passed by
+  // value to a kernel, but its tables must not be read on the host.
+  inline const SphericalVoxelGridView &view() const noexcept {
+    return this->view_;
+  }
+
+  // The number of voxels of the grid, i.e. the size of a field over it.
+  inline std::size_t numVoxels() const noexcept {
+    return this->view_.numRadialSections() * this->view_.numPolarSections() *
+           this->view_.numAzimuthalSections();
+  }
+
+ private:
+  // Uploads the tables of grid to memory, which is set to nullptr if the
+  // upload failed.
+  static SphericalVoxelGridTables upload(const SphericalVoxelGrid &grid,
+                                         void *&memory);
+
+  // Declared before view_, which is constructed from the uploaded tables.
+  void *memory_ = nullptr;
+  const SphericalVoxelGridView view_;
+};
+
+// Traverses num_rays rays through the grid on the GPU, one thread per ray,
+// with the same max_t as walkSphericalVolumeBatch(). As with
+// countSphericalVoxelBatch() and fillSphericalVoxelBatch(), the rays are
+// traversed twice: the first kernel counts the voxels of each ray, and the
+// second writes them to their ranges of a single device allocation, so the
+// kernels allocate no memory. The resulting batch is identical to that of
+// walkSphericalVolumeBatch(). Returns false if a GPU error occurred, in which
+// case batch is unspecified.
+bool walkSphericalVolumeBatchGPU(const Ray *rays, std::size_t num_rays,
+                                 const DeviceSphericalVoxelGrid &grid,
+                                 double max_t, SphericalVoxelBatch &batch);
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_GPU_TRAVERSAL_H
@@ -0,0 +1,19 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_HOST_DEVICE_H
+#define SPHERICAL_VOLUME_RENDERING_HOST_DEVICE_H
+
+// Marks the functions of the traversal that are compiled for both the CPU and
+// the GPU, e.g. when this file is included by a CUDA or HIP kernel. See
+// gpu_traversal.h. Without a GPU compiler, the annotation is empty.
+#if defined(__CUDACC__) || defined(__HIPCC__)
+#define SVR_HOST_DEVICE __host__ __device__
+#else
+#define SVR_HOST_DEVICE
+#endif
+
+// Defined while compiling code that runs on the GPU, which cannot, for
+// example, use thread_local or std::chrono.
+#if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+#define SVR_DEVICE_CODE
+#endif
+
+#endif  // SPHERICAL_VOLUME_RENDERING_HOST_DEVICE_H
@@ -0,0 +1,451 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_LEVEL_OF_DETAIL_H
+#define SPHERICAL_VOLUME_RENDERING_LEVEL_OF_DETAIL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "occupancy_grid.h"
+#include "ray.h"
+#include "ray_integral.h"
+#include "renderer.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+
+namespace svr {
+
+// The number of voxels of a coarse level that a worker reduces at a time.
+constexpr std::size_t LEVEL_VOXELS_PER_CHUNK = 256;
+
+// The levels of detail of a SphericalVoxelGrid, for rendering a preview at a
+// coarse level before refining it, or for traversing distant parts of a scene
+// at a coarser level than near ones. Level 0 is the grid itself, and each
+// level halves the number of sections of the level before it along each
+// dimension with an even number of sections, so that each voxel of a level
+// merges at most 2 x 2 x 2 voxels of the level before it. The voxel
+// boundaries of each level are thus also voxel boundaries of every finer
+// level.
+class MultiResolutionGrid {
+ public:
+  // The levels of grid, which must outlive this. There are at most
+  // max_levels levels, and fewer if no dimension of the coarsest level has an
+  // even number of sections.
+  MultiResolutionGrid(const SphericalVoxelGrid &grid, std::size_t max_levels)
+      : grid_(grid) {
+    this->factors_.push_back({.radial = 1, .polar = 1, .azimuthal = 1});
+    this->coarse_levels_.reserve(max_levels > 1 ? max_levels - 1 : 0);
+    while (this->factors_.size() < max_levels) {
+      const SphericalVoxelGrid &finest = this->level(this->numLevels() - 1);
+      const BrickSize factor = {.radial = halving(finest.numRadialSections()),
+                                .polar = halving(finest.numPolarSections()),
+                                .azimuthal =
+                                    halving(finest.numAzimuthalSections())};
+      if (factor.radial == 1 && factor.polar == 1 && factor.azimuthal == 1) {
+        break;
+      }
+      this->coarse_levels_.push_back(
+          finest.coarsened(factor.radial, factor.polar, factor.azimuthal));
+      this->factors_.push_back(factor);
+    }
+    for (std::size_t level = 0; level < this->numLevels(); ++level) {
+      const SphericalVoxelGrid &voxels = this->level(level);
+      this->voxel_sizes_.push_back(
+          std::max(voxels.deltaRadius(),
+                   voxels.sphereMaxRadius() / 2.0 *
+                       std::max(voxels.deltaTheta(), voxels.deltaPhi())));
+    }
+  }
+
+  inline std::size_t numLevels() const noexcept {
+    return this->factors_.size();
+  }
+
+  // The grid of the given level, where level 0 is the grid this was
+  // constructed from.
+  inline const SphericalVoxelGrid &level(std::size_t level) const noexcept {
+    return level == 0 ? this->grid_ : this->coarse_levels_[level - 1];
+  }
+
+  // The number of voxels of level - 1 merged into each voxel of level along
+  // each dimension, either 1 or 2. This is 1 x 1 x 1 for level 0.
+  inline const BrickSize &levelFactor(std::size_t level) const noexcept {
+    return this->factors_[level];
+  }
+
+  // The width of the voxels of level, taken as the largest of the mean radial
+  // width and the angular widths at half the maximum radius. This does not
+  // decrease from one level to the next.
+  inline double voxelSize(std::size_t level) const noexcept {
+    return this->voxel_sizes_[level];
+  }
+
+  // The coarsest level whose voxels are no wider than footprint, or level 0
+  // if none are.
+  inline std::size_t levelOfWidth(double footprint) const noexcept {
+    const std::size_t num_finer =
+        std::upper_bound(this->voxel_sizes_.begin(), this->voxel_sizes_.end(),
+                         footprint) -
+        this->voxel_sizes_.begin();
+    return num_finer == 0 ? 0 : num_finer - 1;
+  }
+
+ private:
+  static inline std::size_t halving(std::size_t num_sections) noexcept {
+    return num_sections % 2 == 0 ? 2 : 1;
+  }
+
+  const SphericalVoxelGrid &grid_;
+  std::vector<SphericalVoxelGrid> coarse_levels_;
+  std::vector<BrickSize> factors_;
+  std::vector<double> voxel_sizes_;
+};
+
+// A field over the levels of a MultiResolutionGrid. Level 0 is the field it
+// was built from, and each voxel of a coarser level holds the mean of the
+// values of the voxels of the level before it that it merges, weighted by the
+// volume of their radial shells. The voxels merged from a single shell are
+// weighted equally: the polar and azimuthal angles of the grid are measured in
+// separate planes, so their sections have no closed form volume. This leaves
+// a bias toward the smaller angular sections of a shell. The field of each
+// level is laid out as with integrateSphericalVolume() for the grid of that
+// level.
+template <class Value>
+class MultiResolutionField {
+ public:
+  // Reduces field, which holds a value for each voxel of levels.level(0) and
+  // must outlive this, to each coarser level of levels, which must also
+  // outlive this. The voxels of each level are split among the workers of
+  // pool; see walkSphericalVolumeBatch() for num_threads.
+  MultiResolutionField(const MultiResolutionGrid &levels, const Value *field,
+                       ThreadPool &pool = ThreadPool::global(),
+                       std::size_t num_threads = 0)
+      : levels_(levels), field_(field) {
+    this->build(pool, num_threads);
+  }
+
+  inline const MultiResolutionGrid &levels() const noexcept {
+    return this->levels_;
+  }
+
+  // The field of the given level.
+  inline const Value *level(std::size_t level) const noexcept {
+    return level == 0 ? this->field_ : this->coarse_levels_[level - 1].data();
+  }
+
+  // Reduces the coarser levels anew from the field, e.g. once it has changed.
+  void build(ThreadPool &pool = ThreadPool::global(),
+             std::size_t num_threads = 0) {
+    this->coarse_levels_.resize(this->levels_.numLevels() - 1);
+    for (std::size_t level = 1; level < this->levels_.numLevels(); ++level) {
+      const SphericalVoxelGrid &grid = this->levels_.level(level);
+      std::vector<Value> &values = this->coarse_levels_[level - 1];
+      values.resize(grid.numRadialSections() * grid.numPolarSections() *
+                    grid.numAzimuthalSections());
+      pool.parallelFor(
+          values.size(), LEVEL_VOXELS_PER_CHUNK,
+          [&](std::size_t begin, std::size_t end, std::size_t) {
+            for (std::size_t voxel = begin; voxel < end; ++voxel) {
+              values[voxel] = this->reduceVoxel(level, voxel);
+            }
+          },
+          num_threads);
+    }
+  }
+
+ private:
+  // The volume of radial shell r of grid, the r + 1-th radial voxel, up to a
+  // constant factor. The innermost radial voxel includes the ball within it.
+  static inline double radialShellVolume(const SphericalVoxelGrid &grid,
+                                         std::size_t r) noexcept {
+    const double outer = std::sqrt(grid.deltaRadiiSquared(r));
+    const double inner = r + 1 < grid.numRadialSections()
+                             ? std::sqrt(grid.deltaRadiiSquared(r + 1))
+                             : 0.0;
+    return outer * outer * outer - inner * inner * inner;
+  }
+
+  // The mean of the values of level - 1 within the given voxel of level,
+  // weighted by radialShellVolume(). Without the weights, the inner shells of a
+  // coarse voxel, which are far smaller than its outer shells, would count as
+  // much as the outer shells.
+  Value reduceVoxel(std::size_t level, std::size_t voxel) const noexcept {
+    const SphericalVoxelGrid &grid = this->levels_.level(level);
+    const SphericalVoxelGrid &finer = this->levels_.level(level - 1);
+    const BrickSize &factor = this->levels_.levelFactor(level);
+    const Value *const field = this->level(level - 1);
+    const std::size_t num_polar = grid.numPolarSections();
+    const std::size_t num_azimuthal = grid.numAzimuthalSections();
+    const std::size_t radial_begin =
+        voxel / (num_polar * num_azimuthal) * factor.radial;
+    const std::size_t polar_begin =
+        voxel / num_azimuthal % num_polar * factor.polar;
+    const std::size_t azimuthal_begin =
+        voxel % num_azimuthal * factor.azimuthal;
+    double sum = 0.0;
+    double volume = 0.0;
+    for (std::size_t r = radial_begin; r < radial_begin + factor.radial; ++r) {
+      double shell_sum = 0.0;
+      for (std::size_t p = polar_begin; p < polar_begin + factor.polar; ++p) {
+        const Value *const row =
+            field + (r * finer.numPolarSections() + p) *
+                        finer.numAzimuthalSections() +
+            azimuthal_begin;
+        for (std::size_t a = 0; a < factor.azimuthal; ++a) {
+          shell_sum += static_cast<double>(row[a]);
+        }
+      }
+      const double shell_volume = radialShellVolume(finer, r);
+      sum += shell_volume * shell_sum;
+      volume += shell_volume * (factor.polar * factor.azimuthal);
+    }
+    return static_cast<Value>(sum / volume);
+  }
+
+  const MultiResolutionGrid &levels_;
+  const Value *const field_;
+  std::vector<std::vector<Value>> coarse_levels_;
+};
+
+// The width of the footprint of a ray at each time t along it, i.e. at
+// distance t from its origin: width + spread * t. For the ray of a pixel, this
+// is the width of the pixel as it is projected into the scene, e.g.
+// {.width = camera.pixelSize(), .spread = 0} for an orthographic camera and
+// {.width = 0, .spread = camera.pixelSize()} for a perspective camera. The
+// spread must not be negative.
+struct RayFootprint {
+  double width;
+  double spread;
+
+  // The time at which the footprint reaches the given width, which is infinite
+  // if it never does.
+  inline double timeOfWidth(double footprint) const noexcept {
+    if (this->width >= footprint) return 0.0;
+    return this->spread > 0.0 ? (footprint - this->width) / this->spread
+                              : std::numeric_limits<double>::infinity();
+  }
+};
+
+namespace internal {
+
+// Calls visitor(level, radial, polar, azimuthal, enter_t, exit_t), which may
+// return either bool or void, as with visitExit().
+template <class Visitor>
+inline auto visitLevelExit(Visitor &visitor, std::size_t level,
+                           const SphericalVoxel &voxel,
+                           double exit_t) noexcept ->
+    typename std::enable_if<
+        !std::is_void<decltype(visitor(std::size_t(0), 0, 0, 0, 0.0,
+                                       0.0))>::value,
+        bool>::type {
+  return visitor(level, voxel.radial, voxel.polar, voxel.azimuthal,
+                 voxel.enter_t, exit_t);
+}
+
+template <class Visitor>
+inline auto visitLevelExit(Visitor &visitor, std::size_t level,
+                           const SphericalVoxel &voxel,
+                           double exit_t) noexcept ->
+    typename std::enable_if<
+        std::is_void<decltype(visitor(std::size_t(0), 0, 0, 0, 0.0,
+                                      0.0))>::value,
+        bool>::type {
+  visitor(level, voxel.radial, voxel.polar, voxel.azimuthal, voxel.enter_t,
+          exit_t);
+  return true;
+}
+
+// The visitor of the voxels of a single level traversed up to t_end, at which
+// the traversal continues at the next level. The times of the traversal are
+// offset by t_offset, the time at which it began. Voxels of no length are not
+// passed to the visitor.
+template <class Visitor>
+class LevelSegmentVisitor {
+ public:
+  LevelSegmentVisitor(std::size_t level, double t_offset, double t_end,
+                      Visitor &visitor) noexcept
+      : level_(level), t_offset_(t_offset), t_end_(t_end), visitor_(visitor) {}
+
+  inline bool operator()(int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) noexcept {
+    const double enter = this->t_offset_ + enter_t;
+    if (!this->has_entered_) {
+      this->has_entered_ = true;
+      this->t_entry_ = enter;
+    }
+    const double exit = std::min(this->t_offset_ + exit_t, this->t_end_);
+    if (exit > enter) {
+      const SphericalVoxel voxel = {.radial = radial,
+                                    .polar = polar,
+                                    .azimuthal = azimuthal,
+                                    .enter_t = enter};
+      if (!visitLevelExit(this->visitor_, this->level_, voxel, exit)) {
+        this->is_stopped_ = true;
+        return false;
+      }
+    }
+    this->has_reached_end_ = exit >= this->t_end_;
+    return !this->has_reached_end_;
+  }
+
+  // Whether the visitor requested that the traversal stop.
+  inline bool isStopped() const noexcept { return this->is_stopped_; }
+
+  // Whether the traversal reached t_end, and so continues at the next level.
+  inline bool hasReachedEnd() const noexcept { return this->has_reached_end_; }
+
+  // Whether a voxel was traversed, in which case the ray entered the sphere at
+  // entryTime() if the traversal began outside of it.
+  inline bool hasEntered() const noexcept { return this->has_entered_; }
+
+  inline double entryTime() const noexcept { return this->t_entry_; }
+
+ private:
+  const std::size_t level_;
+  const double t_offset_;
+  const double t_end_;
+  Visitor &visitor_;
+  double t_entry_ = 0.0;
+  bool has_entered_ = false;
+  bool has_reached_end_ = false;
+  bool is_stopped_ = false;
+};
+
+// The visitor of the traversal of integrateSphericalVolume() with a
+// MultiResolutionField, which composites the voxels of each level from the
+// field of that level.
+template <class Value, class TransferFunction>
+class LevelCompositor {
+ public:
+  LevelCompositor(const MultiResolutionField<Value> &field,
+                  TransferFunction &transfer_function,
+                  double opacity_threshold) noexcept
+      : field_(field),
+        compositor_(field.level(0), transfer_function,
+                    field.levels().level(0).numPolarSections(),
+                    field.levels().level(0).numAzimuthalSections(),
+                    opacity_threshold) {}
+
+  inline bool operator()(std::size_t level, int radial, int polar,
+                         int azimuthal, double enter_t,
+                         double exit_t) noexcept {
+    const SphericalVoxelGrid &grid = this->field_.levels().level(level);
+    const std::size_t index =
+        (static_cast<std::size_t>(radial - 1) * grid.numPolarSections() +
+         static_cast<std::size_t>(polar)) *
+            grid.numAzimuthalSections() +
+        static_cast<std::size_t>(azimuthal);
+    return this->compositor_.composite(this->field_.level(level)[index],
+                                       enter_t, exit_t);
+  }
+
+  inline const RayIntegral &integral() const noexcept {
+    return this->compositor_.integral();
+  }
+
+ private:
+  const MultiResolutionField<Value> &field_;
+  RayCompositor<double, Value, TransferFunction> compositor_;
+};
+
+}  // namespace internal
+
+// Traverses the ray through the levels of levels, at the coarsest level whose
+// voxels are no wider than the footprint of the ray, so that the level grows
+// coarser as the footprint widens with distance. Calls visitor(level, radial,
+// polar, azimuthal, enter_t, exit_t) upon exiting each voxel, in traversal
+// order, where the voxel is of levels.level(level); the visitor may return
+// bool or void as with walkSphericalVolume(). The traversal of each level
+// begins anew at the time at which the footprint reaches the voxel size of
+// that level, so the voxel in which the level changes is split between the
+// two. With a footprint of no spread, the voxels visited are those of
+// walkSphericalVolume(ray, levels.level(level), max_t) for the level of its
+// width.
+template <class Engine = DefaultEngine, class Visitor>
+inline void walkSphericalVolume(const Ray &ray,
+                                const MultiResolutionGrid &levels,
+                                const RayFootprint &footprint, double max_t,
+                                Visitor &&visitor) noexcept {
+  const double max_diameter = levels.level(0).sphereMaxDiameter();
+  // The time at which the traversal ends, once the ray has entered the sphere.
+  double t_limit = std::numeric_limits<double>::infinity();
+  bool has_entered = false;
+  double t_begin = 0.0;
+  for (std::size_t level = levels.levelOfWidth(footprint.width);; ++level) {
+    const double t_end =
+        level + 1 < levels.numLevels()
+            ? footprint.timeOfWidth(levels.voxelSize(level + 1))
+            : std::numeric_limits<double>::infinity();
+    internal::LevelSegmentVisitor<Visitor> segment(level, t_begin, t_end,
+                                                   visitor);
+    const SphericalVoxelGrid &grid = levels.level(level);
+    if (t_begin == 0.0) {
+      svr::walkSphericalVolume<Engine>(ray, grid, max_t, segment);
+    } else {
+      // Until the ray enters the sphere, max_t is measured from the entry of
+      // the restarted ray, which enters at the same point.
+      if (has_entered && t_limit <= t_begin) return;
+      const Ray restarted(ray.pointAtParameter(t_begin), ray.direction());
+      svr::walkSphericalVolume<Engine>(
+          restarted, grid,
+          has_entered ? (t_limit - t_begin) / max_diameter : max_t, segment);
+    }
+    if (segment.isStopped() || !segment.hasReachedEnd()) return;
+    if (!has_entered && segment.hasEntered()) {
+      has_entered = true;
+      t_limit = segment.entryTime() + max_t * max_diameter;
+    }
+    t_begin = t_end;
+  }
+}
+
+// Similar to integrateSphericalVolume(ray, grid, field, ...), but traverses
+// the levels of field as above, and composites the voxels of each level from
+// the field of that level. With a footprint of no spread, the integral is that
+// of the level of its width and its field. Since a coarser field is the
+// weighted mean described with MultiResolutionField, this approximates the
+// integral of level 0 rather than matching it.
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+inline RayIntegral integrateSphericalVolume(
+    const Ray &ray, const MultiResolutionField<Value> &field,
+    const RayFootprint &footprint, TransferFunction &&transfer_function,
+    double max_t, double opacity_threshold = 0.99) noexcept {
+  internal::LevelCompositor<Value, TransferFunction> compositor(
+      field, transfer_function, opacity_threshold);
+  svr::walkSphericalVolume<Engine>(ray, field.levels(), footprint, max_t,
+                                   compositor);
+  return compositor.integral();
+}
+
+// Similar to renderSphericalVolume(camera, grid, field, ...), but integrates
+// the ray of each pixel through the levels of field as above, with the
+// footprint of its pixel. The footprint of each pixel is taken as that of the
+// image center, i.e. camera.pixelSize(). For a preview at a single level,
+// render the grid and field of that level instead, e.g.
+//   renderSphericalVolume(camera, levels.level(3), field.level(3), ...).
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+void renderSphericalVolume(const Camera &camera,
+                           const MultiResolutionField<Value> &field,
+                           const TransferFunction &transfer_function,
+                           RayIntegral *image, double max_t = 1.0,
+                           double opacity_threshold = 0.99,
+                           ThreadPool &pool = ThreadPool::global(),
+                           std::size_t num_threads = 0) {
+  const RayFootprint footprint =
+      camera.projection() == Projection::ORTHOGRAPHIC
+          ? RayFootprint{.width = camera.pixelSize(), .spread = 0.0}
+          : RayFootprint{.width = 0.0, .spread = camera.pixelSize()};
+  internal::renderTiles(camera, image, pool, num_threads,
+                        [&](const Ray &ray, EntryVoxel &) -> RayIntegral {
+                          return integrateSphericalVolume<Engine>(
+                              ray, field, footprint, transfer_function, max_t,
+                              opacity_threshold);
+                        });
+}
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_LEVEL_OF_DETAIL_H
@@ -0,0 +1,193 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_MPI_TRAVERSAL_H
+#define SPHERICAL_VOLUME_RENDERING_MPI_TRAVERSAL_H
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "ray.h"
+#include "ray_integral.h"
+#include "sector_decomposition.h"
+#include "spherical_volume_rendering_util.h"
+#include "thread_pool.h"
+
+namespace svr {
+
+namespace internal {
+
+// The greatest count or displacement, in elements, of an MPI exchange.
+constexpr std::size_t MAX_MPI_COUNT = std::numeric_limits<int>::max();
+
+// Returns true on every rank if is_valid holds on every rank of comm. This is
+// a collective call.
+inline bool isValidOnEveryRank(bool is_valid, MPI_Comm comm) noexcept {
+  int is_valid_on_every_rank = is_valid;
+  MPI_Allreduce(MPI_IN_PLACE, &is_valid_on_every_rank, 1, MPI_INT, MPI_LAND,
+                comm);
+  return is_valid_on_every_rank != 0;
+}
+
+// The first ray of the block of num_rays rays composited by rank.
+inline std::uint64_t firstRayOfRank(std::size_t num_rays, int rank,
+                                    int num_ranks) noexcept {
+  return static_cast<std::uint64_t>(num_rays) *
+         static_cast<std::uint64_t>(rank) /
+         static_cast<std::uint64_t>(num_ranks);
+}
+
+// An MPI datatype of contiguous bytes for a trivially copyable type, which is
+// freed upon destruction. The ranks are assumed to share a representation of
+// the type, as on the nodes of a single cluster.
+template <class T>
+class ContiguousDatatype {
+ public:
+  ContiguousDatatype() noexcept {
+    MPI_Type_contiguous(static_cast<int>(sizeof(T)), MPI_BYTE,
+                        &this->datatype_);
+    MPI_Type_commit(&this->datatype_);
+  }
+
+  ~ContiguousDatatype() { MPI_Type_free(&this->datatype_); }
+
+  ContiguousDatatype(const ContiguousDatatype &) = delete;
+  ContiguousDatatype &operator=(const ContiguousDatatype &) = delete;
+
+  inline MPI_Datatype get() const noexcept { return this->datatype_; }
+
+ private:
+  MPI_Datatype datatype_;
+};
+
+}  // namespace internal
+
+// Integrates num_rays rays over a grid whose field is distributed across the
+// ranks of comm by sector. Each rank owns sector decomposition.sector(), which
+// must equal its rank, and holds its values in sector_field; the size of comm
+// must equal decomposition.numSectors(). Every rank is given the same rays.
+//
+// Each rank integrates the rays over its own sector alone with
+// integrateSphericalVolumeSegments() on pool, crossing the other sectors in a
+// coarse step each. The rays are then split into a contiguous block per rank.
+// Each segment is sent to the rank of its ray's block, which composites the
+// segments of its rays front to back with compositeRaySegments(), and the
+// integrals of every block are gathered to root. Thus, both the field and the
+// traversal of each ray are split across the ranks, and no rank waits upon
+// another before the exchange. On root, integrals must hold num_rays
+// integrals; it is ignored on the other ranks. See compositeRaySegments() for
+// how the integrals compare to those of integrateSphericalVolume() with
+// opacity_threshold. Returns false if, on any rank, the rank or size of comm
+// does not match decomposition, root is not a rank of comm, or num_rays
+// exceeds the int counts of MPI. The ranks agree upon this with a reduction
+// before any other communication, so every rank returns the same value.
+// Similarly, every rank returns false, before the segments are exchanged, if
+// the segments that any rank sends or receives exceed the int counts of MPI.
+// This is a collective call.
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+bool integrateSphericalVolumeDistributed(
+    const Ray *rays, std::size_t num_rays,
+    const SectorDecomposition &decomposition, const Value *sector_field,
+    TransferFunction &&transfer_function, double max_t, RayIntegral *integrals,
+    MPI_Comm comm, int root = 0, double opacity_threshold = 0.99,
+    ThreadPool &pool = ThreadPool::global(), std::size_t num_threads = 0) {
+  int rank = 0;
+  int num_ranks = 0;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &num_ranks);
+  // A rank that returned alone would leave the others waiting upon it in the
+  // exchange. The integrals are gathered to root at offsets of up to num_rays.
+  if (!internal::isValidOnEveryRank(
+          decomposition.isValid() &&
+              static_cast<std::size_t>(num_ranks) ==
+                  decomposition.numSectors() &&
+              static_cast<std::size_t>(rank) == decomposition.sector() &&
+              root >= 0 && root < num_ranks &&
+              num_rays <= internal::MAX_MPI_COUNT,
+          comm)) {
+    return false;
+  }
+  std::vector<RaySegment> segments = integrateSphericalVolumeSegments<Engine>(
+      rays, num_rays, decomposition, sector_field, transfer_function, max_t,
+      opacity_threshold, pool, num_threads);
+
+  // Orders the segments by the rank that composites them. Since the blocks of
+  // rays are contiguous, sorting by ray suffices.
+  std::sort(segments.begin(), segments.end(),
+            [](const RaySegment &a, const RaySegment &b) {
+              return a.ray < b.ray;
+            });
+  // The counts and offsets of the segments sent are at most segments.size().
+  if (!internal::isValidOnEveryRank(
+          segments.size() <= internal::MAX_MPI_COUNT, comm)) {
+    return false;
+  }
+  std::vector<int> send_counts(num_ranks, 0);
+  std::vector<int> send_offsets(num_ranks, 0);
+  {
+    std::size_t i = 0;
+    for (int destination = 0; destination < num_ranks; ++destination) {
+      const std::uint64_t end_ray =
+          internal::firstRayOfRank(num_rays, destination + 1, num_ranks);
+      send_offsets[destination] = static_cast<int>(i);
+      while (i < segments.size() && segments[i].ray < end_ray) ++i;
+      send_counts[destination] =
+          static_cast<int>(i) - send_offsets[destination];
+    }
+  }
+  std::vector<int> receive_counts(num_ranks, 0);
+  MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1,
+               MPI_INT, comm);
+  // The offsets of the segments received are at most their total.
+  std::size_t num_block_segments = 0;
+  for (const int count : receive_counts) num_block_segments += count;
+  if (!internal::isValidOnEveryRank(
+          num_block_segments <= internal::MAX_MPI_COUNT, comm)) {
+    return false;
+  }
+  std::vector<int> receive_offsets(num_ranks, 0);
+  for (int source = 1; source < num_ranks; ++source) {
+    receive_offsets[source] =
+        receive_offsets[source - 1] + receive_counts[source - 1];
+  }
+  std::vector<RaySegment> block_segments(num_block_segments);
+  const internal::ContiguousDatatype<RaySegment> segment_type;
+  MPI_Alltoallv(segments.data(), send_counts.data(), send_offsets.data(),
+                segment_type.get(), block_segments.data(),
+                receive_counts.data(), receive_offsets.data(),
+                segment_type.get(), comm);
+
+  const std::uint64_t first_ray =
+      internal::firstRayOfRank(num_rays, rank, num_ranks);
+  const std::size_t num_block_rays = static_cast<std::size_t>(
+      internal::firstRayOfRank(num_rays, rank + 1, num_ranks) - first_ray);
+  std::vector<RayIntegral> block_integrals(num_block_rays);
+  compositeRaySegments(block_segments.data(), block_segments.size(),
+                       first_ray, num_block_rays, block_integrals.data(),
+                       opacity_threshold);
+
+  std::vector<int> block_counts;
+  std::vector<int> block_offsets;
+  if (rank == root) {
+    block_counts.resize(num_ranks);
+    block_offsets.resize(num_ranks);
+    for (int source = 0; source < num_ranks; ++source) {
+      const std::uint64_t begin =
+          internal::firstRayOfRank(num_rays, source, num_ranks);
+      block_offsets[source] = static_cast<int>(begin);
+      block_counts[source] = static_cast<int>(
+          internal::firstRayOfRank(num_rays, source + 1, num_ranks) - begin);
+    }
+  }
+  const internal::ContiguousDatatype<RayIntegral> integral_type;
+  MPI_Gatherv(block_integrals.data(), static_cast<int>(num_block_rays),
+              integral_type.get(), integrals, block_counts.data(),
+              block_offsets.data(), integral_type.get(), root, comm);
+  return true;
+}
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_MPI_TRAVERSAL_H
@@ -0,0 +1,418 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_OCCUPANCY_GRID_H
+#define SPHERICAL_VOLUME_RENDERING_OCCUPANCY_GRID_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "ray.h"
+#include "ray_integral.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+
+namespace svr {
+
+// The number of voxels of a grid along each dimension that are merged into a
+// single brick of an OccupancyGrid.
+struct BrickSize {
+  std::size_t radial;
+  std::size_t polar;
+  std::size_t azimuthal;
+};
+
+// The minimum and maximum value of a field within a brick.
+struct ValueRange {
+  double min;
+  double max;
+};
+
+// The number of bricks that a worker builds at a time.
+constexpr std::size_t OCCUPANCY_BRICKS_PER_CHUNK = 16;
+
+// A coarse grid of bricks over a SphericalVoxelGrid that records, for each
+// brick, the range of values of a field within it. Bricks whose entire range
+// lies within the transparent range, e.g. the vacuum around a star or a
+// masked sector, are empty. The traversal of walkSphericalVolume() with an
+// occupancy grid crosses each run of empty bricks with the coarse traversal of
+// bricks(), and only steps through the voxels of occupied bricks.
+//
+// The field is laid out as with integrateSphericalVolume(). The value ranges
+// are built with build(), and may be rebuilt for only the voxels that changed
+// with update(). The transparent range may be changed without reading the
+// field, e.g. when editing a transfer function.
+class OccupancyGrid {
+ public:
+  // The bricks of grid, which must outlive the occupancy grid, with the given
+  // brick size. Each dimension of the brick size must divide the number of
+  // sections of grid in that dimension; check isValid(). If it does not, each
+  // brick is instead a single voxel, so that the occupancy grid remains safe to
+  // build and traverse. All bricks are occupied until the occupancy grid is
+  // built.
+  OccupancyGrid(const SphericalVoxelGrid &grid, const BrickSize &brick_size)
+      : grid_(grid),
+        brick_size_(isValidBrickSize(grid, brick_size)
+                        ? brick_size
+                        : BrickSize{.radial = 1, .polar = 1, .azimuthal = 1}),
+        is_valid_(isValidBrickSize(grid, brick_size)),
+        bricks_(grid.coarsened(this->brick_size_.radial,
+                               this->brick_size_.polar,
+                               this->brick_size_.azimuthal)),
+        value_ranges_(this->numBricks(),
+                      {.min = -std::numeric_limits<double>::infinity(),
+                       .max = std::numeric_limits<double>::infinity()}),
+        is_occupied_(this->numBricks(), 1) {}
+
+  inline bool isValid() const noexcept { return this->is_valid_; }
+
+  inline const SphericalVoxelGrid &grid() const noexcept { return this->grid_; }
+
+  // The grid of bricks, in which voxel (radial, polar, azimuthal) is the brick
+  // brickIndex(radial, polar, azimuthal).
+  inline const SphericalVoxelGrid &bricks() const noexcept {
+    return this->bricks_;
+  }
+
+  // The brick size of the bricks, i.e. 1 x 1 x 1 if the occupancy grid is not
+  // valid.
+  inline const BrickSize &brickSize() const noexcept {
+    return this->brick_size_;
+  }
+
+  inline std::size_t numBricks() const noexcept {
+    return this->bricks_.numRadialSections() *
+           this->bricks_.numPolarSections() *
+           this->bricks_.numAzimuthalSections();
+  }
+
+  // The index of the brick (radial, polar, azimuthal) of bricks(), where
+  // radial is in [1, bricks().numRadialSections()].
+  inline std::size_t brickIndex(int radial, int polar,
+                                int azimuthal) const noexcept {
+    return (static_cast<std::size_t>(radial - 1) *
+                this->bricks_.numPolarSections() +
+            static_cast<std::size_t>(polar)) *
+               this->bricks_.numAzimuthalSections() +
+           static_cast<std::size_t>(azimuthal);
+  }
+
+  // The index of the brick that holds voxel (radial, polar, azimuthal) of
+  // grid().
+  inline std::size_t brickOfVoxel(int radial, int polar,
+                                  int azimuthal) const noexcept {
+    return this->brickIndex(
+        (radial - 1) / static_cast<int>(this->brick_size_.radial) + 1,
+        polar / static_cast<int>(this->brick_size_.polar),
+        azimuthal / static_cast<int>(this->brick_size_.azimuthal));
+  }
+
+  inline bool isOccupied(std::size_t brick) const noexcept {
+    return this->is_occupied_[brick] != 0;
+  }
+
+  inline bool isVoxelOccupied(int radial, int polar,
+                              int azimuthal) const noexcept {
+    return this->isOccupied(this->brickOfVoxel(radial, polar, azimuthal));
+  }
+
+  inline const ValueRange &valueRange(std::size_t brick) const noexcept {
+    return this->value_ranges_[brick];
+  }
+
+  std::size_t numOccupiedBricks() const noexcept {
+    return std::count(this->is_occupied_.begin(), this->is_occupied_.end(), 1);
+  }
+
+  // The range of values for which a voxel is transparent, i.e. for which the
+  // transfer function has no extinction. A brick is empty if all of its values
+  // lie within [min_value, max_value]. By default, only zero is transparent.
+  inline const ValueRange &transparentRange() const noexcept {
+    return this->transparent_range_;
+  }
+
+  // Sets the transparent range, and reclassifies every brick from the value
+  // ranges already built.
+  void setTransparentRange(double min_value, double max_value) noexcept {
+    this->transparent_range_ = {.min = min_value, .max = max_value};
+    for (std::size_t brick = 0; brick < this->numBricks(); ++brick) {
+      this->classifyBrick(brick);
+    }
+  }
+
+  // Builds the value range of every brick from field, which holds a value for
+  // each voxel of grid(). The bricks are split among the workers of pool; see
+  // walkSphericalVolumeBatch() for num_threads.
+  template <class Value>
+  void build(const Value *field, ThreadPool &pool = ThreadPool::global(),
+             std::size_t num_threads = 0) {
+    pool.parallelFor(
+        this->numBricks(), OCCUPANCY_BRICKS_PER_CHUNK,
+        [&](std::size_t begin, std::size_t end, std::size_t) {
+          for (std::size_t brick = begin; brick < end; ++brick) {
+            this->buildBrick(field, brick);
+          }
+        },
+        num_threads);
+  }
+
+  // Rebuilds only the bricks that hold the given voxels of field, which have
+  // changed since the last build. changed_voxels holds num_changed indices
+  // into field, in any order.
+  template <class Value>
+  void update(const Value *field, const std::size_t *changed_voxels,
+              std::size_t num_changed, ThreadPool &pool = ThreadPool::global(),
+              std::size_t num_threads = 0) {
+    const std::size_t num_polar = this->grid_.numPolarSections();
+    const std::size_t num_azimuthal = this->grid_.numAzimuthalSections();
+    std::vector<std::size_t> bricks;
+    bricks.reserve(num_changed);
+    for (std::size_t i = 0; i < num_changed; ++i) {
+      const std::size_t voxel = changed_voxels[i];
+      bricks.push_back(this->brickOfVoxel(
+          static_cast<int>(voxel / (num_polar * num_azimuthal)) + 1,
+          static_cast<int>(voxel / num_azimuthal % num_polar),
+          static_cast<int>(voxel % num_azimuthal)));
+    }
+    std::sort(bricks.begin(), bricks.end());
+    bricks.erase(std::unique(bricks.begin(), bricks.end()), bricks.end());
+    pool.parallelFor(
+        bricks.size(), OCCUPANCY_BRICKS_PER_CHUNK,
+        [&](std::size_t begin, std::size_t end, std::size_t) {
+          for (std::size_t i = begin; i < end; ++i) {
+            this->buildBrick(field, bricks[i]);
+          }
+        },
+        num_threads);
+  }
+
+ private:
+  static inline bool isValidBrickSize(const SphericalVoxelGrid &grid,
+                                      const BrickSize &brick_size) noexcept {
+    return brick_size.radial != 0 && brick_size.polar != 0 &&
+           brick_size.azimuthal != 0 &&
+           grid.numRadialSections() % brick_size.radial == 0 &&
+           grid.numPolarSections() % brick_size.polar == 0 &&
+           grid.numAzimuthalSections() % brick_size.azimuthal == 0;
+  }
+
+  // Computes the value range of the brick from the voxels of field within it.
+  template <class Value>
+  void buildBrick(const Value *field, std::size_t brick) noexcept {
+    const std::size_t num_polar = this->grid_.numPolarSections();
+    const std::size_t num_azimuthal = this->grid_.numAzimuthalSections();
+    const std::size_t num_polar_bricks = this->bricks_.numPolarSections();
+    const std::size_t num_azimuthal_bricks =
+        this->bricks_.numAzimuthalSections();
+    const std::size_t radial_begin =
+        brick / (num_polar_bricks * num_azimuthal_bricks) *
+        this->brick_size_.radial;
+    const std::size_t polar_begin =
+        brick / num_azimuthal_bricks % num_polar_bricks *
+        this->brick_size_.polar;
+    const std::size_t azimuthal_begin =
+        brick % num_azimuthal_bricks * this->brick_size_.azimuthal;
+    ValueRange range = {.min = std::numeric_limits<double>::infinity(),
+                        .max = -std::numeric_limits<double>::infinity()};
+    for (std::size_t r = radial_begin;
+         r < radial_begin + this->brick_size_.radial; ++r) {
+      for (std::size_t p = polar_begin;
+           p < polar_begin + this->brick_size_.polar; ++p) {
+        const Value *const row =
+            field + (r * num_polar + p) * num_azimuthal + azimuthal_begin;
+        for (std::size_t a = 0; a < this->brick_size_.azimuthal; ++a) {
+          const double value = static_cast<double>(row[a]);
+          range.min = std::min(range.min, value);
+          range.max = std::max(range.max, value);
+        }
+      }
+    }
+    this->value_ranges_[brick] = range;
+    this->classifyBrick(brick);
+  }
+
+  inline void classifyBrick(std::size_t brick) noexcept {
+    const ValueRange &range = this->value_ranges_[brick];
+    this->is_occupied_[brick] = !(range.min >= this->transparent_range_.min &&
+                                  range.max <= this->transparent_range_.max);
+  }
+
+  const SphericalVoxelGrid &grid_;
+  const BrickSize brick_size_;
+  const bool is_valid_;
+  const SphericalVoxelGrid bricks_;
+  std::vector<ValueRange> value_ranges_;
+  // Whether each brick is occupied. A byte per brick, rather than a bit, so
+  // that workers may build neighbouring bricks concurrently.
+  std::vector<std::uint8_t> is_occupied_;
+  ValueRange transparent_range_ = {.min = 0.0, .max = 0.0};
+};
+
+namespace internal {
+
+// The visitor of the voxels of grid() traversed up to the end of a run of
+// occupied bricks at t_end. The times of the traversal are offset by t_offset,
+// the time at which it began. Voxels of empty bricks and voxels of no length,
+// which may be visited at either end of the run where the boundaries of the
+// grid and of the bricks differ in the last bits, are not passed to the
+// visitor. Occupancy is an OccupancyGrid, or another coarse classification of
+// the bricks of a grid with the same grid(), bricks(), brickIndex(),
+// isOccupied(), and isVoxelOccupied().
+template <class Occupancy, class Visitor>
+class OccupiedRunVisitor {
+ public:
+  OccupiedRunVisitor(const Occupancy &occupancy, double t_offset,
+                     double t_end, Visitor &visitor) noexcept
+      : occupancy_(occupancy),
+        t_offset_(t_offset),
+        t_end_(t_end),
+        visitor_(visitor) {}
+
+  inline bool operator()(int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) noexcept {
+    const double enter = this->t_offset_ + enter_t;
+    const double exit = std::min(this->t_offset_ + exit_t, this->t_end_);
+    if (exit > enter &&
+        this->occupancy_.isVoxelOccupied(radial, polar, azimuthal)) {
+      const SphericalVoxel voxel = {.radial = radial,
+                                    .polar = polar,
+                                    .azimuthal = azimuthal,
+                                    .enter_t = enter};
+      if (!visitExit(this->visitor_, voxel, exit)) {
+        this->is_stopped_ = true;
+        return false;
+      }
+    }
+    return exit < this->t_end_;
+  }
+
+  // Whether the visitor requested that the traversal stop.
+  inline bool isStopped() const noexcept { return this->is_stopped_; }
+
+ private:
+  const Occupancy &occupancy_;
+  const double t_offset_;
+  const double t_end_;
+  Visitor &visitor_;
+  bool is_stopped_ = false;
+};
+
+// The visitor of the traversal of bricks(). Each maximal run of occupied
+// bricks is traversed through grid() once the run ends, and the empty bricks
+// between runs are skipped in a single coarse step each.
+template <class Engine, class Occupancy, class Visitor>
+class OccupancyVisitor {
+ public:
+  OccupancyVisitor(const Ray &ray, const Occupancy &occupancy, double max_t,
+                   Visitor &visitor) noexcept
+      : ray_(ray), occupancy_(occupancy), max_t_(max_t), visitor_(visitor) {}
+
+  inline bool operator()(int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) noexcept {
+    if (this->is_first_brick_) {
+      // The first brick is entered once the ray enters the sphere, from which
+      // the traversal of max_t is measured.
+      this->is_first_brick_ = false;
+      this->t_limit_ = enter_t + this->max_t_ * this->occupancy_.grid()
+                                                    .sphereMaxDiameter();
+    }
+    if (this->occupancy_.isOccupied(
+            this->occupancy_.brickIndex(radial, polar, azimuthal))) {
+      this->is_within_run_ = true;
+      this->t_run_end_ = exit_t;
+      return true;
+    }
+    const bool is_finished = this->finishRun();
+    this->has_skipped_ = true;
+    this->t_restart_ = (enter_t + exit_t) / 2.0;
+    return is_finished;
+  }
+
+  // Traverses the voxels of the run of occupied bricks that is in progress,
+  // if any. Returns false if the visitor requested that the traversal stop.
+  bool finishRun() noexcept {
+    if (!this->is_within_run_) return true;
+    this->is_within_run_ = false;
+    const double t_end = this->t_run_end_;
+    const SphericalVoxelGrid &grid = this->occupancy_.grid();
+    if (!this->has_skipped_) {
+      // No brick has been skipped, so the ray itself is traversed, and the
+      // times are identical to those of a traversal without occupancy.
+      OccupiedRunVisitor<Occupancy, Visitor> run(this->occupancy_, 0.0, t_end,
+                                                 this->visitor_);
+      svr::walkSphericalVolume<Engine>(this->ray_, grid, this->max_t_, run);
+      return !run.isStopped();
+    }
+    // The traversal begins anew within the empty brick before the run. The
+    // boundary of the run is also a voxel boundary, upon which the voxel of
+    // the ray origin would be ambiguous.
+    const double t_begin = this->t_restart_;
+    const Ray ray(this->ray_.pointAtParameter(t_begin),
+                  this->ray_.direction());
+    OccupiedRunVisitor<Occupancy, Visitor> run(this->occupancy_, t_begin,
+                                               t_end, this->visitor_);
+    svr::walkSphericalVolume<Engine>(
+        ray, grid,
+        (std::min(t_end, this->t_limit_) - t_begin) / grid.sphereMaxDiameter(),
+        run);
+    return !run.isStopped();
+  }
+
+ private:
+  const Ray &ray_;
+  const Occupancy &occupancy_;
+  const double max_t_;
+  Visitor &visitor_;
+  double t_limit_ = 0.0;
+  // The midpoint of the last empty brick, from which the next run is
+  // traversed.
+  double t_restart_ = 0.0;
+  double t_run_end_ = 0.0;
+  bool is_first_brick_ = true;
+  bool is_within_run_ = false;
+  // Whether an empty brick has been crossed, after which each run is
+  // traversed from the empty brick before it.
+  bool has_skipped_ = false;
+};
+
+}  // namespace internal
+
+// Similar to walkSphericalVolume(ray, grid, max_t, visitor) for the grid of
+// occupancy, but skips the voxels of empty bricks. The bricks along the ray
+// are traversed first; empty bricks are crossed in a single step each, and
+// the voxels of each run of occupied bricks are traversed from the middle of
+// the empty brick before it. A traversal through empty space thus takes a step
+// per brick rather than per voxel. The voxels visited are those of the
+// traversal without occupancy that lie within occupied bricks, in the same
+// order. The times of a run that follows an empty brick may differ in the last
+// bits, and voxels of no length at the edges of runs are not visited.
+template <class Engine = DefaultEngine, class Visitor>
+inline void walkSphericalVolume(const Ray &ray, const OccupancyGrid &occupancy,
+                                double max_t, Visitor &&visitor) noexcept {
+  internal::OccupancyVisitor<Engine, OccupancyGrid, Visitor> bricks(
+      ray, occupancy, max_t, visitor);
+  svr::walkSphericalVolume<Engine>(ray, occupancy.bricks(), max_t, bricks);
+  bricks.finishRun();
+}
+
+// Similar to integrateSphericalVolume(ray, grid, field, ...) for the grid of
+// occupancy, but skips the voxels of empty bricks as above. The occupancy
+// grid must have been built from field, and the transfer function must have
+// no extinction within occupancy.transparentRange(), so that the integral is
+// the same as without occupancy.
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+inline RayIntegral integrateSphericalVolume(
+    const Ray &ray, const OccupancyGrid &occupancy, const Value *field,
+    TransferFunction &&transfer_function, double max_t,
+    double opacity_threshold = 0.99) noexcept {
+  internal::RayCompositor<double, Value, TransferFunction> compositor(
+      field, transfer_function, occupancy.grid().numPolarSections(),
+      occupancy.grid().numAzimuthalSections(), opacity_threshold);
+  svr::walkSphericalVolume<Engine>(ray, occupancy, max_t, compositor);
+  return compositor.integral();
+}
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_OCCUPANCY_GRID_H
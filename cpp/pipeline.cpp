@@ -0,0 +1,185 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+
+namespace svr {
+
+namespace {
+
+// The number of waits for a queue that yield before the waits sleep, and the
+// duration of each sleep. A sleep is short relative to the stages of a batch.
+constexpr std::size_t QUEUE_YIELDS = 64;
+constexpr std::chrono::microseconds QUEUE_SLEEP(50);
+
+using BatchQueue = BoundedQueue<RayBatch *>;
+
+}  // namespace
+
+namespace internal {
+
+void QueueBackoff::wait() noexcept {
+  if (++this->waits_ <= QUEUE_YIELDS) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(QUEUE_SLEEP);
+  }
+}
+
+}  // namespace internal
+
+RayPipeline &RayPipeline::addStage(Stage stage, std::size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  this->stages_.push_back(
+      {.stage = std::move(stage), .num_threads = num_threads,
+       .is_ordered = false});
+  return *this;
+}
+
+RayPipeline &RayPipeline::addOrderedStage(Stage stage) {
+  this->stages_.push_back(
+      {.stage = std::move(stage), .num_threads = 1, .is_ordered = true});
+  return *this;
+}
+
+std::size_t RayPipeline::run(const Source &source) {
+  const std::size_t num_stages = this->stages_.size();
+
+  // queues[i] holds the batches waiting for stage i. The batches that have
+  // left the pipeline, or have yet to enter it, are held by free_batches.
+  std::vector<std::unique_ptr<BatchQueue>> queues;
+  std::size_t num_workers = 0;
+  for (const StageSpec &spec : this->stages_) {
+    queues.emplace_back(new BatchQueue(this->queue_capacity_));
+    num_workers += spec.num_threads;
+  }
+
+  // Enough batches to fill every queue and worker, and one for the source, so
+  // that the source is held back by a full queue rather than by a lack of
+  // batches.
+  const std::size_t num_batches =
+      (num_stages > 0 ? num_stages * queues[0]->capacity() : 0) + num_workers +
+      1;
+  BatchQueue free_batches(num_batches);
+  std::vector<std::unique_ptr<RayBatch>> batches;
+  batches.reserve(num_batches);
+  for (std::size_t i = 0; i < num_batches; ++i) {
+    batches.emplace_back(new RayBatch());
+    free_batches.push(batches.back().get());
+  }
+
+  // The last worker of each stage to finish closes the queue of the next.
+  std::unique_ptr<std::atomic<std::size_t>[]> active_workers(
+      new std::atomic<std::size_t>[num_stages]);
+  std::vector<std::thread> workers;
+  workers.reserve(num_workers);
+  for (std::size_t i = 0; i < num_stages; ++i) {
+    const StageSpec &spec = this->stages_[i];
+    BatchQueue &input = *queues[i];
+    BatchQueue &output = i + 1 < num_stages ? *queues[i + 1] : free_batches;
+    std::atomic<std::size_t> &active = active_workers[i];
+    active.store(spec.num_threads, std::memory_order_relaxed);
+    for (std::size_t worker = 0; worker < spec.num_threads; ++worker) {
+      workers.emplace_back([&spec, &input, &output, &active]() {
+        ThreadPool pool(1);
+        RayBatch *batch;
+        if (!spec.is_ordered) {
+          while (input.pop(batch)) {
+            spec.stage(*batch, pool);
+            output.push(batch);
+          }
+        } else {
+          // Holds the batches that arrive ahead of the next in order. At
+          // most the batches in flight are held.
+          std::map<std::size_t, RayBatch *> pending;
+          std::size_t next_index = 0;
+          while (input.pop(batch)) {
+            pending.emplace(batch->index, batch);
+            while (!pending.empty() && pending.begin()->first == next_index) {
+              RayBatch *const next = pending.begin()->second;
+              pending.erase(pending.begin());
+              spec.stage(*next, pool);
+              output.push(next);
+              ++next_index;
+            }
+          }
+        }
+        if (active.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          output.close();
+        }
+      });
+    }
+  }
+
+  std::size_t num_generated = 0;
+  BatchQueue &first = num_stages > 0 ? *queues[0] : free_batches;
+  RayBatch *batch;
+  while (free_batches.pop(batch)) {
+    batch->index = num_generated;
+    batch->rays.clear();
+    if (!source(*batch)) break;
+    first.push(batch);
+    ++num_generated;
+  }
+  if (num_stages > 0) first.close();
+  for (std::thread &worker : workers) worker.join();
+  return num_generated;
+}
+
+RayPipeline::Stage traversalStage(const SphericalVoxelGrid &grid,
+                                  double max_t) {
+  return [&grid, max_t](RayBatch &batch, ThreadPool &pool) {
+    batch.voxels = walkSphericalVolumeBatch(
+        batch.rays.data(), batch.rays.size(), grid, max_t, pool);
+  };
+}
+
+RayPipeline::Stage compactTraversalStage(const SphericalVoxelGrid &grid,
+                                         double max_t,
+                                         CompactVoxelEncoding encoding) {
+  return [&grid, max_t, encoding](RayBatch &batch, ThreadPool &pool) {
+    batch.compact_voxels = walkSphericalVolumeCompactBatch(
+        batch.rays.data(), batch.rays.size(), grid, max_t, encoding, pool);
+  };
+}
+
+RayPipeline::Stage voxelStreamStage(VoxelStreamWriter &writer) {
+  return [&writer](RayBatch &batch, ThreadPool &) {
+    writer.write(batch.compact_voxels);
+  };
+}
+
+bool writeVoxelStreamPipelined(VoxelStreamWriter &writer,
+                               const double *ray_origins,
+                               const double *ray_directions,
+                               std::size_t num_rays, double max_t,
+                               std::size_t batch_size,
+                               std::size_t num_threads) {
+  if (!writer.isOpen()) return false;
+  batch_size = std::max<std::size_t>(batch_size, 1);
+  RayPipeline pipeline;
+  pipeline
+      .addStage(compactTraversalStage(writer.grid(), max_t, writer.encoding()),
+                num_threads)
+      .addOrderedStage(voxelStreamStage(writer));
+  std::size_t next_ray = 0;
+  pipeline.run([&](RayBatch &batch) {
+    if (next_ray == num_rays) return false;
+    const std::size_t end = std::min(num_rays, next_ray + batch_size);
+    for (; next_ray < end; ++next_ray) {
+      const double *origin = ray_origins + 3 * next_ray;
+      const double *direction = ray_directions + 3 * next_ray;
+      batch.rays.emplace_back(BoundVec3(origin[0], origin[1], origin[2]),
+                              UnitVec3(direction[0], direction[1],
+                                       direction[2]));
+    }
+    return true;
+  });
+  return writer.isOpen();
+}
+
+}  // namespace svr
@@ -0,0 +1,264 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_PIPELINE_H
+#define SPHERICAL_VOLUME_RENDERING_PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "compact_voxel.h"
+#include "ray.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+#include "voxel_stream.h"
+
+namespace svr {
+
+namespace internal {
+
+// Waits for a queue that is full or empty. The first waits only yield, so
+// that a queue that is refilled quickly is not delayed; later waits sleep
+// briefly, so that the workers of an idle stage do not take cores from those
+// of a busy one.
+class QueueBackoff {
+ public:
+  void wait() noexcept;
+
+ private:
+  std::size_t waits_ = 0;
+};
+
+}  // namespace internal
+
+// A bounded multi-producer, multi-consumer queue of trivially copyable values,
+// e.g. pointers. Each slot holds a sequence number that tells producers and
+// consumers whether it is free or full, so push and pop each claim a slot with
+// a single compare-and-swap and never take a lock. The capacity is rounded up
+// to a power of two, and is at least 2: with a single slot, the sequence number
+// of a full slot would equal the position of the next push, so that push would
+// overwrite the value.
+template <class T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(std::size_t capacity)
+      : capacity_(roundUpToPowerOfTwo(capacity)),
+        slots_(new Slot[this->capacity_]) {
+    for (std::size_t i = 0; i < this->capacity_; ++i) {
+      this->slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  inline std::size_t capacity() const noexcept { return this->capacity_; }
+
+  // Appends value, or returns false if the queue is full.
+  bool tryPush(const T &value) noexcept {
+    std::size_t position = this->push_position_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = this->slots_[position & (this->capacity_ - 1)];
+      const std::size_t sequence =
+          slot.sequence.load(std::memory_order_acquire);
+      if (sequence == position) {
+        if (this->push_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          slot.value = value;
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (sequence < position) {
+        return false;
+      } else {
+        position = this->push_position_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Removes the oldest value, or returns false if the queue is empty.
+  bool tryPop(T &value) noexcept {
+    std::size_t position = this->pop_position_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = this->slots_[position & (this->capacity_ - 1)];
+      const std::size_t sequence =
+          slot.sequence.load(std::memory_order_acquire);
+      if (sequence == position + 1) {
+        if (this->pop_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          value = slot.value;
+          slot.sequence.store(position + this->capacity_,
+                              std::memory_order_release);
+          return true;
+        }
+      } else if (sequence < position + 1) {
+        return false;
+      } else {
+        position = this->pop_position_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Appends value, waiting while the queue is full. A full queue thus holds
+  // back its producers until its consumers catch up.
+  void push(const T &value) noexcept {
+    internal::QueueBackoff backoff;
+    while (!this->tryPush(value)) backoff.wait();
+  }
+
+  // Removes the oldest value, waiting while the queue is empty. Returns false
+  // once the queue is closed and empty.
+  bool pop(T &value) noexcept {
+    internal::QueueBackoff backoff;
+    while (!this->tryPop(value)) {
+      // Every value is pushed before the queue is closed, so a queue that is
+      // empty once closed remains empty.
+      if (this->closed_.load(std::memory_order_acquire)) {
+        return this->tryPop(value);
+      }
+      backoff.wait();
+    }
+    return true;
+  }
+
+  // Marks the end of the values, once every producer has pushed its last.
+  inline void close() noexcept {
+    this->closed_.store(true, std::memory_order_release);
+  }
+
+ private:
+  // Padded to the size of a cache line, so that the producers and consumers
+  // of adjacent slots rarely share one.
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    T value;
+    char padding[64 - (sizeof(std::atomic<std::size_t>) + sizeof(T)) % 64];
+  };
+
+  static std::size_t roundUpToPowerOfTwo(std::size_t n) noexcept {
+    std::size_t power = 2;
+    while (power < n) power <<= 1;
+    return power;
+  }
+
+  const std::size_t capacity_;
+  const std::unique_ptr<Slot[]> slots_;
+  // The padding keeps the positions of producers and consumers on separate
+  // cache lines.
+  char padding_[64];
+  std::atomic<std::size_t> push_position_{0};
+  char push_padding_[64 - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> pop_position_{0};
+  char pop_padding_[64 - sizeof(std::atomic<std::size_t>)];
+  std::atomic<bool> closed_{false};
+};
+
+// A batch of rays, and the results of the stages of a RayPipeline that process
+// it. Batches are reused once they leave the pipeline, so a stage should assign
+// or resize the vectors it fills rather than appending to them.
+struct RayBatch {
+  // The position of the batch in the order given by the source, which is
+  // assigned by the pipeline.
+  std::size_t index;
+
+  // The rays of the batch, which are filled by the source.
+  std::vector<Ray> rays;
+
+  // The voxels of the rays, for stages that traverse them, e.g.
+  // traversalStage() and compactTraversalStage().
+  SphericalVoxelBatch voxels;
+  CompactVoxelBatch compact_voxels;
+
+  // A value per ray, e.g. the integral of a field sampled along it.
+  std::vector<double> values;
+};
+
+// Runs a sequence of stages over ray batches, e.g. traverse, sample, and write,
+// so that each stage of a batch overlaps with the other stages of the batches
+// before and after it. The traversal of batch k thus proceeds while batch k-1
+// is written.
+//
+// Each stage is run by its own workers, and batches are passed between stages
+// through a BoundedQueue. A stage that falls behind fills its queue, which
+// holds back the stages before it, so that at most a bounded number of batches
+// are in flight. The batches are allocated when the pipeline is run, and are
+// reused by the source once they leave the last stage.
+//
+// A stage with more than one worker may pass batches on out of order. An
+// ordered stage, which has a single worker, restores the order of the source,
+// e.g. to write the batches to a file in order.
+class RayPipeline {
+ public:
+  // Fills batch.rays with the next batch, which has been cleared, or returns
+  // false once there are no more batches.
+  using Source = std::function<bool(RayBatch &batch)>;
+
+  // Processes the batch. pool is a single-threaded pool owned by the worker,
+  // so that the batch functions that take a pool, e.g.
+  // walkSphericalVolumeBatch(), may be called within the stage without the
+  // workers of the pipeline serializing on a shared pool.
+  using Stage = std::function<void(RayBatch &batch, ThreadPool &pool)>;
+
+  // Creates an empty pipeline whose stages are each given a queue of
+  // queue_capacity batches, rounded up to a power of two of at least 2. See
+  // BoundedQueue.
+  explicit RayPipeline(std::size_t queue_capacity = 4) noexcept
+      : queue_capacity_(queue_capacity) {}
+
+  // Appends a stage that is run by num_threads workers. If num_threads is 0,
+  // uses std::thread::hardware_concurrency().
+  RayPipeline &addStage(Stage stage, std::size_t num_threads = 1);
+
+  // Appends a stage with a single worker that is given the batches in the
+  // order of the source.
+  RayPipeline &addOrderedStage(Stage stage);
+
+  // Calls source on the calling thread until it returns false, and passes
+  // each batch through every stage. Blocks until the last batch has left the
+  // pipeline. Returns the number of batches. The pipeline may be run again.
+  std::size_t run(const Source &source);
+
+ private:
+  struct StageSpec {
+    Stage stage;
+    std::size_t num_threads;
+    bool is_ordered;
+  };
+
+  const std::size_t queue_capacity_;
+  std::vector<StageSpec> stages_;
+};
+
+// A stage that traverses the rays of each batch into batch.voxels, as with
+// walkSphericalVolumeBatch(). grid must outlive the pipeline.
+RayPipeline::Stage traversalStage(const SphericalVoxelGrid &grid,
+                                  double max_t);
+
+// A stage that traverses the rays of each batch into batch.compact_voxels, as
+// with walkSphericalVolumeCompactBatch(). grid must outlive the pipeline.
+RayPipeline::Stage compactTraversalStage(const SphericalVoxelGrid &grid,
+                                         double max_t,
+                                         CompactVoxelEncoding encoding);
+
+// An ordered stage that appends batch.compact_voxels of each batch to writer
+// as a chunk. If a chunk could not be written, the stream is closed and the
+// remaining batches are dropped; check writer.isOpen() once the pipeline has
+// run. writer must outlive the pipeline.
+RayPipeline::Stage voxelStreamStage(VoxelStreamWriter &writer);
+
+// Simplified parameters to Cythonize a pipeline that traverses the rays, given
+// as with walkSphericalVolumeBatch(), in batches of batch_size rays on
+// num_threads workers, and appends each batch to writer as a chunk in order.
+// Returns false if a chunk could not be written. writer's grid and encoding
+// are used for the traversal.
+bool writeVoxelStreamPipelined(VoxelStreamWriter &writer,
+                               const double *ray_origins,
+                               const double *ray_directions,
+                               std::size_t num_rays, double max_t,
+                               std::size_t batch_size,
+                               std::size_t num_threads);
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_PIPELINE_H
@@ -1,25 +1,31 @@
 #ifndef SPHERICAL_VOLUME_RENDERING_RAY_H
 #define SPHERICAL_VOLUME_RENDERING_RAY_H
 
+#include "host_device.h"
 #include "vec3.h"
 
 // Encapsulates the functionality of a ray. This consists of two components, the
 // origin of the ray, and the unit direction of the ray. To avoid checking for a
 // non-zero direction upon each function call, these parameters are initialized
-// upon construction.
-struct Ray final {
-  inline Ray(const BoundVec3 &origin, const UnitVec3 &direction) noexcept
+// upon construction. The components are of the floating point type T; Ray is
+// the double precision ray.
+template <class T>
+struct BasicRay final {
+  SVR_HOST_DEVICE inline BasicRay(const BasicBoundVec3<T> &origin,
+                                  const BasicUnitVec3<T> &direction) noexcept
       : origin_(origin),
         direction_(direction),
-        inverse_direction_(FreeVec3(1.0 / direction.x(), 1.0 / direction.y(),
-                                    1.0 / direction.z())),
+        inverse_direction_(BasicFreeVec3<T>(T(1) / direction.x(),
+                                            T(1) / direction.y(),
+                                            T(1) / direction.z())),
         NZD_index_(direction.x() != 0.0
                        ? X_DIRECTION
                        : direction.y() != 0.0 ? Y_DIRECTION : Z_DIRECTION) {}
 
   // Represents the function p(t) = origin + t * direction,
   // where p is a 3-dimensional position, and t is a scalar.
-  inline BoundVec3 pointAtParameter(const double t) const noexcept {
+  SVR_HOST_DEVICE inline BasicBoundVec3<T> pointAtParameter(
+      const T t) const noexcept {
     return this->origin_ + this->direction_ * t;
   }
 
@@ -30,38 +36,44 @@ struct Ray final {
   // direction, we can do the following: Since Point p = ray.origin() +
   // ray.direction() * (v +/- discriminant), We can simply provide the
   // difference or addition of v and the discriminant.
-  inline double timeOfIntersectionAt(double discriminant_v) const noexcept {
+  SVR_HOST_DEVICE inline T timeOfIntersectionAt(
+      T discriminant_v) const noexcept {
     return this->direction_[NZD_index_] * discriminant_v *
            this->inverse_direction_[NZD_index_];
   }
 
   // Similar to above implementation, but uses a given vector p.
-  inline double timeOfIntersectionAt(const Vec3 &p) const noexcept {
+  SVR_HOST_DEVICE inline T timeOfIntersectionAt(
+      const BasicVec3<T> &p) const noexcept {
     return (p[NZD_index_] - this->origin_[NZD_index_]) *
            this->inverse_direction_[NZD_index_];
   }
 
-  inline const BoundVec3 &origin() const noexcept { return this->origin_; }
+  SVR_HOST_DEVICE inline const BasicBoundVec3<T> &origin() const noexcept {
+    return this->origin_;
+  }
 
-  inline const UnitVec3 &direction() const noexcept { return this->direction_; }
+  SVR_HOST_DEVICE inline const BasicUnitVec3<T> &direction() const noexcept {
+    return this->direction_;
+  }
 
-  inline const FreeVec3 &invDirection() const noexcept {
+  SVR_HOST_DEVICE inline const BasicFreeVec3<T> &invDirection() const noexcept {
     return this->inverse_direction_;
   }
 
-  inline DirectionIndex NonZeroDirectionIndex() const noexcept {
+  SVR_HOST_DEVICE inline DirectionIndex NonZeroDirectionIndex() const noexcept {
     return this->NZD_index_;
   }
 
  private:
   // The origin of the ray.
-  const BoundVec3 origin_;
+  const BasicBoundVec3<T> origin_;
 
   // The direction of the ray.
-  const UnitVec3 direction_;
+  const BasicUnitVec3<T> direction_;
 
   // The inverse direction of the ray.
-  const FreeVec3 inverse_direction_;
+  const BasicFreeVec3<T> inverse_direction_;
 
   // Index of a non-zero direction.
   const enum DirectionIndex NZD_index_;
@@ -71,14 +83,17 @@ struct Ray final {
 // generalizes azimuthal and polar hits. Since the ray segment is dependent
 // solely on time, this is unnecessary to calculate twice for each plane hit
 // function. Here, ray_segment is the difference between P2 and P1.
-struct RaySegment {
+template <class T>
+struct BasicRaySegment {
  public:
-  inline RaySegment(double max_t, const Ray &ray) noexcept
+  SVR_HOST_DEVICE inline BasicRaySegment(T max_t,
+                                         const BasicRay<T> &ray) noexcept
       : P2_(ray.pointAtParameter(max_t)), NZDI_(ray.NonZeroDirectionIndex()) {}
 
   // Updates the point P1 with the new time traversal time t. Similarly, updates
   // the segment denoted by P2 - P1.
-  inline void updateAtTime(double t, const Ray &ray) noexcept {
+  SVR_HOST_DEVICE inline void updateAtTime(T t,
+                                           const BasicRay<T> &ray) noexcept {
     P1_ = ray.pointAtParameter(t);
     ray_segment_ = P2_ - P1_;
   }
@@ -86,31 +101,40 @@ struct RaySegment {
   // Calculates the updated ray segment intersection point given an intersect
   // parameter. More information on the use case can be found at:
   // http://geomalgorithms.com/a05-_intersect-1.html#intersect2D_2Segments()
-  inline double intersectionTimeAt(double intersect_parameter,
-                                   const Ray &ray) const noexcept {
+  SVR_HOST_DEVICE inline T intersectionTimeAt(
+      T intersect_parameter, const BasicRay<T> &ray) const noexcept {
     return (P1_[NZDI_] + ray_segment_[NZDI_] * intersect_parameter -
             ray.origin()[NZDI_]) *
            ray.invDirection()[NZDI_];
   }
 
-  inline const BoundVec3 &P1() const noexcept { return P1_; }
+  SVR_HOST_DEVICE inline const BasicBoundVec3<T> &P1() const noexcept {
+    return P1_;
+  }
 
-  inline const BoundVec3 &P2() const noexcept { return P2_; }
+  SVR_HOST_DEVICE inline const BasicBoundVec3<T> &P2() const noexcept {
+    return P2_;
+  }
 
-  inline const FreeVec3 &vector() const noexcept { return ray_segment_; }
+  SVR_HOST_DEVICE inline const BasicFreeVec3<T> &vector() const noexcept {
+    return ray_segment_;
+  }
 
  private:
   // The end point of the ray segment.
-  const BoundVec3 P2_;
+  const BasicBoundVec3<T> P2_;
 
   // The non-zero direction index of the ray.
   const DirectionIndex NZDI_;
 
   // The begin point of the ray segment.
-  BoundVec3 P1_;
+  BasicBoundVec3<T> P1_;
 
   // The free vector represented by P2 - P1.
-  FreeVec3 ray_segment_;
+  BasicFreeVec3<T> ray_segment_;
 };
 
+using Ray = BasicRay<double>;
+using RaySegment = BasicRaySegment<double>;
+
 #endif  // SPHERICAL_VOLUME_RENDERING_RAY_H
@@ -0,0 +1,107 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_RAY_INTEGRAL_H
+#define SPHERICAL_VOLUME_RENDERING_RAY_INTEGRAL_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "host_device.h"
+
+namespace svr {
+
+// The color and extinction coefficient of a voxel, as given by the transfer
+// function of integrateSphericalVolume(). The extinction coefficient is the
+// rate at which the voxel absorbs light per unit time of the ray.
+template <class T>
+struct BasicTransferSample {
+  T red;
+  T green;
+  T blue;
+  T extinction;
+};
+
+// The color and opacity accumulated along a ray by integrateSphericalVolume(),
+// and the number of voxels that were composited.
+template <class T>
+struct BasicRayIntegral {
+  T red;
+  T green;
+  T blue;
+  T opacity;
+  std::size_t num_voxels;
+};
+
+using TransferSample = BasicTransferSample<double>;
+using RayIntegral = BasicRayIntegral<double>;
+
+namespace internal {
+
+// The traversal visitor of integrateSphericalVolume(), which composites the
+// voxels of field front to back as they are visited. It is shared by the
+// traversals on the CPU and the GPU, so that both composite identically. See
+// integrateSphericalVolume() for the parameters.
+template <class T, class Value, class TransferFunction>
+class RayCompositor {
+ public:
+  SVR_HOST_DEVICE inline RayCompositor(const Value *field,
+                                       TransferFunction &transfer_function,
+                                       std::size_t num_polar_sections,
+                                       std::size_t num_azimuthal_sections,
+                                       T opacity_threshold) noexcept
+      : field_(field),
+        transfer_function_(transfer_function),
+        num_polar_sections_(num_polar_sections),
+        num_azimuthal_sections_(num_azimuthal_sections),
+        opacity_threshold_(opacity_threshold),
+        integral_({.red = T(0),
+                   .green = T(0),
+                   .blue = T(0),
+                   .opacity = T(0),
+                   .num_voxels = 0}) {}
+
+  // Composites the voxel, and returns false once the accumulated opacity
+  // reaches the threshold.
+  SVR_HOST_DEVICE inline bool operator()(int radial, int polar, int azimuthal,
+                                         T enter_t, T exit_t) noexcept {
+    const std::size_t index =
+        (static_cast<std::size_t>(radial - 1) * this->num_polar_sections_ +
+         static_cast<std::size_t>(polar)) *
+            this->num_azimuthal_sections_ +
+        static_cast<std::size_t>(azimuthal);
+    return this->composite(this->field_[index], enter_t, exit_t);
+  }
+
+  // Composites a voxel of the given value, e.g. one of another field over a
+  // coarser grid, and returns false once the accumulated opacity reaches the
+  // threshold.
+  SVR_HOST_DEVICE inline bool composite(const Value &value, T enter_t,
+                                        T exit_t) noexcept {
+    const BasicTransferSample<T> sample = this->transfer_function_(value);
+    BasicRayIntegral<T> &integral = this->integral_;
+    const T weight = (T(1) - integral.opacity) *
+                     (T(1) - std::exp(-sample.extinction * (exit_t - enter_t)));
+    integral.red += weight * sample.red;
+    integral.green += weight * sample.green;
+    integral.blue += weight * sample.blue;
+    integral.opacity += weight;
+    ++integral.num_voxels;
+    return integral.opacity < this->opacity_threshold_;
+  }
+
+  SVR_HOST_DEVICE inline const BasicRayIntegral<T> &integral() const noexcept {
+    return this->integral_;
+  }
+
+ private:
+  const Value *const field_;
+  TransferFunction &transfer_function_;
+  const std::size_t num_polar_sections_;
+  const std::size_t num_azimuthal_sections_;
+  const T opacity_threshold_;
+  BasicRayIntegral<T> integral_;
+};
+
+}  // namespace internal
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_RAY_INTEGRAL_H
@@ -0,0 +1,188 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_RAY_ORDER_H
+#define SPHERICAL_VOLUME_RENDERING_RAY_ORDER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ray.h"
+#include "spherical_voxel_grid.h"
+
+namespace svr {
+
+// The space-filling curve used to order rays by RayOrder.
+enum class RayOrdering {
+  // Interleaves the bits of the coordinates. Cheap to compute, but the curve
+  // jumps between distant points at the boundaries of its octants.
+  MORTON,
+  // Every step of the curve is between adjacent cells, so consecutive rays
+  // are closer on average than those of MORTON.
+  HILBERT
+};
+
+namespace internal {
+
+// The bits of each coordinate of the entry point and the direction in the key
+// of a ray. The entry point forms the upper 42 bits of the key, so rays are
+// ordered by where they enter the sphere, and then by their direction.
+constexpr std::uint32_t RAY_ORDER_POSITION_BITS = 14;
+constexpr std::uint32_t RAY_ORDER_DIRECTION_BITS = 7;
+
+// Quantizes a coordinate within [-1, 1] to the given number of bits.
+inline std::uint32_t quantizeRayCoordinate(double value,
+                                           std::uint32_t bits) noexcept {
+  const double max_cell = static_cast<double>((1u << bits) - 1);
+  const double cell =
+      (std::min(std::max(value, -1.0), 1.0) + 1.0) * 0.5 * max_cell;
+  return static_cast<std::uint32_t>(cell + 0.5);
+}
+
+// Interleaves the lower bits of x, y, and z, with x in the most significant
+// position of each triple.
+inline std::uint64_t interleaveBits(std::uint32_t x, std::uint32_t y,
+                                    std::uint32_t z,
+                                    std::uint32_t bits) noexcept {
+  std::uint64_t key = 0;
+  for (std::uint32_t bit = bits; bit-- > 0;) {
+    key = (key << 3) | (std::uint64_t((x >> bit) & 1) << 2) |
+          (std::uint64_t((y >> bit) & 1) << 1) | ((z >> bit) & 1);
+  }
+  return key;
+}
+
+// Returns the distance along the 3D Hilbert curve of the cell (x, y, z) with
+// the given number of bits per coordinate. Uses the transpose of J. Skilling,
+// "Programming the Hilbert curve", AIP Conference Proceedings 707, 2004: the
+// coordinates are transformed in place so that interleaving their bits gives
+// the distance.
+inline std::uint64_t hilbertKey(std::uint32_t x, std::uint32_t y,
+                                std::uint32_t z,
+                                std::uint32_t bits) noexcept {
+  std::uint32_t axes[3] = {x, y, z};
+  const std::uint32_t highest = 1u << (bits - 1);
+  for (std::uint32_t q = highest; q > 1; q >>= 1) {
+    const std::uint32_t p = q - 1;
+    for (int i = 0; i < 3; ++i) {
+      if (axes[i] & q) {
+        axes[0] ^= p;
+      } else {
+        const std::uint32_t t = (axes[0] ^ axes[i]) & p;
+        axes[0] ^= t;
+        axes[i] ^= t;
+      }
+    }
+  }
+  axes[1] ^= axes[0];
+  axes[2] ^= axes[1];
+  std::uint32_t t = 0;
+  for (std::uint32_t q = highest; q > 1; q >>= 1) {
+    if (axes[2] & q) t ^= q - 1;
+  }
+  for (int i = 0; i < 3; ++i) axes[i] ^= t;
+  return interleaveBits(axes[0], axes[1], axes[2], bits);
+}
+
+// Returns the key of the ray, from the point at which it enters the sphere of
+// grid, relative to the sphere and scaled to [-1, 1], and its direction. A ray
+// that begins within the sphere enters at its origin. A ray that misses the
+// sphere is keyed by its closest point to the sphere center, so that it is
+// ordered near the rays that graze the sphere at the same place.
+inline std::uint64_t rayOrderKey(const Ray &ray,
+                                 const SphericalVoxelGrid &grid,
+                                 RayOrdering ordering) noexcept {
+  const double radius = grid.sphereMaxRadius();
+  const double o[3] = {ray.origin().x() - grid.sphereCenter().x(),
+                       ray.origin().y() - grid.sphereCenter().y(),
+                       ray.origin().z() - grid.sphereCenter().z()};
+  const double d[3] = {ray.direction().x(), ray.direction().y(),
+                       ray.direction().z()};
+  const double o_squared = o[0] * o[0] + o[1] * o[1] + o[2] * o[2];
+  // The time of the ray's closest approach to the center, and the squared
+  // half-length of its chord through the sphere.
+  const double b = -(o[0] * d[0] + o[1] * d[1] + o[2] * d[2]);
+  const double chord_squared = b * b - (o_squared - radius * radius);
+  double t = 0.0;
+  if (o_squared > radius * radius) {
+    t = chord_squared >= 0.0 && b >= 0.0 ? b - std::sqrt(chord_squared)
+                                         : std::max(b, 0.0);
+  }
+  std::uint32_t position[3];
+  std::uint32_t direction[3];
+  for (int i = 0; i < 3; ++i) {
+    position[i] = quantizeRayCoordinate((o[i] + t * d[i]) / radius,
+                                        RAY_ORDER_POSITION_BITS);
+    direction[i] = quantizeRayCoordinate(d[i], RAY_ORDER_DIRECTION_BITS);
+  }
+  const std::uint64_t position_key =
+      ordering == RayOrdering::HILBERT
+          ? hilbertKey(position[0], position[1], position[2],
+                       RAY_ORDER_POSITION_BITS)
+          : interleaveBits(position[0], position[1], position[2],
+                           RAY_ORDER_POSITION_BITS);
+  return position_key << (3 * RAY_ORDER_DIRECTION_BITS) |
+         interleaveBits(direction[0], direction[1], direction[2],
+                        RAY_ORDER_DIRECTION_BITS);
+}
+
+// The order of the batch functions that are not given one, in which the k-th
+// ray traversed is ray k. The batch functions index an order, e.g. a RayOrder,
+// with the position of a traversal to find the ray it traverses.
+struct GivenRayOrder {
+  inline std::size_t operator[](std::size_t k) const noexcept { return k; }
+};
+
+}  // namespace internal
+
+// An order in which to traverse a batch of rays, so that consecutive rays
+// enter the sphere near one another in similar directions. Rays traversed in
+// scanline order jump across the sphere at the end of each row, and rays
+// given in no particular order, e.g. those of a simulation, jump with every
+// ray. Nearby rays traverse the same voxels, so traversing them together
+// keeps the boundary tables of those voxels, and the field values sampled
+// from them, in cache.
+//
+// The batch functions that take a RayOrder traverse the rays in the order,
+// but write the voxels of each ray to its place in the batch as given, so
+// their results are identical to those that do not. Since the batch functions
+// split their rays into ranges of 32-bit indices, the rays are indexed with
+// 32 bits.
+class RayOrder {
+ public:
+  // Sorts the rays by the key of internal::rayOrderKey() along the given
+  // curve.
+  RayOrder(const Ray *rays, std::size_t num_rays,
+           const SphericalVoxelGrid &grid,
+           RayOrdering ordering = RayOrdering::HILBERT) {
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> keys(num_rays);
+    for (std::size_t i = 0; i < num_rays; ++i) {
+      keys[i] = {internal::rayOrderKey(rays[i], grid, ordering),
+                 static_cast<std::uint32_t>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+    this->order_.resize(num_rays);
+    for (std::size_t i = 0; i < num_rays; ++i) {
+      this->order_[i] = keys[i].second;
+    }
+  }
+
+  inline std::size_t size() const noexcept { return this->order_.size(); }
+
+  // The index of the ray traversed k-th.
+  inline std::uint32_t operator[](std::size_t k) const noexcept {
+    return this->order_[k];
+  }
+
+  inline const std::uint32_t *data() const noexcept {
+    return this->order_.data();
+  }
+
+ private:
+  std::vector<std::uint32_t> order_;
+};
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_RAY_ORDER_H
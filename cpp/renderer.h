@@ -0,0 +1,249 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_RENDERER_H
+#define SPHERICAL_VOLUME_RENDERING_RENDERER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "ray.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+#include "vec3.h"
+
+namespace svr {
+
+// The projection used by a Camera to generate the ray through each pixel.
+enum class Projection {
+  // Parallel rays, each beginning on the image plane.
+  ORTHOGRAPHIC,
+  // Rays through a common eye point, as with a pinhole camera.
+  PERSPECTIVE,
+  // An equidistant fisheye, where the angle between a ray and the view
+  // direction is proportional to the distance of its pixel from the image
+  // center. With a field of view of 2pi, this is an all-sky projection.
+  FISHEYE
+};
+
+// Generates the rays of an image of width x height pixels. The camera is at
+// position, looks along forward, and is oriented such that up points towards
+// the top of the image; up need not be perpendicular to forward, but must not
+// be parallel to it. Neither forward nor up need be unit vectors.
+class Camera {
+ public:
+  // view_width is the width of the image plane.
+  static inline Camera orthographic(const BoundVec3 &position,
+                                    const FreeVec3 &forward,
+                                    const FreeVec3 &up, std::size_t width,
+                                    std::size_t height,
+                                    double view_width) noexcept {
+    return Camera(Projection::ORTHOGRAPHIC, position, forward, up, width,
+                  height, view_width / 2.0);
+  }
+
+  // field_of_view is the horizontal angle in radians, in (0, pi).
+  static inline Camera perspective(const BoundVec3 &position,
+                                   const FreeVec3 &forward, const FreeVec3 &up,
+                                   std::size_t width, std::size_t height,
+                                   double field_of_view) noexcept {
+    return Camera(Projection::PERSPECTIVE, position, forward, up, width,
+                  height, std::tan(field_of_view / 2.0));
+  }
+
+  // field_of_view is the angular diameter in radians, in (0, 2pi], of the
+  // image circle. The circle is inscribed in the image; pixels outside of it
+  // have no ray.
+  static inline Camera fisheye(const BoundVec3 &position,
+                               const FreeVec3 &forward, const FreeVec3 &up,
+                               std::size_t width, std::size_t height,
+                               double field_of_view) noexcept {
+    return Camera(Projection::FISHEYE, position, forward, up, width, height,
+                  field_of_view / 2.0);
+  }
+
+  inline Projection projection() const noexcept { return this->projection_; }
+
+  inline std::size_t width() const noexcept { return this->width_; }
+
+  inline std::size_t height() const noexcept { return this->height_; }
+
+  // The spacing of the pixels at the image center: a distance on the image
+  // plane for orthographic cameras, and an angle in radians for perspective
+  // and fisheye cameras.
+  inline double pixelSize() const noexcept {
+    return 2.0 * this->scale_ * this->inv_size_;
+  }
+
+  // Calculates the origin and direction of the ray through the center of pixel
+  // (x, y), where (0, 0) is the top left pixel. The direction is not
+  // normalized. Returns false if the pixel has no ray.
+  inline bool generateRay(std::size_t x, std::size_t y, BoundVec3 &origin,
+                          FreeVec3 &direction) const noexcept {
+    // The pixel center in [-1, 1], scaled such that pixels are square and the
+    // smaller image dimension spans [-1, 1].
+    const double u = (2.0 * x + 1.0 - this->width_) * this->inv_size_;
+    const double v = (this->height_ - 2.0 * y - 1.0) * this->inv_size_;
+    switch (this->projection_) {
+      case Projection::ORTHOGRAPHIC: {
+        origin = this->position_ + this->right_ * (u * this->scale_) +
+                 this->up_ * (v * this->scale_);
+        direction = this->forward_;
+        return true;
+      }
+      case Projection::PERSPECTIVE: {
+        origin = this->position_;
+        direction = this->forward_ + this->right_ * (u * this->scale_) +
+                    this->up_ * (v * this->scale_);
+        return true;
+      }
+      case Projection::FISHEYE: {
+        const double radius = std::sqrt(u * u + v * v);
+        if (radius > 1.0) return false;
+        origin = this->position_;
+        if (radius == 0.0) {
+          direction = this->forward_;
+          return true;
+        }
+        const double angle = radius * this->scale_;
+        const double sin_over_radius = std::sin(angle) / radius;
+        direction = this->forward_ * std::cos(angle) +
+                    this->right_ * (u * sin_over_radius) +
+                    this->up_ * (v * sin_over_radius);
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  // scale is half the view width for orthographic cameras, the tangent of half
+  // the field of view for perspective cameras, and half the field of view for
+  // fisheye cameras. The former two span the image width, whereas the pixel
+  // coordinates of generateRay() are in units of half the smaller image
+  // dimension, so they are rescaled accordingly.
+  inline Camera(Projection projection, const BoundVec3 &position,
+                const FreeVec3 &forward, const FreeVec3 &up, std::size_t width,
+                std::size_t height, double scale) noexcept
+      : projection_(projection),
+        width_(width),
+        height_(height),
+        inv_size_(1.0 / std::max<std::size_t>(std::min(width, height), 1)),
+        scale_(projection == Projection::FISHEYE
+                   ? scale
+                   : scale * std::min(width, height) /
+                         std::max<std::size_t>(width, 1)),
+        position_(position),
+        forward_(forward / forward.length()),
+        right_(unit(forward_.cross(up))),
+        up_(right_.cross(forward_)) {}
+
+  static inline FreeVec3 unit(const FreeVec3 &v) noexcept {
+    return v / v.length();
+  }
+
+  Projection projection_;
+  std::size_t width_;
+  std::size_t height_;
+
+  // The reciprocal of the smaller image dimension.
+  double inv_size_;
+  double scale_;
+
+  // The camera position, and the orthonormal basis of its view.
+  BoundVec3 position_;
+  FreeVec3 forward_;
+  FreeVec3 right_;
+  FreeVec3 up_;
+};
+
+namespace internal {
+
+// The width and height in pixels of the tiles rendered by each worker. A tile
+// of coherent rays traverses nearby voxels, and so reuses the cached portions
+// of the field.
+constexpr std::size_t RENDER_TILE_SIZE = 16;
+
+// Renders the image of the camera, whose pixel (x, y) is set to
+// integrate(ray, hint) for its ray. hint is an EntryVoxel that integrate may
+// give to the traversal of the ray and then replace with its entrance voxel.
+// Within a tile, each pixel is given the hint of the pixel before it, and the
+// first pixel of each row that of the first pixel of the row above, so that
+// neighbouring rays share the search for their entrance voxels. See
+// renderSphericalVolume().
+template <class Integrate>
+void renderTiles(const Camera &camera, RayIntegral *image, ThreadPool &pool,
+                 std::size_t num_threads, const Integrate &integrate) {
+  using internal::RENDER_TILE_SIZE;
+  const std::size_t width = camera.width();
+  const std::size_t height = camera.height();
+  const std::size_t num_tile_columns =
+      (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+  const std::size_t num_tile_rows =
+      (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+  pool.parallelFor(
+      num_tile_columns * num_tile_rows, /*grain=*/1,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (std::size_t tile = begin; tile < end; ++tile) {
+          const std::size_t x_begin =
+              (tile % num_tile_columns) * RENDER_TILE_SIZE;
+          const std::size_t y_begin =
+              (tile / num_tile_columns) * RENDER_TILE_SIZE;
+          const std::size_t x_end = std::min(x_begin + RENDER_TILE_SIZE, width);
+          const std::size_t y_end =
+              std::min(y_begin + RENDER_TILE_SIZE, height);
+          EntryVoxel row_hint = EntryVoxel();
+          for (std::size_t y = y_begin; y < y_end; ++y) {
+            EntryVoxel hint = row_hint;
+            for (std::size_t x = x_begin; x < x_end; ++x) {
+              RayIntegral &pixel = image[y * width + x];
+              BoundVec3 origin;
+              FreeVec3 direction;
+              if (!camera.generateRay(x, y, origin, direction)) {
+                pixel = {.red = 0.0,
+                         .green = 0.0,
+                         .blue = 0.0,
+                         .opacity = 0.0,
+                         .num_voxels = 0};
+                continue;
+              }
+              pixel = integrate(Ray(origin, UnitVec3(direction)), hint);
+              if (x == x_begin) row_hint = hint;
+            }
+          }
+        }
+      },
+      num_threads);
+}
+
+}  // namespace internal
+
+// Renders an image of field as seen by the camera. The ray of each pixel is
+// generated as the image is rendered, and integrated with
+// integrateSphericalVolume() given field, transfer_function, max_t, and
+// opacity_threshold. The integral of pixel (x, y) is written to
+// image[y * camera.width() + x]; pixels without a ray are set to zero. image
+// must hold camera.width() * camera.height() integrals.
+//
+// The image is split into square tiles, which are rendered in parallel across
+// the workers of pool with work stealing. At most num_threads workers are
+// used; if num_threads is 0, all workers are used. transfer_function is
+// called concurrently, and so must be thread-safe.
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+void renderSphericalVolume(const Camera &camera, const SphericalVoxelGrid &grid,
+                           const Value *field,
+                           const TransferFunction &transfer_function,
+                           RayIntegral *image, double max_t = 1.0,
+                           double opacity_threshold = 0.99,
+                           ThreadPool &pool = ThreadPool::global(),
+                           std::size_t num_threads = 0) {
+  internal::renderTiles(camera, image, pool, num_threads,
+                        [&](const Ray &ray, EntryVoxel &hint) -> RayIntegral {
+                          return integrateSphericalVolume<Engine>(
+                              ray, grid, field, transfer_function, max_t,
+                              opacity_threshold, hint);
+                        });
+}
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_RENDERER_H
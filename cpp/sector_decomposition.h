@@ -0,0 +1,388 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_SECTOR_DECOMPOSITION_H
+#define SPHERICAL_VOLUME_RENDERING_SECTOR_DECOMPOSITION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "occupancy_grid.h"
+#include "ray.h"
+#include "ray_integral.h"
+#include "spherical_volume_rendering_util.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+
+namespace svr {
+
+// The number of sectors of a SectorDecomposition along each dimension.
+struct SectorCounts {
+  std::size_t radial;
+  std::size_t polar;
+  std::size_t azimuthal;
+};
+
+// The integral of a ray over a contiguous run of voxels of one sector, which
+// the ray enters at enter_t and exits at exit_t. The integral is composited
+// from zero opacity at enter_t, so the segments of a ray may be composited in
+// any grouping with compositeRaySegments(). ray is the index of the ray in the
+// batch that was integrated.
+struct RaySegment {
+  std::uint64_t ray;
+  double enter_t;
+  double exit_t;
+  RayIntegral integral;
+};
+
+// A split of a grid into shells of radial sections and wedges of polar and
+// azimuthal sections, one of which, sector(), is owned by this process. The
+// field of a volume too large for a single node is distributed by sector, so
+// that each process only holds the values of the voxels of its own sector.
+// The grid itself, whose tables hold a few values per section, is held whole
+// by every process. A ray is integrated over the sector with
+// integrateSphericalVolumeSegments(), which crosses the other sectors in a
+// single coarse step each, as with an OccupancyGrid whose only occupied brick
+// is the sector. The segments of every sector are then composited with
+// compositeRaySegments(); see mpi_traversal.h for the distributed reduction.
+//
+// Sectors are indexed as the bricks of bricks(). The field of the sector is
+// laid out as that of integrateSphericalVolume() for the sections of the
+// sector alone, i.e. the value of voxel (radial, polar, azimuthal) is
+// sector_field[sectorVoxelIndex(radial, polar, azimuthal)].
+class SectorDecomposition {
+ public:
+  // The decomposition of grid, which must outlive it, into the given number of
+  // sectors along each dimension. Each count must divide the number of
+  // sections of grid in that dimension, and sector must be less than
+  // numSectors(); check isValid().
+  SectorDecomposition(const SphericalVoxelGrid &grid,
+                      const SectorCounts &counts, std::size_t sector)
+      : grid_(grid),
+        counts_(counts),
+        is_valid_(isValidDecomposition(grid, counts, sector)),
+        sector_size_(
+            {.radial = this->is_valid_
+                           ? grid.numRadialSections() / counts.radial
+                           : grid.numRadialSections(),
+             .polar = this->is_valid_ ? grid.numPolarSections() / counts.polar
+                                      : grid.numPolarSections(),
+             .azimuthal = this->is_valid_ ? grid.numAzimuthalSections() /
+                                                counts.azimuthal
+                                          : grid.numAzimuthalSections()}),
+        bricks_(grid.coarsened(this->sector_size_.radial,
+                               this->sector_size_.polar,
+                               this->sector_size_.azimuthal)),
+        sector_(this->is_valid_ ? sector : 0),
+        radial_begin_(static_cast<int>(
+            this->sector_ / (this->bricks_.numPolarSections() *
+                             this->bricks_.numAzimuthalSections()) *
+                this->sector_size_.radial +
+            1)),
+        polar_begin_(static_cast<int>(this->sector_ /
+                                      this->bricks_.numAzimuthalSections() %
+                                      this->bricks_.numPolarSections() *
+                                      this->sector_size_.polar)),
+        azimuthal_begin_(
+            static_cast<int>(this->sector_ %
+                             this->bricks_.numAzimuthalSections() *
+                             this->sector_size_.azimuthal)) {}
+
+  inline bool isValid() const noexcept { return this->is_valid_; }
+
+  inline const SphericalVoxelGrid &grid() const noexcept { return this->grid_; }
+
+  // The grid of sectors, in which voxel (radial, polar, azimuthal) is the
+  // sector brickIndex(radial, polar, azimuthal).
+  inline const SphericalVoxelGrid &bricks() const noexcept {
+    return this->bricks_;
+  }
+
+  inline const SectorCounts &counts() const noexcept { return this->counts_; }
+
+  inline std::size_t numSectors() const noexcept {
+    return this->counts_.radial * this->counts_.polar *
+           this->counts_.azimuthal;
+  }
+
+  // The sector owned by this process.
+  inline std::size_t sector() const noexcept { return this->sector_; }
+
+  // The number of sections of grid() along each dimension of a sector.
+  inline const BrickSize &sectorSize() const noexcept {
+    return this->sector_size_;
+  }
+
+  // The first voxel of sector() along each dimension, where the radial voxel
+  // is the outermost.
+  inline int radialBegin() const noexcept { return this->radial_begin_; }
+
+  inline int polarBegin() const noexcept { return this->polar_begin_; }
+
+  inline int azimuthalBegin() const noexcept { return this->azimuthal_begin_; }
+
+  // The number of voxels of sector(), i.e. the size of its field.
+  inline std::size_t numSectorVoxels() const noexcept {
+    return this->sector_size_.radial * this->sector_size_.polar *
+           this->sector_size_.azimuthal;
+  }
+
+  // The index of the sector (radial, polar, azimuthal) of bricks(), where
+  // radial is in [1, counts().radial].
+  inline std::size_t brickIndex(int radial, int polar,
+                                int azimuthal) const noexcept {
+    return (static_cast<std::size_t>(radial - 1) * this->counts_.polar +
+            static_cast<std::size_t>(polar)) *
+               this->counts_.azimuthal +
+           static_cast<std::size_t>(azimuthal);
+  }
+
+  // The index of the sector that holds voxel (radial, polar, azimuthal) of
+  // grid().
+  inline std::size_t sectorOfVoxel(int radial, int polar,
+                                   int azimuthal) const noexcept {
+    return this->brickIndex(
+        (radial - 1) / static_cast<int>(this->sector_size_.radial) + 1,
+        polar / static_cast<int>(this->sector_size_.polar),
+        azimuthal / static_cast<int>(this->sector_size_.azimuthal));
+  }
+
+  // Whether the sector is owned by this process.
+  inline bool isOccupied(std::size_t sector) const noexcept {
+    return sector == this->sector_;
+  }
+
+  inline bool isVoxelOccupied(int radial, int polar,
+                              int azimuthal) const noexcept {
+    return this->isOccupied(this->sectorOfVoxel(radial, polar, azimuthal));
+  }
+
+  // The index into the field of sector() of its voxel (radial, polar,
+  // azimuthal).
+  inline std::size_t sectorVoxelIndex(int radial, int polar,
+                                      int azimuthal) const noexcept {
+    return (static_cast<std::size_t>(radial - this->radial_begin_) *
+                this->sector_size_.polar +
+            static_cast<std::size_t>(polar - this->polar_begin_)) *
+               this->sector_size_.azimuthal +
+           static_cast<std::size_t>(azimuthal - this->azimuthal_begin_);
+  }
+
+  // Copies the values of the voxels of sector() from field, which holds a
+  // value for each voxel of grid(), to sector_field, which must hold
+  // numSectorVoxels() values.
+  template <class Value>
+  void copySectorField(const Value *field, Value *sector_field) const noexcept {
+    const std::size_t num_polar = this->grid_.numPolarSections();
+    const std::size_t num_azimuthal = this->grid_.numAzimuthalSections();
+    for (std::size_t r = 0; r < this->sector_size_.radial; ++r) {
+      for (std::size_t p = 0; p < this->sector_size_.polar; ++p) {
+        const Value *const row =
+            field +
+            ((this->radial_begin_ - 1 + r) * num_polar + this->polar_begin_ +
+             p) * num_azimuthal +
+            this->azimuthal_begin_;
+        std::copy(row, row + this->sector_size_.azimuthal,
+                  sector_field + (r * this->sector_size_.polar + p) *
+                                     this->sector_size_.azimuthal);
+      }
+    }
+  }
+
+ private:
+  static inline bool isValidDecomposition(const SphericalVoxelGrid &grid,
+                                          const SectorCounts &counts,
+                                          std::size_t sector) noexcept {
+    return counts.radial != 0 && counts.polar != 0 && counts.azimuthal != 0 &&
+           grid.numRadialSections() % counts.radial == 0 &&
+           grid.numPolarSections() % counts.polar == 0 &&
+           grid.numAzimuthalSections() % counts.azimuthal == 0 &&
+           sector < counts.radial * counts.polar * counts.azimuthal;
+  }
+
+  const SphericalVoxelGrid &grid_;
+  const SectorCounts counts_;
+  const bool is_valid_;
+  const BrickSize sector_size_;
+  const SphericalVoxelGrid bricks_;
+  const std::size_t sector_;
+  const int radial_begin_;
+  const int polar_begin_;
+  const int azimuthal_begin_;
+};
+
+namespace internal {
+
+// The visitor of the voxels of a sector traversed for a ray, which composites
+// each run of contiguous voxels into its own RaySegment. Within a run, each
+// voxel is entered at the exit time of the one before it; a voxel entered at
+// any other time begins a new segment. Splitting a run in two would only
+// composite it in two steps, so the comparison may be exact.
+template <class Value, class TransferFunction>
+class SectorCompositor {
+ public:
+  SectorCompositor(const SectorDecomposition &decomposition,
+                   const Value *sector_field,
+                   TransferFunction &transfer_function, std::uint64_t ray,
+                   double opacity_threshold,
+                   std::vector<RaySegment> &segments) noexcept
+      : decomposition_(decomposition),
+        sector_field_(sector_field),
+        transfer_function_(transfer_function),
+        ray_(ray),
+        opacity_threshold_(opacity_threshold),
+        segments_(segments),
+        first_segment_(segments.size()) {}
+
+  // Composites the voxel, and returns false once the accumulated opacity of
+  // its segment reaches the threshold, behind which the remaining segments of
+  // the sector are occluded.
+  inline bool operator()(int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) {
+    if (this->segments_.size() == this->first_segment_ ||
+        this->segments_.back().exit_t != enter_t) {
+      this->segments_.push_back({.ray = this->ray_,
+                                 .enter_t = enter_t,
+                                 .exit_t = enter_t,
+                                 .integral = {.red = 0.0,
+                                              .green = 0.0,
+                                              .blue = 0.0,
+                                              .opacity = 0.0,
+                                              .num_voxels = 0}});
+    }
+    RaySegment &segment = this->segments_.back();
+    const TransferSample sample = this->transfer_function_(
+        this->sector_field_[this->decomposition_.sectorVoxelIndex(
+            radial, polar, azimuthal)]);
+    RayIntegral &integral = segment.integral;
+    const double weight =
+        (1.0 - integral.opacity) *
+        (1.0 - std::exp(-sample.extinction * (exit_t - enter_t)));
+    integral.red += weight * sample.red;
+    integral.green += weight * sample.green;
+    integral.blue += weight * sample.blue;
+    integral.opacity += weight;
+    ++integral.num_voxels;
+    segment.exit_t = exit_t;
+    return integral.opacity < this->opacity_threshold_;
+  }
+
+ private:
+  const SectorDecomposition &decomposition_;
+  const Value *const sector_field_;
+  TransferFunction &transfer_function_;
+  const std::uint64_t ray_;
+  const double opacity_threshold_;
+  std::vector<RaySegment> &segments_;
+  // The first segment of this ray within segments.
+  const std::size_t first_segment_;
+};
+
+// The number of rays that a worker integrates at a time.
+constexpr std::size_t SECTOR_RAYS_PER_CHUNK = 64;
+
+}  // namespace internal
+
+// Integrates the ray over the voxels of decomposition.sector(), and appends a
+// RaySegment for each run of voxels of the sector along the ray to segments.
+// sector_field holds the values of the voxels of the sector; see
+// SectorDecomposition. The voxels and times are those of
+// walkSphericalVolume(ray, grid, max_t, visitor) with an OccupancyGrid whose
+// only occupied brick is the sector. The traversal of the sector stops once
+// the opacity of a segment reaches opacity_threshold. The segments are labeled
+// with ray_index.
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+inline void integrateSphericalVolumeSegments(
+    const Ray &ray, std::uint64_t ray_index,
+    const SectorDecomposition &decomposition, const Value *sector_field,
+    TransferFunction &&transfer_function, double max_t,
+    std::vector<RaySegment> &segments, double opacity_threshold = 0.99) {
+  internal::SectorCompositor<Value, TransferFunction> compositor(
+      decomposition, sector_field, transfer_function, ray_index,
+      opacity_threshold, segments);
+  internal::OccupancyVisitor<
+      Engine, SectorDecomposition,
+      internal::SectorCompositor<Value, TransferFunction>>
+      sectors(ray, decomposition, max_t, compositor);
+  svr::walkSphericalVolume<Engine>(ray, decomposition.bricks(), max_t,
+                                   sectors);
+  sectors.finishRun();
+}
+
+// Similar to above for num_rays rays, where ray i is labeled i. The rays are
+// split across the workers of pool as with walkSphericalVolumeBatch(). The
+// segments are returned in no particular order.
+template <class Engine = DefaultEngine, class Value, class TransferFunction>
+std::vector<RaySegment> integrateSphericalVolumeSegments(
+    const Ray *rays, std::size_t num_rays,
+    const SectorDecomposition &decomposition, const Value *sector_field,
+    TransferFunction &&transfer_function, double max_t,
+    double opacity_threshold = 0.99, ThreadPool &pool = ThreadPool::global(),
+    std::size_t num_threads = 0) {
+  std::vector<std::vector<RaySegment>> worker_segments(pool.numThreads());
+  pool.parallelFor(
+      num_rays, internal::SECTOR_RAYS_PER_CHUNK,
+      [&](std::size_t begin, std::size_t end, std::size_t worker_id) {
+        for (std::size_t i = begin; i < end; ++i) {
+          integrateSphericalVolumeSegments<Engine>(
+              rays[i], i, decomposition, sector_field, transfer_function,
+              max_t, worker_segments[worker_id], opacity_threshold);
+        }
+      },
+      num_threads);
+  std::size_t num_segments = 0;
+  for (const std::vector<RaySegment> &segments : worker_segments) {
+    num_segments += segments.size();
+  }
+  std::vector<RaySegment> segments;
+  segments.reserve(num_segments);
+  for (const std::vector<RaySegment> &worker_segment : worker_segments) {
+    segments.insert(segments.end(), worker_segment.begin(),
+                    worker_segment.end());
+  }
+  return segments;
+}
+
+// Composites the segments of rays first_ray up to first_ray + num_rays front to
+// back, in the order in which each ray enters them, and writes the integral of
+// ray i to integrals[i - first_ray]. segments holds num_segments segments of
+// any sectors, which are sorted in place. Segments of other rays are ignored.
+// As with integrateSphericalVolume(), the segments behind those that bring the
+// opacity of a ray to opacity_threshold are not composited. Each segment
+// stopped at the threshold for its own opacity, so the integral differs from
+// that of the whole grid by no more than 1 - opacity_threshold in opacity; the
+// two are identical, up to rounding, for a threshold of 1.
+inline void compositeRaySegments(RaySegment *segments,
+                                 std::size_t num_segments,
+                                 std::uint64_t first_ray, std::size_t num_rays,
+                                 RayIntegral *integrals,
+                                 double opacity_threshold = 0.99) noexcept {
+  std::sort(segments, segments + num_segments,
+            [](const RaySegment &a, const RaySegment &b) {
+              return a.ray < b.ray || (a.ray == b.ray && a.enter_t < b.enter_t);
+            });
+  std::fill(integrals, integrals + num_rays,
+            RayIntegral{.red = 0.0,
+                        .green = 0.0,
+                        .blue = 0.0,
+                        .opacity = 0.0,
+                        .num_voxels = 0});
+  for (std::size_t i = 0; i < num_segments; ++i) {
+    const RaySegment &segment = segments[i];
+    if (segment.ray < first_ray || segment.ray - first_ray >= num_rays) {
+      continue;
+    }
+    RayIntegral &integral = integrals[segment.ray - first_ray];
+    if (integral.opacity >= opacity_threshold) continue;
+    const double transmittance = 1.0 - integral.opacity;
+    integral.red += transmittance * segment.integral.red;
+    integral.green += transmittance * segment.integral.green;
+    integral.blue += transmittance * segment.integral.blue;
+    integral.opacity += transmittance * segment.integral.opacity;
+    integral.num_voxels += segment.integral.num_voxels;
+  }
+}
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_SECTOR_DECOMPOSITION_H
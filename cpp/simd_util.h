@@ -0,0 +1,323 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_SIMD_UTIL_H
+#define SPHERICAL_VOLUME_RENDERING_SIMD_UTIL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "floating_point_comparison_util.h"
+
+// Thin wrappers over the vector registers used by the ray packet traversal.
+// See svr::walkSphericalVolumePacket(). With AVX-512, a register holds 8
+// doubles; with AVX (and thus AVX2), it holds 4. Otherwise, 4 doubles are
+// processed with scalar loops. Each operation is performed independently per
+// lane, and yields the same result as the corresponding scalar operation. Only
+// the operations required by the traversal are provided.
+
+namespace svr {
+
+namespace simd {
+
+#if defined(__AVX512F__)
+
+constexpr std::size_t NUM_LANES = 8;
+
+struct Doubles {
+  __m512d value;
+};
+
+// A bit mask of lanes, where bit i corresponds to lane i.
+struct Mask {
+  __mmask8 value;
+};
+
+inline Doubles load(const double *p) noexcept { return {_mm512_loadu_pd(p)}; }
+
+inline void store(double *p, Doubles a) noexcept {
+  _mm512_storeu_pd(p, a.value);
+}
+
+inline Doubles broadcast(double a) noexcept { return {_mm512_set1_pd(a)}; }
+
+inline Doubles operator+(Doubles a, Doubles b) noexcept {
+  return {_mm512_add_pd(a.value, b.value)};
+}
+
+inline Doubles operator-(Doubles a, Doubles b) noexcept {
+  return {_mm512_sub_pd(a.value, b.value)};
+}
+
+inline Doubles operator*(Doubles a, Doubles b) noexcept {
+  return {_mm512_mul_pd(a.value, b.value)};
+}
+
+inline Doubles operator/(Doubles a, Doubles b) noexcept {
+  return {_mm512_div_pd(a.value, b.value)};
+}
+
+inline Doubles sqrt(Doubles a) noexcept { return {_mm512_sqrt_pd(a.value)}; }
+
+inline Doubles abs(Doubles a) noexcept { return {_mm512_abs_pd(a.value)}; }
+
+inline Doubles max(Doubles a, Doubles b) noexcept {
+  return {_mm512_max_pd(a.value, b.value)};
+}
+
+inline Mask operator<(Doubles a, Doubles b) noexcept {
+  return {_mm512_cmp_pd_mask(a.value, b.value, _CMP_LT_OQ)};
+}
+
+inline Mask operator<=(Doubles a, Doubles b) noexcept {
+  return {_mm512_cmp_pd_mask(a.value, b.value, _CMP_LE_OQ)};
+}
+
+inline Mask operator==(Doubles a, Doubles b) noexcept {
+  return {_mm512_cmp_pd_mask(a.value, b.value, _CMP_EQ_OQ)};
+}
+
+inline Mask operator&(Mask a, Mask b) noexcept {
+  return {static_cast<__mmask8>(a.value & b.value)};
+}
+
+inline Mask operator|(Mask a, Mask b) noexcept {
+  return {static_cast<__mmask8>(a.value | b.value)};
+}
+
+inline Mask operator~(Mask a) noexcept {
+  return {static_cast<__mmask8>(~a.value)};
+}
+
+// Returns a in the lanes of mask, and b otherwise.
+inline Doubles select(Mask mask, Doubles a, Doubles b) noexcept {
+  return {_mm512_mask_blend_pd(mask.value, b.value, a.value)};
+}
+
+inline unsigned bits(Mask mask) noexcept { return mask.value; }
+
+#elif defined(__AVX__)
+
+constexpr std::size_t NUM_LANES = 4;
+
+struct Doubles {
+  __m256d value;
+};
+
+// A mask of lanes, where each lane is either all ones or all zeros.
+struct Mask {
+  __m256d value;
+};
+
+inline Doubles load(const double *p) noexcept { return {_mm256_loadu_pd(p)}; }
+
+inline void store(double *p, Doubles a) noexcept {
+  _mm256_storeu_pd(p, a.value);
+}
+
+inline Doubles broadcast(double a) noexcept { return {_mm256_set1_pd(a)}; }
+
+inline Doubles operator+(Doubles a, Doubles b) noexcept {
+  return {_mm256_add_pd(a.value, b.value)};
+}
+
+inline Doubles operator-(Doubles a, Doubles b) noexcept {
+  return {_mm256_sub_pd(a.value, b.value)};
+}
+
+inline Doubles operator*(Doubles a, Doubles b) noexcept {
+  return {_mm256_mul_pd(a.value, b.value)};
+}
+
+inline Doubles operator/(Doubles a, Doubles b) noexcept {
+  return {_mm256_div_pd(a.value, b.value)};
+}
+
+inline Doubles sqrt(Doubles a) noexcept { return {_mm256_sqrt_pd(a.value)}; }
+
+inline Doubles abs(Doubles a) noexcept {
+  return {_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.value)};
+}
+
+inline Doubles max(Doubles a, Doubles b) noexcept {
+  return {_mm256_max_pd(a.value, b.value)};
+}
+
+inline Mask operator<(Doubles a, Doubles b) noexcept {
+  return {_mm256_cmp_pd(a.value, b.value, _CMP_LT_OQ)};
+}
+
+inline Mask operator<=(Doubles a, Doubles b) noexcept {
+  return {_mm256_cmp_pd(a.value, b.value, _CMP_LE_OQ)};
+}
+
+inline Mask operator==(Doubles a, Doubles b) noexcept {
+  return {_mm256_cmp_pd(a.value, b.value, _CMP_EQ_OQ)};
+}
+
+inline Mask operator&(Mask a, Mask b) noexcept {
+  return {_mm256_and_pd(a.value, b.value)};
+}
+
+inline Mask operator|(Mask a, Mask b) noexcept {
+  return {_mm256_or_pd(a.value, b.value)};
+}
+
+inline Mask operator~(Mask a) noexcept {
+  return {_mm256_xor_pd(a.value, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)))};
+}
+
+// Returns a in the lanes of mask, and b otherwise.
+inline Doubles select(Mask mask, Doubles a, Doubles b) noexcept {
+  return {_mm256_blendv_pd(b.value, a.value, mask.value)};
+}
+
+inline unsigned bits(Mask mask) noexcept {
+  return static_cast<unsigned>(_mm256_movemask_pd(mask.value));
+}
+
+#else
+
+constexpr std::size_t NUM_LANES = 4;
+
+struct Doubles {
+  double value[NUM_LANES];
+};
+
+// A bit mask of lanes, where bit i corresponds to lane i.
+struct Mask {
+  unsigned value;
+};
+
+inline Doubles load(const double *p) noexcept {
+  Doubles a;
+  std::copy(p, p + NUM_LANES, a.value);
+  return a;
+}
+
+inline void store(double *p, Doubles a) noexcept {
+  std::copy(a.value, a.value + NUM_LANES, p);
+}
+
+inline Doubles broadcast(double a) noexcept {
+  Doubles b;
+  std::fill(b.value, b.value + NUM_LANES, a);
+  return b;
+}
+
+// Applies the scalar function f to each lane of a and b.
+template <class Function>
+inline Doubles apply(Doubles a, Doubles b, Function f) noexcept {
+  for (std::size_t i = 0; i < NUM_LANES; ++i) {
+    a.value[i] = f(a.value[i], b.value[i]);
+  }
+  return a;
+}
+
+// Compares each lane of a and b with the scalar function f.
+template <class Function>
+inline Mask compare(Doubles a, Doubles b, Function f) noexcept {
+  Mask mask = {0};
+  for (std::size_t i = 0; i < NUM_LANES; ++i) {
+    mask.value |= static_cast<unsigned>(f(a.value[i], b.value[i])) << i;
+  }
+  return mask;
+}
+
+inline Doubles operator+(Doubles a, Doubles b) noexcept {
+  return apply(a, b, [](double x, double y) { return x + y; });
+}
+
+inline Doubles operator-(Doubles a, Doubles b) noexcept {
+  return apply(a, b, [](double x, double y) { return x - y; });
+}
+
+inline Doubles operator*(Doubles a, Doubles b) noexcept {
+  return apply(a, b, [](double x, double y) { return x * y; });
+}
+
+inline Doubles operator/(Doubles a, Doubles b) noexcept {
+  return apply(a, b, [](double x, double y) { return x / y; });
+}
+
+inline Doubles sqrt(Doubles a) noexcept {
+  return apply(a, a, [](double x, double) { return std::sqrt(x); });
+}
+
+inline Doubles abs(Doubles a) noexcept {
+  return apply(a, a, [](double x, double) { return std::abs(x); });
+}
+
+inline Doubles max(Doubles a, Doubles b) noexcept {
+  return apply(a, b, [](double x, double y) { return std::max(x, y); });
+}
+
+inline Mask operator<(Doubles a, Doubles b) noexcept {
+  return compare(a, b, [](double x, double y) { return x < y; });
+}
+
+inline Mask operator<=(Doubles a, Doubles b) noexcept {
+  return compare(a, b, [](double x, double y) { return x <= y; });
+}
+
+inline Mask operator==(Doubles a, Doubles b) noexcept {
+  return compare(a, b, [](double x, double y) { return x == y; });
+}
+
+inline Mask operator&(Mask a, Mask b) noexcept { return {a.value & b.value}; }
+
+inline Mask operator|(Mask a, Mask b) noexcept { return {a.value | b.value}; }
+
+inline Mask operator~(Mask a) noexcept {
+  return {~a.value & ((1u << NUM_LANES) - 1)};
+}
+
+// Returns a in the lanes of mask, and b otherwise.
+inline Doubles select(Mask mask, Doubles a, Doubles b) noexcept {
+  for (std::size_t i = 0; i < NUM_LANES; ++i) {
+    if (!((mask.value >> i) & 1u)) a.value[i] = b.value[i];
+  }
+  return a;
+}
+
+inline unsigned bits(Mask mask) noexcept { return mask.value; }
+
+#endif
+
+// Returns true if lane i of the mask is set.
+inline bool lane(Mask mask, std::size_t i) noexcept {
+  return (bits(mask) >> i) & 1u;
+}
+
+// Per lane, equivalent to svr::isEqual().
+inline Mask isEqual(Doubles a, Doubles b) noexcept {
+  const Doubles diff = simd::abs(a - b);
+  return (diff <= broadcast(ABS_EPSILON)) |
+         (diff <= simd::max(simd::abs(a), simd::abs(b)) *
+                      broadcast(REL_EPSILON));
+}
+
+// Per lane, equivalent to svr::isEqual(a, 0.0) for finite a. Since the
+// relative comparison with zero only holds for zero itself, this reduces to
+// the absolute comparison.
+inline Mask isZero(Doubles a) noexcept {
+  return simd::abs(a) <= broadcast(ABS_EPSILON);
+}
+
+// Per lane, equivalent to svr::lessThan(a, 0.0) for finite a.
+inline Mask lessThanZero(Doubles a) noexcept {
+  return a < broadcast(-ABS_EPSILON);
+}
+
+// Per lane, equivalent to svr::lessThan().
+inline Mask lessThan(Doubles a, Doubles b) noexcept {
+  return (a < b) & ~isEqual(a, b);
+}
+
+}  // namespace simd
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_SIMD_UTIL_H
@@ -0,0 +1,1273 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_INTERNAL_H
+#define SPHERICAL_VOLUME_RENDERING_INTERNAL_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "floating_point_comparison_util.h"
+#include "host_device.h"
+#include "ray.h"
+#include "spherical_voxel_grid.h"
+#include "traversal_statistics.h"
+#include "vec3.h"
+
+// The implementation of the spherical coordinate voxel traversal algorithm.
+// This lives in a header so that the traversal may be inlined with the visitor
+// given to svr::walkSphericalVolume(). Users should include
+// spherical_volume_rendering_util.h rather than this file.
+
+namespace svr {
+
+namespace internal {
+constexpr double DOUBLE_MAX = std::numeric_limits<double>::max();
+
+// Prevents T from being deduced from a function parameter of type
+// NonDeduced<T>::type. This allows, for example, a double max_t to be given to
+// a single precision traversal, where T is deduced from the ray and grid.
+template <class T>
+struct NonDeduced {
+  using type = T;
+};
+
+// The type corresponding to the voxel(s) with the minimum tMax value for a
+// given traversal.
+enum VoxelIntersectionType {
+  Radial = 1,
+  Polar = 2,
+  Azimuthal = 3,
+  RadialPolar = 4,
+  RadialAzimuthal = 5,
+  PolarAzimuthal = 6,
+  RadialPolarAzimuthal = 7
+};
+
+// The parameters of the next hit of a ray with a radial, polar, or azimuthal
+// voxel boundary.
+template <class T>
+struct HitParameters {
+  // The time at which a hit occurs for the ray at the next point of
+  // intersection with a section.
+  T tMax;
+
+  // The voxel traversal value of a radial step: 0, +1, -1. This is added to the
+  // current voxel.
+  int tStep;
+};
+
+// The points of intersection between the angular voxel boundaries and the
+// circle of maximum radius, i.e. the points P1 and P2 of each of the packed
+// boundaries SphericalVoxelGrid::polarBoundary() or
+// SphericalVoxelGrid::azimuthalBoundary(). P_max points to the first of
+// num_segments boundaries, so that the points may be read from either a grid or
+// a grid view.
+template <class T>
+struct MaxRadiusBoundarySegments {
+  const BasicAngularBoundary<T> *P_max;
+  std::size_t num_segments;
+
+  SVR_HOST_DEVICE inline std::size_t size() const noexcept {
+    return num_segments;
+  }
+
+  SVR_HOST_DEVICE inline BasicLineSegment<T> operator[](
+      std::size_t i) const noexcept {
+    return {.P1 = P_max[i].P1, .P2 = P_max[i].P2};
+  }
+};
+
+// The maximum radius boundary segments of the polar and azimuthal voxels of the
+// grid.
+template <class Grid>
+SVR_HOST_DEVICE inline MaxRadiusBoundarySegments<typename Grid::value_type>
+polarMaxRadiusSegments(const Grid &grid) noexcept {
+  return {&grid.polarBoundary(0), grid.numPolarSections() + 1};
+}
+
+template <class Grid>
+SVR_HOST_DEVICE inline MaxRadiusBoundarySegments<typename Grid::value_type>
+azimuthalMaxRadiusSegments(const Grid &grid) noexcept {
+  return {&grid.azimuthalBoundary(0), grid.numAzimuthalSections() + 1};
+}
+
+// The points of intersection between the angular voxel boundaries and the
+// circle of the given radius. Rather than calculating every boundary upon ray
+// setup, each is computed on demand from the grid's trigonometric values. For
+// polar voxels, center_2 is the Y-component of the sphere center; for
+// azimuthal voxels, it is the Z-component. The calculations used are:
+// P1 = radius * trig_value.cosine + sphere_center.x()
+// P2 = radius * trig_value.sine + center_2
+template <class T>
+struct RadiusBoundarySegments {
+  const BasicTrigonometricValues<T> *trig_values;
+  std::size_t num_values;
+  T radius;
+  T center_1;
+  T center_2;
+
+  SVR_HOST_DEVICE inline std::size_t size() const noexcept {
+    return num_values;
+  }
+
+  SVR_HOST_DEVICE inline BasicLineSegment<T> operator[](
+      std::size_t i) const noexcept {
+    return {.P1 = radius * trig_values[i].cosine + center_1,
+            .P2 = radius * trig_values[i].sine + center_2};
+  }
+};
+
+// A point will lie between two polar voxel boundaries iff the angle between it
+// and the polar boundary intersection points along the circle of max radius is
+// obtuse. Equality represents the case when the point lies on a polar
+// boundary. This is similar for azimuthal boundaries. Since both cases use
+// points in a plane (XY for polar, XZ for azimuthal), this can be generalized
+// to a single function. Returns true if the point (p1, p2) lies within the
+// angular voxel i, i.e. between boundaries i and i + 1. BoundarySegments is
+// either MaxRadiusBoundarySegments or RadiusBoundarySegments.
+template <class T, class BoundarySegments>
+SVR_HOST_DEVICE inline bool pointLiesWithinAngularVoxel(
+    const BoundarySegments &angular_max, std::size_t i, T p1, T p2) noexcept {
+  const BasicLineSegment<T> P_i = angular_max[i];
+  const BasicLineSegment<T> P_j = angular_max[i + 1];
+  const T X_diff = P_i.P1 - P_j.P1;
+  const T Y_diff = P_i.P2 - P_j.P2;
+  const T X_p1_diff = P_i.P1 - p1;
+  const T X_p2_diff = P_i.P2 - p2;
+  const T Y_p1_diff = P_j.P1 - p1;
+  const T Y_p2_diff = P_j.P2 - p2;
+  const T d1d2 = (X_p1_diff * X_p1_diff) + (X_p2_diff * X_p2_diff) +
+                      (Y_p1_diff * Y_p1_diff) + (Y_p2_diff * Y_p2_diff);
+  const T d3 = (X_diff * X_diff) + (Y_diff * Y_diff);
+  return d1d2 < d3 || svr::isEqual(d1d2, d3);
+}
+
+// Returns the first angular voxel that contains the point (p1, p2), or
+// angular_max.size() + 1 if no voxel contains the point. This tests each
+// voxel in order, and is therefore linear in the number of sections.
+template <class T, class BoundarySegments>
+SVR_HOST_DEVICE inline int calculateAngularVoxelIDFromPoints(
+    const BoundarySegments &angular_max, const T p1, T p2) noexcept {
+  for (std::size_t i = 0; i + 1 < angular_max.size(); ++i) {
+    if (pointLiesWithinAngularVoxel(angular_max, i, p1, p2)) return i;
+  }
+  return angular_max.size() + 1;
+}
+
+// The maximum number of angular sections for which the angular voxel ID is
+// found with a linear search. With more sections, each voxel spans at most
+// 2pi / 8 radians, so a point may only lie within the voxel containing its
+// angle or, when it lies on a boundary, an adjacent voxel.
+constexpr std::size_t MAX_LINEAR_SEARCH_SECTIONS = 8;
+
+// Similar to calculateAngularVoxelIDFromPoints(), and returns the same voxel
+// ID, but runs in constant time. Here, the point (p1, p2) lies on the circle of
+// the radius used for angular_max, and theta is the angle of the point about
+// the sphere center, as given by std::atan2(). The candidate voxel is found by
+// dividing the angle from min_bound by delta, the angular size of each voxel.
+// Since the point may lie on or within floating point error of a boundary, the
+// candidate's neighbours are tested as well, along with the first and last
+// voxels in the case that the angle wraps around 2pi. As above, the lowest
+// voxel containing the point is returned. A voxel of pi radians or more
+// contains every point of the circle by the test of
+// pointLiesWithinAngularVoxel(), so the voxel of such sections is given by the
+// angle alone.
+template <class T, class BoundarySegments>
+SVR_HOST_DEVICE inline int findAngularVoxelID(
+    const BoundarySegments &angular_max, T p1, T p2, T theta, T min_bound,
+    T delta) noexcept {
+  const std::size_t num_sections = angular_max.size() - 1;
+  T angle = theta - min_bound;
+  angle -= T(TAU) * std::floor(angle / T(TAU));
+  if (delta >= T(M_PI)) {
+    const std::size_t voxel = static_cast<std::size_t>(angle / delta);
+    return voxel < num_sections ? voxel : angular_max.size() + 1;
+  }
+  if (num_sections <= MAX_LINEAR_SEARCH_SECTIONS) {
+    return calculateAngularVoxelIDFromPoints(angular_max, p1, p2);
+  }
+  const std::size_t candidate =
+      std::min(static_cast<std::size_t>(angle / delta), num_sections);
+  if (pointLiesWithinAngularVoxel(angular_max, 0, p1, p2)) return 0;
+  const std::size_t first = std::max<std::size_t>(candidate, 2) - 1;
+  const std::size_t last = std::min(candidate + 1, num_sections - 1);
+  for (std::size_t i = first; i <= last; ++i) {
+    if (pointLiesWithinAngularVoxel(angular_max, i, p1, p2)) return i;
+  }
+  if (last < num_sections - 1 &&
+      pointLiesWithinAngularVoxel(angular_max, num_sections - 1, p1, p2)) {
+    return num_sections - 1;
+  }
+  return angular_max.size() + 1;
+}
+
+// Returns true if voxel is the angular voxel that findAngularVoxelID() returns
+// for the point (p1, p2), i.e. the lowest voxel that contains it. A point lies
+// within at most its own voxel and, when it lies on a boundary, an adjacent
+// one, so the only lower voxels that may also contain it are voxel - 1 and, if
+// the voxels wrap around 2pi, voxel 0.
+template <class T, class BoundarySegments>
+SVR_HOST_DEVICE inline bool isAngularVoxelOfPoint(
+    const BoundarySegments &angular_max, std::size_t voxel, T p1,
+    T p2) noexcept {
+  return pointLiesWithinAngularVoxel(angular_max, voxel, p1, p2) &&
+         (voxel == 0 ||
+          (!pointLiesWithinAngularVoxel(angular_max, voxel - 1, p1, p2) &&
+           !pointLiesWithinAngularVoxel(angular_max, 0, p1, p2)));
+}
+
+// The angular voxel ID hint given to initializeAngularVoxelID() when there is
+// no hint.
+constexpr int NO_ANGULAR_HINT = -1;
+
+// Returns the angular voxel ID that findAngularVoxelID() returns for the point
+// (p1, p2) if it is hint or one of its neighbours, or NO_ANGULAR_HINT
+// otherwise. A correct hint is thus confirmed with at most three tests of
+// pointLiesWithinAngularVoxel(), rather than the std::atan2() and the search of
+// findAngularVoxelID(), and a hint that is off by one voxel, e.g. that of a
+// nearby ray, is corrected locally. Voxels of pi radians or more are found by
+// their angle alone rather than these tests, so are given no hint.
+template <class T, class BoundarySegments>
+SVR_HOST_DEVICE inline int angularVoxelIDFromHint(
+    const BoundarySegments &angular_max, int hint, T p1, T p2,
+    T delta) noexcept {
+  if (hint == NO_ANGULAR_HINT || delta >= T(M_PI)) return NO_ANGULAR_HINT;
+  const std::size_t num_sections = angular_max.size() - 1;
+  // A voxel below 0 wraps around to beyond num_sections.
+  const std::size_t hinted_voxel = static_cast<std::size_t>(hint);
+  const std::size_t candidates[] = {hinted_voxel, hinted_voxel + 1,
+                                    hinted_voxel - 1};
+  for (const std::size_t voxel : candidates) {
+    if (voxel < num_sections &&
+        isAngularVoxelOfPoint(angular_max, voxel, p1, p2)) {
+      countStatistic(NUM_ENTRY_HINTS);
+      return static_cast<int>(voxel);
+    }
+  }
+  return NO_ANGULAR_HINT;
+}
+
+// Initializes an angular voxel ID. For polar initialization, *_2 represents
+// the y-plane. For azimuthal initialization, it represents the z-plane. If the
+// number of sections is 1 or the squared euclidean distance of the ray_sphere
+// vector in the given plane is zero, the voxel ID is set to 0. Otherwise, we
+// find the traversal point of the ray and the sphere center with the projected
+// circle given by the entry_radius. angular_max holds the boundary points
+// along this circle. min_bound and delta are the minimum bound and angular
+// size of the voxels respectively. hint is tested first; see
+// angularVoxelIDFromHint().
+template <class T, class Grid, class BoundarySegments>
+SVR_HOST_DEVICE inline int initializeAngularVoxelID(
+    const Grid &grid, std::size_t number_of_sections,
+    const BasicFreeVec3<T> &ray_sphere, const BoundarySegments &angular_max,
+    T ray_sphere_2, T grid_sphere_2, T entry_radius, T min_bound, T delta,
+    int hint = NO_ANGULAR_HINT) noexcept {
+  if (number_of_sections == 1) return 0;
+  const T SED =
+      ray_sphere.x() * ray_sphere.x() + ray_sphere_2 * ray_sphere_2;
+  if (SED == T(0)) return 0;
+  const T r = entry_radius / std::sqrt(SED);
+  const T p1 = grid.sphereCenter().x() - ray_sphere.x() * r;
+  const T p2 = grid_sphere_2 - ray_sphere_2 * r;
+  const int hinted_voxel =
+      angularVoxelIDFromHint(angular_max, hint, p1, p2, delta);
+  if (hinted_voxel != NO_ANGULAR_HINT) return hinted_voxel;
+  return findAngularVoxelID(angular_max, p1, p2,
+                            std::atan2(-ray_sphere_2, -ray_sphere.x()),
+                            min_bound, delta);
+}
+
+// Initializes the polar and azimuthal voxel IDs of the ray's entrance voxel.
+// See initializeAngularVoxelID(). If the ray origin is outside the grid, the
+// entrance radius is the maximum radius, and the grid's precomputed boundary
+// points are used. Otherwise, the boundary points along the circle of the
+// entrance radius are computed on demand. polar_hint and azimuthal_hint are
+// the hints of initializeAngularVoxelID().
+template <class T, class Grid>
+SVR_HOST_DEVICE inline void initializeAngularVoxelIDs(
+    const Grid &grid, const BasicFreeVec3<T> &ray_sphere,
+    bool ray_origin_is_outside_grid, T entry_radius, int polar_hint,
+    int azimuthal_hint, int &polar_voxel, int &azimuthal_voxel) noexcept {
+  if (ray_origin_is_outside_grid) {
+    polar_voxel = initializeAngularVoxelID(
+        grid, grid.numPolarSections(), ray_sphere,
+        polarMaxRadiusSegments(grid), ray_sphere.y(),
+        grid.sphereCenter().y(), entry_radius, grid.sphereMinBoundPolar(),
+        grid.deltaTheta(), polar_hint);
+    azimuthal_voxel = initializeAngularVoxelID(
+        grid, grid.numAzimuthalSections(), ray_sphere,
+        azimuthalMaxRadiusSegments(grid), ray_sphere.z(),
+        grid.sphereCenter().z(), entry_radius, grid.sphereMinBoundAzi(),
+        grid.deltaPhi(), azimuthal_hint);
+    return;
+  }
+  polar_voxel = initializeAngularVoxelID(
+      grid, grid.numPolarSections(), ray_sphere,
+      RadiusBoundarySegments<T>{&grid.polarTrigValue(0),
+                                grid.numPolarSections() + 1, entry_radius,
+                                grid.sphereCenter().x(),
+                                grid.sphereCenter().y()},
+      ray_sphere.y(), grid.sphereCenter().y(), entry_radius,
+      grid.sphereMinBoundPolar(), grid.deltaTheta(), polar_hint);
+  azimuthal_voxel = initializeAngularVoxelID(
+      grid, grid.numAzimuthalSections(), ray_sphere,
+      RadiusBoundarySegments<T>{&grid.azimuthalTrigValue(0),
+                                grid.numAzimuthalSections() + 1, entry_radius,
+                                grid.sphereCenter().x(),
+                                grid.sphereCenter().z()},
+      ray_sphere.z(), grid.sphereCenter().z(), entry_radius,
+      grid.sphereMinBoundAzi(), grid.deltaPhi(), azimuthal_hint);
+}
+
+// Returns true if the "step" taken from the current voxel ID remains in the
+// grid bounds, i.e. the next voxel ID is within [0, num_sections). A dimension
+// that spans the entire circle is always in bounds, since its voxel IDs wrap
+// around.
+template <class T>
+SVR_HOST_DEVICE inline bool inAngularBounds(int step, int voxel,
+                                            std::size_t num_sections,
+                                            T min_bound, T max_bound) noexcept {
+  const int next = voxel + step;
+  return (next >= 0 && next < static_cast<int>(num_sections)) ||
+         svr::isEqual(max_bound - min_bound, T(TAU));
+}
+
+template <class Grid>
+SVR_HOST_DEVICE inline bool inBoundsAzimuthal(const Grid &grid, const int step,
+                                              const int azi_voxel) noexcept {
+  return inAngularBounds(step, azi_voxel, grid.numAzimuthalSections(),
+                         grid.sphereMinBoundAzi(), grid.sphereMaxBoundAzi());
+}
+
+template <class Grid>
+SVR_HOST_DEVICE inline bool inBoundsPolar(const Grid &grid, const int step,
+                                          const int pol_voxel) noexcept {
+  return inAngularBounds(step, pol_voxel, grid.numPolarSections(),
+                         grid.sphereMinBoundPolar(),
+                         grid.sphereMaxBoundPolar());
+}
+
+// The traversal policy for a grid that spans the entire sphere. Every polar and
+// azimuthal step remains within the grid bounds, so no bounds are checked, and
+// the voxel ID wraps around with a single comparison. Since a step never
+// exceeds the number of sections, this is equivalent to a modulo.
+struct FullSphere {
+  template <class Grid>
+  SVR_HOST_DEVICE static constexpr bool inBoundsPolar(const Grid &, int,
+                                                      int) noexcept {
+    return true;
+  }
+
+  template <class Grid>
+  SVR_HOST_DEVICE static constexpr bool inBoundsAzimuthal(const Grid &, int,
+                                                          int) noexcept {
+    return true;
+  }
+
+  SVR_HOST_DEVICE static inline int step(int voxel, int step,
+                                         std::size_t num_sections) noexcept {
+    const int next = voxel + step;
+    const int n = static_cast<int>(num_sections);
+    return next < 0 ? next + n : next >= n ? next - n : next;
+  }
+};
+
+// The traversal policy for a grid that spans a sector of the sphere. Each
+// polar and azimuthal step is checked against the grid bounds.
+struct Sectored {
+  template <class Grid>
+  SVR_HOST_DEVICE static inline bool inBoundsPolar(const Grid &grid, int step,
+                                                   int pol_voxel) noexcept {
+    return internal::inBoundsPolar(grid, step, pol_voxel);
+  }
+
+  template <class Grid>
+  SVR_HOST_DEVICE static inline bool inBoundsAzimuthal(const Grid &grid,
+                                                       int step,
+                                                       int azi_voxel) noexcept {
+    return internal::inBoundsAzimuthal(grid, step, azi_voxel);
+  }
+
+  SVR_HOST_DEVICE static inline int step(int voxel, int step,
+                                         std::size_t num_sections) noexcept {
+    return FullSphere::step(voxel, step, num_sections);
+  }
+};
+
+// The times at which a ray crosses the radial voxel boundaries, i.e. the
+// spheres of radius sqrt(grid.deltaRadiiSquared(i)), which give the radial hits
+// of the traversal. To determine line-sphere intersection, this follows closely
+// the mathematics presented in:
+// http://cas.xav.free.fr/Graphics%20Gems%204%20-%20Paul%20S.%20Heckbert.pdf
+// Since the spheres are concentric, the ray enters the spheres
+// i = r, r + 1, ..., m in order, where r is the radial voxel in which the
+// traversal begins and m is the innermost sphere that the ray passes through.
+// It then exits the spheres i = m, m - 1, ..., 0. Crossing j of this sequence
+// is with sphere min(j, 2m + 1 - j); it is an entrance if j <= m, and an exit
+// otherwise. Each crossing is calculated once, after the radial step
+// that precedes it, rather than upon every step of the traversal. A sphere
+// that the ray is tangent to is not considered crossed.
+//
+// A visual demonstration of the radial hits can be found here:
+// https://github.com/spherical-volume-rendering/svr-algorithm/pull/169
+template <class T>
+class RadialCrossings {
+ public:
+  // The crossings of no ray, e.g. of an inactive lane of a ray packet. These
+  // must be assigned before use.
+  RadialCrossings() noexcept = default;
+
+  // Begins with the next crossing of a ray in current_radial_voxel. If
+  // radial_step_has_transitioned, the ray only exits spheres from then on.
+  // See TraversalState for v and rsvd_minus_v_squared.
+  template <class Grid>
+  SVR_HOST_DEVICE inline RadialCrossings(const BasicRay<T> &ray,
+                                         const Grid &grid,
+                                         int current_radial_voxel,
+                                         bool radial_step_has_transitioned, T v,
+                                         T rsvd_minus_v_squared) noexcept
+      : v_(v),
+        rsvd_minus_v_squared_(rsvd_minus_v_squared),
+        j_(current_radial_voxel),
+        innermost_(current_radial_voxel - 1) {
+    if (!radial_step_has_transitioned) {
+      const int max_innermost = static_cast<int>(grid.numRadialSections()) - 1;
+      while (innermost_ < max_innermost &&
+             !(grid.deltaRadiiSquared(innermost_ + 1) <
+               rsvd_minus_v_squared)) {
+        ++innermost_;
+      }
+      // The innermost sphere is not crossed if the ray is tangent to it.
+      innermost_ -= innermost_ >= current_radial_voxel &&
+                    grid.deltaRadiiSquared(innermost_) == rsvd_minus_v_squared;
+    }
+    this->calculateCrossing(ray, grid);
+  }
+
+  // Returns the radial hit of the next crossing, given the time at which the
+  // traversal ends.
+  SVR_HOST_DEVICE inline HitParameters<T> hit(T max_t) const noexcept {
+    if (this->t_crossing_ < max_t) {
+      return {.tMax = this->t_crossing_, .tStep = this->step_};
+    }
+    return {.tMax = std::numeric_limits<T>::max(), .tStep = 0};
+  }
+
+  // Proceeds to the next crossing. This is called once the radial step of the
+  // current crossing is taken.
+  template <class Grid>
+  SVR_HOST_DEVICE inline void advance(const BasicRay<T> &ray,
+                                      const Grid &grid) noexcept {
+    ++this->j_;
+    this->calculateCrossing(ray, grid);
+  }
+
+ private:
+  template <class Grid>
+  SVR_HOST_DEVICE inline void calculateCrossing(const BasicRay<T> &ray,
+                                                const Grid &grid) noexcept {
+    const bool is_exit = this->j_ > this->innermost_;
+    const int sphere = is_exit ? 2 * this->innermost_ + 1 - this->j_ : this->j_;
+    const T d = std::sqrt(grid.deltaRadiiSquared(sphere) -
+                          this->rsvd_minus_v_squared_);
+    this->t_crossing_ = ray.timeOfIntersectionAt(is_exit ? this->v_ + d
+                                                         : this->v_ - d);
+    this->step_ = is_exit ? -1 : 1;
+  }
+
+  // See TraversalState.
+  T v_;
+  T rsvd_minus_v_squared_;
+
+  // The position of the next crossing in the sequence, and the innermost
+  // sphere, m, that the ray passes through.
+  int j_;
+  int innermost_;
+
+  // The time and radial step of the next crossing.
+  T t_crossing_;
+  int step_;
+};
+
+// The perpendicular products used to intersect a ray segment with an angular
+// voxel boundary, where u is the vector from the sphere center to the
+// boundary, v is the ray segment, and w is the vector from the beginning of the
+// ray segment to the boundary point.
+template <class T>
+struct PerpProducts {
+  T uv;
+  T uw;
+  T vw;
+};
+
+// Calculates the perpendicular products for the angular voxel boundary
+// (bound_1, bound_2) in a 2-d plane (XY for polar, XZ for azimuthal), where
+// (center_to_bound_1, center_to_bound_2) is the vector from the sphere center
+// to the boundary, (P1_1, P1_2) is the beginning of the ray segment, and
+// (V_1, V_2) is the ray segment's vector.
+template <class T>
+SVR_HOST_DEVICE inline PerpProducts<T> perpProducts(T bound_1, T bound_2,
+                                                    T center_to_bound_1,
+                                                    T center_to_bound_2, T P1_1,
+                                                    T P1_2, T V_1,
+                                                    T V_2) noexcept {
+  const T w_1 = bound_1 - P1_1;
+  const T w_2 = bound_2 - P1_2;
+  return {.uv = center_to_bound_1 * V_2 - center_to_bound_2 * V_1,
+          .uw = center_to_bound_1 * w_2 - center_to_bound_2 * w_1,
+          .vw = V_1 * w_2 - V_2 * w_1};
+}
+
+// The intersection of a ray segment with an angular voxel boundary.
+template <class T>
+struct BoundaryIntersection {
+  // The time of intersection if is_intersect is true. Otherwise, the
+  // collinear time if is_collinear is true, and 0.0 if not.
+  T t;
+  bool is_intersect;
+  bool is_collinear;
+};
+
+// Intersects the ray segment with an angular voxel boundary given their
+// perpendicular products. The calculations presented below follow closely the
+// works of [Foley et al, 1996], [O'Rourke, 1998]. Reference:
+// http://geomalgorithms.com/a05-_intersect-1.html#intersect2D_2Segments()
+// collinear_time is the time used in the case that the ray segment is
+// collinear with the boundary. The values are compared with Comparison, e.g.
+// RobustComparison.
+template <class Comparison = RobustComparison, class T>
+SVR_HOST_DEVICE inline BoundaryIntersection<T> boundaryIntersection(
+    const PerpProducts<T> &perp, const BasicRaySegment<T> &ray_segment,
+    const BasicRay<T> &ray, T collinear_time) noexcept {
+  const bool is_parallel = Comparison::isZero(perp.uv);
+  const bool is_collinear = is_parallel && Comparison::isZero(perp.uw) &&
+                            Comparison::isZero(perp.vw);
+  if (!is_parallel) {
+    const T inv_perp_uv = T(1) / perp.uv;
+    const T a = perp.vw * inv_perp_uv;
+    const T b = perp.uw * inv_perp_uv;
+    if (!((Comparison::lessThanZero(a) || Comparison::lessThan(T(1), a)) ||
+          Comparison::lessThanZero(b) || Comparison::lessThan(T(1), b))) {
+      return {.t = ray_segment.intersectionTimeAt(b, ray),
+              .is_intersect = true,
+              .is_collinear = false};
+    }
+  }
+  return {.t = is_collinear ? collinear_time : T(0),
+          .is_intersect = false,
+          .is_collinear = is_collinear};
+}
+
+// A generalized version of the latter half of the polar and azimuthal hit
+// parameters. Since the only difference is the 2-d plane for which they exist
+// in, this portion can be generalized to a single function. min and max are
+// the intersections of the ray segment with the current voxel's minimum and
+// maximum boundaries. The times are compared with Comparison.
+template <class Comparison = RobustComparison, class T, class Grid>
+SVR_HOST_DEVICE inline HitParameters<T> angularHit(
+    const Grid &grid, const BasicRay<T> &ray,
+    const BoundaryIntersection<T> &min, const BoundaryIntersection<T> &max, T t,
+    T max_t, T ray_direction_2, T sphere_center_2,
+    const MaxRadiusBoundarySegments<T> &P_max, T min_bound, T delta,
+    int current_voxel) noexcept {
+  const bool is_intersect_min = min.is_intersect;
+  const bool is_intersect_max = max.is_intersect;
+  const bool is_collinear_min = min.is_collinear;
+  const bool is_collinear_max = max.is_collinear;
+  const T t_min = min.t;
+  const T t_max = max.t;
+  const bool t_t_max_eq = Comparison::isEqual(t, t_max);
+  const bool t_max_within_bounds = t < t_max && !t_t_max_eq && t_max < max_t;
+  const bool t_t_min_eq = Comparison::isEqual(t, t_min);
+  const bool t_min_within_bounds = t < t_min && !t_t_min_eq && t_min < max_t;
+  if (!t_max_within_bounds && !t_min_within_bounds) {
+    return {.tMax = std::numeric_limits<T>::max(), .tStep = 0};
+  }
+  if (is_intersect_max && !is_intersect_min && !is_collinear_min &&
+      t_max_within_bounds) {
+    return {.tMax = t_max, .tStep = 1};
+  }
+  if (is_intersect_min && !is_intersect_max && !is_collinear_max &&
+      t_min_within_bounds) {
+    return {.tMax = t_min, .tStep = -1};
+  }
+  if ((is_intersect_min && is_intersect_max) ||
+      (is_intersect_min && is_collinear_max) ||
+      (is_intersect_max && is_collinear_min)) {
+    const bool min_max_eq = Comparison::isEqual(t_min, t_max);
+    if (min_max_eq && t_min_within_bounds) {
+      countStatistic(NUM_ANGULAR_PERTURBATIONS);
+      const T perturbed_t = T(0.1);
+      const T a = -ray.direction().x() * perturbed_t;
+      const T b = -ray_direction_2 * perturbed_t;
+      const T max_radius_over_plane_length =
+          grid.sphereMaxRadius() / std::sqrt(a * a + b * b);
+      const T p1 =
+          grid.sphereCenter().x() - max_radius_over_plane_length * a;
+      const T p2 = sphere_center_2 - max_radius_over_plane_length * b;
+      const int next_step = std::abs(
+          current_voxel -
+          findAngularVoxelID(P_max, p1, p2,
+                             std::atan2(-b, -a), min_bound, delta));
+      return {.tMax = t_max,
+              .tStep = ray.direction().x() < T(0) || ray_direction_2 < T(0)
+                           ? next_step
+                           : -next_step};
+    }
+    if (t_min_within_bounds && ((t_min < t_max && !min_max_eq) || t_t_max_eq)) {
+      return {.tMax = t_min, .tStep = -1};
+    }
+    if (t_max_within_bounds && ((t_max < t_min && !min_max_eq) || t_t_min_eq)) {
+      return {.tMax = t_max, .tStep = 1};
+    }
+  }
+  return {.tMax = std::numeric_limits<T>::max(), .tStep = 0};
+}
+
+// Determines whether a polar hit occurs for the given ray given the
+// intersections of the ray segment with the current voxel's minimum and
+// maximum polar boundaries. See angularHit().
+template <class Comparison = RobustComparison, class T, class Grid>
+SVR_HOST_DEVICE inline HitParameters<T> polarHit(
+    const BasicRay<T> &ray, const Grid &grid,
+    const BoundaryIntersection<T> &min, const BoundaryIntersection<T> &max,
+    int current_polar_voxel, T t, T max_t) noexcept {
+  return angularHit<Comparison>(
+      grid, ray, min, max, t, max_t, ray.direction().y(),
+      grid.sphereCenter().y(), polarMaxRadiusSegments(grid),
+      grid.sphereMinBoundPolar(), grid.deltaTheta(), current_polar_voxel);
+}
+
+// Determines whether a polar hit occurs for the given ray. A polar hit is
+// considered an intersection with the ray and a polar section. The polar
+// sections live in the XY plane.
+template <class Comparison = RobustComparison, class T, class Grid>
+SVR_HOST_DEVICE inline HitParameters<T> polarHit(
+    const BasicRay<T> &ray, const Grid &grid,
+    const BasicRaySegment<T> &ray_segment, T collinear_time,
+    int current_polar_voxel, T t, T max_t) noexcept {
+  // Calculate the voxel boundary vectors.
+  const BasicAngularBoundary<T> &b_min =
+      grid.polarBoundary(current_polar_voxel);
+  const BasicAngularBoundary<T> &b_max =
+      grid.polarBoundary(current_polar_voxel + 1);
+  const BasicBoundVec3<T> &P1 = ray_segment.P1();
+  const BasicFreeVec3<T> &V = ray_segment.vector();
+  return polarHit<Comparison>(
+      ray, grid,
+      boundaryIntersection<Comparison>(
+          perpProducts(b_min.P1, b_min.P2, b_min.center_to_bound_1,
+                       b_min.center_to_bound_2, P1.x(), P1.y(), V.x(), V.y()),
+          ray_segment, ray, collinear_time),
+      boundaryIntersection<Comparison>(
+          perpProducts(b_max.P1, b_max.P2, b_max.center_to_bound_1,
+                       b_max.center_to_bound_2, P1.x(), P1.y(), V.x(), V.y()),
+          ray_segment, ray, collinear_time),
+      current_polar_voxel, t, max_t);
+}
+
+// Determines whether an azimuthal hit occurs for the given ray given the
+// intersections of the ray segment with the current voxel's minimum and
+// maximum azimuthal boundaries. See angularHit().
+template <class Comparison = RobustComparison, class T, class Grid>
+SVR_HOST_DEVICE inline HitParameters<T> azimuthalHit(
+    const BasicRay<T> &ray, const Grid &grid,
+    const BoundaryIntersection<T> &min, const BoundaryIntersection<T> &max,
+    int current_azimuthal_voxel, T t, T max_t) noexcept {
+  return angularHit<Comparison>(
+      grid, ray, min, max, t, max_t, ray.direction().z(),
+      grid.sphereCenter().z(), azimuthalMaxRadiusSegments(grid),
+      grid.sphereMinBoundAzi(), grid.deltaPhi(), current_azimuthal_voxel);
+}
+
+// Determines whether an azimuthal hit occurs for the given ray. An azimuthal
+// hit is considered an intersection with the ray and an azimuthal section. The
+// azimuthal sections live in the XZ plane.
+template <class Comparison = RobustComparison, class T, class Grid>
+SVR_HOST_DEVICE inline HitParameters<T> azimuthalHit(
+    const BasicRay<T> &ray, const Grid &grid,
+    const BasicRaySegment<T> &ray_segment, T collinear_time,
+    int current_azimuthal_voxel, T t, T max_t) noexcept {
+  // Calculate the voxel boundary vectors.
+  const BasicAngularBoundary<T> &b_min =
+      grid.azimuthalBoundary(current_azimuthal_voxel);
+  const BasicAngularBoundary<T> &b_max =
+      grid.azimuthalBoundary(current_azimuthal_voxel + 1);
+  const BasicBoundVec3<T> &P1 = ray_segment.P1();
+  const BasicFreeVec3<T> &V = ray_segment.vector();
+  return azimuthalHit<Comparison>(
+      ray, grid,
+      boundaryIntersection<Comparison>(
+          perpProducts(b_min.P1, b_min.P2, b_min.center_to_bound_1,
+                       b_min.center_to_bound_2, P1.x(), P1.z(), V.x(), V.z()),
+          ray_segment, ray, collinear_time),
+      boundaryIntersection<Comparison>(
+          perpProducts(b_max.P1, b_max.P2, b_max.center_to_bound_1,
+                       b_max.center_to_bound_2, P1.x(), P1.z(), V.x(), V.z()),
+          ray_segment, ray, collinear_time),
+      current_azimuthal_voxel, t, max_t);
+}
+
+// Intersects the ray with an angular voxel boundary in closed form, rather
+// than intersecting the ray segment [t, max_t] with the boundary as in
+// boundaryIntersection(). The boundary lies on a plane through the sphere
+// center, so the time at which the ray crosses it is the ratio of two
+// perpendicular products with u = (center_to_bound_1, center_to_bound_2):
+//          t_intersect = perp(u, center - origin) / perp(u, direction).
+// The remaining terms are those of boundaryIntersection() rewritten in terms of
+// the ray, so that the same boundaries are intersected, and the segments are
+// never calculated. Here, direction is the in-plane ray direction,
+// ray_to_center is the in-plane vector from the ray origin to the sphere center
+// and direction_perp_ray_to_center is their perpendicular product. The length
+// of the ray segment is max_t - t.
+template <class Comparison = RobustComparison, class T>
+SVR_HOST_DEVICE inline BoundaryIntersection<T> planeIntersection(
+    T center_to_bound_1, T center_to_bound_2, T direction_1, T direction_2,
+    T ray_to_center_1, T ray_to_center_2, T direction_perp_ray_to_center, T t,
+    T segment_length, T inv_segment_length, T collinear_time) noexcept {
+  const T u_perp_direction =
+      center_to_bound_1 * direction_2 - center_to_bound_2 * direction_1;
+  const T u_perp_ray_to_center =
+      center_to_bound_1 * ray_to_center_2 - center_to_bound_2 * ray_to_center_1;
+  const bool is_parallel =
+      Comparison::isZero(u_perp_direction * segment_length);
+  if (!is_parallel) {
+    const T inv_u_perp_direction = T(1) / u_perp_direction;
+    const T t_intersect = u_perp_ray_to_center * inv_u_perp_direction;
+    const T a = T(1) + direction_perp_ray_to_center * inv_u_perp_direction;
+    const T b = (t_intersect - t) * inv_segment_length;
+    if (!((Comparison::lessThanZero(a) || Comparison::lessThan(T(1), a)) ||
+          Comparison::lessThanZero(b) || Comparison::lessThan(T(1), b))) {
+      return {.t = t_intersect, .is_intersect = true, .is_collinear = false};
+    }
+  }
+  const bool is_collinear =
+      is_parallel &&
+      Comparison::isZero(u_perp_ray_to_center - t * u_perp_direction) &&
+      Comparison::isZero(segment_length *
+                         (direction_perp_ray_to_center + u_perp_direction));
+  return {.t = is_collinear ? collinear_time : T(0),
+          .is_intersect = false,
+          .is_collinear = is_collinear};
+}
+
+// Calculates the voxel(s) with the minimal tMax for the next intersection.
+// Since t is being updated with each interval of the algorithm, this must check
+// the following cases:
+// 1. tMaxR is the minimum.
+// 2. tMaxTheta is the minimum.
+// 3. tMaxPhi is the minimum.
+// 4. tMaxR, tMaxTheta, tMaxPhi equal intersection.
+// 5. tMaxR, tMaxTheta equal intersection.
+// 6. tMaxR, tMaxPhi equal intersection.
+// 7. tMaxTheta, tMaxPhi equal intersection.
+// For each case, the following must hold: t < tMax < max_t
+// For reference, uses the following shortform naming:
+//        RP = Radial - Polar
+//        RA = Radial - Azimuthal
+//        PA = Polar  - Azimuthal
+// Here, *_eq is the svr::isEqual() comparison of the two tMax values, and *_lt
+// is the < comparison.
+SVR_HOST_DEVICE inline VoxelIntersectionType minimumIntersection(
+    bool RP_eq, bool RA_eq, bool PA_eq, bool RP_lt, bool RA_lt,
+    bool PA_lt) noexcept {
+  if (RP_lt && !RP_eq && RA_lt && !RA_eq) return Radial;
+  if (!RP_lt && !RP_eq && PA_lt && !PA_eq) return Polar;
+  if (!PA_lt && !PA_eq && !RA_lt && !RA_eq) return Azimuthal;
+  if (RP_eq && RA_eq) return RadialPolarAzimuthal;
+  if (PA_eq) return PolarAzimuthal;
+  if (RP_eq) return RadialPolar;
+  return RadialAzimuthal;
+}
+
+// Similar to above, but compares the tMax values of the given hits with
+// Comparison.
+template <class Comparison = RobustComparison, class T>
+SVR_HOST_DEVICE inline VoxelIntersectionType minimumIntersection(
+    const HitParameters<T> &radial, const HitParameters<T> &polar,
+    const HitParameters<T> &azimuthal) noexcept {
+  return minimumIntersection(Comparison::isEqual(radial.tMax, polar.tMax),
+                             Comparison::isEqual(radial.tMax, azimuthal.tMax),
+                             Comparison::isEqual(polar.tMax, azimuthal.tMax),
+                             radial.tMax < polar.tMax,
+                             radial.tMax < azimuthal.tMax,
+                             polar.tMax < azimuthal.tMax);
+}
+
+// Calls the visitor with the given voxel, which is exited at time exit_t.
+// Returns false if the visitor requests the traversal to stop. Visitors may
+// return either bool or void; a visitor returning void never stops the
+// traversal early.
+template <class T, class Visitor>
+SVR_HOST_DEVICE inline auto visitExit(Visitor &visitor,
+                                      const BasicSphericalVoxel<T> &voxel,
+                                      T exit_t) noexcept ->
+    typename std::enable_if<
+        !std::is_void<decltype(visitor(0, 0, 0, T(0), T(0)))>::value,
+        bool>::type {
+  return visitor(voxel.radial, voxel.polar, voxel.azimuthal, voxel.enter_t,
+                 exit_t);
+}
+
+template <class T, class Visitor>
+SVR_HOST_DEVICE inline auto visitExit(Visitor &visitor,
+                                      const BasicSphericalVoxel<T> &voxel,
+                                      T exit_t) noexcept ->
+    typename std::enable_if<
+        std::is_void<decltype(visitor(0, 0, 0, T(0), T(0)))>::value,
+        bool>::type {
+  visitor(voxel.radial, voxel.polar, voxel.azimuthal, voxel.enter_t, exit_t);
+  return true;
+}
+
+// The state of a single ray's traversal between steps.
+template <class T>
+struct TraversalState {
+  // The dot product of the ray sphere vector with the ray direction, and the
+  // squared length of the ray sphere vector less its square. See
+  // RadialCrossings.
+  T v;
+  T rsvd_minus_v_squared;
+
+  // The current time, the time at which the traversal ends, and the time at
+  // which the ray exits the grid.
+  T t;
+  T max_t;
+  T t_ray_exit;
+
+  // The time in case of collinear min or collinear max for angular plane hits,
+  // i.e. the time at which the ray passes the sphere center.
+  T collinear_time;
+
+  int current_radial_voxel;
+  int current_polar_voxel;
+  int current_azimuthal_voxel;
+  bool radial_step_has_transitioned;
+
+  // The voxel currently being traversed. It is passed to the visitor upon
+  // exit.
+  BasicSphericalVoxel<T> voxel;
+};
+
+// Returns the radial voxel in which a point lies, given SED_from_center, its
+// squared distance from the sphere center. This is the number of radial edges
+// whose squared radius is greater than SED_from_center, and thus is 0 if the
+// point is outside of the grid, or at most grid.numRadialSections(). Since
+// the squared radii decrease, the voxel is found by binary search. For a
+// radially uniform grid, the voxel is first calculated directly, and the
+// search only verifies it. If hint is the voxel, e.g. that of a nearby ray, it
+// is confirmed with two comparisons and no search.
+template <class T, class Grid>
+SVR_HOST_DEVICE inline int radialEntranceVoxel(const Grid &grid,
+                                               T SED_from_center,
+                                               int hint = 0) noexcept {
+  // Most rays begin outside of the grid.
+  if (!(SED_from_center < grid.deltaRadiiSquared(0))) return 0;
+  const std::size_t num_radial_sections = grid.numRadialSections();
+  const std::size_t hinted_voxel = static_cast<std::size_t>(hint);
+  if (hinted_voxel >= 1 && hinted_voxel <= num_radial_sections &&
+      SED_from_center < grid.deltaRadiiSquared(hinted_voxel - 1) &&
+      (hinted_voxel == num_radial_sections ||
+       !(SED_from_center < grid.deltaRadiiSquared(hinted_voxel)))) {
+    return hint;
+  }
+  // The voxel is within [lower, upper].
+  std::size_t lower = 1;
+  std::size_t upper = num_radial_sections;
+  if (grid.isRadiallyUniform()) {
+    // Edge i has a radius of (N - i) * deltaRadius() up to rounding, so the
+    // estimate is exact unless the point is within rounding of an edge.
+    const T estimate =
+        std::ceil(static_cast<T>(num_radial_sections) -
+                  std::sqrt(SED_from_center) / grid.deltaRadius());
+    if (estimate >= T(1) && estimate <= static_cast<T>(num_radial_sections)) {
+      const std::size_t voxel = static_cast<std::size_t>(estimate);
+      if (SED_from_center < grid.deltaRadiiSquared(voxel - 1)) lower = voxel;
+      if (!(SED_from_center < grid.deltaRadiiSquared(voxel))) upper = voxel;
+    }
+  }
+  while (lower < upper) {
+    const std::size_t middle = lower + (upper - lower) / 2;
+    if (SED_from_center < grid.deltaRadiiSquared(middle)) {
+      lower = middle + 1;
+    } else {
+      upper = middle;
+    }
+  }
+  return static_cast<int>(lower);
+}
+
+// Initializes the traversal state of the ray. Returns false if the ray does
+// not intersect the grid within max_t, in which case no voxels are traversed.
+// The voxel IDs of hint, if any, are tested before the entrance voxel is
+// searched for; the state is the same with or without a hint.
+template <class T, class Grid>
+SVR_HOST_DEVICE inline bool initializeTraversal(
+    const BasicRay<T> &ray, const Grid &grid, T max_t,
+    TraversalState<T> &state, const EntryVoxel &hint = EntryVoxel()) noexcept {
+  if (max_t <= T(0)) return false;
+  const BasicFreeVec3<T> rsv =
+      grid.sphereCenter() - ray.pointAtParameter(0.0);  // Ray Sphere Vector.
+  const T SED_from_center = rsv.squared_length();
+  const int radial_entrance_voxel =
+      radialEntranceVoxel(grid, SED_from_center, hint.radial);
+  const bool ray_origin_is_outside_grid = (radial_entrance_voxel == 0);
+
+  const std::size_t vector_index =
+      radial_entrance_voxel - !ray_origin_is_outside_grid;
+  const T entry_radius_squared = grid.deltaRadiiSquared(vector_index);
+  const T entry_radius =
+      grid.isRadiallyUniform()
+          ? grid.deltaRadius() *
+                static_cast<T>(grid.numRadialSections() - vector_index)
+          : std::sqrt(entry_radius_squared);
+  const T rsvd = rsv.dot(rsv);
+  const T v = rsv.dot(ray.direction().to_free());
+  const T rsvd_minus_v_squared = rsvd - v * v;
+
+  if (entry_radius_squared <= rsvd_minus_v_squared) return false;
+  const T d = std::sqrt(entry_radius_squared - rsvd_minus_v_squared);
+  const T t_ray_exit = ray.timeOfIntersectionAt(v + d);
+  if (t_ray_exit < T(0)) return false;
+  const T t_ray_entrance = ray.timeOfIntersectionAt(v - d);
+  // A ray that begins within the grid exits through the outermost edge rather
+  // than the edge of its radial entrance voxel.
+  const T t_grid_exit =
+      ray_origin_is_outside_grid
+          ? t_ray_exit
+          : ray.timeOfIntersectionAt(
+                v + std::sqrt(grid.deltaRadiiSquared(0) -
+                              rsvd_minus_v_squared));
+  const int current_radial_voxel =
+      radial_entrance_voxel + ray_origin_is_outside_grid;
+
+  const BasicFreeVec3<T> ray_sphere =
+      ray_origin_is_outside_grid
+          ? grid.sphereCenter() - ray.pointAtParameter(t_ray_entrance)
+          : SED_from_center == T(0) ? rsv - ray.direction().to_free() : rsv;
+
+  int current_polar_voxel, current_azimuthal_voxel;
+  const bool has_hint = hint.radial != 0;
+  initializeAngularVoxelIDs(
+      grid, ray_sphere, ray_origin_is_outside_grid, entry_radius,
+      has_hint ? hint.polar : NO_ANGULAR_HINT,
+      has_hint ? hint.azimuthal : NO_ANGULAR_HINT, current_polar_voxel,
+      current_azimuthal_voxel);
+  if (static_cast<std::size_t>(current_polar_voxel) >=
+          grid.numPolarSections() ||
+      static_cast<std::size_t>(current_azimuthal_voxel) >=
+          grid.numAzimuthalSections()) {
+    return false;
+  }
+
+  countStatistic(NUM_RAYS);
+  const T t = t_ray_entrance * ray_origin_is_outside_grid;
+  const T unitized_ray_time = max_t * grid.sphereMaxDiameter() +
+                                   t_ray_entrance * ray_origin_is_outside_grid;
+  state = {.v = v,
+           .rsvd_minus_v_squared = rsvd_minus_v_squared,
+           .t = t,
+           .max_t = ray_origin_is_outside_grid
+                        ? std::min(t_ray_exit, unitized_ray_time)
+                        : unitized_ray_time,
+           .t_ray_exit = t_grid_exit,
+           .collinear_time = ray.timeOfIntersectionAt(grid.sphereCenter()),
+           .current_radial_voxel = current_radial_voxel,
+           .current_polar_voxel = current_polar_voxel,
+           .current_azimuthal_voxel = current_azimuthal_voxel,
+           // A ray that begins within the grid and does not enter the sphere
+           // of its radial voxel's inner boundary only exits spheres.
+           .radial_step_has_transitioned =
+               !ray_origin_is_outside_grid &&
+               !(v > T(0) && rsvd_minus_v_squared <=
+                                 grid.deltaRadiiSquared(current_radial_voxel)),
+           .voxel = {.radial = current_radial_voxel,
+                     .polar = current_polar_voxel,
+                     .azimuthal = current_azimuthal_voxel,
+                     .enter_t = t}};
+  return true;
+}
+
+// Takes a single step of the traversal given the radial, polar, and azimuthal
+// hits from the current voxel, and voxel_intersection, the result of
+// minimumIntersection() for these hits. Upon entering a new voxel, the visitor
+// is called with the voxel that was exited. Returns false once the traversal
+// is complete, i.e. the ray has exited the grid or the visitor requested that
+// the traversal stop. Sectors is either FullSphere or Sectored, and must match
+// grid.isFullSphere().
+template <class Sectors, class T, class Grid, class Visitor>
+SVR_HOST_DEVICE inline bool advanceTraversal(
+    const Grid &grid, const HitParameters<T> &radial,
+    const HitParameters<T> &polar, const HitParameters<T> &azimuthal,
+    VoxelIntersectionType voxel_intersection, TraversalState<T> &state,
+    Visitor &visitor) noexcept {
+  int &current_radial_voxel = state.current_radial_voxel;
+  int &current_polar_voxel = state.current_polar_voxel;
+  int &current_azimuthal_voxel = state.current_azimuthal_voxel;
+  T &t = state.t;
+  constexpr T no_hit = std::numeric_limits<T>::max();
+  countStatistic(NUM_ITERATIONS);
+  // The ray exits the outermost radial voxel only once the radial crossing is
+  // the nearest, so that the angular boundaries it crosses beforehand are not
+  // skipped.
+  const bool is_radial_step =
+      voxel_intersection == Radial || voxel_intersection == RadialPolar ||
+      voxel_intersection == RadialAzimuthal ||
+      voxel_intersection == RadialPolarAzimuthal;
+  if ((is_radial_step && current_radial_voxel + radial.tStep == 0) ||
+      (radial.tMax == no_hit && polar.tMax == no_hit &&
+       azimuthal.tMax == no_hit)) {
+    visitExit(visitor, state.voxel, state.t_ray_exit);
+    return false;
+  }
+  bool polar_step = false, azimuthal_step = false;
+  countStatistic(static_cast<Statistic>(NUM_RADIAL_STEPS + voxel_intersection -
+                                        Radial));
+  switch (voxel_intersection) {
+    case Radial: {
+      t = radial.tMax;
+      current_radial_voxel += radial.tStep;
+      break;
+    }
+    case Polar: {
+      t = polar.tMax;
+      polar_step = true;
+      break;
+    }
+    case Azimuthal: {
+      t = azimuthal.tMax;
+      azimuthal_step = true;
+      break;
+    }
+    case RadialPolar: {
+      t = radial.tMax;
+      current_radial_voxel += radial.tStep;
+      polar_step = true;
+      break;
+    }
+    case RadialAzimuthal: {
+      t = radial.tMax;
+      current_radial_voxel += radial.tStep;
+      azimuthal_step = true;
+      break;
+    }
+    case PolarAzimuthal: {
+      t = polar.tMax;
+      polar_step = azimuthal_step = true;
+      break;
+    }
+    case RadialPolarAzimuthal: {
+      t = radial.tMax;
+      current_radial_voxel += radial.tStep;
+      polar_step = azimuthal_step = true;
+      break;
+    }
+  }
+  // For a FullSphere grid, the bounds checks are constant and removed.
+  const bool azimuthal_exit =
+      azimuthal_step && !Sectors::inBoundsAzimuthal(grid, azimuthal.tStep,
+                                                    current_azimuthal_voxel);
+  if (azimuthal_exit ||
+      (polar_step &&
+       !Sectors::inBoundsPolar(grid, polar.tStep, current_polar_voxel))) {
+    countStatistic(azimuthal_exit ? NUM_AZIMUTHAL_EXITS : NUM_POLAR_EXITS);
+    visitExit(visitor, state.voxel, state.t_ray_exit);
+    return false;
+  }
+  if (polar_step) {
+    current_polar_voxel = Sectors::step(current_polar_voxel, polar.tStep,
+                                        grid.numPolarSections());
+  }
+  if (azimuthal_step) {
+    current_azimuthal_voxel = Sectors::step(
+        current_azimuthal_voxel, azimuthal.tStep, grid.numAzimuthalSections());
+  }
+  if (state.voxel.radial == current_radial_voxel &&
+      state.voxel.polar == current_polar_voxel &&
+      state.voxel.azimuthal == current_azimuthal_voxel) {
+    countStatistic(NUM_NO_PROGRESS_STEPS);
+    return true;
+  }
+  if (!visitExit(visitor, state.voxel, t)) return false;
+  state.voxel = {.radial = current_radial_voxel,
+                 .polar = current_polar_voxel,
+                 .azimuthal = current_azimuthal_voxel,
+                 .enter_t = t};
+  return true;
+}
+
+// The engine that calculates the polar and azimuthal hits by intersecting the
+// ray segment [t, max_t] with each voxel boundary. See boundaryIntersection().
+// The comparisons of each step are made with Comparison.
+template <class Comparison>
+struct BasicSegmentEngine {
+  using ComparisonPolicy = Comparison;
+
+  template <class T>
+  struct AngularHits {
+    template <class Grid>
+    SVR_HOST_DEVICE inline AngularHits(const BasicRay<T> &ray, const Grid &,
+                                       const TraversalState<T> &state) noexcept
+        : ray_segment(state.max_t, ray) {}
+
+    // Calculates the polar and azimuthal hits from the current voxel of state.
+    template <class Grid>
+    SVR_HOST_DEVICE inline void calculate(
+        const BasicRay<T> &ray, const Grid &grid,
+        const TraversalState<T> &state, HitParameters<T> &polar,
+        HitParameters<T> &azimuthal) noexcept {
+      this->ray_segment.updateAtTime(state.t, ray);
+      polar = polarHit<Comparison>(ray, grid, this->ray_segment,
+                                   state.collinear_time,
+                                   state.current_polar_voxel, state.t,
+                                   state.max_t);
+      azimuthal = azimuthalHit<Comparison>(
+          ray, grid, this->ray_segment, state.collinear_time,
+          state.current_azimuthal_voxel, state.t, state.max_t);
+    }
+
+    BasicRaySegment<T> ray_segment;
+  };
+};
+
+// The engine that calculates the polar and azimuthal hits with the closed form
+// crossing times of the ray with each voxel boundary. See planeIntersection().
+// The values that depend only upon the ray are calculated once, and no ray
+// segment is maintained. The comparisons of each step are made with
+// Comparison.
+template <class Comparison>
+struct BasicPlaneEngine {
+  using ComparisonPolicy = Comparison;
+
+  template <class T>
+  struct AngularHits {
+    template <class Grid>
+    SVR_HOST_DEVICE inline AngularHits(const BasicRay<T> &ray, const Grid &grid,
+                                       const TraversalState<T> &) noexcept
+        : ray_to_center(grid.sphereCenter() - ray.origin()),
+          polar_direction_perp_ray_to_center(
+              ray.direction().x() * ray_to_center.y() -
+              ray.direction().y() * ray_to_center.x()),
+          azimuthal_direction_perp_ray_to_center(
+              ray.direction().x() * ray_to_center.z() -
+              ray.direction().z() * ray_to_center.x()) {}
+
+    // Calculates the polar and azimuthal hits from the current voxel of state.
+    template <class Grid>
+    SVR_HOST_DEVICE inline void calculate(
+        const BasicRay<T> &ray, const Grid &grid,
+        const TraversalState<T> &state, HitParameters<T> &polar,
+        HitParameters<T> &azimuthal) const noexcept {
+      const T segment_length = state.max_t - state.t;
+      const T inv_segment_length = T(1) / segment_length;
+      const BasicUnitVec3<T> &D = ray.direction();
+      const BasicAngularBoundary<T> &p_min =
+          grid.polarBoundary(state.current_polar_voxel);
+      const BasicAngularBoundary<T> &p_max =
+          grid.polarBoundary(state.current_polar_voxel + 1);
+      polar = polarHit<Comparison>(
+          ray, grid,
+          planeIntersection<Comparison>(
+              p_min.center_to_bound_1, p_min.center_to_bound_2, D.x(), D.y(),
+              this->ray_to_center.x(), this->ray_to_center.y(),
+              this->polar_direction_perp_ray_to_center, state.t,
+              segment_length, inv_segment_length, state.collinear_time),
+          planeIntersection<Comparison>(
+              p_max.center_to_bound_1, p_max.center_to_bound_2, D.x(), D.y(),
+              this->ray_to_center.x(), this->ray_to_center.y(),
+              this->polar_direction_perp_ray_to_center, state.t,
+              segment_length, inv_segment_length, state.collinear_time),
+          state.current_polar_voxel, state.t, state.max_t);
+      const BasicAngularBoundary<T> &a_min =
+          grid.azimuthalBoundary(state.current_azimuthal_voxel);
+      const BasicAngularBoundary<T> &a_max =
+          grid.azimuthalBoundary(state.current_azimuthal_voxel + 1);
+      azimuthal = azimuthalHit<Comparison>(
+          ray, grid,
+          planeIntersection<Comparison>(
+              a_min.center_to_bound_1, a_min.center_to_bound_2, D.x(), D.z(),
+              this->ray_to_center.x(), this->ray_to_center.z(),
+              this->azimuthal_direction_perp_ray_to_center, state.t,
+              segment_length, inv_segment_length, state.collinear_time),
+          planeIntersection<Comparison>(
+              a_max.center_to_bound_1, a_max.center_to_bound_2, D.x(), D.z(),
+              this->ray_to_center.x(), this->ray_to_center.z(),
+              this->azimuthal_direction_perp_ray_to_center, state.t,
+              segment_length, inv_segment_length, state.collinear_time),
+          state.current_azimuthal_voxel, state.t, state.max_t);
+    }
+
+    // The vector from the ray origin to the sphere center.
+    const BasicFreeVec3<T> ray_to_center;
+
+    // The perpendicular products of the ray direction with ray_to_center in
+    // the XY and XZ planes respectively.
+    const T polar_direction_perp_ray_to_center;
+    const T azimuthal_direction_perp_ray_to_center;
+  };
+};
+
+// The spherical coordinate voxel traversal algorithm with the policy Sectors,
+// where the polar and azimuthal hits are calculated by Engine, either
+// BasicSegmentEngine or BasicPlaneEngine. See svr::walkSphericalVolume() for a
+// description of the parameters. Returns the entrance voxel of the ray, or
+// EntryVoxel() if it does not intersect the grid.
+template <class Sectors, class Engine, class T, class Grid, class Visitor>
+SVR_HOST_DEVICE EntryVoxel walkSphericalVolume(
+    const BasicRay<T> &ray, const Grid &grid, T max_t, Visitor &visitor,
+    const EntryVoxel &hint = EntryVoxel()) noexcept {
+  StatisticsTimer timer;
+  TraversalState<T> state;
+  if (!initializeTraversal(ray, grid, max_t, state, hint)) {
+    timer.lap(SETUP_NANOSECONDS);
+    return EntryVoxel();
+  }
+  const EntryVoxel entry_voxel = {.radial = state.current_radial_voxel,
+                                  .polar = state.current_polar_voxel,
+                                  .azimuthal = state.current_azimuthal_voxel};
+  RadialCrossings<T> radial_crossings(
+      ray, grid, state.current_radial_voxel, state.radial_step_has_transitioned,
+      state.v, state.rsvd_minus_v_squared);
+  typename Engine::template AngularHits<T> angular_hits(ray, grid, state);
+  HitParameters<T> polar, azimuthal;
+  timer.lap(SETUP_NANOSECONDS);
+  do {
+    const HitParameters<T> radial = radial_crossings.hit(state.max_t);
+    angular_hits.calculate(ray, grid, state, polar, azimuthal);
+    const int previous_radial_voxel = state.current_radial_voxel;
+    if (!advanceTraversal<Sectors>(
+            grid, radial, polar, azimuthal,
+            minimumIntersection<typename Engine::ComparisonPolicy>(
+                radial, polar, azimuthal),
+            state, visitor)) {
+      break;
+    }
+    if (state.current_radial_voxel != previous_radial_voxel) {
+      radial_crossings.advance(ray, grid);
+    }
+  } while (true);
+  timer.lap(STEPPING_NANOSECONDS);
+  return entry_voxel;
+}
+
+// The spherical coordinate voxel traversal algorithm with Engine, and the
+// policy chosen by grid.isFullSphere().
+template <class Engine, class T, class Grid, class Visitor>
+SVR_HOST_DEVICE inline EntryVoxel walkSphericalVolume(
+    const BasicRay<T> &ray, const Grid &grid, T max_t, Visitor &visitor,
+    const EntryVoxel &hint = EntryVoxel()) noexcept {
+  if (grid.isFullSphere()) {
+    return walkSphericalVolume<FullSphere, Engine>(ray, grid, max_t, visitor,
+                                                   hint);
+  }
+  return walkSphericalVolume<Sectored, Engine>(ray, grid, max_t, visitor,
+                                               hint);
+}
+
+}  // namespace internal
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_INTERNAL_H
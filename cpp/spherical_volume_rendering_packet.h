@@ -0,0 +1,395 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_PACKET_H
+#define SPHERICAL_VOLUME_RENDERING_PACKET_H
+
+#include <cstddef>
+#include <utility>
+
+#include "ray.h"
+#include "simd_util.h"
+#include "spherical_volume_rendering_internal.h"
+#include "spherical_voxel_grid.h"
+#include "vec3.h"
+
+// The implementation of the ray packet traversal. Each of the packet functions
+// below is the counterpart of a scalar function in
+// spherical_volume_rendering_internal.h, and yields the same result for each
+// lane. Users should include spherical_volume_rendering_util.h rather than this
+// file.
+
+namespace svr {
+
+namespace internal {
+
+// The number of rays traversed together by walkSphericalVolumePacket().
+constexpr std::size_t PACKET_SIZE = simd::NUM_LANES;
+
+// Forwards the voxels of a single lane of a ray packet to a packet visitor,
+// which additionally receives the lane.
+template <class PacketVisitor>
+struct LaneVisitor {
+  PacketVisitor &visitor;
+  std::size_t lane;
+
+  inline auto operator()(int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) const noexcept
+      -> decltype(std::declval<PacketVisitor &>()(std::size_t(0), 0, 0, 0, 0.0,
+                                                  0.0)) {
+    return visitor(lane, radial, polar, azimuthal, enter_t, exit_t);
+  }
+};
+
+// The angular voxel boundaries of each lane of a ray packet in
+// structure-of-arrays form. See AngularBoundary.
+struct PacketBoundaries {
+  double P1[PACKET_SIZE];
+  double P2[PACKET_SIZE];
+  double center_to_bound_1[PACKET_SIZE];
+  double center_to_bound_2[PACKET_SIZE];
+
+  inline void set(std::size_t lane, const AngularBoundary &boundary) noexcept {
+    this->P1[lane] = boundary.P1;
+    this->P2[lane] = boundary.P2;
+    this->center_to_bound_1[lane] = boundary.center_to_bound_1;
+    this->center_to_bound_2[lane] = boundary.center_to_bound_2;
+  }
+};
+
+// The ray segments of each lane of a ray packet. *_1 and *_2 are the
+// components in the plane of the boundaries, and *_nzd are the components
+// along the non-zero direction of each lane's ray. See RaySegment.
+struct PacketSegments {
+  simd::Doubles P1_1, P1_2, V_1, V_2;
+  simd::Doubles P1_nzd, V_nzd, origin_nzd, inverse_direction_nzd;
+};
+
+// The BoundaryIntersection of each lane of a ray packet.
+struct PacketBoundaryIntersections {
+  simd::Doubles t;
+  simd::Mask is_intersect;
+  simd::Mask is_collinear;
+
+  inline BoundaryIntersection<double> operator[](std::size_t lane) const
+      noexcept {
+    double t[PACKET_SIZE];
+    simd::store(t, this->t);
+    return {.t = t[lane],
+            .is_intersect = simd::lane(this->is_intersect, lane),
+            .is_collinear = simd::lane(this->is_collinear, lane)};
+  }
+};
+
+// The HitParameters of each lane of a ray packet. tStep is stored as a double
+// so that it may be selected with the same masks as tMax.
+struct PacketHits {
+  simd::Doubles tMax;
+  simd::Doubles tStep;
+};
+
+// Returns the hit (tMax, tStep) in the lanes of mask, and hits otherwise.
+inline PacketHits select(simd::Mask mask, simd::Doubles tMax, double tStep,
+                         const PacketHits &hits) noexcept {
+  return {.tMax = simd::select(mask, tMax, hits.tMax),
+          .tStep = simd::select(mask, simd::broadcast(tStep), hits.tStep)};
+}
+
+// Calculates perpProducts() and boundaryIntersection() for each lane of a ray
+// packet. Rather than branching when the boundary is parallel to the ray
+// segment, the intersect parameters are calculated for every lane and masked.
+inline PacketBoundaryIntersections packetBoundaryIntersections(
+    const PacketBoundaries &boundaries, const PacketSegments &segments,
+    simd::Doubles collinear_time) noexcept {
+  using simd::Doubles;
+  using simd::Mask;
+  const Doubles zero = simd::broadcast(0.0);
+  const Doubles one = simd::broadcast(1.0);
+  const Doubles center_to_bound_1 = simd::load(boundaries.center_to_bound_1);
+  const Doubles center_to_bound_2 = simd::load(boundaries.center_to_bound_2);
+  const Doubles w_1 = simd::load(boundaries.P1) - segments.P1_1;
+  const Doubles w_2 = simd::load(boundaries.P2) - segments.P1_2;
+  const Doubles uv =
+      center_to_bound_1 * segments.V_2 - center_to_bound_2 * segments.V_1;
+  const Doubles uw = center_to_bound_1 * w_2 - center_to_bound_2 * w_1;
+  const Doubles vw = segments.V_1 * w_2 - segments.V_2 * w_1;
+
+  const Mask is_parallel = simd::isZero(uv);
+  const Mask is_collinear =
+      is_parallel & simd::isZero(uw) & simd::isZero(vw);
+  // a and b are only finite, and thus only used, in lanes that are not
+  // parallel.
+  const Doubles inv_perp_uv = one / uv;
+  const Doubles a = vw * inv_perp_uv;
+  const Doubles b = uw * inv_perp_uv;
+  const Mask is_intersect =
+      ~is_parallel & ~(simd::lessThanZero(a) | simd::lessThan(one, a) |
+                       simd::lessThanZero(b) | simd::lessThan(one, b));
+  const Doubles intersection_t =
+      (segments.P1_nzd + segments.V_nzd * b - segments.origin_nzd) *
+      segments.inverse_direction_nzd;
+  return {.t = simd::select(is_intersect, intersection_t,
+                            simd::select(is_collinear, collinear_time, zero)),
+          .is_intersect = is_intersect,
+          .is_collinear = is_collinear};
+}
+
+// Calculates angularHit() for each lane of a ray packet, given the
+// intersections with the minimum and maximum boundaries of each lane's
+// current voxel. Lanes for which the hit requires the perturbation of the
+// ray are set in perturbed; the hits of these lanes must instead be calculated
+// with angularHit().
+inline PacketHits packetAngularHits(const PacketBoundaryIntersections &min,
+                                    const PacketBoundaryIntersections &max,
+                                    simd::Doubles t, simd::Doubles max_t,
+                                    simd::Mask &perturbed) noexcept {
+  using simd::Doubles;
+  using simd::Mask;
+  const Doubles t_min = min.t;
+  const Doubles t_max = max.t;
+  const Mask t_t_max_eq = simd::isEqual(t, t_max);
+  const Mask t_max_within_bounds = (t < t_max) & ~t_t_max_eq & (t_max < max_t);
+  const Mask t_t_min_eq = simd::isEqual(t, t_min);
+  const Mask t_min_within_bounds = (t < t_min) & ~t_t_min_eq & (t_min < max_t);
+  const Mask max_only = max.is_intersect & ~min.is_intersect &
+                        ~min.is_collinear & t_max_within_bounds;
+  const Mask min_only = min.is_intersect & ~max.is_intersect &
+                        ~max.is_collinear & t_min_within_bounds;
+  const Mask both = (min.is_intersect & max.is_intersect) |
+                    (min.is_intersect & max.is_collinear) |
+                    (max.is_intersect & min.is_collinear);
+  const Mask min_max_eq = simd::isEqual(t_min, t_max);
+  const Mask min_first =
+      both & t_min_within_bounds &
+      (((t_min < t_max) & ~min_max_eq) | t_t_max_eq);
+  const Mask max_first =
+      both & t_max_within_bounds &
+      (((t_max < t_min) & ~min_max_eq) | t_t_min_eq);
+  perturbed = both & min_max_eq & t_min_within_bounds;
+  // Since max_only, min_only, and both are mutually exclusive, and the hits
+  // are selected from the lowest to the highest precedence, this matches the
+  // order of the branches in angularHit().
+  PacketHits hits = {.tMax = simd::broadcast(DOUBLE_MAX),
+                     .tStep = simd::broadcast(0.0)};
+  hits = select(max_first, t_max, 1.0, hits);
+  hits = select(min_first, t_min, -1.0, hits);
+  hits = select(min_only, t_min, -1.0, hits);
+  hits = select(max_only, t_max, 1.0, hits);
+  return select(~(t_max_within_bounds | t_min_within_bounds),
+                simd::broadcast(DOUBLE_MAX), 0.0, hits);
+}
+
+// The spherical coordinate voxel traversal algorithm for a packet of up to
+// PACKET_SIZE rays, one per lane of a vector register. Each step of the
+// traversal is taken for every lane together: the polar and azimuthal hits and
+// the comparisons for the minimum intersection are calculated with vector
+// instructions. The radial hits are the RadialCrossings of each lane, since
+// each crossing is calculated only once per ray. The step itself is then taken
+// per lane with advanceTraversal(), as in the scalar traversal. Lanes that have
+// completed their traversal are masked out, and are reset to the voxel
+// (0, 0, 0) so that the grid lookups remain in bounds. Sectors is the policy of
+// advanceTraversal(). See svr::walkSphericalVolumePacket() for a description of
+// the parameters.
+template <class Sectors, class PacketVisitor>
+void walkSphericalVolumePacket(const Ray *rays, std::size_t num_rays,
+                               const svr::SphericalVoxelGrid &grid,
+                               double max_t,
+                               PacketVisitor &visitor) noexcept {
+  using simd::Doubles;
+  using simd::Mask;
+  StatisticsTimer timer;
+  TraversalState<double> states[PACKET_SIZE];
+  RadialCrossings<double> radial_crossings[PACKET_SIZE];
+  bool active[PACKET_SIZE];
+  std::size_t num_active = 0;
+  // The per-lane values that remain constant throughout the traversal.
+  // Inactive lanes are zero.
+  double origin[3][PACKET_SIZE] = {}, direction[3][PACKET_SIZE] = {};
+  double P2[3][PACKET_SIZE] = {};
+  double origin_nzd[PACKET_SIZE] = {}, direction_nzd[PACKET_SIZE] = {};
+  double inverse_direction_nzd[PACKET_SIZE] = {}, P2_nzd[PACKET_SIZE] = {};
+  double lane_max_t[PACKET_SIZE] = {}, collinear_time[PACKET_SIZE] = {};
+  // The rays of a packet are coherent, so each lane is given the entrance
+  // voxel of the lane before it as a hint.
+  EntryVoxel hint = EntryVoxel();
+  for (std::size_t i = 0; i < PACKET_SIZE; ++i) {
+    active[i] = i < num_rays &&
+                initializeTraversal(rays[i], grid, max_t, states[i], hint);
+    if (!active[i]) {
+      states[i] = TraversalState<double>();
+      continue;
+    }
+    ++num_active;
+    const Ray &ray = rays[i];
+    const TraversalState<double> &state = states[i];
+    hint = {.radial = state.current_radial_voxel,
+            .polar = state.current_polar_voxel,
+            .azimuthal = state.current_azimuthal_voxel};
+    radial_crossings[i] = RadialCrossings<double>(
+        ray, grid, state.current_radial_voxel,
+        state.radial_step_has_transitioned, state.v,
+        state.rsvd_minus_v_squared);
+    const BoundVec3 end = ray.pointAtParameter(state.max_t);
+    for (std::size_t k = 0; k < 3; ++k) {
+      origin[k][i] = ray.origin()[k];
+      direction[k][i] = ray.direction()[k];
+      P2[k][i] = end[k];
+    }
+    const DirectionIndex nzd = ray.NonZeroDirectionIndex();
+    origin_nzd[i] = ray.origin()[nzd];
+    direction_nzd[i] = ray.direction()[nzd];
+    inverse_direction_nzd[i] = ray.invDirection()[nzd];
+    P2_nzd[i] = end[nzd];
+    lane_max_t[i] = state.max_t;
+    collinear_time[i] = state.collinear_time;
+  }
+  if (num_active == 0) {
+    timer.lap(SETUP_NANOSECONDS);
+    return;
+  }
+
+  const Doubles max_t_v = simd::load(lane_max_t);
+  const Doubles collinear_time_v = simd::load(collinear_time);
+  const Doubles direction_nzd_v = simd::load(direction_nzd);
+  const Doubles inverse_direction_nzd_v = simd::load(inverse_direction_nzd);
+  PacketSegments polar_segments, azimuthal_segments;
+  polar_segments.origin_nzd = azimuthal_segments.origin_nzd =
+      simd::load(origin_nzd);
+  polar_segments.inverse_direction_nzd =
+      azimuthal_segments.inverse_direction_nzd = inverse_direction_nzd_v;
+
+  double t[PACKET_SIZE];
+  double tMax[3][PACKET_SIZE], tStep[3][PACKET_SIZE];
+  PacketBoundaries polar_min, polar_max, azimuthal_min, azimuthal_max;
+  timer.lap(SETUP_NANOSECONDS);
+  while (num_active > 0) {
+    for (std::size_t i = 0; i < PACKET_SIZE; ++i) {
+      const TraversalState<double> &state = states[i];
+      t[i] = state.t;
+      // Inactive lanes have no radial hit.
+      const HitParameters<double> radial_hit =
+          active[i] ? radial_crossings[i].hit(state.max_t)
+                    : HitParameters<double>{.tMax = DOUBLE_MAX, .tStep = 0};
+      tMax[0][i] = radial_hit.tMax;
+      tStep[0][i] = radial_hit.tStep;
+      polar_min.set(i, grid.polarBoundary(state.current_polar_voxel));
+      polar_max.set(i, grid.polarBoundary(state.current_polar_voxel + 1));
+      azimuthal_min.set(i,
+                        grid.azimuthalBoundary(state.current_azimuthal_voxel));
+      azimuthal_max.set(
+          i, grid.azimuthalBoundary(state.current_azimuthal_voxel + 1));
+    }
+    const Doubles t_v = simd::load(t);
+    const PacketHits radial = {.tMax = simd::load(tMax[0]),
+                               .tStep = simd::load(tStep[0])};
+
+    // Ray segments. See RaySegment::updateAtTime().
+    Doubles P1[3], V[3];
+    for (std::size_t k = 0; k < 3; ++k) {
+      P1[k] = simd::load(origin[k]) + simd::load(direction[k]) * t_v;
+      V[k] = simd::load(P2[k]) - P1[k];
+    }
+    const Doubles P1_nzd = polar_segments.origin_nzd + direction_nzd_v * t_v;
+    const Doubles V_nzd = simd::load(P2_nzd) - P1_nzd;
+    polar_segments.P1_1 = azimuthal_segments.P1_1 = P1[X_DIRECTION];
+    polar_segments.V_1 = azimuthal_segments.V_1 = V[X_DIRECTION];
+    polar_segments.P1_2 = P1[Y_DIRECTION];
+    polar_segments.V_2 = V[Y_DIRECTION];
+    azimuthal_segments.P1_2 = P1[Z_DIRECTION];
+    azimuthal_segments.V_2 = V[Z_DIRECTION];
+    polar_segments.P1_nzd = azimuthal_segments.P1_nzd = P1_nzd;
+    polar_segments.V_nzd = azimuthal_segments.V_nzd = V_nzd;
+
+    // Polar and azimuthal hits. See polarHit() and azimuthalHit().
+    const PacketBoundaryIntersections polar_min_intersections =
+        packetBoundaryIntersections(polar_min, polar_segments,
+                                    collinear_time_v);
+    const PacketBoundaryIntersections polar_max_intersections =
+        packetBoundaryIntersections(polar_max, polar_segments,
+                                    collinear_time_v);
+    const PacketBoundaryIntersections azimuthal_min_intersections =
+        packetBoundaryIntersections(azimuthal_min, azimuthal_segments,
+                                    collinear_time_v);
+    const PacketBoundaryIntersections azimuthal_max_intersections =
+        packetBoundaryIntersections(azimuthal_max, azimuthal_segments,
+                                    collinear_time_v);
+    Mask polar_perturbed, azimuthal_perturbed;
+    const PacketHits polar = packetAngularHits(
+        polar_min_intersections, polar_max_intersections, t_v, max_t_v,
+        polar_perturbed);
+    const PacketHits azimuthal = packetAngularHits(
+        azimuthal_min_intersections, azimuthal_max_intersections, t_v,
+        max_t_v, azimuthal_perturbed);
+    simd::store(tMax[1], polar.tMax);
+    simd::store(tStep[1], polar.tStep);
+    simd::store(tMax[2], azimuthal.tMax);
+    simd::store(tStep[2], azimuthal.tStep);
+
+    // The comparisons of minimumIntersection().
+    const unsigned RP_eq = simd::bits(simd::isEqual(radial.tMax, polar.tMax));
+    const unsigned RA_eq =
+        simd::bits(simd::isEqual(radial.tMax, azimuthal.tMax));
+    const unsigned PA_eq =
+        simd::bits(simd::isEqual(polar.tMax, azimuthal.tMax));
+    const unsigned RP_lt = simd::bits(radial.tMax < polar.tMax);
+    const unsigned RA_lt = simd::bits(radial.tMax < azimuthal.tMax);
+    const unsigned PA_lt = simd::bits(polar.tMax < azimuthal.tMax);
+
+    for (std::size_t i = 0; i < PACKET_SIZE; ++i) {
+      if (!active[i]) continue;
+      TraversalState<double> &state = states[i];
+      const HitParameters<double> radial_hit = {
+          .tMax = tMax[0][i], .tStep = static_cast<int>(tStep[0][i])};
+      HitParameters<double> polar_hit = {.tMax = tMax[1][i],
+                                 .tStep = static_cast<int>(tStep[1][i])};
+      HitParameters<double> azimuthal_hit = {.tMax = tMax[2][i],
+                                     .tStep = static_cast<int>(tStep[2][i])};
+      VoxelIntersectionType voxel_intersection = minimumIntersection(
+          (RP_eq >> i) & 1u, (RA_eq >> i) & 1u, (PA_eq >> i) & 1u,
+          (RP_lt >> i) & 1u, (RA_lt >> i) & 1u, (PA_lt >> i) & 1u);
+      if (simd::lane(polar_perturbed | azimuthal_perturbed, i)) {
+        polar_hit = polarHit(rays[i], grid, polar_min_intersections[i],
+                             polar_max_intersections[i],
+                             state.current_polar_voxel, state.t, state.max_t);
+        azimuthal_hit = azimuthalHit(
+            rays[i], grid, azimuthal_min_intersections[i],
+            azimuthal_max_intersections[i], state.current_azimuthal_voxel,
+            state.t, state.max_t);
+        voxel_intersection =
+            minimumIntersection(radial_hit, polar_hit, azimuthal_hit);
+      }
+      LaneVisitor<PacketVisitor> lane_visitor = {.visitor = visitor,
+                                                 .lane = i};
+      const int previous_radial_voxel = state.current_radial_voxel;
+      if (advanceTraversal<Sectors>(grid, radial_hit, polar_hit,
+                                    azimuthal_hit, voxel_intersection, state,
+                                    lane_visitor)) {
+        if (state.current_radial_voxel != previous_radial_voxel) {
+          radial_crossings[i].advance(rays[i], grid);
+        }
+        continue;
+      }
+      active[i] = false;
+      state = TraversalState<double>();
+      --num_active;
+    }
+  }
+  timer.lap(STEPPING_NANOSECONDS);
+}
+
+// The packet traversal algorithm, with the policy chosen by
+// grid.isFullSphere().
+template <class PacketVisitor>
+inline void walkSphericalVolumePacket(const Ray *rays, std::size_t num_rays,
+                                      const svr::SphericalVoxelGrid &grid,
+                                      double max_t,
+                                      PacketVisitor &visitor) noexcept {
+  if (grid.isFullSphere()) {
+    walkSphericalVolumePacket<FullSphere>(rays, num_rays, grid, max_t, visitor);
+  } else {
+    walkSphericalVolumePacket<Sectored>(rays, num_rays, grid, max_t, visitor);
+  }
+}
+
+}  // namespace internal
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_PACKET_H
@@ -1,23 +1,31 @@
 #ifndef SPHERICAL_VOLUME_RENDERING_SPHERICALVOLUMERENDERINGUTIL_H
 #define SPHERICAL_VOLUME_RENDERING_SPHERICALVOLUMERENDERINGUTIL_H
 
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
+#include "host_device.h"
 #include "ray.h"
+#include "ray_integral.h"
+#include "spherical_volume_rendering_internal.h"
+#include "spherical_volume_rendering_packet.h"
 #include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+#include "traversal_statistics.h"
+#include "traversal_workspace.h"
 #include "vec3.h"
 
 namespace svr {
 
-// Represents a spherical voxel coordinate.
-struct SphericalVoxel {
-  int radial;
-  int polar;
-  int azimuthal;
+class RayOrder;
 
-  // Entrance and exit time into the given voxel.
-  double enter_t;
-  double exit_t;
+// The voxels traversed by a batch of rays, stored contiguously in ray order.
+// The voxels traversed by ray i are voxels[offsets[i]] up to, but not
+// including, voxels[offsets[i + 1]]. Thus offsets.size() == num_rays + 1.
+struct SphericalVoxelBatch {
+  std::vector<std::size_t> offsets;
+  std::vector<SphericalVoxel> voxels;
 };
 
 // A spherical coordinate voxel traversal algorithm. The algorithm traces the
@@ -29,8 +37,284 @@ struct SphericalVoxel {
 // expected values are within bounds [0.0, 1.0]. For example, if max_t <= 0.0,
 // then no voxels will be traversed. If max_t >= 1.0, then the entire sphere
 // will be traversed.
-std::vector<SphericalVoxel> walkSphericalVolume(
-    const Ray &ray, const svr::SphericalVoxelGrid &grid, double max_t) noexcept;
+//
+// The traversal is performed in the floating point type T of the ray and grid.
+// A single precision traversal halves the memory used by the grid and voxels,
+// at the cost of accuracy near the voxel boundaries. It is instantiated for
+// float and double.
+template <class T>
+std::vector<BasicSphericalVoxel<T>> walkSphericalVolume(
+    const BasicRay<T> &ray, const BasicSphericalVoxelGrid<T> &grid,
+    typename internal::NonDeduced<T>::type max_t) noexcept;
+
+extern template std::vector<BasicSphericalVoxel<float>> walkSphericalVolume(
+    const BasicRay<float> &ray, const BasicSphericalVoxelGrid<float> &grid,
+    float max_t) noexcept;
+
+extern template std::vector<BasicSphericalVoxel<double>> walkSphericalVolume(
+    const BasicRay<double> &ray, const BasicSphericalVoxelGrid<double> &grid,
+    double max_t) noexcept;
+
+// The engines with which the traversal calculates the times at which the ray
+// crosses the polar and azimuthal voxel boundaries. SegmentEngine intersects
+// the remaining segment of the ray with each boundary as a 2-d line segment.
+// PlaneEngine instead calculates the crossing times in closed form, since each
+// boundary lies on a plane through the sphere center; this requires fewer
+// operations per step, and no ray segment is maintained. Both make the same
+// comparisons, and so traverse the same voxels, though the times may differ in
+// the last bits. Thus, when the traversal ends exactly upon a boundary, e.g.
+// with max_t such that the ray ends at the sphere center, the engines may
+// disagree upon whether the boundary is crossed.
+//
+// Each engine compares the times and perpendicular products of every step with
+// a comparison policy; see floating_point_comparison_util.h. SegmentEngine and
+// PlaneEngine use RobustComparison, and FastSegmentEngine and FastPlaneEngine
+// use FastComparison, whose wider branchless tolerance may classify crossings
+// within rounding of a boundary differently. The packet traversal always uses
+// the robust comparisons. Other policies are given as, e.g.,
+// BasicSegmentEngine<Comparison>. DefaultEngine is used unless another engine
+// is given; it is SegmentEngine, or FastSegmentEngine when built with
+// -DSVR_ENABLE_FAST_COMPARISON.
+template <class Comparison>
+using BasicSegmentEngine = internal::BasicSegmentEngine<Comparison>;
+template <class Comparison>
+using BasicPlaneEngine = internal::BasicPlaneEngine<Comparison>;
+using SegmentEngine = BasicSegmentEngine<RobustComparison>;
+using PlaneEngine = BasicPlaneEngine<RobustComparison>;
+using FastSegmentEngine = BasicSegmentEngine<FastComparison>;
+using FastPlaneEngine = BasicPlaneEngine<FastComparison>;
+#ifdef SVR_ENABLE_FAST_COMPARISON
+using DefaultEngine = FastSegmentEngine;
+#else
+using DefaultEngine = SegmentEngine;
+#endif
+
+// Similar to above, but rather than returning the voxels traversed, calls
+// visitor(radial, polar, azimuthal, enter_t, exit_t) upon exiting each voxel,
+// in traversal order. No voxel vector is allocated. If the visitor returns
+// false, the traversal stops; this allows, for example, a ray to be terminated
+// once its accumulated opacity is saturated. The visitor may also return void,
+// in which case the entire traversal is completed. The times given to the
+// visitor are of type T. The engine may be chosen explicitly, e.g.
+// walkSphericalVolume<svr::SegmentEngine>(ray, grid, max_t, visitor).
+template <class Engine = DefaultEngine, class T, class Visitor>
+inline void walkSphericalVolume(const BasicRay<T> &ray,
+                                const BasicSphericalVoxelGrid<T> &grid,
+                                typename internal::NonDeduced<T>::type max_t,
+                                Visitor &&visitor) noexcept {
+  internal::walkSphericalVolume<Engine>(ray, grid, max_t, visitor);
+}
+
+// Similar to above, but the setup of the traversal first tests the voxel IDs
+// of hint, the entrance voxel of a nearby ray, e.g. the ray of the same pixel
+// in the previous frame of an animation, or the neighbouring ray of a tile.
+// A hint that is correct, or off by one angular voxel, is confirmed or
+// corrected with a few comparisons, rather than the search for each voxel ID;
+// any other hint falls back to that search. The voxels visited are identical
+// with or without a hint. Returns the entrance voxel of the ray, i.e. the
+// first voxel visited, or EntryVoxel() if the ray does not intersect the grid
+// within max_t, to be given as the hint of the ray's next traversal.
+template <class Engine = DefaultEngine, class T, class Visitor>
+inline EntryVoxel walkSphericalVolume(
+    const BasicRay<T> &ray, const BasicSphericalVoxelGrid<T> &grid,
+    typename internal::NonDeduced<T>::type max_t, const EntryVoxel &hint,
+    Visitor &&visitor) noexcept {
+  return internal::walkSphericalVolume<Engine>(ray, grid, max_t, visitor,
+                                               hint);
+}
+
+// Similar to above, but traverses a view of a grid, e.g. one whose tables are
+// in GPU memory. The voxels visited are identical to those of the grid the
+// view was constructed from. This may be called from a GPU kernel.
+template <class Engine = DefaultEngine, class T, class Visitor>
+SVR_HOST_DEVICE inline void walkSphericalVolume(
+    const BasicRay<T> &ray, const BasicSphericalVoxelGridView<T> &grid,
+    typename internal::NonDeduced<T>::type max_t, Visitor &&visitor) noexcept {
+  internal::walkSphericalVolume<Engine>(ray, grid, max_t, visitor);
+}
+
+// Traverses the ray as above, and composites the voxels of field front to back
+// as they are visited, so that no voxel vector is allocated. field holds a
+// value for each voxel in row-major order, beginning with the outermost radial
+// voxel, i.e. the value of voxel (radial, polar, azimuthal) is:
+//   field[((radial - 1) * grid.numPolarSections() + polar) *
+//         grid.numAzimuthalSections() + azimuthal]
+// transfer_function(value) returns the BasicTransferSample<T> of a value. A
+// voxel the ray spends a time dt within has the opacity alpha = 1 -
+// exp(-extinction * dt), and is weighted by (1 - opacity) * alpha, where
+// opacity is that accumulated thus far. The traversal stops once the
+// accumulated opacity reaches opacity_threshold, so the remaining voxels of an
+// opaque ray are never traversed.
+template <class Engine = DefaultEngine, class T, class Value,
+          class TransferFunction>
+inline BasicRayIntegral<T> integrateSphericalVolume(
+    const BasicRay<T> &ray, const BasicSphericalVoxelGrid<T> &grid,
+    const Value *field, TransferFunction &&transfer_function,
+    typename internal::NonDeduced<T>::type max_t,
+    typename internal::NonDeduced<T>::type opacity_threshold =
+        0.99) noexcept {
+  internal::RayCompositor<T, Value, TransferFunction> compositor(
+      field, transfer_function, grid.numPolarSections(),
+      grid.numAzimuthalSections(), opacity_threshold);
+  internal::walkSphericalVolume<Engine>(ray, grid, max_t, compositor);
+  return compositor.integral();
+}
+
+// Similar to above, but the traversal is given an EntryVoxel hint as with the
+// hinted walkSphericalVolume(). If the ray intersects the grid, hint is then
+// replaced by its entrance voxel, so that the same hint may be passed to the
+// integral of the next ray, e.g. the neighbouring pixel of an image.
+template <class Engine = DefaultEngine, class T, class Value,
+          class TransferFunction>
+inline BasicRayIntegral<T> integrateSphericalVolume(
+    const BasicRay<T> &ray, const BasicSphericalVoxelGrid<T> &grid,
+    const Value *field, TransferFunction &&transfer_function,
+    typename internal::NonDeduced<T>::type max_t,
+    typename internal::NonDeduced<T>::type opacity_threshold,
+    EntryVoxel &hint) noexcept {
+  internal::RayCompositor<T, Value, TransferFunction> compositor(
+      field, transfer_function, grid.numPolarSections(),
+      grid.numAzimuthalSections(), opacity_threshold);
+  const EntryVoxel entry_voxel =
+      internal::walkSphericalVolume<Engine>(ray, grid, max_t, compositor, hint);
+  if (entry_voxel.radial != 0) hint = entry_voxel;
+  return compositor.integral();
+}
+
+// The number of rays traversed together by walkSphericalVolumePacket(). This
+// is the number of double-precision lanes in a vector register: 8 with
+// AVX-512, and 4 otherwise.
+constexpr std::size_t RAY_PACKET_SIZE = internal::PACKET_SIZE;
+
+// Traverses a packet of up to RAY_PACKET_SIZE rays together, with the same
+// grid and max_t as above. Calls visitor(lane, radial, polar, azimuthal,
+// enter_t, exit_t) upon exiting each voxel, where lane is the index of the ray
+// in rays. The voxels of each lane are visited in traversal order and are
+// identical to those of walkSphericalVolume(rays[lane], grid, max_t), though
+// the visits of different lanes are interleaved. The enter and exit times may
+// differ in the last bits if the compiler contracts multiply-adds (e.g. with
+// FMA) differently for the vector and scalar code. If the visitor returns
+// false, the traversal of that lane stops. Rays beyond the first
+// RAY_PACKET_SIZE are ignored. This is most effective for coherent rays, such
+// as neighbouring rays of an orthographic projection, which take a similar
+// number of steps. The packet traversal is double precision only.
+template <class PacketVisitor>
+inline void walkSphericalVolumePacket(const Ray *rays, std::size_t num_rays,
+                                      const svr::SphericalVoxelGrid &grid,
+                                      double max_t,
+                                      PacketVisitor &&visitor) noexcept {
+  internal::walkSphericalVolumePacket(
+      rays, std::min(num_rays, RAY_PACKET_SIZE), grid, max_t, visitor);
+}
+
+// Similar to the vector-returning walkSphericalVolume() in double precision,
+// but the voxels are written to workspace.voxels(), which is cleared first.
+// Returns a reference to workspace.voxels(), which is valid until the workspace
+// is used again.
+const std::vector<SphericalVoxel> &walkSphericalVolume(
+    const Ray &ray, const svr::SphericalVoxelGrid &grid, double max_t,
+    TraversalWorkspace &workspace) noexcept;
+
+// Traverses num_rays rays with the same grid and max_t as above. The rays are
+// split across the workers of svr::ThreadPool::global() with work stealing. At
+// most num_threads workers are used; if num_threads is 0, all workers are
+// used. The resulting voxels of each ray are identical to those returned by
+// walkSphericalVolume() in double precision.
+SphericalVoxelBatch walkSphericalVolumeBatch(const Ray *rays,
+                                             std::size_t num_rays,
+                                             const SphericalVoxelGrid &grid,
+                                             double max_t,
+                                             std::size_t num_threads = 0);
+
+// Similar to above, but runs on the given thread pool.
+SphericalVoxelBatch walkSphericalVolumeBatch(const Ray *rays,
+                                             std::size_t num_rays,
+                                             const SphericalVoxelGrid &grid,
+                                             double max_t, ThreadPool &pool,
+                                             std::size_t num_threads = 0);
+
+// Similar to above, but warm starts the traversals from hints, the entrance
+// voxels of the previous batch of rays, e.g. the previous frame of an
+// animation whose camera moves little between frames. Ray i is given the hint
+// hints[i] or, if there is none, the entrance voxel of the ray before it, and
+// hints[i] is then set to its entrance voxel for the next batch. Hints of a
+// different number of rays are discarded first. See the hinted
+// walkSphericalVolume(); the voxels are identical to those without hints.
+SphericalVoxelBatch walkSphericalVolumeBatch(
+    const Ray *rays, std::size_t num_rays, const SphericalVoxelGrid &grid,
+    double max_t, EntryVoxelHints &hints,
+    ThreadPool &pool = ThreadPool::global(), std::size_t num_threads = 0);
+
+// The first pass of a batched traversal into caller-provided memory. Counts
+// the voxels traversed by each of num_rays rays with the same grid and max_t as
+// above, without storing the voxels. offsets must hold num_rays + 1 elements.
+// Upon return, offsets[0] is 0 and offsets[i + 1] - offsets[i] is the number
+// of voxels traversed by ray i, i.e. offsets are those of a
+// SphericalVoxelBatch. Returns offsets[num_rays], the total number of voxels.
+// The rays are split across the workers of pool as with
+// walkSphericalVolumeBatch().
+std::size_t countSphericalVoxelBatch(const Ray *rays, std::size_t num_rays,
+                                     const SphericalVoxelGrid &grid,
+                                     double max_t, std::size_t *offsets,
+                                     ThreadPool &pool = ThreadPool::global(),
+                                     std::size_t num_threads = 0);
+
+// Similar to above, but with the 64-bit signed offsets used by NumPy and MPI.
+std::size_t countSphericalVoxelBatch(const Ray *rays, std::size_t num_rays,
+                                     const SphericalVoxelGrid &grid,
+                                     double max_t, std::int64_t *offsets,
+                                     ThreadPool &pool = ThreadPool::global(),
+                                     std::size_t num_threads = 0);
+
+// The second pass of a batched traversal into caller-provided memory. Given
+// the offsets returned by countSphericalVoxelBatch() for the same rays, grid,
+// and max_t, writes the voxels traversed by ray i to voxels[offsets[i]] up to,
+// but not including, voxels[offsets[i + 1]]. voxels must hold
+// offsets[num_rays] voxels. Since each ray writes only to its own range, the
+// output is perfectly packed, and no memory is allocated or copied after the
+// traversal. This traverses each ray twice, but for large batches avoids the
+// per-worker buffers and the gather of walkSphericalVolumeBatch(), and allows
+// the caller to reuse one allocation across batches. A ray never writes
+// beyond its range, even if offsets do not match the rays.
+void fillSphericalVoxelBatch(const Ray *rays, std::size_t num_rays,
+                             const SphericalVoxelGrid &grid, double max_t,
+                             const std::size_t *offsets,
+                             SphericalVoxel *voxels,
+                             ThreadPool &pool = ThreadPool::global(),
+                             std::size_t num_threads = 0);
+
+// Similar to above, but writes the voxels to flat, row-major arrays as with
+// copySphericalVoxelBatch(), e.g. those of NumPy arrays.
+void fillSphericalVoxelBatch(const Ray *rays, std::size_t num_rays,
+                             const SphericalVoxelGrid &grid, double max_t,
+                             const std::int64_t *offsets,
+                             std::int32_t *indices, double *times,
+                             ThreadPool &pool = ThreadPool::global(),
+                             std::size_t num_threads = 0);
+
+// Similar to the batch functions above, but the rays are traversed in the
+// given order, e.g. a RayOrder of the same rays, so that consecutive
+// traversals touch nearby voxels. The voxels of each ray are still written to
+// its own place in the batch, so the results are identical to those above.
+// order.size() must be num_rays.
+SphericalVoxelBatch walkSphericalVolumeBatch(
+    const Ray *rays, std::size_t num_rays, const SphericalVoxelGrid &grid,
+    double max_t, const RayOrder &order,
+    ThreadPool &pool = ThreadPool::global(), std::size_t num_threads = 0);
+
+std::size_t countSphericalVoxelBatch(const Ray *rays, std::size_t num_rays,
+                                     const SphericalVoxelGrid &grid,
+                                     double max_t, std::size_t *offsets,
+                                     const RayOrder &order,
+                                     ThreadPool &pool = ThreadPool::global(),
+                                     std::size_t num_threads = 0);
+
+void fillSphericalVoxelBatch(const Ray *rays, std::size_t num_rays,
+                             const SphericalVoxelGrid &grid, double max_t,
+                             const std::size_t *offsets,
+                             SphericalVoxel *voxels, const RayOrder &order,
+                             ThreadPool &pool = ThreadPool::global(),
+                             std::size_t num_threads = 0);
 
 // Simplified parameters to Cythonize the function; implementation remains the
 // same as above.
@@ -40,6 +324,88 @@ std::vector<SphericalVoxel> walkSphericalVolume(
     std::size_t num_polar_voxels, std::size_t num_azimuthal_voxels,
     double *sphere_center, double max_t) noexcept;
 
+// Similar to above, but traverses a grid that is already constructed. Since
+// constructing a grid computes its boundary tables, a grid that is reused
+// across calls should be passed here instead.
+std::vector<SphericalVoxel> walkSphericalVolume(
+    const double *ray_origin, const double *ray_direction,
+    const SphericalVoxelGrid &grid, double max_t) noexcept;
+
+// Simplified parameters to Cythonize the batched traversal; implementation
+// remains the same as walkSphericalVolumeBatch() above. The origin and
+// direction of ray i are given by the three elements beginning at
+// ray_origins[3 * i] and ray_directions[3 * i] respectively. The grid
+// parameters are the same as the single ray version above.
+SphericalVoxelBatch walkSphericalVolumeBatch(
+    const double *ray_origins, const double *ray_directions,
+    std::size_t num_rays, const double *min_bound, const double *max_bound,
+    std::size_t num_radial_voxels, std::size_t num_polar_voxels,
+    std::size_t num_azimuthal_voxels, const double *sphere_center,
+    double max_t, std::size_t num_threads);
+
+// Similar to above, but traverses a grid that is already constructed.
+SphericalVoxelBatch walkSphericalVolumeBatch(const double *ray_origins,
+                                             const double *ray_directions,
+                                             std::size_t num_rays,
+                                             const SphericalVoxelGrid &grid,
+                                             double max_t,
+                                             std::size_t num_threads);
+
+// Simplified parameters to Cythonize the two-pass batched traversal;
+// implementation remains the same as countSphericalVoxelBatch() and
+// fillSphericalVoxelBatch() above. The rays are given as with
+// walkSphericalVolumeBatch() above.
+std::size_t countSphericalVoxelBatch(const double *ray_origins,
+                                     const double *ray_directions,
+                                     std::size_t num_rays,
+                                     const SphericalVoxelGrid &grid,
+                                     double max_t, std::int64_t *offsets,
+                                     std::size_t num_threads);
+
+void fillSphericalVoxelBatch(const double *ray_origins,
+                             const double *ray_directions,
+                             std::size_t num_rays,
+                             const SphericalVoxelGrid &grid, double max_t,
+                             const std::int64_t *offsets,
+                             std::int32_t *indices, double *times,
+                             std::size_t num_threads);
+
+// Simplified parameters to Cythonize the ordered two-pass batched traversal.
+// orderSphericalRays() writes the RayOrder of the rays for the given ordering,
+// i.e. a svr::RayOrdering, to order, which holds num_rays elements. The count
+// and fill functions traverse the rays in that order, or in the order given
+// if order is null, and are otherwise the same as those above.
+void orderSphericalRays(const double *ray_origins,
+                        const double *ray_directions, std::size_t num_rays,
+                        const SphericalVoxelGrid &grid, int ordering,
+                        std::uint32_t *order);
+
+std::size_t countSphericalVoxelBatch(const double *ray_origins,
+                                     const double *ray_directions,
+                                     std::size_t num_rays,
+                                     const SphericalVoxelGrid &grid,
+                                     double max_t, std::int64_t *offsets,
+                                     const std::uint32_t *order,
+                                     std::size_t num_threads);
+
+void fillSphericalVoxelBatch(const double *ray_origins,
+                             const double *ray_directions,
+                             std::size_t num_rays,
+                             const SphericalVoxelGrid &grid, double max_t,
+                             const std::int64_t *offsets,
+                             std::int32_t *indices, double *times,
+                             const std::uint32_t *order,
+                             std::size_t num_threads);
+
+// Copies the batch into flat, row-major arrays, e.g. those of NumPy arrays.
+// offsets holds batch.offsets, and thus has num_rays + 1 elements. For voxel i
+// of batch.voxels, indices[3 * i, 3 * i + 3) holds its radial, polar, and
+// azimuthal voxel IDs, and times[2 * i, 2 * i + 2) holds its enter and exit
+// times.
+void copySphericalVoxelBatch(const SphericalVoxelBatch &batch,
+                             std::int64_t *offsets, std::int32_t *indices,
+                             double *times) noexcept;
+
 }  // namespace svr
 
 #endif  // SPHERICAL_VOLUME_RENDERING_SPHERICALVOLUMERENDERINGUTIL_H
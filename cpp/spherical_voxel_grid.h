@@ -1,31 +1,81 @@
 #ifndef SPHERICAL_VOLUME_RENDERING_SPHERICALVOXELGRID_H
 #define SPHERICAL_VOLUME_RENDERING_SPHERICALVOXELGRID_H
 
+#include <algorithm>
+#include <cmath>
+#include <utility>
 #include <vector>
 
+#include "aligned_allocator.h"
+#include "floating_point_comparison_util.h"
+#include "host_device.h"
 #include "vec3.h"
 
 namespace svr {
 
 // Represents the boundary for the sphere. This is used to determine the minimum
 // and maximum boundaries for a sectored traversal.
-struct SphereBound {
-  double radial;
-  double polar;
-  double azimuthal;
+template <class T>
+struct BasicSphereBound {
+  T radial;
+  T polar;
+  T azimuthal;
+};
+
+// Represents a spherical voxel coordinate.
+template <class T>
+struct BasicSphericalVoxel {
+  int radial;
+  int polar;
+  int azimuthal;
+
+  // Entrance and exit time into the given voxel.
+  T enter_t;
+  T exit_t;
+};
+
+// The voxel in which the traversal of a ray begins. Given as a hint to the
+// traversal of a nearby ray, e.g. the ray of the same pixel in the previous
+// frame of an animation, its voxel IDs are tested before they are searched
+// for. A radial voxel ID of 0, as with EntryVoxel(), is no hint, since
+// traversed voxels have radial voxel IDs of at least 1.
+struct EntryVoxel {
+  int radial;
+  int polar;
+  int azimuthal;
 };
 
 // Represents a line segment that is used for the points of intersections
 // between the lines corresponding to voxel boundaries and a given radial voxel.
-struct LineSegment {
-  double P1;
-  double P2;
+template <class T>
+struct BasicLineSegment {
+  T P1;
+  T P2;
 };
 
 // The trigonometric values for a given radian.
-struct TrigonometricValues {
-  double cosine;
-  double sine;
+template <class T>
+struct BasicTrigonometricValues {
+  T cosine;
+  T sine;
+};
+
+// The values needed to test for an intersection with a single angular voxel
+// boundary, packed together so that a boundary test reads them from one cache
+// line rather than from separate tables. The boundaries of polar voxels lie in
+// the XY plane, and the boundaries of azimuthal voxels lie in the XZ plane. For
+// a polar boundary, the second component of each value is Y; for an azimuthal
+// boundary, it is Z.
+template <class T>
+struct alignas(4 * sizeof(T)) BasicAngularBoundary {
+  // The point of intersection between the boundary and the circle of maximum
+  // radius.
+  T P1;
+  T P2;
+
+  // The in-plane components of the vector sphere center - {P1, P2}.
+  T center_to_bound_1;
+  T center_to_bound_2;
 };
 
 namespace {
@@ -40,21 +90,59 @@ constexpr double TAU = 2 * M_PI;
 //
 // Given: num_radial_voxels = 3, max_radius = 6, delta_radius = 2
 // Returns: { 6*6, 4*4, 2*2, 0*0 }
-std::vector<double> initializeDeltaRadiiSquared(
-    const std::size_t num_radial_voxels, const double max_radius,
-    const double delta_radius) noexcept {
-  std::vector<double> delta_radii_squared(num_radial_voxels + 1);
+template <class T>
+AlignedVector<T> initializeDeltaRadiiSquared(
+    const std::size_t num_radial_voxels, const T max_radius,
+    const T delta_radius) noexcept {
+  AlignedVector<T> delta_radii_squared(num_radial_voxels + 1);
 
-  double current_delta_radius = max_radius;
+  T current_delta_radius = max_radius;
   std::generate(delta_radii_squared.begin(), delta_radii_squared.end(),
-                [&]() -> double {
-                  const double old_delta_radius = current_delta_radius;
+                [&]() -> T {
+                  const T old_delta_radius = current_delta_radius;
                   current_delta_radius -= delta_radius;
                   return old_delta_radius * old_delta_radius;
                 });
   return delta_radii_squared;
 }
 
+// Initializes the delta radii squared of a grid with the given increasing
+// radial edges. As above, these are the squared radii from the outermost edge
+// to the innermost. For example,
+//
+// Given: radial_edges = { 0, 1, 3, 6 }
+// Returns: { 6*6, 3*3, 1*1, 0*0 }
+template <class T>
+AlignedVector<T> initializeDeltaRadiiSquared(
+    const std::vector<T> &radial_edges) noexcept {
+  AlignedVector<T> delta_radii_squared(radial_edges.size());
+  std::transform(radial_edges.crbegin(), radial_edges.crend(),
+                 delta_radii_squared.begin(),
+                 [](T radius) -> T { return radius * radius; });
+  return delta_radii_squared;
+}
+
+// Returns the num_radial_sections + 1 radial edges of a logarithmic grid. The
+// innermost section is the ball of radius min_radius, and the radii of the
+// remaining edges increase geometrically from min_radius to max_radius. For
+// example,
+//
+// Given: num_radial_sections = 4, min_radius = 1, max_radius = 27
+// Returns: { 0, 1, 3, 9, 27 }
+template <class T>
+std::vector<T> initializeLogarithmicRadialEdges(
+    std::size_t num_radial_sections, T min_radius, T max_radius) noexcept {
+  std::vector<T> radial_edges(num_radial_sections + 1, T(0));
+  radial_edges.back() = max_radius;
+  if (num_radial_sections < 2) return radial_edges;
+  const T log_ratio = std::log(max_radius / min_radius) /
+                      static_cast<T>(num_radial_sections - 1);
+  for (std::size_t i = 1; i < num_radial_sections; ++i) {
+    radial_edges[i] = min_radius * std::exp(log_ratio * static_cast<T>(i - 1));
+  }
+  return radial_edges;
+}
+
 // Returns a vector of TrigonometricValues for the given number of voxels.
 // This begins with min_bound, and increments by a value of delta
 // for num_voxels + 1 iterations. For example,
@@ -63,16 +151,16 @@ std::vector<double> initializeDeltaRadiiSquared(
 // Returns: { {.cosine=1.0, .sine=0.0},
 //            {.cosine=0.0, .sine=1.0},
 //            {.cosine=1.0, .sine=0.0} }
-std::vector<TrigonometricValues> initializeTrigonometricValues(
-    const std::size_t num_voxels, const double min_bound,
-    const double delta) noexcept {
-  std::vector<TrigonometricValues> trig_values(num_voxels + 1);
+template <class T>
+std::vector<BasicTrigonometricValues<T>> initializeTrigonometricValues(
+    const std::size_t num_voxels, const T min_bound, const T delta) noexcept {
+  std::vector<BasicTrigonometricValues<T>> trig_values(num_voxels + 1);
 
-  double radians = min_bound;
+  T radians = min_bound;
   std::generate(trig_values.begin(), trig_values.end(),
-                [&]() -> TrigonometricValues {
-                  const double cos = std::cos(radians);
-                  const double sin = std::sin(radians);
+                [&]() -> BasicTrigonometricValues<T> {
+                  const T cos = std::cos(radians);
+                  const T sin = std::sin(radians);
                   radians += delta;
                   return {.cosine = cos, .sine = sin};
                 });
@@ -85,53 +173,81 @@ std::vector<TrigonometricValues> initializeTrigonometricValues(
 //
 // The LineSegment points P1 and P2 are calculated with the following equation:
 // .P1 = max_radius * trig_value.cosine + center.x().
-// .P2 = max_radius * trig_value.sine + center.y().
-std::vector<LineSegment> initializeMaxRadiusLineSegments(
-    const std::size_t num_voxels, const BoundVec3 &center,
-    const double max_radius,
-    const std::vector<TrigonometricValues> &trig_values) noexcept {
-  std::vector<LineSegment> line_segments(num_voxels + 1);
-  std::transform(trig_values.cbegin(), trig_values.cend(),
-                 line_segments.begin(),
-                 [&](const TrigonometricValues &trig_value) -> LineSegment {
-                   return {.P1 = max_radius * trig_value.cosine + center.x(),
-                           .P2 = max_radius * trig_value.sine + center.y()};
-                 });
+// .P2 = max_radius * trig_value.sine + sphere_center_2.
+// Here, sphere_center_2 is the second in-plane component of the sphere center,
+// i.e. Y for polar voxels and Z for azimuthal voxels.
+template <class T>
+std::vector<BasicLineSegment<T>> initializeMaxRadiusLineSegments(
+    const std::size_t num_voxels, const BasicBoundVec3<T> &center,
+    const T sphere_center_2, const T max_radius,
+    const std::vector<BasicTrigonometricValues<T>> &trig_values) noexcept {
+  std::vector<BasicLineSegment<T>> line_segments(num_voxels + 1);
+  std::transform(
+      trig_values.cbegin(), trig_values.cend(), line_segments.begin(),
+      [&](const BasicTrigonometricValues<T> &trig_value)
+          -> BasicLineSegment<T> {
+        return {.P1 = max_radius * trig_value.cosine + center.x(),
+                .P2 = max_radius * trig_value.sine + sphere_center_2};
+      });
   return line_segments;
 }
 
-// Initializes the vectors determined by the following calculation:
-// sphere center - {X, Y, Z}, WHERE X, Y = P1, P2 for polar voxels.
-std::vector<BoundVec3> initializeCenterToPolarPMaxVectors(
-    const std::vector<LineSegment> &line_segments,
-    const BoundVec3 &center) noexcept {
-  std::vector<BoundVec3> center_to_pmax_vectors;
-  center_to_pmax_vectors.reserve(line_segments.size());
-
-  for (const auto &points : line_segments) {
-    center_to_pmax_vectors.emplace_back(center -
-                                        FreeVec3(points.P1, points.P2, 0.0));
-  }
-  return center_to_pmax_vectors;
+// Initializes the packed angular boundaries from the maximum radius line
+// segments. The center to boundary vectors are determined by the following
+// calculation: sphere center - {X, Y, Z}, WHERE X, Y = P1, P2 for polar voxels,
+// and X, Z = P1, P2 for azimuthal voxels. Here, sphere_center_2 is the second
+// in-plane component of the sphere center, i.e. Y for polar voxels and Z for
+// azimuthal voxels.
+template <class T>
+AlignedVector<BasicAngularBoundary<T>> initializeAngularBoundaries(
+    const std::vector<BasicLineSegment<T>> &line_segments,
+    const BasicBoundVec3<T> &center, const T sphere_center_2) noexcept {
+  AlignedVector<BasicAngularBoundary<T>> boundaries(line_segments.size());
+  std::transform(
+      line_segments.cbegin(), line_segments.cend(), boundaries.begin(),
+      [&](const BasicLineSegment<T> &points) -> BasicAngularBoundary<T> {
+        return {.P1 = points.P1,
+                .P2 = points.P2,
+                .center_to_bound_1 = center.x() - points.P1,
+                .center_to_bound_2 = sphere_center_2 - points.P2};
+      });
+  return boundaries;
 }
 
-// Similar to above, but uses:
-// sphere center - {X, Y, Z}, WHERE X, Z = P1, P2 for azimuthal voxels.
-std::vector<BoundVec3> initializeCenterToAzimuthalPMaxVectors(
-    const std::vector<LineSegment> &line_segments,
-    const BoundVec3 &center) noexcept {
-  std::vector<BoundVec3> center_to_pmax_vectors;
-  center_to_pmax_vectors.reserve(line_segments.size());
-
-  for (const auto &points : line_segments) {
-    center_to_pmax_vectors.emplace_back(center -
-                                        FreeVec3(points.P1, 0.0, points.P2));
-  }
-  return center_to_pmax_vectors;
+// Returns true if the bounds span the entire sphere, i.e. [0, 2pi] in both the
+// polar and azimuthal angles.
+template <class T>
+inline bool initializeIsFullSphere(const BasicSphereBound<T> &min_bound,
+                                   const BasicSphereBound<T> &max_bound) {
+  return svr::isEqual(min_bound.polar, T(0)) &&
+         svr::isEqual(min_bound.azimuthal, T(0)) &&
+         svr::isEqual(max_bound.polar, T(TAU)) &&
+         svr::isEqual(max_bound.azimuthal, T(TAU));
 }
 
 }  // namespace
 
+// The values of a spherical voxel grid other than its tables, as returned by
+// BasicSphericalVoxelGrid::parameters(). See BasicSphericalVoxelGrid for each.
+template <class T>
+struct BasicSphericalVoxelGridParameters {
+  std::size_t num_radial_sections, num_polar_sections, num_azimuthal_sections;
+  BasicBoundVec3<T> sphere_center;
+  T sphere_max_bound_polar;
+  T sphere_min_bound_polar;
+  T sphere_max_bound_azimuthal;
+  T sphere_min_bound_azimuthal;
+  T sphere_max_radius;
+  T sphere_max_diameter;
+  T delta_radius;
+  T delta_theta, delta_phi;
+  bool is_full_sphere;
+  bool is_radially_uniform;
+};
+
+template <class T>
+class BasicSphericalVoxelGridView;
+
 // Represents a spherical voxel grid used for ray casting. The bounds of the
 // grid are determined by min_bound and max_bound. The deltas are then
 // determined by (max_bound.X - min_bound.X) / num_X_sections. To minimize
@@ -142,50 +258,142 @@ std::vector<BoundVec3> initializeCenterToAzimuthalPMaxVectors(
 // from spherical coordinates. We represent both polar and azimuthal within
 // bounds [0, 2pi].
 // TODO(cgyurgyik): Look into updating polar grid from [0, 2pi] -> [0, pi].
-struct SphericalVoxelGrid {
+//
+// The radial sections are uniform unless the grid is constructed from its
+// radial edges, e.g. with logarithmic(), in which case the radial voxel of a
+// point is found by binary search rather than directly.
+//
+// The grid values are of the floating point type T, as are the rays that
+// traverse it. SphericalVoxelGrid is the double precision grid.
+template <class T>
+struct BasicSphericalVoxelGrid {
  public:
-  SphericalVoxelGrid(const SphereBound &min_bound, const SphereBound &max_bound,
-                     std::size_t num_radial_sections,
-                     std::size_t num_polar_sections,
-                     std::size_t num_azimuthal_sections,
-                     const BoundVec3 &sphere_center) noexcept
-      : num_radial_sections_(num_radial_sections),
-        num_polar_sections_(num_polar_sections),
-        num_azimuthal_sections_(num_azimuthal_sections),
-        sphere_center_(sphere_center),
-        sphere_max_bound_polar_(max_bound.polar),
-        sphere_min_bound_polar_(min_bound.polar),
-        sphere_max_bound_azimuthal_(max_bound.azimuthal),
-        sphere_min_bound_azimuthal_(min_bound.azimuthal),
-        // TODO(cgyurgyik): Verify we want the sphere_max_radius to simply be
-        // max_bound.radial.
-        sphere_max_radius_(max_bound.radial),
-        sphere_max_diameter_(sphere_max_radius_ * 2.0),
-        delta_radius_((max_bound.radial - min_bound.radial) /
-                      num_radial_sections),
-        delta_theta_((max_bound.polar - min_bound.polar) / num_polar_sections),
-        delta_phi_((max_bound.azimuthal - min_bound.azimuthal) /
-                   num_azimuthal_sections),
-        // TODO(cgyurgyik): Verify this is actually what we want for
-        // 'max_radius'. The other option is simply using max_bound.radial
-        delta_radii_sq_(initializeDeltaRadiiSquared(
-            num_radial_sections,
-            /*max_radius=*/max_bound.radial - min_bound.radial, delta_radius_)),
-        polar_trig_values_(initializeTrigonometricValues(
-            num_polar_sections, min_bound.polar, delta_theta_)),
-        azimuthal_trig_values_(initializeTrigonometricValues(
-            num_azimuthal_sections, min_bound.azimuthal, delta_phi_)),
-        P_max_polar_(initializeMaxRadiusLineSegments(
-            num_polar_sections, sphere_center, sphere_max_radius_,
-            polar_trig_values_)),
-        P_max_azimuthal_(initializeMaxRadiusLineSegments(
-            num_azimuthal_sections, sphere_center, sphere_max_radius_,
-            azimuthal_trig_values_)),
-        center_to_polar_bound_vectors_(
-            initializeCenterToPolarPMaxVectors(P_max_polar_, sphere_center)),
-        center_to_azimuthal_bound_vectors_(
-            initializeCenterToAzimuthalPMaxVectors(P_max_azimuthal_,
-                                                   sphere_center)) {}
+  using value_type = T;
+
+  BasicSphericalVoxelGrid(const BasicSphereBound<T> &min_bound,
+                          const BasicSphereBound<T> &max_bound,
+                          std::size_t num_radial_sections,
+                          std::size_t num_polar_sections,
+                          std::size_t num_azimuthal_sections,
+                          const BasicBoundVec3<T> &sphere_center) noexcept
+      // TODO(cgyurgyik): Verify this is actually what we want for
+      // 'max_radius'. The other option is simply using max_bound.radial
+      : BasicSphericalVoxelGrid(
+            min_bound, max_bound,
+            initializeDeltaRadiiSquared(
+                num_radial_sections,
+                /*max_radius=*/max_bound.radial - min_bound.radial,
+                (max_bound.radial - min_bound.radial) / num_radial_sections),
+            /*is_radially_uniform=*/true, num_polar_sections,
+            num_azimuthal_sections, sphere_center) {}
+
+  // A grid with non-uniform radial sections, e.g. finer near the center.
+  // radial_edges holds the N + 1 strictly increasing radii that bound the N
+  // radial sections. Radial voxel i, for i in [1, N], lies between
+  // radial_edges[N - i] and radial_edges[N - i + 1], so voxel 1 remains the
+  // outermost. The ball within radial_edges[0] is traversed as part of voxel N,
+  // so radial_edges[0] is usually 0. The radial bounds of min_bound and
+  // max_bound are unused; the angular bounds are as above. radial_edges must
+  // hold at least 2 edges, with radial_edges[0] >= 0; check isValid(). If it
+  // does not, the grid instead has the single radial section of radial edges
+  // { 0, 1 }, so that it remains safe to traverse.
+  BasicSphericalVoxelGrid(const BasicSphereBound<T> &min_bound,
+                          const BasicSphereBound<T> &max_bound,
+                          const std::vector<T> &radial_edges,
+                          std::size_t num_polar_sections,
+                          std::size_t num_azimuthal_sections,
+                          const BasicBoundVec3<T> &sphere_center) noexcept
+      : BasicSphericalVoxelGrid(min_bound, max_bound,
+                                validRadialEdges(radial_edges),
+                                isValidRadialEdges(radial_edges),
+                                num_polar_sections, num_azimuthal_sections,
+                                sphere_center) {}
+
+  // A grid whose radial sections grow geometrically from the center, for data
+  // that needs finer sections near the center than at the edge. The innermost
+  // radial voxel is the ball of radius min_bound.radial, and the remaining
+  // num_radial_sections - 1 sections are between radii that increase by a
+  // constant factor up to max_bound.radial. Requires 0 < min_bound.radial <
+  // max_bound.radial and num_radial_sections > 0; check isValid(). The angular
+  // bounds are as above.
+  static inline BasicSphericalVoxelGrid logarithmic(
+      const BasicSphereBound<T> &min_bound,
+      const BasicSphereBound<T> &max_bound, std::size_t num_radial_sections,
+      std::size_t num_polar_sections, std::size_t num_azimuthal_sections,
+      const BasicBoundVec3<T> &sphere_center) noexcept {
+    return BasicSphericalVoxelGrid(
+        min_bound, max_bound,
+        initializeLogarithmicRadialEdges(num_radial_sections, min_bound.radial,
+                                         max_bound.radial),
+        num_polar_sections, num_azimuthal_sections, sphere_center);
+  }
+
+  // A grid with the parameters of view and copies of its tables, which is
+  // identical to the grid the view was constructed from. Since the tables are
+  // copied rather than recomputed, e.g. from a file mapped by
+  // MappedSphericalVoxelGrid, no trigonometric functions are evaluated. The
+  // tables of view must be in host memory.
+  explicit BasicSphericalVoxelGrid(
+      const BasicSphericalVoxelGridView<T> &view) noexcept
+      : num_radial_sections_(view.numRadialSections()),
+        num_polar_sections_(view.numPolarSections()),
+        num_azimuthal_sections_(view.numAzimuthalSections()),
+        sphere_center_(view.sphereCenter()),
+        sphere_max_bound_polar_(view.sphereMaxBoundPolar()),
+        sphere_min_bound_polar_(view.sphereMinBoundPolar()),
+        sphere_max_bound_azimuthal_(view.sphereMaxBoundAzi()),
+        sphere_min_bound_azimuthal_(view.sphereMinBoundAzi()),
+        sphere_max_radius_(view.sphereMaxRadius()),
+        sphere_max_diameter_(view.sphereMaxDiameter()),
+        delta_radius_(view.deltaRadius()),
+        delta_theta_(view.deltaTheta()),
+        delta_phi_(view.deltaPhi()),
+        delta_radii_sq_(
+            view.tables().delta_radii_sq,
+            view.tables().delta_radii_sq + num_radial_sections_ + 1),
+        polar_trig_values_(
+            view.tables().polar_trig_values,
+            view.tables().polar_trig_values + num_polar_sections_ + 1),
+        azimuthal_trig_values_(
+            view.tables().azimuthal_trig_values,
+            view.tables().azimuthal_trig_values + num_azimuthal_sections_ + 1),
+        polar_boundaries_(
+            view.tables().polar_boundaries,
+            view.tables().polar_boundaries + num_polar_sections_ + 1),
+        azimuthal_boundaries_(
+            view.tables().azimuthal_boundaries,
+            view.tables().azimuthal_boundaries + num_azimuthal_sections_ + 1),
+        is_full_sphere_(view.isFullSphere()),
+        is_radially_uniform_(view.isRadiallyUniform()),
+        is_valid_(true) {}
+
+  // A grid over the same sphere in which each voxel merges radial_factor x
+  // polar_factor x azimuthal_factor voxels of this grid, e.g. the bricks of an
+  // OccupancyGrid. Each factor must divide the corresponding number of
+  // sections. The radial edges of the coarsened grid are exactly every
+  // radial_factor-th edge of this grid.
+  inline BasicSphericalVoxelGrid coarsened(
+      std::size_t radial_factor, std::size_t polar_factor,
+      std::size_t azimuthal_factor) const noexcept {
+    AlignedVector<T> delta_radii_sq;
+    delta_radii_sq.reserve(this->num_radial_sections_ / radial_factor + 1);
+    for (std::size_t i = 0; i <= this->num_radial_sections_;
+         i += radial_factor) {
+      delta_radii_sq.push_back(this->delta_radii_sq_[i]);
+    }
+    return BasicSphericalVoxelGrid(
+        {.radial = this->sphere_max_radius_ -
+                   this->delta_radius_ * this->num_radial_sections_,
+         .polar = this->sphere_min_bound_polar_,
+         .azimuthal = this->sphere_min_bound_azimuthal_},
+        {.radial = this->sphere_max_radius_,
+         .polar = this->sphere_max_bound_polar_,
+         .azimuthal = this->sphere_max_bound_azimuthal_},
+        std::move(delta_radii_sq), this->is_radially_uniform_,
+        this->num_polar_sections_ / polar_factor,
+        this->num_azimuthal_sections_ / azimuthal_factor,
+        this->sphere_center_);
+  }
 
   inline std::size_t numRadialSections() const noexcept {
     return this->num_radial_sections_;
@@ -199,126 +407,409 @@ struct SphericalVoxelGrid {
     return this->num_azimuthal_sections_;
   }
 
-  inline double sphereMaxBoundPolar() const noexcept {
+  inline BasicSphericalVoxelGridParameters<T> parameters() const noexcept {
+    return {.num_radial_sections = this->num_radial_sections_,
+            .num_polar_sections = this->num_polar_sections_,
+            .num_azimuthal_sections = this->num_azimuthal_sections_,
+            .sphere_center = this->sphere_center_,
+            .sphere_max_bound_polar = this->sphere_max_bound_polar_,
+            .sphere_min_bound_polar = this->sphere_min_bound_polar_,
+            .sphere_max_bound_azimuthal = this->sphere_max_bound_azimuthal_,
+            .sphere_min_bound_azimuthal = this->sphere_min_bound_azimuthal_,
+            .sphere_max_radius = this->sphere_max_radius_,
+            .sphere_max_diameter = this->sphere_max_diameter_,
+            .delta_radius = this->delta_radius_,
+            .delta_theta = this->delta_theta_,
+            .delta_phi = this->delta_phi_,
+            .is_full_sphere = this->is_full_sphere_,
+            .is_radially_uniform = this->is_radially_uniform_};
+  }
+
+  inline T sphereMaxBoundPolar() const noexcept {
     return this->sphere_max_bound_polar_;
   }
 
-  inline double sphereMinBoundPolar() const noexcept {
+  inline T sphereMinBoundPolar() const noexcept {
     return this->sphere_min_bound_polar_;
   }
 
-  inline double sphereMaxBoundAzi() const noexcept {
+  inline T sphereMaxBoundAzi() const noexcept {
     return this->sphere_max_bound_azimuthal_;
   }
 
-  inline double sphereMinBoundAzi() const noexcept {
+  inline T sphereMinBoundAzi() const noexcept {
     return this->sphere_min_bound_azimuthal_;
   }
 
-  inline double sphereMaxRadius() const noexcept {
+  // Returns false if the grid was constructed from invalid radial edges. See
+  // the constructor from radial edges.
+  inline bool isValid() const noexcept { return this->is_valid_; }
+
+  // Returns true if the grid spans the entire sphere, in which case no polar
+  // or azimuthal step of the traversal leaves the grid bounds.
+  inline bool isFullSphere() const noexcept { return this->is_full_sphere_; }
+
+  // Returns true if the radial sections are of uniform width deltaRadius().
+  inline bool isRadiallyUniform() const noexcept {
+    return this->is_radially_uniform_;
+  }
+
+  inline T sphereMaxRadius() const noexcept {
     return this->sphere_max_radius_;
   }
 
-  inline double sphereMaxDiameter() const noexcept {
+  inline T sphereMaxDiameter() const noexcept {
     return this->sphere_max_diameter_;
   }
 
-  inline const BoundVec3 &sphereCenter() const noexcept {
+  inline const BasicBoundVec3<T> &sphereCenter() const noexcept {
     return this->sphere_center_;
   }
 
-  inline double deltaRadius() const noexcept { return delta_radius_; }
+  inline T deltaRadius() const noexcept { return delta_radius_; }
 
-  inline double deltaPhi() const noexcept { return delta_phi_; }
+  inline T deltaPhi() const noexcept { return delta_phi_; }
 
-  inline double deltaTheta() const noexcept { return delta_theta_; }
+  inline T deltaTheta() const noexcept { return delta_theta_; }
 
-  inline double deltaRadiiSquared(std::size_t i) const noexcept {
+  inline T deltaRadiiSquared(std::size_t i) const noexcept {
     return this->delta_radii_sq_[i];
   }
 
-  inline const LineSegment &pMaxPolar(std::size_t i) const noexcept {
-    return this->P_max_polar_[i];
+  inline const AlignedVector<T> &deltaRadiiSquared() const noexcept {
+    return this->delta_radii_sq_;
   }
 
-  inline const std::vector<LineSegment> &pMaxPolar() const noexcept {
-    return this->P_max_polar_;
+  inline const BasicAngularBoundary<T> &polarBoundary(std::size_t i) const
+      noexcept {
+    return this->polar_boundaries_[i];
   }
 
-  inline const BoundVec3 &centerToPolarBound(std::size_t i) const noexcept {
-    return this->center_to_polar_bound_vectors_[i];
+  inline const BasicAngularBoundary<T> &azimuthalBoundary(std::size_t i) const
+      noexcept {
+    return this->azimuthal_boundaries_[i];
   }
 
-  inline const LineSegment &pMaxAzimuthal(std::size_t i) const noexcept {
-    return this->P_max_azimuthal_[i];
+  inline const std::vector<BasicTrigonometricValues<T>> &polarTrigValues()
+      const noexcept {
+    return polar_trig_values_;
   }
 
-  inline const std::vector<LineSegment> &pMaxAzimuthal() const noexcept {
-    return this->P_max_azimuthal_;
+  inline const BasicTrigonometricValues<T> &polarTrigValue(std::size_t i) const
+      noexcept {
+    return this->polar_trig_values_[i];
   }
 
-  inline const BoundVec3 &centerToAzimuthalBound(std::size_t i) const noexcept {
-    return this->center_to_azimuthal_bound_vectors_[i];
+  inline const std::vector<BasicTrigonometricValues<T>>
+      &azimuthalTrigValues() const noexcept {
+    return azimuthal_trig_values_;
   }
 
-  inline const std::vector<TrigonometricValues> &polarTrigValues()
-      const noexcept {
-    return polar_trig_values_;
+  inline const BasicTrigonometricValues<T> &azimuthalTrigValue(
+      std::size_t i) const noexcept {
+    return this->azimuthal_trig_values_[i];
   }
 
-  inline const std::vector<TrigonometricValues> &azimuthalTrigValues()
-      const noexcept {
-    return azimuthal_trig_values_;
+ private:
+  static inline bool isValidRadialEdges(
+      const std::vector<T> &radial_edges) noexcept {
+    if (radial_edges.size() < 2 || !(radial_edges.front() >= T(0))) {
+      return false;
+    }
+    for (std::size_t i = 1; i < radial_edges.size(); ++i) {
+      if (!(radial_edges[i - 1] < radial_edges[i])) return false;
+    }
+    return true;
   }
 
- private:
+  // Returns radial_edges if they are valid, and otherwise the edges of a
+  // single radial section.
+  static inline const std::vector<T> &validRadialEdges(
+      const std::vector<T> &radial_edges) noexcept {
+    static const std::vector<T> unit_radial_edges = {T(0), T(1)};
+    return isValidRadialEdges(radial_edges) ? radial_edges
+                                            : unit_radial_edges;
+  }
+
+  // The grid with the given valid radial edges.
+  BasicSphericalVoxelGrid(const BasicSphereBound<T> &min_bound,
+                          const BasicSphereBound<T> &max_bound,
+                          const std::vector<T> &radial_edges, bool is_valid,
+                          std::size_t num_polar_sections,
+                          std::size_t num_azimuthal_sections,
+                          const BasicBoundVec3<T> &sphere_center) noexcept
+      : BasicSphericalVoxelGrid(
+            {.radial = radial_edges.front(),
+             .polar = min_bound.polar,
+             .azimuthal = min_bound.azimuthal},
+            {.radial = radial_edges.back(),
+             .polar = max_bound.polar,
+             .azimuthal = max_bound.azimuthal},
+            initializeDeltaRadiiSquared(radial_edges),
+            /*is_radially_uniform=*/false, num_polar_sections,
+            num_azimuthal_sections, sphere_center, is_valid) {}
+
+  // The grid with the given delta radii squared, which hold the N + 1 squared
+  // radii of the radial edges from the outermost to the innermost.
+  BasicSphericalVoxelGrid(const BasicSphereBound<T> &min_bound,
+                          const BasicSphereBound<T> &max_bound,
+                          AlignedVector<T> delta_radii_sq,
+                          bool is_radially_uniform,
+                          std::size_t num_polar_sections,
+                          std::size_t num_azimuthal_sections,
+                          const BasicBoundVec3<T> &sphere_center,
+                          bool is_valid = true) noexcept
+      : num_radial_sections_(delta_radii_sq.size() - 1),
+        num_polar_sections_(num_polar_sections),
+        num_azimuthal_sections_(num_azimuthal_sections),
+        sphere_center_(sphere_center),
+        sphere_max_bound_polar_(max_bound.polar),
+        sphere_min_bound_polar_(min_bound.polar),
+        sphere_max_bound_azimuthal_(max_bound.azimuthal),
+        sphere_min_bound_azimuthal_(min_bound.azimuthal),
+        // TODO(cgyurgyik): Verify we want the sphere_max_radius to simply be
+        // max_bound.radial.
+        sphere_max_radius_(max_bound.radial),
+        sphere_max_diameter_(sphere_max_radius_ * T(2)),
+        delta_radius_((max_bound.radial - min_bound.radial) /
+                      num_radial_sections_),
+        delta_theta_((max_bound.polar - min_bound.polar) / num_polar_sections),
+        delta_phi_((max_bound.azimuthal - min_bound.azimuthal) /
+                   num_azimuthal_sections),
+        delta_radii_sq_(std::move(delta_radii_sq)),
+        polar_trig_values_(initializeTrigonometricValues(
+            num_polar_sections, min_bound.polar, delta_theta_)),
+        azimuthal_trig_values_(initializeTrigonometricValues(
+            num_azimuthal_sections, min_bound.azimuthal, delta_phi_)),
+        polar_boundaries_(initializeAngularBoundaries(
+            initializeMaxRadiusLineSegments(num_polar_sections, sphere_center,
+                                            sphere_center.y(),
+                                            sphere_max_radius_,
+                                            polar_trig_values_),
+            sphere_center, sphere_center.y())),
+        azimuthal_boundaries_(initializeAngularBoundaries(
+            initializeMaxRadiusLineSegments(num_azimuthal_sections,
+                                            sphere_center, sphere_center.z(),
+                                            sphere_max_radius_,
+                                            azimuthal_trig_values_),
+            sphere_center, sphere_center.z())),
+        is_full_sphere_(initializeIsFullSphere(min_bound, max_bound)),
+        is_radially_uniform_(is_radially_uniform),
+        is_valid_(is_valid) {}
+
   // The number of radial, polar, and azimuthal voxels.
   const std::size_t num_radial_sections_, num_polar_sections_,
       num_azimuthal_sections_;
 
   // The center of the sphere.
-  const BoundVec3 sphere_center_;
+  const BasicBoundVec3<T> sphere_center_;
 
   // The maximum polar bound of the sphere.
-  const double sphere_max_bound_polar_;
+  const T sphere_max_bound_polar_;
 
   // The minimum polar bound of the sphere.
-  const double sphere_min_bound_polar_;
+  const T sphere_min_bound_polar_;
 
   // The maximum azimuthal bound of the sphere.
-  const double sphere_max_bound_azimuthal_;
+  const T sphere_max_bound_azimuthal_;
 
   // The minimum azimuthal bound of the sphere.
-  const double sphere_min_bound_azimuthal_;
+  const T sphere_min_bound_azimuthal_;
 
   // The maximum radius of the sphere.
-  const double sphere_max_radius_;
+  const T sphere_max_radius_;
 
   // The maximum diamater of the sphere.
-  const double sphere_max_diameter_;
+  const T sphere_max_diameter_;
 
-  // The maximum sphere radius divided by the number of radial sections.
-  const double delta_radius_;
+  // The maximum sphere radius divided by the number of radial sections. This
+  // is the mean width of the radial sections of a non-uniform grid.
+  const T delta_radius_;
 
   // 2 * PI divided by X, where X is the number of polar and number of azimuthal
   // sections respectively.
-  const double delta_theta_, delta_phi_;
+  const T delta_theta_, delta_phi_;
 
   // The delta radii squared calculated for use in radial hit calculations.
-  const std::vector<double> delta_radii_sq_;
+  // Aligned to a cache line for vector loads.
+  const AlignedVector<T> delta_radii_sq_;
+
+  // The trigonometric values calculated for the polar and azimuthal voxels.
+  const std::vector<BasicTrigonometricValues<T>> polar_trig_values_,
+      azimuthal_trig_values_;
+
+  // The packed boundary values for polar and azimuthal voxels, used by the
+  // angular hit calculations and the angular voxel ID lookup. Boundaries i
+  // and i + 1 of a voxel are adjacent in memory.
+  const AlignedVector<BasicAngularBoundary<T>> polar_boundaries_,
+      azimuthal_boundaries_;
+
+  // Whether the grid spans the entire sphere. This determines whether the
+  // traversal checks the polar and azimuthal bounds.
+  const bool is_full_sphere_;
+
+  // Whether the radial sections are of uniform width delta_radius_, in which
+  // case the radial voxel of a point is calculated directly.
+  const bool is_radially_uniform_;
+  const bool is_valid_;
+};
+
+// The tables of a spherical voxel grid that are read by the traversal, each of
+// the size of the corresponding table of BasicSphericalVoxelGrid.
+template <class T>
+struct BasicSphericalVoxelGridTables {
+  const T *delta_radii_sq;
+  const BasicTrigonometricValues<T> *polar_trig_values;
+  const BasicTrigonometricValues<T> *azimuthal_trig_values;
+  const BasicAngularBoundary<T> *polar_boundaries;
+  const BasicAngularBoundary<T> *azimuthal_boundaries;
+};
+
+// A view of a spherical voxel grid with the accessors used by the traversal.
+// Rather than owning its tables, the view holds pointers to them, so that it is
+// trivially copyable and may be passed by value to a GPU kernel, with its
+// tables in device memory. See gpu_traversal.h. Traversing a view is identical
+// to traversing the grid it was constructed from.
+template <class T>
+class BasicSphericalVoxelGridView {
+ public:
+  using value_type = T;
+
+  // A view of the grid's own tables, which must outlive the view.
+  explicit BasicSphericalVoxelGridView(
+      const BasicSphericalVoxelGrid<T> &grid) noexcept
+      : BasicSphericalVoxelGridView(
+            grid,
+            {.delta_radii_sq = grid.deltaRadiiSquared().data(),
+             .polar_trig_values = grid.polarTrigValues().data(),
+             .azimuthal_trig_values = grid.azimuthalTrigValues().data(),
+             .polar_boundaries = &grid.polarBoundary(0),
+             .azimuthal_boundaries = &grid.azimuthalBoundary(0)}) {}
+
+  // A view of the grid's parameters with the given copies of its tables.
+  BasicSphericalVoxelGridView(
+      const BasicSphericalVoxelGrid<T> &grid,
+      const BasicSphericalVoxelGridTables<T> &tables) noexcept
+      : BasicSphericalVoxelGridView(grid.parameters(), tables) {}
+
+  // A view of a grid with the given parameters and tables, e.g. those of a
+  // file mapped by MappedSphericalVoxelGrid.
+  BasicSphericalVoxelGridView(
+      const BasicSphericalVoxelGridParameters<T> &parameters,
+      const BasicSphericalVoxelGridTables<T> &tables) noexcept
+      : parameters_(parameters), tables_(tables) {}
+
+  SVR_HOST_DEVICE inline std::size_t numRadialSections() const noexcept {
+    return this->parameters_.num_radial_sections;
+  }
+
+  SVR_HOST_DEVICE inline std::size_t numPolarSections() const noexcept {
+    return this->parameters_.num_polar_sections;
+  }
+
+  SVR_HOST_DEVICE inline std::size_t numAzimuthalSections() const noexcept {
+    return this->parameters_.num_azimuthal_sections;
+  }
+
+  SVR_HOST_DEVICE inline T sphereMaxBoundPolar() const noexcept {
+    return this->parameters_.sphere_max_bound_polar;
+  }
+
+  SVR_HOST_DEVICE inline T sphereMinBoundPolar() const noexcept {
+    return this->parameters_.sphere_min_bound_polar;
+  }
+
+  SVR_HOST_DEVICE inline T sphereMaxBoundAzi() const noexcept {
+    return this->parameters_.sphere_max_bound_azimuthal;
+  }
 
-  // The trigonometric values calculated for the azimuthal and polar voxels.
-  const std::vector<TrigonometricValues> azimuthal_trig_values_,
-      polar_trig_values_;
+  SVR_HOST_DEVICE inline T sphereMinBoundAzi() const noexcept {
+    return this->parameters_.sphere_min_bound_azimuthal;
+  }
+
+  SVR_HOST_DEVICE inline bool isFullSphere() const noexcept {
+    return this->parameters_.is_full_sphere;
+  }
+
+  SVR_HOST_DEVICE inline bool isRadiallyUniform() const noexcept {
+    return this->parameters_.is_radially_uniform;
+  }
+
+  SVR_HOST_DEVICE inline T sphereMaxRadius() const noexcept {
+    return this->parameters_.sphere_max_radius;
+  }
+
+  SVR_HOST_DEVICE inline T sphereMaxDiameter() const noexcept {
+    return this->parameters_.sphere_max_diameter;
+  }
+
+  SVR_HOST_DEVICE inline const BasicBoundVec3<T> &sphereCenter() const
+      noexcept {
+    return this->parameters_.sphere_center;
+  }
+
+  SVR_HOST_DEVICE inline T deltaRadius() const noexcept {
+    return this->parameters_.delta_radius;
+  }
+
+  SVR_HOST_DEVICE inline T deltaPhi() const noexcept {
+    return this->parameters_.delta_phi;
+  }
+
+  SVR_HOST_DEVICE inline T deltaTheta() const noexcept {
+    return this->parameters_.delta_theta;
+  }
+
+  SVR_HOST_DEVICE inline T deltaRadiiSquared(std::size_t i) const noexcept {
+    return this->tables_.delta_radii_sq[i];
+  }
+
+  SVR_HOST_DEVICE inline const BasicAngularBoundary<T> &polarBoundary(
+      std::size_t i) const noexcept {
+    return this->tables_.polar_boundaries[i];
+  }
+
+  SVR_HOST_DEVICE inline const BasicAngularBoundary<T> &azimuthalBoundary(
+      std::size_t i) const noexcept {
+    return this->tables_.azimuthal_boundaries[i];
+  }
+
+  SVR_HOST_DEVICE inline const BasicTrigonometricValues<T> &polarTrigValue(
+      std::size_t i) const noexcept {
+    return this->tables_.polar_trig_values[i];
+  }
+
+  SVR_HOST_DEVICE inline const BasicTrigonometricValues<T> &azimuthalTrigValue(
+      std::size_t i) const noexcept {
+    return this->tables_.azimuthal_trig_values[i];
+  }
+
+  inline const BasicSphericalVoxelGridParameters<T> &parameters() const
+      noexcept {
+    return this->parameters_;
+  }
 
-  // The maximum radius line segments for polar and azimuthal voxels.
-  const std::vector<LineSegment> P_max_polar_, P_max_azimuthal_;
+  inline const BasicSphericalVoxelGridTables<T> &tables() const noexcept {
+    return this->tables_;
+  }
 
-  // The vectors represented by the vector sphere center - P_max[i].
-  const std::vector<BoundVec3> center_to_polar_bound_vectors_,
-      center_to_azimuthal_bound_vectors_;
+ private:
+  BasicSphericalVoxelGridParameters<T> parameters_;
+  BasicSphericalVoxelGridTables<T> tables_;
 };
 
+// The double precision types used throughout the traversal, unless a single
+// precision traversal is requested.
+using SphereBound = BasicSphereBound<double>;
+using SphericalVoxel = BasicSphericalVoxel<double>;
+using LineSegment = BasicLineSegment<double>;
+using TrigonometricValues = BasicTrigonometricValues<double>;
+using AngularBoundary = BasicAngularBoundary<double>;
+using SphericalVoxelGrid = BasicSphericalVoxelGrid<double>;
+using SphericalVoxelGridParameters = BasicSphericalVoxelGridParameters<double>;
+using SphericalVoxelGridTables = BasicSphericalVoxelGridTables<double>;
+using SphericalVoxelGridView = BasicSphericalVoxelGridView<double>;
+
 }  // namespace svr
 
 #endif  // SPHERICAL_VOLUME_RENDERING_SPHERICALVOXELGRID_H
@@ -0,0 +1,212 @@
+#include "spherical_voxel_grid_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace svr {
+
+namespace {
+
+static_assert(sizeof(SphericalVoxelGridFileHeader) == 256,
+              "The spherical voxel grid header must be 256 bytes.");
+static_assert(sizeof(SphericalVoxelGridFileHeader) % CACHE_LINE_SIZE == 0,
+              "The tables of a spherical voxel grid file begin on a cache "
+              "line.");
+
+inline std::size_t aligned(std::size_t size) noexcept {
+  return (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+}
+
+// The offsets of each table from the beginning of the file, and the size of
+// the file. See spherical_voxel_grid_file.h for the layout.
+struct GridLayout {
+  std::size_t delta_radii_sq;
+  std::size_t polar_trig_values;
+  std::size_t azimuthal_trig_values;
+  std::size_t polar_boundaries;
+  std::size_t azimuthal_boundaries;
+  std::size_t size;
+};
+
+GridLayout gridLayout(std::size_t num_radial_sections,
+                      std::size_t num_polar_sections,
+                      std::size_t num_azimuthal_sections) noexcept {
+  const std::size_t num_polar = num_polar_sections + 1;
+  const std::size_t num_azimuthal = num_azimuthal_sections + 1;
+  GridLayout layout;
+  layout.delta_radii_sq = sizeof(SphericalVoxelGridFileHeader);
+  layout.polar_trig_values =
+      layout.delta_radii_sq +
+      aligned((num_radial_sections + 1) * sizeof(double));
+  layout.azimuthal_trig_values =
+      layout.polar_trig_values +
+      aligned(num_polar * sizeof(TrigonometricValues));
+  layout.polar_boundaries =
+      layout.azimuthal_trig_values +
+      aligned(num_azimuthal * sizeof(TrigonometricValues));
+  layout.azimuthal_boundaries =
+      layout.polar_boundaries + aligned(num_polar * sizeof(AngularBoundary));
+  layout.size = layout.azimuthal_boundaries +
+                aligned(num_azimuthal * sizeof(AngularBoundary));
+  return layout;
+}
+
+// Writes size bytes of data to file, padded to a cache line with zeros.
+bool writeTable(std::FILE *file, const void *data, std::size_t size) {
+  static const char padding[CACHE_LINE_SIZE] = {};
+  const std::size_t padding_size = aligned(size) - size;
+  return (size == 0 || std::fwrite(data, 1, size, file) == size) &&
+         (padding_size == 0 ||
+          std::fwrite(padding, 1, padding_size, file) == padding_size);
+}
+
+}  // namespace
+
+bool writeSphericalVoxelGrid(const SphericalVoxelGrid &grid,
+                             const std::string &path) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) return false;
+  const SphericalVoxelGridParameters parameters = grid.parameters();
+  const GridLayout layout =
+      gridLayout(parameters.num_radial_sections, parameters.num_polar_sections,
+                 parameters.num_azimuthal_sections);
+  SphericalVoxelGridFileHeader header = {};
+  std::memcpy(header.magic, SPHERICAL_VOXEL_GRID_MAGIC, sizeof(header.magic));
+  header.version = SPHERICAL_VOXEL_GRID_VERSION;
+  header.value_size = sizeof(double);
+  header.num_radial_sections = parameters.num_radial_sections;
+  header.num_polar_sections = parameters.num_polar_sections;
+  header.num_azimuthal_sections = parameters.num_azimuthal_sections;
+  header.sphere_center[0] = parameters.sphere_center.x();
+  header.sphere_center[1] = parameters.sphere_center.y();
+  header.sphere_center[2] = parameters.sphere_center.z();
+  header.sphere_max_bound_polar = parameters.sphere_max_bound_polar;
+  header.sphere_min_bound_polar = parameters.sphere_min_bound_polar;
+  header.sphere_max_bound_azimuthal = parameters.sphere_max_bound_azimuthal;
+  header.sphere_min_bound_azimuthal = parameters.sphere_min_bound_azimuthal;
+  header.sphere_max_radius = parameters.sphere_max_radius;
+  header.sphere_max_diameter = parameters.sphere_max_diameter;
+  header.delta_radius = parameters.delta_radius;
+  header.delta_theta = parameters.delta_theta;
+  header.delta_phi = parameters.delta_phi;
+  header.is_full_sphere = parameters.is_full_sphere;
+  header.is_radially_uniform = parameters.is_radially_uniform;
+  header.file_size = layout.size;
+  const std::size_t num_polar = parameters.num_polar_sections + 1;
+  const std::size_t num_azimuthal = parameters.num_azimuthal_sections + 1;
+  const bool written =
+      std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+      writeTable(file, grid.deltaRadiiSquared().data(),
+                 grid.deltaRadiiSquared().size() * sizeof(double)) &&
+      writeTable(file, grid.polarTrigValues().data(),
+                 num_polar * sizeof(TrigonometricValues)) &&
+      writeTable(file, grid.azimuthalTrigValues().data(),
+                 num_azimuthal * sizeof(TrigonometricValues)) &&
+      writeTable(file, &grid.polarBoundary(0),
+                 num_polar * sizeof(AngularBoundary)) &&
+      writeTable(file, &grid.azimuthalBoundary(0),
+                 num_azimuthal * sizeof(AngularBoundary));
+  const bool closed = std::fclose(file) == 0;
+  return written && closed;
+}
+
+MappedSphericalVoxelGrid::MappedSphericalVoxelGrid(const std::string &path)
+    : view_(map(path, this->data_, this->size_)) {}
+
+MappedSphericalVoxelGrid::~MappedSphericalVoxelGrid() {
+  if (this->data_ != nullptr) {
+    ::munmap(const_cast<char *>(this->data_), this->size_);
+  }
+}
+
+SphericalVoxelGridView MappedSphericalVoxelGrid::map(const std::string &path,
+                                                     const char *&data,
+                                                     std::size_t &size) {
+  const SphericalVoxelGridView invalid(SphericalVoxelGridParameters{},
+                                       SphericalVoxelGridTables{});
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return invalid;
+  struct stat status;
+  if (::fstat(fd, &status) != 0 ||
+      static_cast<std::size_t>(status.st_size) <
+          sizeof(SphericalVoxelGridFileHeader)) {
+    ::close(fd);
+    return invalid;
+  }
+  const std::size_t file_size = status.st_size;
+  void *mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping remains valid once the file is closed.
+  ::close(fd);
+  if (mapping == MAP_FAILED) return invalid;
+  const char *const bytes = static_cast<const char *>(mapping);
+
+  // Validates the header, so that every table is within the file. The number
+  // of sections is bounded by the file size before the layout is computed, so
+  // that the layout cannot overflow.
+  const SphericalVoxelGridFileHeader &header =
+      *reinterpret_cast<const SphericalVoxelGridFileHeader *>(bytes);
+  const bool valid =
+      std::memcmp(header.magic, SPHERICAL_VOXEL_GRID_MAGIC,
+                  sizeof(header.magic)) == 0 &&
+      header.version == SPHERICAL_VOXEL_GRID_VERSION &&
+      header.value_size == sizeof(double) && header.num_radial_sections > 0 &&
+      header.num_polar_sections > 0 && header.num_azimuthal_sections > 0 &&
+      header.num_radial_sections < file_size &&
+      header.num_polar_sections < file_size &&
+      header.num_azimuthal_sections < file_size &&
+      header.file_size == file_size &&
+      gridLayout(header.num_radial_sections, header.num_polar_sections,
+                 header.num_azimuthal_sections)
+              .size == file_size;
+  if (!valid) {
+    ::munmap(mapping, file_size);
+    return invalid;
+  }
+  data = bytes;
+  size = file_size;
+  const GridLayout layout =
+      gridLayout(header.num_radial_sections, header.num_polar_sections,
+                 header.num_azimuthal_sections);
+  return SphericalVoxelGridView(
+      {.num_radial_sections = header.num_radial_sections,
+       .num_polar_sections = header.num_polar_sections,
+       .num_azimuthal_sections = header.num_azimuthal_sections,
+       .sphere_center = BoundVec3(header.sphere_center[0],
+                                  header.sphere_center[1],
+                                  header.sphere_center[2]),
+       .sphere_max_bound_polar = header.sphere_max_bound_polar,
+       .sphere_min_bound_polar = header.sphere_min_bound_polar,
+       .sphere_max_bound_azimuthal = header.sphere_max_bound_azimuthal,
+       .sphere_min_bound_azimuthal = header.sphere_min_bound_azimuthal,
+       .sphere_max_radius = header.sphere_max_radius,
+       .sphere_max_diameter = header.sphere_max_diameter,
+       .delta_radius = header.delta_radius,
+       .delta_theta = header.delta_theta,
+       .delta_phi = header.delta_phi,
+       .is_full_sphere = header.is_full_sphere != 0,
+       .is_radially_uniform = header.is_radially_uniform != 0},
+      {.delta_radii_sq =
+           reinterpret_cast<const double *>(bytes + layout.delta_radii_sq),
+       .polar_trig_values = reinterpret_cast<const TrigonometricValues *>(
+           bytes + layout.polar_trig_values),
+       .azimuthal_trig_values = reinterpret_cast<const TrigonometricValues *>(
+           bytes + layout.azimuthal_trig_values),
+       .polar_boundaries = reinterpret_cast<const AngularBoundary *>(
+           bytes + layout.polar_boundaries),
+       .azimuthal_boundaries = reinterpret_cast<const AngularBoundary *>(
+           bytes + layout.azimuthal_boundaries)});
+}
+
+SharedSphericalVoxelGrid readSphericalVoxelGrid(const std::string &path) {
+  // The mapping is only held while the tables are copied.
+  const MappedSphericalVoxelGrid mapped(path);
+  if (!mapped.isOpen()) return nullptr;
+  return std::make_shared<const SphericalVoxelGrid>(mapped.view());
+}
+
+}  // namespace svr
@@ -0,0 +1,117 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_SPHERICAL_VOXEL_GRID_FILE_H
+#define SPHERICAL_VOLUME_RENDERING_SPHERICAL_VOXEL_GRID_FILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "spherical_voxel_grid.h"
+
+// A file of the precomputed tables of a spherical voxel grid, so that a grid is
+// computed once and loaded by each process that traverses it. The file is
+// written by writeSphericalVoxelGrid(), and is memory-mapped read-only by
+// MappedSphericalVoxelGrid, so that the processes that map it share its pages
+// rather than each holding a copy of the tables.
+//
+// The values are in the byte order of the machine that wrote the file, with
+// every table aligned to a cache line, as are those of SphericalVoxelGrid.
+//   SphericalVoxelGridFileHeader, at offset 0.
+//   The tables, each padded to CACHE_LINE_SIZE bytes, in order:
+//     delta_radii_sq:        float64[R + 1].
+//     polar_trig_values:     TrigonometricValues[P + 1].
+//     azimuthal_trig_values: TrigonometricValues[A + 1].
+//     polar_boundaries:      AngularBoundary[P + 1].
+//     azimuthal_boundaries:  AngularBoundary[A + 1].
+//   where R, P, and A are the number of radial, polar, and azimuthal sections.
+
+namespace svr {
+
+// The first 8 bytes of a spherical voxel grid file, and its version.
+constexpr char SPHERICAL_VOXEL_GRID_MAGIC[8] = {'S', 'V', 'R', 'G',
+                                                'R', 'I', 'D', '\0'};
+// Version 2 removed the maximum radius line segments, whose points are those
+// of the angular boundaries.
+constexpr std::uint32_t SPHERICAL_VOXEL_GRID_VERSION = 2;
+
+// The parameters of the grid, as given by SphericalVoxelGrid::parameters().
+struct SphericalVoxelGridFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  // The size of the floating point values of the grid, i.e. sizeof(double).
+  std::uint32_t value_size;
+  std::uint64_t num_radial_sections;
+  std::uint64_t num_polar_sections;
+  std::uint64_t num_azimuthal_sections;
+  double sphere_center[3];
+  double sphere_max_bound_polar;
+  double sphere_min_bound_polar;
+  double sphere_max_bound_azimuthal;
+  double sphere_min_bound_azimuthal;
+  double sphere_max_radius;
+  double sphere_max_diameter;
+  double delta_radius;
+  double delta_theta;
+  double delta_phi;
+  std::uint32_t is_full_sphere;
+  std::uint32_t is_radially_uniform;
+  // The size of the file, so that a truncated file is rejected.
+  std::uint64_t file_size;
+  std::uint64_t reserved[13];
+};
+
+// Writes the parameters and tables of grid to the file at path, which is
+// truncated if it exists. Returns false if the file could not be written.
+bool writeSphericalVoxelGrid(const SphericalVoxelGrid &grid,
+                             const std::string &path);
+
+// Memory-maps a file written by writeSphericalVoxelGrid(). The tables are read
+// from the mapped pages on demand, and are shared by every process that maps
+// the file. The mapping is immutable, so it may be traversed by many threads
+// at once.
+class MappedSphericalVoxelGrid {
+ public:
+  // Maps the file at path. Check isOpen() for whether the file could be mapped
+  // and is a valid grid of this version.
+  explicit MappedSphericalVoxelGrid(const std::string &path);
+
+  ~MappedSphericalVoxelGrid();
+
+  MappedSphericalVoxelGrid(const MappedSphericalVoxelGrid &) = delete;
+  MappedSphericalVoxelGrid &operator=(const MappedSphericalVoxelGrid &) =
+      delete;
+
+  inline bool isOpen() const noexcept { return this->data_ != nullptr; }
+
+  // A view of the grid whose tables point into the mapped file, which
+  // traverses identically to the grid that was written. The view is valid for
+  // the lifetime of this. Requires isOpen().
+  inline const SphericalVoxelGridView &view() const noexcept {
+    return this->view_;
+  }
+
+ private:
+  // Maps the file at path to data and size, and returns a view of its grid.
+  // data is set to nullptr if the file could not be mapped or is invalid.
+  static SphericalVoxelGridView map(const std::string &path, const char *&data,
+                                    std::size_t &size);
+
+  // Declared before view_, which is constructed from the mapped file.
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+  const SphericalVoxelGridView view_;
+};
+
+// An immutable grid that is shared, rather than copied, by the threads and
+// Python objects that traverse it. The grid is destroyed with its last handle.
+using SharedSphericalVoxelGrid = std::shared_ptr<const SphericalVoxelGrid>;
+
+// Reads the grid of the file at path, as written by writeSphericalVoxelGrid().
+// The tables are copied from the file rather than recomputed, so no
+// trigonometric functions are evaluated. Since each grid read holds its own
+// tables, a process should read a grid once and share its handle. Returns
+// nullptr if the file could not be mapped or is not a valid grid.
+SharedSphericalVoxelGrid readSphericalVoxelGrid(const std::string &path);
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_SPHERICAL_VOXEL_GRID_FILE_H
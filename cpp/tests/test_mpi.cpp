@@ -0,0 +1,145 @@
+#include <mpi.h>
+
+#include <limits>
+#include <vector>
+
+#include "../mpi_traversal.h"
+#include "gtest/gtest.h"
+
+// Tests for the traversal of a grid distributed by sector across MPI ranks.
+// These are built with cmake -DSVR_ENABLE_MPI=ON .., and run on 4 ranks:
+//   >    mpiexec -n 4 ./bin/test_mpi_svr
+namespace {
+constexpr double TAU = 2 * M_PI;
+constexpr svr::SphereBound MIN_BOUND = {
+    .radial = 0.0, .polar = 0.0, .azimuthal = 0.0};
+constexpr std::size_t NUM_RADIAL = 8;
+constexpr std::size_t NUM_POLAR = 8;
+constexpr std::size_t NUM_AZIMUTHAL = 4;
+
+// A field that varies along each dimension, so that the integral of a ray
+// depends upon the order in which its segments are composited.
+std::vector<double> layeredField() {
+  std::vector<double> field(NUM_RADIAL * NUM_POLAR * NUM_AZIMUTHAL);
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    field[i] = 1.0 + static_cast<double>(i % 5) + i / 32.0;
+  }
+  return field;
+}
+
+TEST(SphericalCoordinateIntegrationMPI, MatchesIntegralOfWholeGrid) {
+  int rank = 0;
+  int num_ranks = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+  ASSERT_EQ(num_ranks, 4) << "Run with mpiexec -n 4.";
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, NUM_RADIAL,
+      NUM_POLAR, NUM_AZIMUTHAL, BoundVec3(0.5, -0.25, 0.0));
+  const svr::SectorDecomposition decomposition(
+      grid, {.radial = 2, .polar = 1, .azimuthal = 2}, rank);
+  const std::vector<double> field = layeredField();
+  std::vector<double> sector_field(decomposition.numSectorVoxels());
+  decomposition.copySectorField(field.data(), sector_field.data());
+  const auto transfer_function = [](double value) -> svr::TransferSample {
+    return {.red = value / 8.0, .green = 1.0, .blue = 0.25,
+            .extinction = 0.01 * value};
+  };
+  std::vector<Ray> rays;
+  for (int i = -10; i <= 10; ++i) {
+    for (int j = -10; j <= 10; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+    }
+  }
+  std::vector<svr::RayIntegral> integrals(rays.size());
+  ASSERT_TRUE(svr::integrateSphericalVolumeDistributed(
+      rays.data(), rays.size(), decomposition, sector_field.data(),
+      transfer_function, /*max_t=*/1.0, integrals.data(), MPI_COMM_WORLD,
+      /*root=*/0, /*opacity_threshold=*/1.0));
+  if (rank != 0) return;
+  for (std::size_t i = 0; i < rays.size(); ++i) {
+    const svr::RayIntegral expected = svr::integrateSphericalVolume(
+        rays[i], grid, field.data(), transfer_function, /*max_t=*/1.0,
+        /*opacity_threshold=*/1.0);
+    EXPECT_NEAR(integrals[i].red, expected.red, 1e-9);
+    EXPECT_NEAR(integrals[i].green, expected.green, 1e-9);
+    EXPECT_NEAR(integrals[i].blue, expected.blue, 1e-9);
+    EXPECT_NEAR(integrals[i].opacity, expected.opacity, 1e-9);
+  }
+}
+
+TEST(SphericalCoordinateIntegrationMPI, RejectsMismatchedCommunicator) {
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, NUM_RADIAL,
+      NUM_POLAR, NUM_AZIMUTHAL, BoundVec3(0.0, 0.0, 0.0));
+  const svr::SectorDecomposition decomposition(
+      grid, {.radial = 2, .polar = 1, .azimuthal = 1}, rank % 2);
+  const std::vector<double> sector_field(decomposition.numSectorVoxels(), 1.0);
+  const Ray ray(BoundVec3(0.0, 0.0, -15.0), UnitVec3(0.0, 0.0, 1.0));
+  svr::RayIntegral integral;
+  EXPECT_FALSE(svr::integrateSphericalVolumeDistributed(
+      &ray, 1, decomposition, sector_field.data(),
+      [](double) -> svr::TransferSample {
+        return {.red = 1.0, .green = 1.0, .blue = 1.0, .extinction = 1.0};
+      },
+      /*max_t=*/1.0, &integral, MPI_COMM_WORLD));
+}
+
+TEST(SphericalCoordinateIntegrationMPI, RejectsMismatchOnAnyRank) {
+  int rank = 0;
+  int num_ranks = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+  ASSERT_EQ(num_ranks, 4) << "Run with mpiexec -n 4.";
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, NUM_RADIAL,
+      NUM_POLAR, NUM_AZIMUTHAL, BoundVec3(0.0, 0.0, 0.0));
+  // Only the last rank is given the sector of another, so the other ranks
+  // must not begin the exchange.
+  const svr::SectorDecomposition decomposition(
+      grid, {.radial = 2, .polar = 1, .azimuthal = 2},
+      rank == num_ranks - 1 ? 0 : rank);
+  const std::vector<double> sector_field(decomposition.numSectorVoxels(), 1.0);
+  const Ray ray(BoundVec3(0.0, 0.0, -15.0), UnitVec3(0.0, 0.0, 1.0));
+  svr::RayIntegral integral;
+  EXPECT_FALSE(svr::integrateSphericalVolumeDistributed(
+      &ray, 1, decomposition, sector_field.data(),
+      [](double) -> svr::TransferSample {
+        return {.red = 1.0, .green = 1.0, .blue = 1.0, .extinction = 1.0};
+      },
+      /*max_t=*/1.0, &integral, MPI_COMM_WORLD));
+}
+
+TEST(SphericalCoordinateIntegrationMPI, RejectsRaysBeyondIntCounts) {
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, NUM_RADIAL,
+      NUM_POLAR, NUM_AZIMUTHAL, BoundVec3(0.0, 0.0, 0.0));
+  const svr::SectorDecomposition decomposition(
+      grid, {.radial = 2, .polar = 1, .azimuthal = 2}, rank);
+  const std::vector<double> sector_field(decomposition.numSectorVoxels(), 1.0);
+  const Ray ray(BoundVec3(0.0, 0.0, -15.0), UnitVec3(0.0, 0.0, 1.0));
+  svr::RayIntegral integral;
+  // The rays are rejected before any is read, since their integrals could not
+  // be gathered with int offsets.
+  EXPECT_FALSE(svr::integrateSphericalVolumeDistributed(
+      &ray, std::size_t(std::numeric_limits<int>::max()) + 1, decomposition,
+      sector_field.data(),
+      [](double) -> svr::TransferSample {
+        return {.red = 1.0, .green = 1.0, .blue = 1.0, .extinction = 1.0};
+      },
+      /*max_t=*/1.0, &integral, MPI_COMM_WORLD));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  MPI_Init(&argc, &argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  const int result = RUN_ALL_TESTS();
+  MPI_Finalize();
+  return result;
+}
@@ -1,6 +1,23 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <random>
 
+#include "../compact_voxel.h"
+#include "../level_of_detail.h"
+#include "../occupancy_grid.h"
+#include "../pipeline.h"
+#include "../ray_order.h"
+#ifdef SVR_ENABLE_GPU
+#include "../gpu_traversal.h"
+#endif
+#include "../renderer.h"
+#include "../sector_decomposition.h"
 #include "../spherical_volume_rendering_util.h"
+#include "../spherical_voxel_grid_file.h"
+#include "../voxel_stream.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -107,6 +124,59 @@ TEST(SphericalCoordinateTraversal, RayBeginsWithinSphere) {
                     expected_theta_voxels, expected_phi_voxels);
 }
 
+TEST(SphericalCoordinateTraversal, RayBeginsWithinSphereMovingOutward) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 4;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  // The ray begins past the inner boundary of its radial voxel, so it only
+  // exits spheres.
+  const BoundVec3 ray_origin(-3.0, 5.2, 0.5);
+  const UnitVec3 ray_direction(0.0, 1.0, 0.0);
+  const Ray ray(ray_origin, ray_direction);
+
+  const auto actual_voxels = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+  const std::vector<int> expected_radial_voxels = {2, 1};
+  const std::vector<int> expected_theta_voxels = {1, 1};
+  const std::vector<int> expected_phi_voxels = {1, 1};
+  verifyEqualVoxels(actual_voxels, expected_radial_voxels,
+                    expected_theta_voxels, expected_phi_voxels);
+  EXPECT_DOUBLE_EQ(actual_voxels[0].enter_t, 0.0);
+  EXPECT_NEAR(actual_voxels[0].exit_t, std::sqrt(7.5 * 7.5 - 9.25) - 5.2,
+              1e-12);
+}
+
+TEST(SphericalCoordinateTraversal, RayBeginsWithinSphereExitsGrid) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 4;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  // The final voxel is exited through the outermost sphere, rather than the
+  // sphere of the radial voxel in which the ray begins.
+  const BoundVec3 ray_origin(-3.0, 5.2, 0.5);
+  const UnitVec3 ray_direction(0.0, 1.0, 0.0);
+  const Ray ray(ray_origin, ray_direction);
+
+  const auto actual_voxels = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+  ASSERT_EQ(actual_voxels.size(), 2);
+  EXPECT_NEAR(actual_voxels[1].enter_t, std::sqrt(7.5 * 7.5 - 9.25) - 5.2,
+              1e-12);
+  EXPECT_NEAR(actual_voxels[1].exit_t, std::sqrt(10.0 * 10.0 - 9.25) - 5.2,
+              1e-12);
+}
+
 TEST(SphericalCoordinateTraversal, RayEndsWithinSphere) {
   const BoundVec3 sphere_center(0.0, 0.0, 0.0);
   const double sphere_max_radius = 10.0;
@@ -1129,4 +1199,2523 @@ TEST(SphericalCoordinateTraversal, FirstOctantMiss) {
   };
 }
 
+TEST(ThreadPool, ParallelForVisitsEachIndexOnce) {
+  svr::ThreadPool pool(4);
+  const std::size_t n = 10007;
+  std::vector<int> visits(n, 0);
+  pool.parallelFor(n, /*grain=*/7,
+                   [&](std::size_t begin, std::size_t end, std::size_t) {
+                     for (std::size_t i = begin; i < end; ++i) ++visits[i];
+                   });
+  EXPECT_EQ(std::count(visits.cbegin(), visits.cend(), 1), n);
+  pool.parallelFor(n, /*grain=*/1,
+                   [&](std::size_t begin, std::size_t end, std::size_t) {
+                     for (std::size_t i = begin; i < end; ++i) ++visits[i];
+                   },
+                   /*max_workers=*/2);
+  EXPECT_EQ(std::count(visits.cbegin(), visits.cend(), 2), n);
+}
+
+TEST(ThreadPool, NestedParallelForRunsOnCallingWorker) {
+  svr::ThreadPool pool(4);
+  const std::size_t n = 64;
+  std::vector<std::atomic<int>> visits(n * n);
+  for (std::atomic<int> &visit : visits) visit.store(0);
+  std::atomic<bool> is_same_worker(true);
+  pool.parallelFor(n, /*grain=*/1, [&](std::size_t begin, std::size_t end,
+                                       std::size_t outer_worker_id) {
+    for (std::size_t i = begin; i < end; ++i) {
+      pool.parallelFor(n, /*grain=*/5,
+                       [&](std::size_t inner_begin, std::size_t inner_end,
+                           std::size_t worker_id) {
+                         if (worker_id != outer_worker_id) {
+                           is_same_worker.store(false);
+                         }
+                         for (std::size_t j = inner_begin; j < inner_end;
+                              ++j) {
+                           ++visits[i * n + j];
+                         }
+                       });
+    }
+  });
+  EXPECT_TRUE(is_same_worker.load());
+  EXPECT_EQ(std::count_if(visits.cbegin(), visits.cend(),
+                          [](const std::atomic<int> &visit) {
+                            return visit.load() == 1;
+                          }),
+            n * n);
+  // The pool is usable once the nested calls return.
+  std::atomic<std::size_t> count(0);
+  pool.parallelFor(n, /*grain=*/1,
+                   [&](std::size_t begin, std::size_t end, std::size_t) {
+                     count += end - begin;
+                   });
+  EXPECT_EQ(count.load(), n);
+}
+
+TEST(SphericalCoordinateTraversalBatch, MatchesSingleRayTraversal) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 8;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 2.0, j / 2.0, 0.5),
+                        UnitVec3(-1.0, 0.5, 0.25));
+    }
+  }
+  for (const std::size_t num_threads : {1, 3, 0}) {
+    const auto batch = svr::walkSphericalVolumeBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, num_threads);
+    ASSERT_EQ(batch.offsets.size(), rays.size() + 1);
+    EXPECT_EQ(batch.offsets.back(), batch.voxels.size());
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      const auto expected = walkSphericalVolume(rays[i], grid, /*max_t=*/1.0);
+      ASSERT_EQ(batch.offsets[i + 1] - batch.offsets[i], expected.size());
+      for (std::size_t j = 0; j < expected.size(); ++j) {
+        const svr::SphericalVoxel &actual =
+            batch.voxels[batch.offsets[i] + j];
+        EXPECT_EQ(actual.radial, expected[j].radial);
+        EXPECT_EQ(actual.polar, expected[j].polar);
+        EXPECT_EQ(actual.azimuthal, expected[j].azimuthal);
+        EXPECT_DOUBLE_EQ(actual.enter_t, expected[j].enter_t);
+        EXPECT_DOUBLE_EQ(actual.exit_t, expected[j].exit_t);
+      }
+    }
+  }
+}
+
+TEST(SphericalCoordinateTraversalBatch, EmptyBatch) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 4, 4,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  const auto batch =
+      svr::walkSphericalVolumeBatch(nullptr, 0, grid, /*max_t=*/1.0);
+  EXPECT_EQ(batch.offsets.size(), 1);
+  EXPECT_TRUE(batch.voxels.empty());
+}
+
+TEST(SphericalCoordinateTraversalBatch, FlatArraysMatchBatch) {
+  const double min_bound[3] = {0.0, 0.0, 0.0};
+  const double max_bound[3] = {10.0, TAU, TAU};
+  const double sphere_center[3] = {0.0, 0.0, 0.0};
+  std::vector<double> ray_origins, ray_directions;
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    ray_origins.insert(ray_origins.end(), {i / 2.0, 1.0, -15.0});
+    ray_directions.insert(ray_directions.end(), {0.1, -0.2, 1.0});
+    rays.emplace_back(BoundVec3(i / 2.0, 1.0, -15.0), UnitVec3(0.1, -0.2, 1.0));
+  }
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 8, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const auto expected = svr::walkSphericalVolumeBatch(rays.data(), rays.size(),
+                                                      grid, /*max_t=*/1.0);
+  const auto batch = svr::walkSphericalVolumeBatch(
+      ray_origins.data(), ray_directions.data(), rays.size(), min_bound,
+      max_bound, 4, 8, 4, sphere_center, /*max_t=*/1.0, /*num_threads=*/0);
+  ASSERT_EQ(batch.offsets, expected.offsets);
+  const auto grid_batch = svr::walkSphericalVolumeBatch(
+      ray_origins.data(), ray_directions.data(), rays.size(), grid,
+      /*max_t=*/1.0, /*num_threads=*/0);
+  EXPECT_EQ(grid_batch.offsets, expected.offsets);
+
+  const std::size_t num_voxels = batch.voxels.size();
+  std::vector<std::int64_t> offsets(rays.size() + 1);
+  std::vector<std::int32_t> indices(3 * num_voxels);
+  std::vector<double> times(2 * num_voxels);
+  svr::copySphericalVoxelBatch(batch, offsets.data(), indices.data(),
+                               times.data());
+  for (std::size_t i = 0; i <= rays.size(); ++i) {
+    EXPECT_EQ(offsets[i], expected.offsets[i]);
+  }
+  for (std::size_t i = 0; i < num_voxels; ++i) {
+    EXPECT_EQ(indices[3 * i], expected.voxels[i].radial);
+    EXPECT_EQ(indices[3 * i + 1], expected.voxels[i].polar);
+    EXPECT_EQ(indices[3 * i + 2], expected.voxels[i].azimuthal);
+    EXPECT_DOUBLE_EQ(times[2 * i], expected.voxels[i].enter_t);
+    EXPECT_DOUBLE_EQ(times[2 * i + 1], expected.voxels[i].exit_t);
+  }
+}
+
+TEST(SphericalCoordinateTraversalBatch, TwoPassMatchesBatch) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 4,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 2.0, j / 2.0, 0.5),
+                        UnitVec3(-1.0, 0.5, 0.25));
+    }
+  }
+  const auto batch = svr::walkSphericalVolumeBatch(rays.data(), rays.size(),
+                                                   grid, /*max_t=*/1.0);
+  svr::ThreadPool pool(3);
+  std::vector<std::size_t> offsets(rays.size() + 1);
+  const std::size_t num_voxels = svr::countSphericalVoxelBatch(
+      rays.data(), rays.size(), grid, /*max_t=*/1.0, offsets.data(), pool);
+  EXPECT_EQ(num_voxels, batch.voxels.size());
+  EXPECT_THAT(offsets, testing::ContainerEq(batch.offsets));
+  std::vector<svr::SphericalVoxel> voxels(num_voxels);
+  svr::fillSphericalVoxelBatch(rays.data(), rays.size(), grid, /*max_t=*/1.0,
+                               offsets.data(), voxels.data(), pool);
+  for (std::size_t i = 0; i < num_voxels; ++i) {
+    EXPECT_EQ(voxels[i].radial, batch.voxels[i].radial);
+    EXPECT_EQ(voxels[i].polar, batch.voxels[i].polar);
+    EXPECT_EQ(voxels[i].azimuthal, batch.voxels[i].azimuthal);
+    EXPECT_DOUBLE_EQ(voxels[i].enter_t, batch.voxels[i].enter_t);
+    EXPECT_DOUBLE_EQ(voxels[i].exit_t, batch.voxels[i].exit_t);
+  }
+
+  std::vector<std::int64_t> flat_offsets(rays.size() + 1);
+  EXPECT_EQ(svr::countSphericalVoxelBatch(rays.data(), rays.size(), grid,
+                                          /*max_t=*/1.0, flat_offsets.data()),
+            num_voxels);
+  std::vector<std::int32_t> indices(3 * num_voxels);
+  std::vector<double> times(2 * num_voxels);
+  svr::fillSphericalVoxelBatch(rays.data(), rays.size(), grid, /*max_t=*/1.0,
+                               flat_offsets.data(), indices.data(),
+                               times.data());
+  std::vector<std::int64_t> expected_offsets(rays.size() + 1);
+  std::vector<std::int32_t> expected_indices(3 * num_voxels);
+  std::vector<double> expected_times(2 * num_voxels);
+  svr::copySphericalVoxelBatch(batch, expected_offsets.data(),
+                               expected_indices.data(), expected_times.data());
+  EXPECT_THAT(flat_offsets, testing::ContainerEq(expected_offsets));
+  EXPECT_THAT(indices, testing::ContainerEq(expected_indices));
+  EXPECT_THAT(times, testing::ContainerEq(expected_times));
+}
+
+TEST(SphericalCoordinateTraversalBatch, FillDoesNotOverrunOffsets) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 4,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+  ASSERT_GT(expected.size(), 2);
+  // Offsets that are too small for the ray truncate its voxels.
+  const std::size_t offsets[] = {0, 2};
+  svr::SphericalVoxel voxels[3] = {};
+  svr::fillSphericalVoxelBatch(&ray, 1, grid, /*max_t=*/1.0, offsets, voxels);
+  EXPECT_EQ(voxels[0].radial, expected[0].radial);
+  EXPECT_EQ(voxels[1].radial, expected[1].radial);
+  EXPECT_EQ(voxels[2].radial, 0);
+}
+
+TEST(RayOrder, HilbertCurveStepsBetweenAdjacentCells) {
+  const std::uint32_t bits = 3;
+  const std::uint32_t size = 1u << bits;
+  std::vector<std::pair<std::uint64_t, std::array<int, 3>>> cells;
+  for (std::uint32_t x = 0; x < size; ++x) {
+    for (std::uint32_t y = 0; y < size; ++y) {
+      for (std::uint32_t z = 0; z < size; ++z) {
+        cells.push_back({svr::internal::hilbertKey(x, y, z, bits),
+                         {int(x), int(y), int(z)}});
+      }
+    }
+  }
+  std::sort(cells.begin(), cells.end());
+  for (std::size_t i = 0; i < cells.size(); ++i) {
+    ASSERT_EQ(cells[i].first, i);
+    if (i == 0) continue;
+    int distance = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      distance += std::abs(cells[i].second[axis] - cells[i - 1].second[axis]);
+    }
+    EXPECT_EQ(distance, 1);
+  }
+}
+
+TEST(RayOrder, OrdersRaysByEntryPoint) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 8, 8, 8,
+      BoundVec3(1.0, 2.0, 3.0));
+  std::mt19937 generator(29);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::vector<Ray> rays;
+  std::vector<FreeVec3> entry_points;
+  while (rays.size() < 4096) {
+    const FreeVec3 p(uniform(generator), uniform(generator),
+                     uniform(generator));
+    if (p.squared_length() > 1.0 || p.squared_length() < 0.01) continue;
+    const FreeVec3 entry = p * (10.0 / p.length());
+    // Rays from outside the sphere towards its center enter at entry.
+    const BoundVec3 origin(1.0 + 1.5 * entry.x(), 2.0 + 1.5 * entry.y(),
+                           3.0 + 1.5 * entry.z());
+    rays.emplace_back(origin, UnitVec3(-p.x(), -p.y(), -p.z()));
+    entry_points.push_back(entry);
+  }
+  const auto meanStep = [&](const std::vector<std::uint32_t> &order) {
+    double distance = 0.0;
+    for (std::size_t k = 1; k < order.size(); ++k) {
+      distance +=
+          (entry_points[order[k]] - entry_points[order[k - 1]]).length();
+    }
+    return distance / (order.size() - 1);
+  };
+  std::vector<std::uint32_t> given(rays.size());
+  for (std::size_t i = 0; i < given.size(); ++i) given[i] = i;
+  for (const svr::RayOrdering ordering :
+       {svr::RayOrdering::MORTON, svr::RayOrdering::HILBERT}) {
+    const svr::RayOrder order(rays.data(), rays.size(), grid, ordering);
+    ASSERT_EQ(order.size(), rays.size());
+    std::vector<std::uint32_t> indices(order.data(),
+                                       order.data() + order.size());
+    EXPECT_LT(meanStep(indices), meanStep(given) / 10.0);
+    std::sort(indices.begin(), indices.end());
+    EXPECT_THAT(indices, testing::ContainerEq(given));
+  }
+}
+
+TEST(RayOrder, OrderedBatchesMatchBatch) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 8, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  std::vector<Ray> rays;
+  std::vector<double> origins;
+  std::vector<double> directions;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 2.0, j / 2.0, 0.5),
+                        UnitVec3(-1.0, 0.5, 0.25));
+    }
+  }
+  for (const Ray &ray : rays) {
+    origins.insert(origins.end(),
+                   {ray.origin().x(), ray.origin().y(), ray.origin().z()});
+    directions.insert(directions.end(), {ray.direction().x(),
+                                         ray.direction().y(),
+                                         ray.direction().z()});
+  }
+  const auto batch = svr::walkSphericalVolumeBatch(rays.data(), rays.size(),
+                                                   grid, /*max_t=*/1.0);
+  const auto compact = svr::walkSphericalVolumeCompactBatch(
+      rays.data(), rays.size(), grid, /*max_t=*/1.0,
+      svr::CompactVoxelEncoding::STEPS);
+  // The simplified parameters normalize the directions again, so their
+  // voxels are compared with those of the given order.
+  std::vector<std::int64_t> expected_offsets(rays.size() + 1);
+  std::vector<std::int32_t> expected_indices(3 * batch.voxels.size());
+  std::vector<double> expected_times(2 * batch.voxels.size());
+  svr::countSphericalVoxelBatch(origins.data(), directions.data(), rays.size(),
+                                grid, /*max_t=*/1.0, expected_offsets.data(),
+                                /*order=*/nullptr, /*num_threads=*/0);
+  svr::fillSphericalVoxelBatch(origins.data(), directions.data(), rays.size(),
+                               grid, /*max_t=*/1.0, expected_offsets.data(),
+                               expected_indices.data(), expected_times.data(),
+                               /*order=*/nullptr, /*num_threads=*/0);
+  svr::ThreadPool pool(3);
+  for (const svr::RayOrdering ordering :
+       {svr::RayOrdering::MORTON, svr::RayOrdering::HILBERT}) {
+    const svr::RayOrder order(rays.data(), rays.size(), grid, ordering);
+    const auto ordered = svr::walkSphericalVolumeBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, order, pool);
+    EXPECT_THAT(ordered.offsets, testing::ContainerEq(batch.offsets));
+    ASSERT_EQ(ordered.voxels.size(), batch.voxels.size());
+    std::vector<std::size_t> offsets(rays.size() + 1);
+    EXPECT_EQ(svr::countSphericalVoxelBatch(rays.data(), rays.size(), grid,
+                                            /*max_t=*/1.0, offsets.data(),
+                                            order, pool),
+              batch.voxels.size());
+    EXPECT_THAT(offsets, testing::ContainerEq(batch.offsets));
+    std::vector<svr::SphericalVoxel> voxels(batch.voxels.size());
+    svr::fillSphericalVoxelBatch(rays.data(), rays.size(), grid,
+                                 /*max_t=*/1.0, offsets.data(), voxels.data(),
+                                 order, pool);
+    for (std::size_t i = 0; i < batch.voxels.size(); ++i) {
+      EXPECT_EQ(ordered.voxels[i].radial, batch.voxels[i].radial);
+      EXPECT_EQ(ordered.voxels[i].polar, batch.voxels[i].polar);
+      EXPECT_EQ(ordered.voxels[i].azimuthal, batch.voxels[i].azimuthal);
+      EXPECT_DOUBLE_EQ(ordered.voxels[i].enter_t, batch.voxels[i].enter_t);
+      EXPECT_DOUBLE_EQ(ordered.voxels[i].exit_t, batch.voxels[i].exit_t);
+      EXPECT_EQ(voxels[i].radial, batch.voxels[i].radial);
+      EXPECT_EQ(voxels[i].polar, batch.voxels[i].polar);
+      EXPECT_EQ(voxels[i].azimuthal, batch.voxels[i].azimuthal);
+      EXPECT_DOUBLE_EQ(voxels[i].exit_t, batch.voxels[i].exit_t);
+    }
+    const auto ordered_compact = svr::walkSphericalVolumeCompactBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0,
+        svr::CompactVoxelEncoding::STEPS, order, pool);
+    EXPECT_THAT(ordered_compact.offsets, testing::ContainerEq(compact.offsets));
+    EXPECT_THAT(ordered_compact.steps, testing::ContainerEq(compact.steps));
+    EXPECT_THAT(ordered_compact.indices,
+                testing::ContainerEq(compact.indices));
+
+    // The simplified parameters of the Cythonized traversal.
+    std::vector<std::uint32_t> flat_order(rays.size());
+    svr::orderSphericalRays(origins.data(), directions.data(), rays.size(),
+                            grid, static_cast<int>(ordering),
+                            flat_order.data());
+    EXPECT_TRUE(std::equal(flat_order.begin(), flat_order.end(),
+                           order.data()));
+    std::vector<std::int64_t> flat_offsets(rays.size() + 1);
+    svr::countSphericalVoxelBatch(origins.data(), directions.data(),
+                                  rays.size(), grid, /*max_t=*/1.0,
+                                  flat_offsets.data(), flat_order.data(),
+                                  /*num_threads=*/0);
+    std::vector<std::int32_t> indices(3 * batch.voxels.size());
+    std::vector<double> times(2 * batch.voxels.size());
+    svr::fillSphericalVoxelBatch(origins.data(), directions.data(),
+                                 rays.size(), grid, /*max_t=*/1.0,
+                                 flat_offsets.data(), indices.data(),
+                                 times.data(), flat_order.data(),
+                                 /*num_threads=*/0);
+    EXPECT_THAT(flat_offsets, testing::ContainerEq(expected_offsets));
+    EXPECT_THAT(indices, testing::ContainerEq(expected_indices));
+    EXPECT_THAT(times, testing::ContainerEq(expected_times));
+  }
+}
+
+TEST(EntryVoxelHint, HintedTraversalMatchesTraversal) {
+  // A grid whose angular voxels are found by their angle, one whose voxels
+  // are searched linearly, and a sectored grid.
+  const svr::SphericalVoxelGrid grids[] = {
+      svr::SphericalVoxelGrid(
+          MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 16, 32,
+          64, BoundVec3(0.5, -0.25, 0.0)),
+      svr::SphericalVoxelGrid(
+          MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 8, 3,
+          BoundVec3(0.0, 0.0, 0.0)),
+      svr::SphericalVoxelGrid(
+          MIN_BOUND, {.radial = 10.0, .polar = M_PI, .azimuthal = M_PI / 2.0},
+          8, 16, 16, BoundVec3(0.0, 0.0, 0.0))};
+  std::mt19937 generator(30);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::vector<Ray> rays;
+  for (int i = 0; i < 256; ++i) {
+    const double scale = i % 2 == 0 ? 15.0 : 8.0;
+    rays.emplace_back(BoundVec3(scale * uniform(generator),
+                                scale * uniform(generator),
+                                scale * uniform(generator)),
+                      UnitVec3(uniform(generator), uniform(generator),
+                               uniform(generator)));
+  }
+  // Rays that enter upon the angular voxel boundaries.
+  rays.emplace_back(BoundVec3(-15.0, 0.0, 0.0), UnitVec3(1.0, 0.0, 0.0));
+  rays.emplace_back(BoundVec3(0.0, -15.0, 0.0), UnitVec3(0.0, 1.0, 0.0));
+  rays.emplace_back(BoundVec3(15.0, 15.0, 15.0), UnitVec3(-1.0, -1.0, -1.0));
+  rays.emplace_back(BoundVec3(0.0, 0.0, 0.0), UnitVec3(1.0, 0.0, 0.0));
+
+  const auto expectSameVoxels = [](
+      const std::vector<svr::SphericalVoxel> &actual,
+      const std::vector<svr::SphericalVoxel> &expected) {
+    ASSERT_EQ(actual.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(actual[i].radial, expected[i].radial);
+      EXPECT_EQ(actual[i].polar, expected[i].polar);
+      EXPECT_EQ(actual[i].azimuthal, expected[i].azimuthal);
+      EXPECT_EQ(actual[i].enter_t, expected[i].enter_t);
+      EXPECT_EQ(actual[i].exit_t, expected[i].exit_t);
+    }
+  };
+  for (const svr::SphericalVoxelGrid &grid : grids) {
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      const auto expected = walkSphericalVolume(rays[i], grid, /*max_t=*/1.0);
+      svr::EntryVoxel entry_voxel = svr::EntryVoxel();
+      if (!expected.empty()) {
+        entry_voxel = {.radial = expected[0].radial,
+                       .polar = expected[0].polar,
+                       .azimuthal = expected[0].azimuthal};
+      }
+      const svr::EntryVoxel hints[] = {
+          entry_voxel,
+          {.radial = entry_voxel.radial + 1,
+           .polar = entry_voxel.polar + 1,
+           .azimuthal = entry_voxel.azimuthal - 1},
+          {.radial = 1, .polar = -7, .azimuthal = 1000},
+          {.radial = 1, .polar = 2, .azimuthal = 2}};
+      for (const svr::EntryVoxel &hint : hints) {
+        std::vector<svr::SphericalVoxel> voxels;
+        const svr::EntryVoxel actual_entry_voxel = svr::walkSphericalVolume(
+            rays[i], grid, /*max_t=*/1.0, hint,
+            [&](int radial, int polar, int azimuthal, double enter_t,
+                double exit_t) {
+              voxels.push_back({radial, polar, azimuthal, enter_t, exit_t});
+            });
+        expectSameVoxels(voxels, expected);
+        EXPECT_EQ(actual_entry_voxel.radial, entry_voxel.radial);
+        EXPECT_EQ(actual_entry_voxel.polar, entry_voxel.polar);
+        EXPECT_EQ(actual_entry_voxel.azimuthal, entry_voxel.azimuthal);
+      }
+    }
+  }
+}
+
+TEST(EntryVoxelHint, BatchWarmStartsFromPreviousFrame) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 16, 64, 64,
+      BoundVec3(0.0, 0.0, 0.0));
+  svr::ThreadPool pool(2);
+  svr::EntryVoxelHints hints;
+  // The camera of each frame moves slightly along x.
+  for (int frame = 0; frame < 3; ++frame) {
+    std::vector<Ray> rays;
+    for (int i = -20; i <= 20; ++i) {
+      for (int j = -20; j <= 20; ++j) {
+        rays.emplace_back(BoundVec3(i / 2.0 + frame * 0.05, j / 2.0, -15.0),
+                          UnitVec3(0.02, -0.01, 1.0));
+      }
+    }
+    svr::resetTraversalStatistics();
+    const auto batch = svr::walkSphericalVolumeBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, hints, pool);
+    const std::uint64_t num_entry_hints =
+        svr::traversalStatistics().num_entry_hints;
+    const auto expected = svr::walkSphericalVolumeBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0, pool);
+    EXPECT_THAT(batch.offsets, testing::ContainerEq(expected.offsets));
+    ASSERT_EQ(batch.voxels.size(), expected.voxels.size());
+    for (std::size_t i = 0; i < expected.voxels.size(); ++i) {
+      EXPECT_EQ(batch.voxels[i].radial, expected.voxels[i].radial);
+      EXPECT_EQ(batch.voxels[i].polar, expected.voxels[i].polar);
+      EXPECT_EQ(batch.voxels[i].azimuthal, expected.voxels[i].azimuthal);
+      EXPECT_EQ(batch.voxels[i].exit_t, expected.voxels[i].exit_t);
+    }
+    ASSERT_EQ(hints.size(), rays.size());
+    std::size_t num_hits = 0;
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      const std::size_t offset = expected.offsets[i];
+      if (offset == expected.offsets[i + 1]) {
+        EXPECT_EQ(hints[i].radial, 0);
+        continue;
+      }
+      ++num_hits;
+      EXPECT_EQ(hints[i].radial, expected.voxels[offset].radial);
+      EXPECT_EQ(hints[i].polar, expected.voxels[offset].polar);
+      EXPECT_EQ(hints[i].azimuthal, expected.voxels[offset].azimuthal);
+    }
+    if (svr::traversalStatisticsEnabled()) {
+      // Most polar and azimuthal voxel IDs are confirmed from a hint, whether
+      // that of the previous frame or of the ray before.
+      EXPECT_GT(num_entry_hints, num_hits);
+    }
+  }
+}
+
+TEST(CompactVoxelCodec, PacksAndStepsVoxelIDs) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::CompactVoxelCodec codec(svr::SphericalVoxelGrid(
+      MIN_BOUND, max_bound, 1000, 512, 3, BoundVec3(0.0, 0.0, 0.0)));
+  EXPECT_TRUE(codec.isValid());
+  int radial, polar, azimuthal;
+  codec.unpack(codec.pack(1000, 511, 2), radial, polar, azimuthal);
+  EXPECT_EQ(radial, 1000);
+  EXPECT_EQ(polar, 511);
+  EXPECT_EQ(azimuthal, 2);
+  // The polar and azimuthal IDs wrap around.
+  const std::uint8_t step = codec.step(1000, 511, 0, 999, 0, 2);
+  ASSERT_NE(step, svr::CompactVoxelCodec::FULL_INDEX_STEP);
+  codec.applyStep(step, radial, polar, azimuthal);
+  EXPECT_EQ(radial, 999);
+  EXPECT_EQ(polar, 0);
+  EXPECT_EQ(azimuthal, 1);
+  EXPECT_EQ(codec.step(3, 4, 1, 3, 6, 1),
+            svr::CompactVoxelCodec::FULL_INDEX_STEP);
+  EXPECT_FALSE(svr::CompactVoxelCodec(
+                   svr::SphericalVoxelGrid(MIN_BOUND, max_bound, 4096, 4096,
+                                           1024, BoundVec3(0.0, 0.0, 0.0)))
+                   .isValid());
+}
+
+TEST(CompactVoxelBatch, DecodedVoxelsMatchBatch) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = M_PI, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 4,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 2.0, j / 2.0, 0.5),
+                        UnitVec3(-1.0, 0.5, 0.25));
+    }
+  }
+  const auto batch = svr::walkSphericalVolumeBatch(rays.data(), rays.size(),
+                                                   grid, /*max_t=*/1.0);
+  svr::ThreadPool pool(3);
+  for (const svr::CompactVoxelEncoding encoding :
+       {svr::CompactVoxelEncoding::PACKED,
+        svr::CompactVoxelEncoding::STEPS}) {
+    const svr::CompactVoxelBatch compact =
+        svr::walkSphericalVolumeCompactBatch(rays.data(), rays.size(), grid,
+                                             /*max_t=*/1.0, encoding, pool);
+    // Excludes the per-ray offsets and enter times, since these rays traverse
+    // few voxels each.
+    EXPECT_LT((compact.exit_offsets.size() + compact.indices.size()) * 4 +
+                  compact.steps.size(),
+              batch.voxels.size() * sizeof(svr::SphericalVoxel) / 3);
+    const svr::CompactVoxelBatch encoded =
+        svr::compactSphericalVoxelBatch(batch, grid, encoding);
+    EXPECT_THAT(encoded.indices, testing::ContainerEq(compact.indices));
+    EXPECT_THAT(encoded.steps, testing::ContainerEq(compact.steps));
+    EXPECT_THAT(encoded.exit_offsets,
+                testing::ContainerEq(compact.exit_offsets));
+    const svr::SphericalVoxelBatch decoded =
+        svr::decodeCompactVoxelBatch(compact);
+    EXPECT_THAT(decoded.offsets, testing::ContainerEq(batch.offsets));
+    ASSERT_EQ(decoded.voxels.size(), batch.voxels.size());
+    for (std::size_t i = 0; i < batch.voxels.size(); ++i) {
+      EXPECT_EQ(decoded.voxels[i].radial, batch.voxels[i].radial);
+      EXPECT_EQ(decoded.voxels[i].polar, batch.voxels[i].polar);
+      EXPECT_EQ(decoded.voxels[i].azimuthal, batch.voxels[i].azimuthal);
+      EXPECT_NEAR(decoded.voxels[i].enter_t, batch.voxels[i].enter_t, 1e-5);
+      EXPECT_NEAR(decoded.voxels[i].exit_t, batch.voxels[i].exit_t, 1e-5);
+    }
+  }
+}
+
+TEST(VoxelStream, ReaderMatchesTraversal) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 4,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+    }
+  }
+  const std::string path = testing::TempDir() + "voxel_stream_test.svr";
+  for (const svr::CompactVoxelEncoding encoding :
+       {svr::CompactVoxelEncoding::PACKED,
+        svr::CompactVoxelEncoding::STEPS}) {
+    {
+      svr::VoxelStreamWriter writer(path, grid, encoding);
+      ASSERT_TRUE(writer.isOpen());
+      // Chunks of uneven sizes, including an empty chunk.
+      const std::size_t split = rays.size() / 3;
+      EXPECT_TRUE(writer.write(rays.data(), split, /*max_t=*/1.0));
+      EXPECT_TRUE(writer.write(rays.data() + split, 0, /*max_t=*/1.0));
+      EXPECT_TRUE(writer.write(rays.data() + split, rays.size() - split,
+                               /*max_t=*/1.0));
+      EXPECT_EQ(writer.numRays(), rays.size());
+      EXPECT_TRUE(writer.close());
+    }
+    const svr::VoxelStreamReader reader(path);
+    ASSERT_TRUE(reader.isOpen());
+    EXPECT_EQ(reader.encoding(), encoding);
+    EXPECT_EQ(reader.numRays(), rays.size());
+    EXPECT_EQ(reader.numChunks(), 3);
+    std::size_t num_voxels = 0;
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      const auto expected = walkSphericalVolume(rays[i], grid, /*max_t=*/1.0);
+      std::vector<svr::SphericalVoxel> voxels;
+      reader.decodeRay(i, voxels);
+      ASSERT_EQ(voxels.size(), expected.size());
+      for (std::size_t j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(voxels[j].radial, expected[j].radial);
+        EXPECT_EQ(voxels[j].polar, expected[j].polar);
+        EXPECT_EQ(voxels[j].azimuthal, expected[j].azimuthal);
+        EXPECT_NEAR(voxels[j].enter_t, expected[j].enter_t, 1e-5);
+        EXPECT_NEAR(voxels[j].exit_t, expected[j].exit_t, 1e-5);
+      }
+      num_voxels += expected.size();
+    }
+    EXPECT_EQ(reader.numVoxels(), num_voxels);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(VoxelStream, ReaderRejectsUnclosedStream) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 4, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const std::string path = testing::TempDir() + "voxel_stream_unclosed.svr";
+  EXPECT_FALSE(svr::VoxelStreamReader(path).isOpen());
+  svr::VoxelStreamWriter writer(path, grid, svr::CompactVoxelEncoding::PACKED);
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  ASSERT_TRUE(writer.write(&ray, 1, /*max_t=*/1.0));
+  std::fflush(nullptr);
+  EXPECT_FALSE(svr::VoxelStreamReader(path).isOpen());
+  EXPECT_TRUE(writer.close());
+  EXPECT_TRUE(svr::VoxelStreamReader(path).isOpen());
+  std::remove(path.c_str());
+}
+
+TEST(VoxelStream, ReaderRejectsOverflowingChunkCounts) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 4, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const std::string path = testing::TempDir() + "voxel_stream_overflow.svr";
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  // Counts whose arrays wrap around to a size of 0 bytes.
+  for (const std::size_t field :
+       {offsetof(svr::VoxelStreamChunk, num_voxels),
+        offsetof(svr::VoxelStreamChunk, num_indices)}) {
+    {
+      svr::VoxelStreamWriter writer(path, grid,
+                                    svr::CompactVoxelEncoding::PACKED);
+      ASSERT_TRUE(writer.write(&ray, 1, /*max_t=*/1.0));
+      ASSERT_TRUE(writer.close());
+    }
+    ASSERT_TRUE(svr::VoxelStreamReader(path).isOpen());
+    std::FILE *file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    svr::VoxelStreamHeader header;
+    ASSERT_EQ(std::fread(&header, sizeof(header), 1, file), 1);
+    const std::uint64_t count = std::uint64_t(1) << 62;
+    std::fseek(file, header.chunk_table_offset + field, SEEK_SET);
+    std::fwrite(&count, sizeof(count), 1, file);
+    std::fclose(file);
+    EXPECT_FALSE(svr::VoxelStreamReader(path).isOpen());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(VoxelStream, ReaderRejectsCorruptedOffsets) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 4, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const std::string path = testing::TempDir() + "voxel_stream_offsets.svr";
+  const Ray rays[] = {
+      Ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0)),
+      Ray(BoundVec3(-13.0, 2.0, -13.0), UnitVec3(1.0, 0.0, 1.0))};
+  // The offsets from the chunk of offsets[1], offsets[2], and, for STEPS,
+  // index_offsets[1], each set to more than the number of voxels.
+  const struct {
+    svr::CompactVoxelEncoding encoding;
+    std::size_t offset;
+  } corruptions[] = {{svr::CompactVoxelEncoding::PACKED, 8},
+                     {svr::CompactVoxelEncoding::PACKED, 16},
+                     {svr::CompactVoxelEncoding::STEPS, 8},
+                     {svr::CompactVoxelEncoding::STEPS, 24 + 16 + 8}};
+  for (const auto &corruption : corruptions) {
+    {
+      svr::VoxelStreamWriter writer(path, grid, corruption.encoding);
+      ASSERT_TRUE(writer.write(rays, 2, /*max_t=*/1.0));
+      ASSERT_TRUE(writer.close());
+    }
+    ASSERT_TRUE(svr::VoxelStreamReader(path).isOpen());
+    std::FILE *file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    svr::VoxelStreamHeader header;
+    ASSERT_EQ(std::fread(&header, sizeof(header), 1, file), 1);
+    svr::VoxelStreamChunk chunk;
+    std::fseek(file, header.chunk_table_offset, SEEK_SET);
+    ASSERT_EQ(std::fread(&chunk, sizeof(chunk), 1, file), 1);
+    const std::uint64_t offset = std::uint64_t(1) << 40;
+    std::fseek(file, chunk.file_offset + corruption.offset, SEEK_SET);
+    std::fwrite(&offset, sizeof(offset), 1, file);
+    std::fclose(file);
+    EXPECT_FALSE(svr::VoxelStreamReader(path).isOpen());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(VoxelStream, WriterRejectsMismatchedBatch) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 4, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const svr::SphericalVoxelGrid other_grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 8, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const std::string path = testing::TempDir() + "voxel_stream_mismatch.svr";
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  svr::VoxelStreamWriter writer(path, grid, svr::CompactVoxelEncoding::STEPS);
+  ASSERT_TRUE(writer.isOpen());
+  EXPECT_FALSE(writer.write(svr::walkSphericalVolumeCompactBatch(
+      &ray, 1, grid, /*max_t=*/1.0, svr::CompactVoxelEncoding::PACKED)));
+  EXPECT_FALSE(writer.write(svr::walkSphericalVolumeCompactBatch(
+      &ray, 1, other_grid, /*max_t=*/1.0, svr::CompactVoxelEncoding::STEPS)));
+  svr::CompactVoxelBatch batch = svr::walkSphericalVolumeCompactBatch(
+      &ray, 1, grid, /*max_t=*/1.0, svr::CompactVoxelEncoding::STEPS);
+  svr::CompactVoxelBatch truncated = batch;
+  truncated.steps.pop_back();
+  EXPECT_FALSE(writer.write(truncated));
+  truncated = batch;
+  truncated.offsets.clear();
+  EXPECT_FALSE(writer.write(truncated));
+  EXPECT_EQ(writer.numRays(), 0);
+  ASSERT_TRUE(writer.isOpen());
+  EXPECT_TRUE(writer.write(batch));
+  EXPECT_TRUE(writer.close());
+  const svr::VoxelStreamReader reader(path);
+  ASSERT_TRUE(reader.isOpen());
+  EXPECT_EQ(reader.numRays(), 1);
+  std::vector<svr::SphericalVoxel> voxels;
+  reader.decodeRay(0, voxels);
+  EXPECT_EQ(voxels.size(), batch.exit_offsets.size());
+  std::remove(path.c_str());
+}
+
+TEST(RayPipeline, BoundedQueueIsFirstInFirstOut) {
+  svr::BoundedQueue<int> queue(3);
+  EXPECT_EQ(queue.capacity(), 4);
+  for (int i = 0; i < 4; ++i) EXPECT_TRUE(queue.tryPush(i));
+  EXPECT_FALSE(queue.tryPush(4));
+  int value;
+  for (int round = 0; round < 3; ++round) {
+    // Wraps around the slots of the queue.
+    EXPECT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, 4 * round);
+    for (int i = 1; i < 4; ++i) {
+      ASSERT_TRUE(queue.tryPop(value));
+      EXPECT_EQ(value, 4 * round + i);
+    }
+    EXPECT_FALSE(queue.tryPop(value));
+    for (int i = 0; i < 4; ++i) EXPECT_TRUE(queue.tryPush(4 * (round + 1) + i));
+  }
+  queue.close();
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, 12 + i);
+  }
+  EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(RayPipeline, BoundedQueueCapacityIsAtLeastTwo) {
+  // A single slot cannot tell a full slot from a free one, so the capacity is
+  // at least 2.
+  for (const std::size_t capacity : {0, 1, 2}) {
+    svr::BoundedQueue<int> queue(capacity);
+    EXPECT_EQ(queue.capacity(), 2);
+    EXPECT_TRUE(queue.tryPush(1));
+    EXPECT_TRUE(queue.tryPush(2));
+    EXPECT_FALSE(queue.tryPush(3));
+    int value;
+    ASSERT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, 1);
+    ASSERT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, 2);
+    EXPECT_FALSE(queue.tryPop(value));
+  }
+}
+
+TEST(RayPipeline, StagesMatchSequentialTraversal) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 8, 8, 8,
+      BoundVec3(0.0, 0.0, 0.0));
+  std::vector<Ray> rays;
+  for (int i = -20; i <= 20; ++i) {
+    for (int j = -20; j <= 20; ++j) {
+      rays.emplace_back(BoundVec3(0.5 * i, 0.5 * j, -15.0),
+                        UnitVec3(0.05, -0.1, 1.0));
+    }
+  }
+  // Batches of uneven sizes, so that the workers finish out of order.
+  const std::size_t batch_size = 37;
+  std::size_t next_ray = 0;
+  std::vector<std::size_t> sink_indices;
+  std::size_t num_sunk_rays = 0;
+  svr::RayPipeline pipeline(/*queue_capacity=*/2);
+  pipeline.addStage(svr::traversalStage(grid, /*max_t=*/1.0), 3)
+      .addStage(
+          [](svr::RayBatch &batch, svr::ThreadPool &) {
+            batch.values.resize(batch.rays.size());
+            for (std::size_t i = 0; i < batch.rays.size(); ++i) {
+              batch.values[i] = batch.voxels.offsets[i + 1] -
+                                batch.voxels.offsets[i];
+            }
+          },
+          2)
+      .addOrderedStage([&](svr::RayBatch &batch, svr::ThreadPool &) {
+        sink_indices.push_back(batch.index);
+        for (std::size_t i = 0; i < batch.rays.size(); ++i) {
+          const auto expected = walkSphericalVolume(
+              rays[num_sunk_rays + i], grid, /*max_t=*/1.0);
+          ASSERT_EQ(static_cast<std::size_t>(batch.values[i]), expected.size());
+          const std::size_t offset = batch.voxels.offsets[i];
+          for (std::size_t j = 0; j < expected.size(); ++j) {
+            const svr::SphericalVoxel &voxel = batch.voxels.voxels[offset + j];
+            EXPECT_EQ(voxel.radial, expected[j].radial);
+            EXPECT_EQ(voxel.polar, expected[j].polar);
+            EXPECT_EQ(voxel.azimuthal, expected[j].azimuthal);
+            EXPECT_DOUBLE_EQ(voxel.enter_t, expected[j].enter_t);
+            EXPECT_DOUBLE_EQ(voxel.exit_t, expected[j].exit_t);
+          }
+        }
+        num_sunk_rays += batch.rays.size();
+      });
+  const std::size_t num_batches = pipeline.run([&](svr::RayBatch &batch) {
+    if (next_ray == rays.size()) return false;
+    const std::size_t size =
+        std::min(rays.size() - next_ray, batch_size + next_ray % 5);
+    for (std::size_t i = 0; i < size; ++i) {
+      batch.rays.push_back(rays[next_ray++]);
+    }
+    return true;
+  });
+  EXPECT_EQ(num_sunk_rays, rays.size());
+  ASSERT_EQ(sink_indices.size(), num_batches);
+  for (std::size_t i = 0; i < num_batches; ++i) {
+    EXPECT_EQ(sink_indices[i], i);
+  }
+}
+
+TEST(RayPipeline, WritesVoxelStreamInOrder) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 8, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  std::vector<double> origins;
+  std::vector<double> directions;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      origins.insert(origins.end(), {double(i), double(j), -15.0});
+      directions.insert(directions.end(), {0.1, -0.2, 1.0});
+    }
+  }
+  const std::size_t num_rays = origins.size() / 3;
+  const std::string path = testing::TempDir() + "voxel_stream_pipeline.svr";
+  {
+    svr::VoxelStreamWriter writer(path, grid,
+                                  svr::CompactVoxelEncoding::STEPS);
+    ASSERT_TRUE(writer.isOpen());
+    EXPECT_TRUE(svr::writeVoxelStreamPipelined(
+        writer, origins.data(), directions.data(), num_rays, /*max_t=*/1.0,
+        /*batch_size=*/64, /*num_threads=*/4));
+    EXPECT_EQ(writer.numRays(), num_rays);
+    EXPECT_TRUE(writer.close());
+  }
+  const svr::VoxelStreamReader reader(path);
+  ASSERT_TRUE(reader.isOpen());
+  EXPECT_EQ(reader.numRays(), num_rays);
+  EXPECT_EQ(reader.numChunks(), (num_rays + 63) / 64);
+  for (std::size_t i = 0; i < num_rays; ++i) {
+    const Ray ray(BoundVec3(origins[3 * i], origins[3 * i + 1],
+                            origins[3 * i + 2]),
+                  UnitVec3(directions[3 * i], directions[3 * i + 1],
+                           directions[3 * i + 2]));
+    const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+    std::vector<svr::SphericalVoxel> voxels;
+    reader.decodeRay(i, voxels);
+    ASSERT_EQ(voxels.size(), expected.size());
+    for (std::size_t j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(voxels[j].radial, expected[j].radial);
+      EXPECT_EQ(voxels[j].polar, expected[j].polar);
+      EXPECT_EQ(voxels[j].azimuthal, expected[j].azimuthal);
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(SphericalVoxelGridFile, MappedGridMatchesGrid) {
+  const BoundVec3 sphere_center(1.0, -2.0, 0.5);
+  const std::vector<svr::SphericalVoxelGrid> grids = {
+      svr::SphericalVoxelGrid(
+          MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 6, 8,
+          12, sphere_center),
+      svr::SphericalVoxelGrid::logarithmic(
+          {.radial = 0.5, .polar = 0.0, .azimuthal = 0.0},
+          {.radial = 10.0, .polar = M_PI, .azimuthal = TAU / 3.0}, 5, 7, 3,
+          sphere_center)};
+  const std::string path = testing::TempDir() + "spherical_voxel_grid.svr";
+  for (const svr::SphericalVoxelGrid &grid : grids) {
+    ASSERT_TRUE(svr::writeSphericalVoxelGrid(grid, path));
+    const svr::MappedSphericalVoxelGrid mapped(path);
+    ASSERT_TRUE(mapped.isOpen());
+    const svr::SharedSphericalVoxelGrid read =
+        svr::readSphericalVoxelGrid(path);
+    ASSERT_NE(read, nullptr);
+    EXPECT_EQ(read->numRadialSections(), grid.numRadialSections());
+    EXPECT_EQ(read->numPolarSections(), grid.numPolarSections());
+    EXPECT_EQ(read->numAzimuthalSections(), grid.numAzimuthalSections());
+    EXPECT_EQ(read->isFullSphere(), grid.isFullSphere());
+    EXPECT_EQ(read->isRadiallyUniform(), grid.isRadiallyUniform());
+    for (int i = -12; i <= 12; ++i) {
+      for (int j = -12; j <= 12; ++j) {
+        const Ray ray(BoundVec3(i, j, -15.0), UnitVec3(0.3, -0.2, 1.0));
+        const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+        std::vector<svr::SphericalVoxel> mapped_voxels;
+        svr::walkSphericalVolume(
+            ray, mapped.view(), /*max_t=*/1.0,
+            [&](int radial, int polar, int azimuthal, double enter_t,
+                double exit_t) {
+              mapped_voxels.push_back({.radial = radial,
+                                       .polar = polar,
+                                       .azimuthal = azimuthal,
+                                       .enter_t = enter_t,
+                                       .exit_t = exit_t});
+            });
+        const auto read_voxels = walkSphericalVolume(ray, *read, 1.0);
+        ASSERT_EQ(mapped_voxels.size(), expected.size());
+        ASSERT_EQ(read_voxels.size(), expected.size());
+        for (std::size_t k = 0; k < expected.size(); ++k) {
+          EXPECT_EQ(mapped_voxels[k].radial, expected[k].radial);
+          EXPECT_EQ(mapped_voxels[k].polar, expected[k].polar);
+          EXPECT_EQ(mapped_voxels[k].azimuthal, expected[k].azimuthal);
+          EXPECT_EQ(mapped_voxels[k].enter_t, expected[k].enter_t);
+          EXPECT_EQ(mapped_voxels[k].exit_t, expected[k].exit_t);
+          EXPECT_EQ(read_voxels[k].radial, expected[k].radial);
+          EXPECT_EQ(read_voxels[k].polar, expected[k].polar);
+          EXPECT_EQ(read_voxels[k].azimuthal, expected[k].azimuthal);
+          EXPECT_EQ(read_voxels[k].enter_t, expected[k].enter_t);
+          EXPECT_EQ(read_voxels[k].exit_t, expected[k].exit_t);
+        }
+      }
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(SphericalVoxelGridFile, RejectsInvalidFile) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 4, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  const std::string path = testing::TempDir() + "spherical_voxel_grid_bad.svr";
+  std::remove(path.c_str());
+  EXPECT_FALSE(svr::MappedSphericalVoxelGrid(path).isOpen());
+  EXPECT_EQ(svr::readSphericalVoxelGrid(path), nullptr);
+  ASSERT_TRUE(svr::writeSphericalVoxelGrid(grid, path));
+  ASSERT_TRUE(svr::MappedSphericalVoxelGrid(path).isOpen());
+
+  // A file of another version, including the previous version, whose tables
+  // are laid out differently.
+  std::FILE *file;
+  for (const std::uint32_t version : {svr::SPHERICAL_VOXEL_GRID_VERSION - 1,
+                                      svr::SPHERICAL_VOXEL_GRID_VERSION + 1}) {
+    ASSERT_TRUE(svr::writeSphericalVoxelGrid(grid, path));
+    file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, offsetof(svr::SphericalVoxelGridFileHeader, version),
+               SEEK_SET);
+    std::fwrite(&version, sizeof(version), 1, file);
+    std::fclose(file);
+    EXPECT_FALSE(svr::MappedSphericalVoxelGrid(path).isOpen());
+  }
+
+  // A truncated file.
+  ASSERT_TRUE(svr::writeSphericalVoxelGrid(grid, path));
+  file = std::fopen(path.c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  std::vector<char> bytes(sizeof(svr::SphericalVoxelGridFileHeader) + 64);
+  ASSERT_EQ(std::fread(bytes.data(), 1, bytes.size(), file), bytes.size());
+  std::fclose(file);
+  file = std::fopen(path.c_str(), "wb");
+  std::fwrite(bytes.data(), 1, bytes.size(), file);
+  std::fclose(file);
+  EXPECT_FALSE(svr::MappedSphericalVoxelGrid(path).isOpen());
+  EXPECT_EQ(svr::readSphericalVoxelGrid(path), nullptr);
+  std::remove(path.c_str());
+}
+
+TEST(SphericalCoordinateTraversalVisitor, MatchesReturnedVoxels) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 4;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  std::vector<svr::SphericalVoxel> visited_voxels;
+  walkSphericalVolume(ray, grid, /*max_t=*/1.0,
+                      [&](int radial, int polar, int azimuthal, double enter_t,
+                          double exit_t) {
+                        visited_voxels.push_back({.radial = radial,
+                                                  .polar = polar,
+                                                  .azimuthal = azimuthal,
+                                                  .enter_t = enter_t,
+                                                  .exit_t = exit_t});
+                      });
+  const std::vector<int> expected_radial_voxels = {1, 2, 3, 4, 4, 3, 2, 1};
+  const std::vector<int> expected_theta_voxels = {2, 2, 2, 2, 0, 0, 0, 0};
+  const std::vector<int> expected_phi_voxels = {2, 2, 2, 2, 0, 0, 0, 0};
+  verifyEqualVoxels(visited_voxels, expected_radial_voxels,
+                    expected_theta_voxels, expected_phi_voxels);
+  const auto returned_voxels = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+  ASSERT_EQ(visited_voxels.size(), returned_voxels.size());
+  for (std::size_t i = 0; i < visited_voxels.size(); ++i) {
+    EXPECT_DOUBLE_EQ(visited_voxels[i].enter_t, returned_voxels[i].enter_t);
+    EXPECT_DOUBLE_EQ(visited_voxels[i].exit_t, returned_voxels[i].exit_t);
+    if (i > 0) {
+      EXPECT_DOUBLE_EQ(visited_voxels[i].enter_t, visited_voxels[i - 1].exit_t);
+    }
+  }
+  EXPECT_DOUBLE_EQ(visited_voxels.front().enter_t,
+                   13.0 * std::sqrt(3.0) - sphere_max_radius);
+  EXPECT_DOUBLE_EQ(visited_voxels.back().exit_t,
+                   13.0 * std::sqrt(3.0) + sphere_max_radius);
+}
+
+TEST(SphericalCoordinateTraversalVisitor, VisitorStopsTraversalEarly) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 4;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  std::vector<int> radial_voxels;
+  walkSphericalVolume(ray, grid, /*max_t=*/1.0,
+                      [&](int radial, int, int, double, double) -> bool {
+                        radial_voxels.push_back(radial);
+                        return radial != 3;
+                      });
+  const std::vector<int> expected_radial_voxels = {1, 2, 3};
+  EXPECT_THAT(radial_voxels, testing::ContainerEq(expected_radial_voxels));
+}
+
+TEST(SphericalCoordinateIntegration, MatchesCompositedVoxels) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 8;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  std::vector<float> field(num_radial_sections * num_polar_sections *
+                           num_azimuthal_sections);
+  for (std::size_t i = 0; i < field.size(); ++i) field[i] = i / 128.0f;
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = 1.0 - value, .blue = 0.5,
+            .extinction = 0.05 * value};
+  };
+  for (int i = -12; i <= 12; ++i) {
+    const Ray ray(BoundVec3(i / 2.0, 1.0, -15.0), UnitVec3(0.1, -0.2, 1.0));
+    const svr::RayIntegral integral = svr::integrateSphericalVolume(
+        ray, grid, field.data(), transfer_function, /*max_t=*/1.0,
+        /*opacity_threshold=*/1.0);
+
+    double red = 0.0, green = 0.0, blue = 0.0, opacity = 0.0;
+    const auto voxels = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+    for (const svr::SphericalVoxel &voxel : voxels) {
+      const std::size_t index =
+          ((voxel.radial - 1) * num_polar_sections + voxel.polar) *
+              num_azimuthal_sections +
+          voxel.azimuthal;
+      const svr::TransferSample sample = transfer_function(field[index]);
+      const double alpha =
+          1.0 - std::exp(-sample.extinction * (voxel.exit_t - voxel.enter_t));
+      red += (1.0 - opacity) * alpha * sample.red;
+      green += (1.0 - opacity) * alpha * sample.green;
+      blue += (1.0 - opacity) * alpha * sample.blue;
+      opacity += (1.0 - opacity) * alpha;
+    }
+    EXPECT_EQ(integral.num_voxels, voxels.size());
+    EXPECT_DOUBLE_EQ(integral.red, red);
+    EXPECT_DOUBLE_EQ(integral.green, green);
+    EXPECT_DOUBLE_EQ(integral.blue, blue);
+    EXPECT_DOUBLE_EQ(integral.opacity, opacity);
+  }
+}
+
+TEST(SphericalCoordinateIntegration, OpaqueRayTerminatesEarly) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 4, 4,
+                                     sphere_center);
+  const std::vector<double> field(4 * 4 * 4, 1.0);
+  const Ray ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0));
+  const svr::RayIntegral integral = svr::integrateSphericalVolume(
+      ray, grid, field.data(),
+      [](double value) -> svr::TransferSample {
+        return {.red = value, .green = value, .blue = value,
+                .extinction = 10.0};
+      },
+      /*max_t=*/1.0, /*opacity_threshold=*/0.99);
+  // The first voxel alone is nearly opaque.
+  EXPECT_EQ(integral.num_voxels, 1);
+  EXPECT_GE(integral.opacity, 0.99);
+  EXPECT_DOUBLE_EQ(integral.red, integral.opacity);
+}
+
+TEST(Camera, GeneratesRaysForEachProjection) {
+  const BoundVec3 position(0.0, 0.0, -20.0);
+  const FreeVec3 forward(0.0, 0.0, 2.0);
+  const FreeVec3 up(0.0, 1.0, 0.0);
+  BoundVec3 origin;
+  FreeVec3 direction;
+
+  // The pixel centers of a 4 x 2 image lie at x = -0.75, ..., 0.75 and
+  // y = 0.25, -0.25 of the view.
+  const auto orthographic = svr::Camera::orthographic(
+      position, forward, up, /*width=*/4, /*height=*/2, /*view_width=*/8.0);
+  ASSERT_TRUE(orthographic.generateRay(3, 0, origin, direction));
+  EXPECT_DOUBLE_EQ(origin.x(), -3.0);
+  EXPECT_DOUBLE_EQ(origin.y(), 1.0);
+  EXPECT_DOUBLE_EQ(origin.z(), -20.0);
+  EXPECT_DOUBLE_EQ(direction.z(), 1.0);
+
+  const auto perspective = svr::Camera::perspective(
+      position, forward, up, /*width=*/4, /*height=*/2,
+      /*field_of_view=*/M_PI / 2.0);
+  ASSERT_TRUE(perspective.generateRay(0, 1, origin, direction));
+  EXPECT_TRUE(origin == position);
+  EXPECT_DOUBLE_EQ(direction.x(), 0.75);
+  EXPECT_DOUBLE_EQ(direction.y(), -0.25);
+  EXPECT_DOUBLE_EQ(direction.z(), 1.0);
+
+  // An all-sky fisheye maps the edge of its image circle directly behind the
+  // camera, and has no rays in the corners of the image.
+  const auto fisheye = svr::Camera::fisheye(position, forward, up,
+                                            /*width=*/5, /*height=*/5,
+                                            /*field_of_view=*/TAU);
+  ASSERT_TRUE(fisheye.generateRay(2, 2, origin, direction));
+  EXPECT_DOUBLE_EQ(direction.z(), 1.0);
+  ASSERT_TRUE(fisheye.generateRay(2, 0, origin, direction));
+  EXPECT_NEAR(direction.z(), std::cos(0.8 * M_PI), 1e-12);
+  EXPECT_GT(direction.y(), 0.0);
+  EXPECT_FALSE(fisheye.generateRay(0, 0, origin, direction));
+}
+
+TEST(Renderer, MatchesIntegratedCameraRays) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 4,
+                                     BoundVec3(0.5, -0.5, 0.0));
+  std::vector<float> field(4 * 8 * 4);
+  for (std::size_t i = 0; i < field.size(); ++i) field[i] = i / 128.0f;
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = 1.0 - value, .blue = 0.5,
+            .extinction = 0.2 * value};
+  };
+  const BoundVec3 position(1.0, 2.0, -25.0);
+  const FreeVec3 forward(0.0, -0.05, 1.0);
+  const FreeVec3 up(0.0, 1.0, 0.0);
+  // The image sizes are not multiples of the tile size.
+  const std::size_t width = 37, height = 23;
+  const std::vector<svr::Camera> cameras = {
+      svr::Camera::orthographic(position, forward, up, width, height, 24.0),
+      svr::Camera::perspective(position, forward, up, width, height, 0.9),
+      svr::Camera::fisheye(position, forward, up, width, height, 1.2)};
+  for (const svr::Camera &camera : cameras) {
+    std::vector<svr::RayIntegral> image(width * height);
+    svr::renderSphericalVolume(camera, grid, field.data(), transfer_function,
+                               image.data());
+    std::size_t num_opaque_pixels = 0;
+    for (std::size_t y = 0; y < height; ++y) {
+      for (std::size_t x = 0; x < width; ++x) {
+        const svr::RayIntegral &pixel = image[y * width + x];
+        BoundVec3 origin;
+        FreeVec3 direction;
+        if (!camera.generateRay(x, y, origin, direction)) {
+          EXPECT_EQ(pixel.num_voxels, 0);
+          EXPECT_EQ(pixel.opacity, 0.0);
+          continue;
+        }
+        const svr::RayIntegral expected = svr::integrateSphericalVolume(
+            Ray(origin, UnitVec3(direction)), grid, field.data(),
+            transfer_function, /*max_t=*/1.0);
+        EXPECT_EQ(pixel.num_voxels, expected.num_voxels);
+        EXPECT_DOUBLE_EQ(pixel.red, expected.red);
+        EXPECT_DOUBLE_EQ(pixel.opacity, expected.opacity);
+        num_opaque_pixels += pixel.opacity > 0.0;
+      }
+    }
+    EXPECT_GT(num_opaque_pixels, 0);
+  }
+}
+
+TEST(SphericalCoordinateTraversalWorkspace, ReusedWorkspaceMatchesTraversal) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 4;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  const std::vector<Ray> rays = {
+      Ray(BoundVec3(-3.0, 4.0, 5.0), UnitVec3(1.0, -1.0, -1.0)),
+      Ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0)),
+      Ray(BoundVec3(0.0, 0.0, 0.0), UnitVec3(1.0, 1.0, 1.0)),
+      Ray(BoundVec3(13.0, -15.0, 16.0), UnitVec3(-1.5, 1.2, -1.5))};
+  svr::TraversalWorkspace workspace(grid);
+  for (int repetition = 0; repetition < 2; ++repetition) {
+    for (const Ray &ray : rays) {
+      const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+      const auto &actual = walkSphericalVolume(ray, grid, /*max_t=*/1.0,
+                                               workspace);
+      EXPECT_EQ(&actual, &workspace.voxels());
+      ASSERT_EQ(actual.size(), expected.size());
+      for (std::size_t i = 0; i < actual.size(); ++i) {
+        EXPECT_EQ(actual[i].radial, expected[i].radial);
+        EXPECT_EQ(actual[i].polar, expected[i].polar);
+        EXPECT_EQ(actual[i].azimuthal, expected[i].azimuthal);
+        EXPECT_DOUBLE_EQ(actual[i].enter_t, expected[i].enter_t);
+        EXPECT_DOUBLE_EQ(actual[i].exit_t, expected[i].exit_t);
+      }
+    }
+  }
+}
+
+TEST(SphericalVoxelGrid, PackedAngularBoundariesMatchMaxRadiusSegments) {
+  const BoundVec3 sphere_center(1.0, -2.0, 3.0);
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = M_PI};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound,
+                                     /*num_radial_sections=*/4,
+                                     /*num_polar_sections=*/7,
+                                     /*num_azimuthal_sections=*/5,
+                                     sphere_center);
+  for (std::size_t i = 0; i <= grid.numPolarSections(); ++i) {
+    const svr::AngularBoundary &boundary = grid.polarBoundary(i);
+    const svr::TrigonometricValues &trig_value = grid.polarTrigValues()[i];
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&boundary) % 32, 0);
+    EXPECT_DOUBLE_EQ(boundary.P1,
+                     10.0 * trig_value.cosine + sphere_center.x());
+    EXPECT_DOUBLE_EQ(boundary.P2, 10.0 * trig_value.sine + sphere_center.y());
+    EXPECT_DOUBLE_EQ(boundary.center_to_bound_1,
+                     sphere_center.x() - boundary.P1);
+    EXPECT_DOUBLE_EQ(boundary.center_to_bound_2,
+                     sphere_center.y() - boundary.P2);
+  }
+  for (std::size_t i = 0; i <= grid.numAzimuthalSections(); ++i) {
+    const svr::AngularBoundary &boundary = grid.azimuthalBoundary(i);
+    const svr::TrigonometricValues &trig_value =
+        grid.azimuthalTrigValues()[i];
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&boundary) % 32, 0);
+    EXPECT_DOUBLE_EQ(boundary.P1,
+                     10.0 * trig_value.cosine + sphere_center.x());
+    EXPECT_DOUBLE_EQ(boundary.P2, 10.0 * trig_value.sine + sphere_center.z());
+    EXPECT_DOUBLE_EQ(boundary.center_to_bound_1,
+                     sphere_center.x() - boundary.P1);
+    EXPECT_DOUBLE_EQ(boundary.center_to_bound_2,
+                     sphere_center.z() - boundary.P2);
+  }
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(grid.deltaRadiiSquared().data()) %
+                svr::CACHE_LINE_SIZE,
+            0);
+}
+
+TEST(AngularVoxelID, ConstantTimeLookupMatchesLinearSearch) {
+  const BoundVec3 sphere_center(1.0, 2.0, 3.0);
+  const double radius = 10.0;
+  const std::vector<double> max_bounds = {TAU, M_PI, M_PI / 2.0};
+  for (const double max_bound_polar : max_bounds) {
+    for (const std::size_t num_sections : {9, 16, 100, 1024}) {
+      const svr::SphereBound max_bound = {
+          .radial = radius, .polar = max_bound_polar, .azimuthal = TAU};
+      const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4,
+                                         num_sections, 4, sphere_center);
+      // Sample angles between each boundary, on each boundary, and outside
+      // of the grid's polar bounds.
+      for (std::size_t i = 0; i < 4 * num_sections + 8; ++i) {
+        const double theta = -1.0 + i * grid.deltaTheta() / 2.0;
+        const double p1 = sphere_center.x() + radius * std::cos(theta);
+        const double p2 = sphere_center.y() + radius * std::sin(theta);
+        const svr::internal::MaxRadiusBoundarySegments<double> P_max =
+            svr::internal::polarMaxRadiusSegments(grid);
+        EXPECT_EQ(svr::internal::findAngularVoxelID(
+                      P_max, p1, p2,
+                      std::atan2(p2 - sphere_center.y(),
+                                 p1 - sphere_center.x()),
+                      grid.sphereMinBoundPolar(), grid.deltaTheta()),
+                  svr::internal::calculateAngularVoxelIDFromPoints(P_max, p1,
+                                                                   p2));
+        // Similarly, for points along a circle of smaller radius.
+        const double inner_radius = 4.5;
+        const svr::internal::RadiusBoundarySegments<double> P_inner{
+            grid.polarTrigValues().data(), grid.polarTrigValues().size(),
+            inner_radius, sphere_center.x(), sphere_center.y()};
+        const double q1 = sphere_center.x() + inner_radius * std::cos(theta);
+        const double q2 = sphere_center.y() + inner_radius * std::sin(theta);
+        EXPECT_EQ(svr::internal::findAngularVoxelID(
+                      P_inner, q1, q2, theta, grid.sphereMinBoundPolar(),
+                      grid.deltaTheta()),
+                  svr::internal::calculateAngularVoxelIDFromPoints(P_inner, q1,
+                                                                   q2));
+      }
+    }
+  }
+}
+
+TEST(SphericalVoxelGrid, IsFullSphere) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const svr::SphereBound full_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  EXPECT_TRUE(svr::SphericalVoxelGrid(MIN_BOUND, full_bound, 4, 4, 4,
+                                      sphere_center)
+                  .isFullSphere());
+  const svr::SphereBound polar_sector = {
+      .radial = 10.0, .polar = M_PI, .azimuthal = TAU};
+  EXPECT_FALSE(svr::SphericalVoxelGrid(MIN_BOUND, polar_sector, 4, 4, 4,
+                                       sphere_center)
+                   .isFullSphere());
+  const svr::SphereBound azimuthal_sector = {
+      .radial = 10.0, .polar = TAU, .azimuthal = M_PI / 2.0};
+  EXPECT_FALSE(svr::SphericalVoxelGrid(MIN_BOUND, azimuthal_sector, 4, 4, 4,
+                                       sphere_center)
+                   .isFullSphere());
+}
+
+TEST(SphericalVoxelGrid, RadialEdgesMatchUniformGrid) {
+  const BoundVec3 sphere_center(1.0, -2.0, 0.5);
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid uniform(MIN_BOUND, max_bound, 4, 8, 8,
+                                        sphere_center);
+  const svr::SphericalVoxelGrid edges(MIN_BOUND, max_bound,
+                                      {0.0, 2.5, 5.0, 7.5, 10.0}, 8, 8,
+                                      sphere_center);
+  ASSERT_TRUE(uniform.isRadiallyUniform());
+  ASSERT_FALSE(edges.isRadiallyUniform());
+  ASSERT_EQ(edges.numRadialSections(), 4);
+  EXPECT_DOUBLE_EQ(edges.sphereMaxRadius(), 10.0);
+  // Rays that begin both outside and within the grid.
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.3, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 3.0, 0.5, j / 3.0),
+                        UnitVec3(-1.0, 0.25, 0.5));
+    }
+  }
+  for (const Ray &ray : rays) {
+    const auto expected = walkSphericalVolume(ray, uniform, /*max_t=*/1.0);
+    const auto actual = walkSphericalVolume(ray, edges, /*max_t=*/1.0);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (std::size_t k = 0; k < expected.size(); ++k) {
+      EXPECT_EQ(actual[k].radial, expected[k].radial);
+      EXPECT_EQ(actual[k].polar, expected[k].polar);
+      EXPECT_EQ(actual[k].azimuthal, expected[k].azimuthal);
+      EXPECT_DOUBLE_EQ(actual[k].enter_t, expected[k].enter_t);
+      EXPECT_DOUBLE_EQ(actual[k].exit_t, expected[k].exit_t);
+    }
+  }
+}
+
+TEST(SphericalVoxelGrid, RejectsInvalidRadialEdges) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  EXPECT_TRUE(
+      svr::SphericalVoxelGrid(MIN_BOUND, max_bound, 4, 4, 4, sphere_center)
+          .isValid());
+  EXPECT_TRUE(svr::SphericalVoxelGrid(MIN_BOUND, max_bound, {0.0, 10.0}, 4, 4,
+                                      sphere_center)
+                  .isValid());
+  EXPECT_FALSE(svr::SphericalVoxelGrid::logarithmic(
+                   {.radial = 1.0, .polar = 0.0, .azimuthal = 0.0}, max_bound,
+                   0, 4, 4, sphere_center)
+                   .isValid());
+  const std::vector<std::vector<double>> invalid_edges = {
+      {},
+      {10.0},
+      {0.0, 5.0, 5.0, 10.0},
+      {0.0, 7.5, 5.0, 10.0},
+      {-1.0, 5.0, 10.0},
+      {0.0, std::numeric_limits<double>::quiet_NaN(), 10.0}};
+  const Ray ray(BoundVec3(0.25, 0.5, -15.0), UnitVec3(0.0, 0.0, 1.0));
+  for (const std::vector<double> &radial_edges : invalid_edges) {
+    const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, radial_edges, 4,
+                                       4, sphere_center);
+    EXPECT_FALSE(grid.isValid());
+    // The grid remains safe to traverse.
+    ASSERT_EQ(grid.numRadialSections(), 1);
+    EXPECT_DOUBLE_EQ(grid.sphereMaxRadius(), 1.0);
+    for (const svr::SphericalVoxel &voxel :
+         walkSphericalVolume(ray, grid, /*max_t=*/1.0)) {
+      EXPECT_EQ(voxel.radial, 1);
+    }
+  }
+}
+
+TEST(SphericalVoxelGrid, RadialEntranceVoxelMatchesLinearSearch) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  for (const std::size_t num_sections : {1, 3, 64, 1000}) {
+    const std::vector<svr::SphericalVoxelGrid> grids = {
+        svr::SphericalVoxelGrid(MIN_BOUND, max_bound, num_sections, 4, 4,
+                                sphere_center),
+        svr::SphericalVoxelGrid::logarithmic(
+            {.radial = 0.01, .polar = 0.0, .azimuthal = 0.0}, max_bound,
+            num_sections, 4, 4, sphere_center)};
+    for (const svr::SphericalVoxelGrid &grid : grids) {
+      // Sample squared distances between each edge, on each edge, and
+      // outside of the grid.
+      std::vector<double> samples = {0.0, 100.0, 150.0};
+      for (std::size_t i = 0; i <= num_sections; ++i) {
+        const double radius_squared = grid.deltaRadiiSquared(i);
+        samples.push_back(radius_squared);
+        samples.push_back(std::nextafter(radius_squared, 0.0));
+        samples.push_back(std::nextafter(radius_squared, 200.0));
+        if (i < num_sections) {
+          samples.push_back(
+              (radius_squared + grid.deltaRadiiSquared(i + 1)) / 2.0);
+        }
+      }
+      for (const double SED_from_center : samples) {
+        std::size_t expected = 0;
+        while (expected < num_sections &&
+               SED_from_center < grid.deltaRadiiSquared(expected)) {
+          ++expected;
+        }
+        EXPECT_EQ(svr::internal::radialEntranceVoxel(grid, SED_from_center),
+                  static_cast<int>(expected));
+      }
+    }
+  }
+}
+
+TEST(SphericalVoxelGrid, LogarithmicRadialVoxelsContainRay) {
+  const BoundVec3 sphere_center(0.5, -1.0, 0.25);
+  const std::size_t num_radial_sections = 12;
+  const svr::SphericalVoxelGrid grid = svr::SphericalVoxelGrid::logarithmic(
+      {.radial = 0.05, .polar = 0.0, .azimuthal = 0.0},
+      {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, num_radial_sections, 4,
+      4, sphere_center);
+  ASSERT_EQ(grid.numRadialSections(), num_radial_sections);
+  // The edges grow by a constant factor from the innermost ball.
+  EXPECT_DOUBLE_EQ(grid.deltaRadiiSquared(0), 100.0);
+  EXPECT_DOUBLE_EQ(grid.deltaRadiiSquared(num_radial_sections - 1),
+                   0.05 * 0.05);
+  EXPECT_DOUBLE_EQ(grid.deltaRadiiSquared(num_radial_sections), 0.0);
+  const double ratio = grid.deltaRadiiSquared(1) / grid.deltaRadiiSquared(2);
+  for (std::size_t i = 1; i + 1 < num_radial_sections; ++i) {
+    EXPECT_NEAR(grid.deltaRadiiSquared(i) / grid.deltaRadiiSquared(i + 1),
+                ratio, 1e-9);
+  }
+  for (int i = -10; i <= 10; ++i) {
+    for (int j = -10; j <= 10; ++j) {
+      const Ray rays[] = {
+          Ray(BoundVec3(0.5 + i / 40.0, -1.0 + j / 40.0, -15.0),
+              UnitVec3(0.01, 0.02, 1.0)),
+          Ray(BoundVec3(0.5 + i / 400.0, -1.0, 0.25 + j / 400.0),
+              UnitVec3(1.0, 0.5, -0.25))};
+      for (const Ray &ray : rays) {
+        const auto voxels = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+        for (const svr::SphericalVoxel &voxel : voxels) {
+          // The midpoint of each voxel lies within its radial section.
+          const double distance_squared =
+              (ray.pointAtParameter((voxel.enter_t + voxel.exit_t) / 2.0) -
+               sphere_center)
+                  .squared_length();
+          EXPECT_LE(distance_squared, grid.deltaRadiiSquared(voxel.radial - 1));
+          EXPECT_GE(distance_squared, grid.deltaRadiiSquared(voxel.radial));
+        }
+        // The ray exits the grid through its outermost edge, including a ray
+        // that begins within the grid.
+        ASSERT_FALSE(voxels.empty());
+        EXPECT_NEAR(
+            (ray.pointAtParameter(voxels.back().exit_t) - sphere_center)
+                .length(),
+            10.0, 1e-9);
+      }
+    }
+  }
+}
+
+TEST(SphericalCoordinateTraversal, AngularVoxelsContainRay) {
+  // The sphere center is offset in each axis, and the outermost radial voxel
+  // is wide enough that rays cross angular boundaries within it as they exit.
+  // Sections of pi radians, as in the coarse grid of hemispheres, are not
+  // distinguished by their boundary points alone.
+  const BoundVec3 sphere_center(0.5, -0.25, 0.75);
+  for (const std::size_t num_sections : {8, 3, 2}) {
+    const double delta = TAU / num_sections;
+    const svr::SphericalVoxelGrid grid(
+        MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4,
+        num_sections, num_sections, sphere_center);
+    const auto within = [&](double angle, int voxel) {
+      angle -= TAU * std::floor(angle / TAU);
+      return angle >= voxel * delta - 1e-9 &&
+             angle <= (voxel + 1) * delta + 1e-9;
+    };
+    for (int i = -10; i <= 10; ++i) {
+      for (int j = -10; j <= 10; ++j) {
+        const Ray rays[] = {
+            Ray(BoundVec3(i * 0.9, j * 0.9, -15.0), UnitVec3(0.1, -0.2, 1.0)),
+            Ray(BoundVec3(i / 2.0 + 0.05, j / 3.0, 1.0),
+                UnitVec3(-1.0, 0.3, 0.2))};
+        for (const Ray &ray : rays) {
+          for (const svr::SphericalVoxel &voxel :
+               walkSphericalVolume(ray, grid, /*max_t=*/1.0)) {
+            const FreeVec3 midpoint =
+                ray.pointAtParameter((voxel.enter_t + voxel.exit_t) / 2.0) -
+                sphere_center;
+            EXPECT_TRUE(within(std::atan2(midpoint.y(), midpoint.x()),
+                               voxel.polar));
+            EXPECT_TRUE(within(std::atan2(midpoint.z(), midpoint.x()),
+                               voxel.azimuthal));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(SphericalCoordinateTraversal, SectoredGridExitsThroughMinimumBound) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = M_PI, .azimuthal = TAU}, 4, 8, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  // The ray leaves the upper hemisphere through the polar boundary at 0.
+  const Ray ray(BoundVec3(5.0, 15.0, 0.5), UnitVec3(0.0, -1.0, 0.0));
+  const auto voxels = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+  ASSERT_FALSE(voxels.empty());
+  for (const svr::SphericalVoxel &voxel : voxels) {
+    EXPECT_LE(voxel.polar, 2);
+  }
+  EXPECT_EQ(voxels.back().polar, 0);
+}
+
+TEST(SphericalVoxelGrid, CoarsenedGridSharesEdges) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = M_PI, .azimuthal = TAU}, 12, 8, 6,
+      BoundVec3(1.0, 0.0, -1.0));
+  const svr::SphericalVoxelGrid coarse = grid.coarsened(3, 4, 2);
+  ASSERT_EQ(coarse.numRadialSections(), 4);
+  ASSERT_EQ(coarse.numPolarSections(), 2);
+  ASSERT_EQ(coarse.numAzimuthalSections(), 3);
+  EXPECT_EQ(coarse.isFullSphere(), grid.isFullSphere());
+  EXPECT_DOUBLE_EQ(coarse.deltaRadius(), 3.0 * grid.deltaRadius());
+  for (std::size_t i = 0; i <= coarse.numRadialSections(); ++i) {
+    EXPECT_EQ(coarse.deltaRadiiSquared(i), grid.deltaRadiiSquared(3 * i));
+  }
+  for (std::size_t i = 0; i <= coarse.numPolarSections(); ++i) {
+    EXPECT_NEAR(coarse.polarTrigValue(i).cosine,
+                grid.polarTrigValue(4 * i).cosine, 1e-12);
+  }
+}
+
+namespace occupancy {
+
+constexpr std::size_t NUM_RADIAL = 12;
+constexpr std::size_t NUM_POLAR = 16;
+constexpr std::size_t NUM_AZIMUTHAL = 8;
+
+// A field that is zero except within alternating shells of bricks of 3 x 4 x 2
+// voxels, so that rays cross several runs of occupied bricks.
+std::vector<double> shellField() {
+  std::vector<double> field(NUM_RADIAL * NUM_POLAR * NUM_AZIMUTHAL, 0.0);
+  for (std::size_t r = 0; r < NUM_RADIAL; ++r) {
+    for (std::size_t p = 0; p < NUM_POLAR; ++p) {
+      for (std::size_t a = 0; a < NUM_AZIMUTHAL; ++a) {
+        if ((r / 3) % 2 == 1 || p / 4 == 1) {
+          field[(r * NUM_POLAR + p) * NUM_AZIMUTHAL + a] = 1.0 + r + a / 8.0;
+        }
+      }
+    }
+  }
+  return field;
+}
+
+}  // namespace occupancy
+
+TEST(OccupancyGrid, BuildsAndUpdatesValueRanges) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU},
+      occupancy::NUM_RADIAL, occupancy::NUM_POLAR, occupancy::NUM_AZIMUTHAL,
+      BoundVec3(0.0, 0.0, 0.0));
+  EXPECT_FALSE(svr::OccupancyGrid(grid, {.radial = 5, .polar = 4,
+                                         .azimuthal = 2})
+                   .isValid());
+  svr::OccupancyGrid occupancy(grid, {.radial = 3, .polar = 4, .azimuthal = 2});
+  ASSERT_TRUE(occupancy.isValid());
+  ASSERT_EQ(occupancy.numBricks(), 4 * 4 * 4);
+  EXPECT_EQ(occupancy.numOccupiedBricks(), occupancy.numBricks());
+
+  std::vector<double> field = occupancy::shellField();
+  svr::ThreadPool pool(4);
+  occupancy.build(field.data(), pool);
+  // Radial bricks 2 and 4 hold every polar brick, and radial bricks 1 and 3
+  // only polar brick 1.
+  EXPECT_EQ(occupancy.numOccupiedBricks(), 2 * 16 + 2 * 4);
+  EXPECT_TRUE(occupancy.isOccupied(occupancy.brickIndex(2, 3, 0)));
+  EXPECT_FALSE(occupancy.isOccupied(occupancy.brickIndex(1, 0, 0)));
+  EXPECT_TRUE(occupancy.isVoxelOccupied(1, 5, 7));
+  EXPECT_FALSE(occupancy.isVoxelOccupied(7, 8, 0));
+  const svr::ValueRange &range =
+      occupancy.valueRange(occupancy.brickIndex(2, 0, 1));
+  EXPECT_DOUBLE_EQ(range.min, 4.0 + 2.0 / 8.0);
+  EXPECT_DOUBLE_EQ(range.max, 6.0 + 3.0 / 8.0);
+
+  // Only the brick of the changed voxel is rebuilt.
+  const std::size_t changed = (6 * occupancy::NUM_POLAR + 8) *
+                              occupancy::NUM_AZIMUTHAL;
+  field[changed] = -2.0;
+  field[0] = 100.0;
+  occupancy.update(field.data(), &changed, 1, pool);
+  EXPECT_TRUE(occupancy.isVoxelOccupied(7, 8, 0));
+  EXPECT_EQ(occupancy.valueRange(occupancy.brickOfVoxel(7, 8, 0)).min, -2.0);
+  EXPECT_FALSE(occupancy.isVoxelOccupied(1, 0, 0));
+
+  // Reclassifying does not read the field.
+  occupancy.setTransparentRange(-2.0, 0.0);
+  EXPECT_FALSE(occupancy.isVoxelOccupied(7, 8, 0));
+  EXPECT_EQ(occupancy.numOccupiedBricks(), 2 * 16 + 2 * 4);
+}
+
+TEST(OccupancyGrid, InvalidBrickSizeUsesSingleVoxelBricks) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 4, 4, 4,
+      BoundVec3(0.0, 0.0, 0.0));
+  svr::OccupancyGrid occupancy(grid, {.radial = 3, .polar = 2, .azimuthal = 2});
+  EXPECT_FALSE(occupancy.isValid());
+  EXPECT_EQ(occupancy.brickSize().radial, 1);
+  EXPECT_EQ(occupancy.brickSize().polar, 1);
+  EXPECT_EQ(occupancy.brickSize().azimuthal, 1);
+  ASSERT_EQ(occupancy.numBricks(), 4 * 4 * 4);
+
+  std::vector<double> field(4 * 4 * 4, 0.0);
+  field[(2 * 4 + 1) * 4 + 3] = 1.0;
+  occupancy.build(field.data());
+  EXPECT_EQ(occupancy.numOccupiedBricks(), 1);
+  EXPECT_TRUE(occupancy.isVoxelOccupied(3, 1, 3));
+  EXPECT_EQ(occupancy.brickOfVoxel(3, 1, 3), (2 * 4 + 1) * 4 + 3);
+
+  const std::size_t changed = 63;
+  field[changed] = 2.0;
+  occupancy.update(field.data(), &changed, 1);
+  EXPECT_EQ(occupancy.numOccupiedBricks(), 2);
+  EXPECT_TRUE(occupancy.isVoxelOccupied(4, 3, 3));
+}
+
+TEST(SphericalCoordinateTraversalOccupancy, MatchesOccupiedVoxels) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU},
+      occupancy::NUM_RADIAL, occupancy::NUM_POLAR, occupancy::NUM_AZIMUTHAL,
+      BoundVec3(0.5, -0.25, 0.0));
+  svr::OccupancyGrid occupancy(grid, {.radial = 3, .polar = 4, .azimuthal = 2});
+  const std::vector<double> field = occupancy::shellField();
+  occupancy.build(field.data());
+  const auto is_long = [](const svr::SphericalVoxel &voxel) {
+    return voxel.exit_t - voxel.enter_t > 1e-9;
+  };
+  std::size_t num_skipped_voxels = 0;
+  for (int i = -8; i <= 8; ++i) {
+    for (int j = -8; j <= 8; ++j) {
+      const Ray rays[] = {
+          Ray(BoundVec3(i * 1.1, j * 1.1, -15.0), UnitVec3(0.05, -0.1, 1.0)),
+          Ray(BoundVec3(i / 2.0 + 0.05, j / 3.0, 1.0),
+              UnitVec3(-1.0, 0.3, 0.2))};
+      for (const Ray &ray : rays) {
+        for (const double max_t : {1.0, 0.6}) {
+          std::vector<svr::SphericalVoxel> expected;
+          for (const svr::SphericalVoxel &voxel :
+               walkSphericalVolume(ray, grid, max_t)) {
+            if (occupancy.isVoxelOccupied(voxel.radial, voxel.polar,
+                                          voxel.azimuthal) &&
+                is_long(voxel)) {
+              expected.push_back(voxel);
+            }
+          }
+          std::vector<svr::SphericalVoxel> actual;
+          svr::walkSphericalVolume(
+              ray, occupancy, max_t,
+              [&](int radial, int polar, int azimuthal, double enter_t,
+                  double exit_t) {
+                const svr::SphericalVoxel voxel = {.radial = radial,
+                                                   .polar = polar,
+                                                   .azimuthal = azimuthal,
+                                                   .enter_t = enter_t,
+                                                   .exit_t = exit_t};
+                EXPECT_TRUE(
+                    occupancy.isVoxelOccupied(radial, polar, azimuthal));
+                if (is_long(voxel)) actual.push_back(voxel);
+              });
+          num_skipped_voxels += walkSphericalVolume(ray, grid, max_t).size() -
+                                expected.size();
+          ASSERT_EQ(actual.size(), expected.size());
+          for (std::size_t k = 0; k < expected.size(); ++k) {
+            EXPECT_EQ(actual[k].radial, expected[k].radial);
+            EXPECT_EQ(actual[k].polar, expected[k].polar);
+            EXPECT_EQ(actual[k].azimuthal, expected[k].azimuthal);
+            EXPECT_NEAR(actual[k].enter_t, expected[k].enter_t, 1e-9);
+            EXPECT_NEAR(actual[k].exit_t, expected[k].exit_t, 1e-9);
+          }
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_skipped_voxels, 0);
+}
+
+TEST(SphericalCoordinateIntegrationOccupancy, MatchesIntegralWithoutOccupancy) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU},
+      occupancy::NUM_RADIAL, occupancy::NUM_POLAR, occupancy::NUM_AZIMUTHAL,
+      BoundVec3(0.0, 0.0, 0.0));
+  svr::OccupancyGrid occupancy(grid, {.radial = 3, .polar = 4, .azimuthal = 2});
+  const std::vector<double> field = occupancy::shellField();
+  occupancy.build(field.data());
+  const auto transfer_function = [](double value) -> svr::TransferSample {
+    return {.red = value / 16.0, .green = 1.0, .blue = 0.5,
+            .extinction = 0.02 * value};
+  };
+  for (int i = -12; i <= 12; ++i) {
+    const Ray ray(BoundVec3(i / 1.5, 1.0, -15.0), UnitVec3(0.1, -0.2, 1.0));
+    const svr::RayIntegral expected = svr::integrateSphericalVolume(
+        ray, grid, field.data(), transfer_function, /*max_t=*/1.0);
+    const svr::RayIntegral actual = svr::integrateSphericalVolume(
+        ray, occupancy, field.data(), transfer_function, /*max_t=*/1.0);
+    EXPECT_LE(actual.num_voxels, expected.num_voxels);
+    EXPECT_NEAR(actual.red, expected.red, 1e-12);
+    EXPECT_NEAR(actual.green, expected.green, 1e-12);
+    EXPECT_NEAR(actual.blue, expected.blue, 1e-12);
+    EXPECT_NEAR(actual.opacity, expected.opacity, 1e-12);
+  }
+}
+
+TEST(MultiResolutionGrid, HalvesSectionsAndReducesField) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 8, 6, 4,
+      BoundVec3(0.5, -0.5, 0.0));
+  const svr::MultiResolutionGrid levels(grid, /*max_levels=*/8);
+  // The polar sections are halved once, after which only the radial sections
+  // are even.
+  ASSERT_EQ(levels.numLevels(), 4);
+  const std::vector<std::vector<std::size_t>> expected_sections = {
+      {8, 6, 4}, {4, 3, 2}, {2, 3, 1}, {1, 3, 1}};
+  for (std::size_t level = 0; level < levels.numLevels(); ++level) {
+    EXPECT_EQ(levels.level(level).numRadialSections(),
+              expected_sections[level][0]);
+    EXPECT_EQ(levels.level(level).numPolarSections(),
+              expected_sections[level][1]);
+    EXPECT_EQ(levels.level(level).numAzimuthalSections(),
+              expected_sections[level][2]);
+    if (level > 0) {
+      EXPECT_GE(levels.voxelSize(level), levels.voxelSize(level - 1));
+    }
+  }
+  EXPECT_EQ(&levels.level(0), &grid);
+  EXPECT_EQ(svr::MultiResolutionGrid(grid, /*max_levels=*/2).numLevels(), 2);
+
+  // Each voxel of a level holds the mean of the voxels of the grid within it,
+  // weighted by the volume of their radial shells. The radial sections are
+  // 1.25 wide, and the innermost includes the ball within it.
+  const auto shell_volume = [](std::size_t r) {
+    const double outer = 10.0 - 1.25 * r;
+    const double inner = std::max(outer - 1.25, 0.0);
+    return outer * outer * outer - inner * inner * inner;
+  };
+  std::vector<double> field(8 * 6 * 4);
+  for (std::size_t i = 0; i < field.size(); ++i) field[i] = i % 7 + i / 10.0;
+  const svr::MultiResolutionField<double> field_levels(levels, field.data());
+  EXPECT_EQ(field_levels.level(0), field.data());
+  for (std::size_t level = 1; level < levels.numLevels(); ++level) {
+    const svr::SphericalVoxelGrid &coarse = levels.level(level);
+    const std::size_t radial_factor = 8 / coarse.numRadialSections();
+    const std::size_t polar_factor = 6 / coarse.numPolarSections();
+    const std::size_t azimuthal_factor = 4 / coarse.numAzimuthalSections();
+    std::size_t voxel = 0;
+    for (std::size_t r = 0; r < coarse.numRadialSections(); ++r) {
+      for (std::size_t p = 0; p < coarse.numPolarSections(); ++p) {
+        for (std::size_t a = 0; a < coarse.numAzimuthalSections(); ++a) {
+          double sum = 0.0;
+          double volume = 0.0;
+          for (std::size_t i = 0; i < radial_factor; ++i) {
+            const double weight = shell_volume(r * radial_factor + i);
+            for (std::size_t j = 0; j < polar_factor; ++j) {
+              for (std::size_t k = 0; k < azimuthal_factor; ++k) {
+                sum += weight * field[((r * radial_factor + i) * 6 +
+                                       p * polar_factor + j) *
+                                          4 +
+                                      a * azimuthal_factor + k];
+                volume += weight;
+              }
+            }
+          }
+          EXPECT_NEAR(field_levels.level(level)[voxel++], sum / volume, 1e-12);
+        }
+      }
+    }
+  }
+}
+
+TEST(MultiResolutionGrid, FootprintTraversalMatchesLevel) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 16, 16, 8,
+      BoundVec3(0.5, -0.5, 0.0));
+  const svr::MultiResolutionGrid levels(grid, /*max_levels=*/4);
+  ASSERT_EQ(levels.numLevels(), 4);
+  for (std::size_t level = 0; level < levels.numLevels(); ++level) {
+    // A footprint of no spread traverses the single level of its width.
+    const svr::RayFootprint footprint = {.width = levels.voxelSize(level),
+                                         .spread = 0.0};
+    EXPECT_EQ(levels.levelOfWidth(footprint.width), level);
+    for (int i = -12; i <= 12; i += 3) {
+      const Ray ray(BoundVec3(i, 0.5 * i, -15.0), UnitVec3(0.1, -0.2, 1.0));
+      std::vector<svr::SphericalVoxel> voxels;
+      svr::walkSphericalVolume(
+          ray, levels, footprint, /*max_t=*/0.8,
+          [&](std::size_t voxel_level, int radial, int polar, int azimuthal,
+              double enter_t, double exit_t) {
+            EXPECT_EQ(voxel_level, level);
+            voxels.push_back({.radial = radial,
+                              .polar = polar,
+                              .azimuthal = azimuthal,
+                              .enter_t = enter_t,
+                              .exit_t = exit_t});
+          });
+      const auto expected =
+          walkSphericalVolume(ray, levels.level(level), /*max_t=*/0.8);
+      ASSERT_EQ(voxels.size(), expected.size());
+      for (std::size_t k = 0; k < expected.size(); ++k) {
+        EXPECT_EQ(voxels[k].radial, expected[k].radial);
+        EXPECT_EQ(voxels[k].polar, expected[k].polar);
+        EXPECT_EQ(voxels[k].azimuthal, expected[k].azimuthal);
+        EXPECT_DOUBLE_EQ(voxels[k].enter_t, expected[k].enter_t);
+        EXPECT_DOUBLE_EQ(voxels[k].exit_t, expected[k].exit_t);
+      }
+    }
+  }
+}
+
+TEST(MultiResolutionGrid, FootprintIntegralCoarsensWithDistance) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU}, 16, 16, 8,
+      BoundVec3(0.5, -0.5, 0.0));
+  const svr::MultiResolutionGrid levels(grid, /*max_levels=*/4);
+  // A constant field is the same at every level, so the integral is that of
+  // the grid however the levels are chosen.
+  const std::vector<float> field(16 * 16 * 8, 0.5f);
+  const svr::MultiResolutionField<float> field_levels(levels, field.data());
+  const auto transfer_function = [](float value) -> svr::TransferSample {
+    return {.red = value, .green = 1.0, .blue = 0.25, .extinction = 0.1};
+  };
+  // The footprint reaches the voxel size of the coarsest level within the
+  // sphere.
+  const svr::RayFootprint footprint = {
+      .width = 0.0, .spread = levels.voxelSize(3) / 20.0};
+  for (int i = -8; i <= 8; i += 2) {
+    const Ray ray(BoundVec3(i, -0.5 * i, -15.0), UnitVec3(-0.05, 0.1, 1.0));
+    std::size_t previous_level = 0;
+    std::vector<svr::SphericalVoxel> voxels;
+    svr::walkSphericalVolume(
+        ray, levels, footprint, /*max_t=*/1.0,
+        [&](std::size_t level, int radial, int polar, int azimuthal,
+            double enter_t, double exit_t) {
+          EXPECT_GE(level, previous_level);
+          EXPECT_LE(footprint.timeOfWidth(levels.voxelSize(level)), exit_t);
+          previous_level = level;
+          voxels.push_back({.radial = radial,
+                            .polar = polar,
+                            .azimuthal = azimuthal,
+                            .enter_t = enter_t,
+                            .exit_t = exit_t});
+        });
+    const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+    if (expected.empty()) {
+      EXPECT_TRUE(voxels.empty());
+      continue;
+    }
+    // The voxels of the levels are contiguous, and span the traversal of the
+    // grid with fewer voxels once the levels coarsen.
+    ASSERT_FALSE(voxels.empty());
+    EXPECT_GT(previous_level, 0);
+    EXPECT_LT(voxels.size(), expected.size());
+    EXPECT_NEAR(voxels.front().enter_t, expected.front().enter_t, 1e-9);
+    EXPECT_NEAR(voxels.back().exit_t, expected.back().exit_t, 1e-9);
+    for (std::size_t k = 1; k < voxels.size(); ++k) {
+      EXPECT_NEAR(voxels[k].enter_t, voxels[k - 1].exit_t, 1e-9);
+    }
+    const svr::RayIntegral integral = svr::integrateSphericalVolume(
+        ray, field_levels, footprint, transfer_function, /*max_t=*/1.0,
+        /*opacity_threshold=*/1.0);
+    const svr::RayIntegral expected_integral = svr::integrateSphericalVolume(
+        ray, grid, field.data(), transfer_function, /*max_t=*/1.0,
+        /*opacity_threshold=*/1.0);
+    EXPECT_EQ(integral.num_voxels, voxels.size());
+    EXPECT_NEAR(integral.red, expected_integral.red, 1e-9);
+    EXPECT_NEAR(integral.opacity, expected_integral.opacity, 1e-9);
+  }
+
+  // The renderer integrates each pixel with the footprint of the camera.
+  const auto camera = svr::Camera::perspective(
+      BoundVec3(0.0, 0.0, -25.0), FreeVec3(0.0, 0.0, 1.0),
+      FreeVec3(0.0, 1.0, 0.0), /*width=*/9, /*height=*/7,
+      /*field_of_view=*/0.8);
+  std::vector<svr::RayIntegral> image(9 * 7);
+  svr::renderSphericalVolume(camera, field_levels, transfer_function,
+                             image.data());
+  const svr::RayFootprint camera_footprint = {.width = 0.0,
+                                              .spread = camera.pixelSize()};
+  for (std::size_t y = 0; y < 7; ++y) {
+    for (std::size_t x = 0; x < 9; ++x) {
+      BoundVec3 origin;
+      FreeVec3 direction;
+      ASSERT_TRUE(camera.generateRay(x, y, origin, direction));
+      const svr::RayIntegral expected = svr::integrateSphericalVolume(
+          Ray(origin, UnitVec3(direction)), field_levels, camera_footprint,
+          transfer_function, /*max_t=*/1.0);
+      EXPECT_EQ(image[y * 9 + x].num_voxels, expected.num_voxels);
+      EXPECT_DOUBLE_EQ(image[y * 9 + x].red, expected.red);
+    }
+  }
+}
+
+TEST(SectorDecomposition, PartitionsVoxels) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU},
+      occupancy::NUM_RADIAL, occupancy::NUM_POLAR, occupancy::NUM_AZIMUTHAL,
+      BoundVec3(0.0, 0.0, 0.0));
+  const svr::SectorCounts counts = {.radial = 2, .polar = 2, .azimuthal = 4};
+  EXPECT_FALSE(svr::SectorDecomposition(grid, counts, 16).isValid());
+  EXPECT_FALSE(svr::SectorDecomposition(
+                   grid, {.radial = 5, .polar = 2, .azimuthal = 4}, 0)
+                   .isValid());
+  const std::vector<double> field = occupancy::shellField();
+  std::vector<std::size_t> num_owners(field.size(), 0);
+  for (std::size_t sector = 0; sector < 16; ++sector) {
+    const svr::SectorDecomposition decomposition(grid, counts, sector);
+    ASSERT_TRUE(decomposition.isValid());
+    ASSERT_EQ(decomposition.numSectors(), 16);
+    ASSERT_EQ(decomposition.numSectorVoxels(), field.size() / 16);
+    std::vector<double> sector_field(decomposition.numSectorVoxels());
+    decomposition.copySectorField(field.data(), sector_field.data());
+    for (int r = 1; r <= static_cast<int>(occupancy::NUM_RADIAL); ++r) {
+      for (int p = 0; p < static_cast<int>(occupancy::NUM_POLAR); ++p) {
+        for (int a = 0; a < static_cast<int>(occupancy::NUM_AZIMUTHAL); ++a) {
+          if (!decomposition.isVoxelOccupied(r, p, a)) continue;
+          const std::size_t index =
+              ((r - 1) * occupancy::NUM_POLAR + p) * occupancy::NUM_AZIMUTHAL +
+              a;
+          ++num_owners[index];
+          EXPECT_EQ(sector_field[decomposition.sectorVoxelIndex(r, p, a)],
+                    field[index]);
+        }
+      }
+    }
+  }
+  EXPECT_TRUE(std::all_of(num_owners.begin(), num_owners.end(),
+                          [](std::size_t n) { return n == 1; }));
+  const svr::SectorDecomposition decomposition(grid, counts, 13);
+  EXPECT_EQ(decomposition.radialBegin(), 7);
+  EXPECT_EQ(decomposition.polarBegin(), 8);
+  EXPECT_EQ(decomposition.azimuthalBegin(), 2);
+}
+
+TEST(SphericalCoordinateIntegrationSector, CompositedSegmentsMatchIntegral) {
+  const svr::SphericalVoxelGrid grid(
+      MIN_BOUND, {.radial = 10.0, .polar = TAU, .azimuthal = TAU},
+      occupancy::NUM_RADIAL, occupancy::NUM_POLAR, occupancy::NUM_AZIMUTHAL,
+      BoundVec3(0.5, -0.25, 0.0));
+  const std::vector<double> field = occupancy::shellField();
+  const auto transfer_function = [](double value) -> svr::TransferSample {
+    return {.red = 1.0 + value / 16.0, .green = 1.0, .blue = 0.5,
+            .extinction = 0.01 + 0.02 * value};
+  };
+  std::vector<Ray> rays;
+  for (int i = -8; i <= 8; ++i) {
+    for (int j = -8; j <= 8; ++j) {
+      rays.emplace_back(BoundVec3(i * 1.1, j * 1.1, -15.0),
+                        UnitVec3(0.05, -0.1, 1.0));
+      rays.emplace_back(BoundVec3(i / 2.0 + 0.05, j / 3.0, 1.0),
+                        UnitVec3(-1.0, 0.3, 0.2));
+    }
+  }
+  const svr::SectorCounts counts = {.radial = 3, .polar = 2, .azimuthal = 2};
+  svr::ThreadPool pool(4);
+  for (const double max_t : {1.0, 0.6}) {
+    // A threshold of 1 composites every voxel, so that the segments and the
+    // whole grid composite the same voxels.
+    std::vector<svr::RaySegment> segments;
+    for (std::size_t sector = 0; sector < 12; ++sector) {
+      const svr::SectorDecomposition decomposition(grid, counts, sector);
+      std::vector<double> sector_field(decomposition.numSectorVoxels());
+      decomposition.copySectorField(field.data(), sector_field.data());
+      const std::vector<svr::RaySegment> sector_segments =
+          svr::integrateSphericalVolumeSegments(
+              rays.data(), rays.size(), decomposition, sector_field.data(),
+              transfer_function, max_t, /*opacity_threshold=*/1.0, pool);
+      for (const svr::RaySegment &segment : sector_segments) {
+        EXPECT_LT(segment.enter_t, segment.exit_t);
+        EXPECT_GT(segment.integral.num_voxels, 0);
+      }
+      segments.insert(segments.end(), sector_segments.begin(),
+                      sector_segments.end());
+    }
+    EXPECT_GT(segments.size(), rays.size());
+    std::vector<svr::RayIntegral> integrals(rays.size());
+    svr::compositeRaySegments(segments.data(), segments.size(),
+                              /*first_ray=*/0, rays.size(), integrals.data(),
+                              /*opacity_threshold=*/1.0);
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      const svr::RayIntegral expected = svr::integrateSphericalVolume(
+          rays[i], grid, field.data(), transfer_function, max_t,
+          /*opacity_threshold=*/1.0);
+      EXPECT_LE(integrals[i].num_voxels, expected.num_voxels);
+      EXPECT_NEAR(integrals[i].red, expected.red, 1e-9);
+      EXPECT_NEAR(integrals[i].green, expected.green, 1e-9);
+      EXPECT_NEAR(integrals[i].blue, expected.blue, 1e-9);
+      EXPECT_NEAR(integrals[i].opacity, expected.opacity, 1e-9);
+    }
+  }
+}
+
+TEST(SphericalCoordinateTraversal, FullSpherePolicyWrapsVoxelID) {
+  using svr::internal::FullSphere;
+  EXPECT_EQ(FullSphere::step(0, -1, 3), 2);
+  EXPECT_EQ(FullSphere::step(2, 1, 3), 0);
+  EXPECT_EQ(FullSphere::step(1, 2, 3), 0);
+  EXPECT_EQ(FullSphere::step(1, -2, 3), 2);
+  EXPECT_EQ(FullSphere::step(1, 0, 3), 1);
+}
+
+TEST(SphericalCoordinateTraversal, FullSpherePolicyMatchesSectoredPolicy) {
+  const BoundVec3 sphere_center(1.0, -1.0, 0.5);
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 16,
+                                     sphere_center);
+  ASSERT_TRUE(grid.isFullSphere());
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      const Ray ray(BoundVec3(i, j, -15.0), UnitVec3(0.3, -0.2, 1.0));
+      std::vector<svr::SphericalVoxel> full_sphere, sectored;
+      const auto collect = [](std::vector<svr::SphericalVoxel> &voxels) {
+        return [&voxels](int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) {
+          voxels.push_back({.radial = radial,
+                            .polar = polar,
+                            .azimuthal = azimuthal,
+                            .enter_t = enter_t,
+                            .exit_t = exit_t});
+        };
+      };
+      auto full_sphere_visitor = collect(full_sphere);
+      auto sectored_visitor = collect(sectored);
+      svr::internal::walkSphericalVolume<svr::internal::FullSphere,
+                                          svr::DefaultEngine>(
+          ray, grid, /*max_t=*/1.0, full_sphere_visitor);
+      svr::internal::walkSphericalVolume<svr::internal::Sectored,
+                                          svr::DefaultEngine>(
+          ray, grid, /*max_t=*/1.0, sectored_visitor);
+      ASSERT_EQ(full_sphere.size(), sectored.size());
+      for (std::size_t k = 0; k < sectored.size(); ++k) {
+        EXPECT_EQ(full_sphere[k].radial, sectored[k].radial);
+        EXPECT_EQ(full_sphere[k].polar, sectored[k].polar);
+        EXPECT_EQ(full_sphere[k].azimuthal, sectored[k].azimuthal);
+        EXPECT_DOUBLE_EQ(full_sphere[k].enter_t, sectored[k].enter_t);
+        EXPECT_DOUBLE_EQ(full_sphere[k].exit_t, sectored[k].exit_t);
+      }
+    }
+  }
+}
+
+TEST(SphericalCoordinateTraversal, PlaneEngineMatchesSegmentEngine) {
+  const BoundVec3 sphere_center(1.0, -2.0, 0.5);
+  const double sphere_max_radius = 10.0;
+  const std::vector<svr::SphereBound> max_bounds = {
+      {.radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU},
+      {.radial = sphere_max_radius, .polar = M_PI, .azimuthal = TAU / 3.0}};
+  for (const svr::SphereBound &max_bound : max_bounds) {
+    const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 6, 8, 12,
+                                       sphere_center);
+    std::vector<Ray> rays;
+    for (int i = -12; i <= 12; ++i) {
+      for (int j = -12; j <= 12; ++j) {
+        rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.3, -0.2, 1.0));
+        rays.emplace_back(BoundVec3(i / 3.0, 0.5, j / 3.0),
+                          UnitVec3(-1.0, 0.25, 0.5));
+      }
+    }
+    for (const Ray &ray : rays) {
+      std::vector<svr::SphericalVoxel> segment, plane;
+      const auto collect = [](std::vector<svr::SphericalVoxel> &voxels) {
+        return [&voxels](int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) {
+          voxels.push_back({.radial = radial,
+                            .polar = polar,
+                            .azimuthal = azimuthal,
+                            .enter_t = enter_t,
+                            .exit_t = exit_t});
+        };
+      };
+      svr::walkSphericalVolume<svr::SegmentEngine>(ray, grid, /*max_t=*/1.0,
+                                                   collect(segment));
+      svr::walkSphericalVolume<svr::PlaneEngine>(ray, grid, /*max_t=*/1.0,
+                                                 collect(plane));
+      ASSERT_EQ(plane.size(), segment.size());
+      for (std::size_t k = 0; k < segment.size(); ++k) {
+        EXPECT_EQ(plane[k].radial, segment[k].radial);
+        EXPECT_EQ(plane[k].polar, segment[k].polar);
+        EXPECT_EQ(plane[k].azimuthal, segment[k].azimuthal);
+        EXPECT_NEAR(plane[k].enter_t, segment[k].enter_t, 1e-9);
+        EXPECT_NEAR(plane[k].exit_t, segment[k].exit_t, 1e-9);
+      }
+    }
+  }
+}
+
+TEST(FloatingPointComparison, FastComparisonContainsRobustComparison) {
+  using svr::FastComparison;
+  using svr::RobustComparison;
+  const double values[] = {0.0,    1e-13, -1e-13, 1e-11, 1.0,
+                           1.0 + 1e-9,    1.0 + 1e-7,    -2.0,
+                           1e5,    1e5 + 1e-4,    1e5 + 1e-2};
+  for (const double a : values) {
+    for (const double b : values) {
+      if (RobustComparison::isEqual(a, b)) {
+        EXPECT_TRUE(FastComparison::isEqual(a, b)) << a << " " << b;
+      }
+      if (FastComparison::lessThan(a, b)) {
+        EXPECT_TRUE(RobustComparison::lessThan(a, b)) << a << " " << b;
+      }
+      EXPECT_EQ(FastComparison::isZero(a), RobustComparison::isZero(a)) << a;
+      EXPECT_EQ(FastComparison::lessThanZero(a),
+                RobustComparison::lessThanZero(a))
+          << a;
+    }
+  }
+  // Within the sum of the epsilons, but neither epsilon alone.
+  const double tolerance = svr::ABS_EPSILON + svr::REL_EPSILON * 1e-4;
+  EXPECT_FALSE(RobustComparison::isEqual(1e-4, 1e-4 + 0.9 * tolerance));
+  EXPECT_TRUE(FastComparison::isEqual(1e-4, 1e-4 + 0.9 * tolerance));
+  EXPECT_TRUE(FastComparison::lessThan(1e-4, 1e-4 + 1.1 * tolerance));
+}
+
+TEST(SphericalCoordinateTraversal, FastComparisonMatchesRobustComparison) {
+  const BoundVec3 sphere_center(1.0, -2.0, 0.5);
+  const std::vector<svr::SphereBound> max_bounds = {
+      {.radial = 10.0, .polar = TAU, .azimuthal = TAU},
+      {.radial = 10.0, .polar = M_PI, .azimuthal = TAU / 3.0}};
+  std::mt19937 generator(24);
+  std::uniform_real_distribution<double> position(-15.0, 15.0);
+  std::uniform_real_distribution<double> direction(-1.0, 1.0);
+  for (const svr::SphereBound &max_bound : max_bounds) {
+    const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 8, 12, 16,
+                                       sphere_center);
+    for (int i = 0; i < 2000; ++i) {
+      // Random rays lie far from the boundaries relative to the difference
+      // between the tolerances, so both policies traverse the same voxels.
+      const Ray ray(BoundVec3(position(generator), position(generator),
+                              position(generator) / 2.0),
+                    UnitVec3(direction(generator), direction(generator),
+                             direction(generator)));
+      const auto robust = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+      std::vector<svr::SphericalVoxel> segment, plane;
+      const auto collect = [](std::vector<svr::SphericalVoxel> &voxels) {
+        return [&voxels](int radial, int polar, int azimuthal, double enter_t,
+                         double exit_t) {
+          voxels.push_back({.radial = radial,
+                            .polar = polar,
+                            .azimuthal = azimuthal,
+                            .enter_t = enter_t,
+                            .exit_t = exit_t});
+        };
+      };
+      svr::walkSphericalVolume<svr::FastSegmentEngine>(
+          ray, grid, /*max_t=*/1.0, collect(segment));
+      svr::walkSphericalVolume<svr::FastPlaneEngine>(ray, grid, /*max_t=*/1.0,
+                                                     collect(plane));
+      for (const std::vector<svr::SphericalVoxel> *fast : {&segment, &plane}) {
+        ASSERT_EQ(fast->size(), robust.size());
+        for (std::size_t k = 0; k < robust.size(); ++k) {
+          EXPECT_EQ((*fast)[k].radial, robust[k].radial);
+          EXPECT_EQ((*fast)[k].polar, robust[k].polar);
+          EXPECT_EQ((*fast)[k].azimuthal, robust[k].azimuthal);
+          EXPECT_NEAR((*fast)[k].enter_t, robust[k].enter_t, 1e-9);
+          EXPECT_NEAR((*fast)[k].exit_t, robust[k].exit_t, 1e-9);
+        }
+      }
+    }
+  }
+}
+
+TEST(SphericalVoxelGridView, TraversalMatchesGrid) {
+  const BoundVec3 sphere_center(1.0, -2.0, 0.5);
+  const double sphere_max_radius = 10.0;
+  const std::vector<svr::SphereBound> max_bounds = {
+      {.radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU},
+      {.radial = sphere_max_radius, .polar = M_PI, .azimuthal = TAU / 3.0}};
+  for (const svr::SphereBound &max_bound : max_bounds) {
+    const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 6, 8, 12,
+                                       sphere_center);
+    // The view traverses the grid's tables through pointers, as a GPU kernel
+    // traverses their copies in device memory.
+    const svr::SphericalVoxelGridView view(grid);
+    std::vector<float> field(6 * 8 * 12);
+    for (std::size_t i = 0; i < field.size(); ++i) field[i] = i / 576.0f;
+    const auto transfer_function = [](float value) -> svr::TransferSample {
+      return {.red = value, .green = 1.0 - value, .blue = 0.5,
+              .extinction = 0.05 * value};
+    };
+    for (int i = -12; i <= 12; ++i) {
+      for (int j = -12; j <= 12; ++j) {
+        const Ray ray(BoundVec3(i, j, -15.0), UnitVec3(0.3, -0.2, 1.0));
+        std::vector<svr::SphericalVoxel> voxels;
+        svr::walkSphericalVolume(ray, view, /*max_t=*/1.0,
+                                 [&](int radial, int polar, int azimuthal,
+                                     double enter_t, double exit_t) {
+                                   voxels.push_back({.radial = radial,
+                                                     .polar = polar,
+                                                     .azimuthal = azimuthal,
+                                                     .enter_t = enter_t,
+                                                     .exit_t = exit_t});
+                                 });
+        const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+        // The view and the grid may be compiled to different instructions,
+        // e.g. fused multiply-adds, so the times are compared to within the
+        // epsilons of svr::isEqual().
+        ASSERT_EQ(voxels.size(), expected.size());
+        for (std::size_t k = 0; k < expected.size(); ++k) {
+          EXPECT_EQ(voxels[k].radial, expected[k].radial);
+          EXPECT_EQ(voxels[k].polar, expected[k].polar);
+          EXPECT_EQ(voxels[k].azimuthal, expected[k].azimuthal);
+          EXPECT_TRUE(svr::isEqual(voxels[k].enter_t, expected[k].enter_t))
+              << voxels[k].enter_t << " " << expected[k].enter_t;
+          EXPECT_TRUE(svr::isEqual(voxels[k].exit_t, expected[k].exit_t))
+              << voxels[k].exit_t << " " << expected[k].exit_t;
+        }
+
+        // The compositor of a GPU kernel matches integrateSphericalVolume().
+        using Compositor = svr::internal::RayCompositor<
+            double, float, decltype(transfer_function)>;
+        Compositor compositor(field.data(), transfer_function,
+                              view.numPolarSections(),
+                              view.numAzimuthalSections(),
+                              /*opacity_threshold=*/0.5);
+        svr::walkSphericalVolume(ray, view, /*max_t=*/1.0, compositor);
+        const svr::RayIntegral integral = svr::integrateSphericalVolume(
+            ray, grid, field.data(), transfer_function, /*max_t=*/1.0,
+            /*opacity_threshold=*/0.5);
+        EXPECT_EQ(compositor.integral().num_voxels, integral.num_voxels);
+        EXPECT_TRUE(svr::isEqual(compositor.integral().red, integral.red))
+            << compositor.integral().red << " " << integral.red;
+        EXPECT_TRUE(
+            svr::isEqual(compositor.integral().opacity, integral.opacity))
+            << compositor.integral().opacity << " " << integral.opacity;
+      }
+    }
+  }
+}
+
+#ifdef SVR_ENABLE_GPU
+TEST(SphericalCoordinateTraversalGPU, MatchesBatchTraversal) {
+  const BoundVec3 sphere_center(1.0, -2.0, 0.5);
+  const double sphere_max_radius = 10.0;
+  const std::vector<svr::SphereBound> max_bounds = {
+      {.radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU},
+      {.radial = sphere_max_radius, .polar = M_PI, .azimuthal = TAU / 3.0}};
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.3, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 3.0, 0.5, j / 3.0),
+                        UnitVec3(-1.0, 0.25, 0.5));
+    }
+  }
+  for (const svr::SphereBound &max_bound : max_bounds) {
+    const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 6, 8, 12,
+                                       sphere_center);
+    const svr::DeviceSphericalVoxelGrid device_grid(grid);
+    ASSERT_TRUE(device_grid.isValid());
+    svr::SphericalVoxelBatch batch;
+    ASSERT_TRUE(svr::walkSphericalVolumeBatchGPU(
+        rays.data(), rays.size(), device_grid, /*max_t=*/1.0, batch));
+    const auto expected = svr::walkSphericalVolumeBatch(
+        rays.data(), rays.size(), grid, /*max_t=*/1.0);
+    // The voxels are identical; the times may differ by the contraction of
+    // floating point operations on the device.
+    ASSERT_EQ(batch.offsets, expected.offsets);
+    for (std::size_t i = 0; i < expected.voxels.size(); ++i) {
+      EXPECT_EQ(batch.voxels[i].radial, expected.voxels[i].radial);
+      EXPECT_EQ(batch.voxels[i].polar, expected.voxels[i].polar);
+      EXPECT_EQ(batch.voxels[i].azimuthal, expected.voxels[i].azimuthal);
+      EXPECT_TRUE(
+          svr::isEqual(batch.voxels[i].enter_t, expected.voxels[i].enter_t));
+      EXPECT_TRUE(
+          svr::isEqual(batch.voxels[i].exit_t, expected.voxels[i].exit_t));
+    }
+  }
+}
+#endif
+
+TEST(SphericalCoordinateTraversalPacket, MatchesSingleRayTraversal) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const std::size_t num_radial_sections = 4;
+  const std::size_t num_polar_sections = 8;
+  const std::size_t num_azimuthal_sections = 4;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, num_radial_sections,
+                                     num_polar_sections, num_azimuthal_sections,
+                                     sphere_center);
+  // Includes rays that miss the grid, rays that begin within the grid, and a
+  // final packet that is only partially filled.
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+      rays.emplace_back(BoundVec3(i / 2.0, j / 2.0, 0.5),
+                        UnitVec3(-1.0, 0.5, 0.25));
+    }
+  }
+  rays.emplace_back(BoundVec3(0.0, 0.0, -15.0), UnitVec3(0.0, 0.0, 1.0));
+  ASSERT_NE(rays.size() % svr::RAY_PACKET_SIZE, 0);
+
+  for (std::size_t begin = 0; begin < rays.size();
+       begin += svr::RAY_PACKET_SIZE) {
+    const std::size_t num_rays =
+        std::min(svr::RAY_PACKET_SIZE, rays.size() - begin);
+    std::vector<std::vector<svr::SphericalVoxel>> actual(num_rays);
+    svr::walkSphericalVolumePacket(
+        &rays[begin], num_rays, grid, /*max_t=*/1.0,
+        [&](std::size_t lane, int radial, int polar, int azimuthal,
+            double enter_t, double exit_t) {
+          ASSERT_LT(lane, num_rays);
+          actual[lane].push_back({.radial = radial,
+                                  .polar = polar,
+                                  .azimuthal = azimuthal,
+                                  .enter_t = enter_t,
+                                  .exit_t = exit_t});
+        });
+    for (std::size_t lane = 0; lane < num_rays; ++lane) {
+      const auto expected =
+          walkSphericalVolume(rays[begin + lane], grid, /*max_t=*/1.0);
+      ASSERT_EQ(actual[lane].size(), expected.size());
+      for (std::size_t j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(actual[lane][j].radial, expected[j].radial);
+        EXPECT_EQ(actual[lane][j].polar, expected[j].polar);
+        EXPECT_EQ(actual[lane][j].azimuthal, expected[j].azimuthal);
+        // The times may differ by rounding when multiply-adds are contracted
+        // differently in the vector and scalar code.
+        EXPECT_NEAR(actual[lane][j].enter_t, expected[j].enter_t, 1e-12);
+        EXPECT_NEAR(actual[lane][j].exit_t, expected[j].exit_t, 1e-12);
+      }
+    }
+  }
+}
+
+TEST(SphericalCoordinateTraversalPacket, VisitorStopsLaneEarly) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 4, 4,
+                                     sphere_center);
+  const std::vector<Ray> rays(svr::RAY_PACKET_SIZE,
+                              Ray(BoundVec3(-13.0, -13.0, -13.0),
+                                  UnitVec3(1.0, 1.0, 1.0)));
+  std::vector<std::size_t> visits(rays.size(), 0);
+  // Lane i stops after visiting i + 1 voxels.
+  svr::walkSphericalVolumePacket(
+      rays.data(), rays.size(), grid, /*max_t=*/1.0,
+      [&](std::size_t lane, int, int, int, double, double) {
+        return ++visits[lane] <= lane;
+      });
+  const std::size_t num_voxels =
+      walkSphericalVolume(rays[0], grid, /*max_t=*/1.0).size();
+  for (std::size_t lane = 0; lane < rays.size(); ++lane) {
+    EXPECT_EQ(visits[lane], std::min(lane + 1, num_voxels));
+  }
+}
+
+TEST(SphericalCoordinateTraversalPrecision, SinglePrecisionMatchesDouble) {
+  const BoundVec3 sphere_center(0.0, 0.0, 0.0);
+  const double sphere_max_radius = 10.0;
+  const svr::SphereBound max_bound = {
+      .radial = sphere_max_radius, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 4, 4,
+                                     sphere_center);
+  const svr::BasicSphericalVoxelGrid<float> float_grid(
+      {.radial = 0.0f, .polar = 0.0f, .azimuthal = 0.0f},
+      {.radial = 10.0f, .polar = float(TAU), .azimuthal = float(TAU)}, 4, 4, 4,
+      BasicBoundVec3<float>(0.0f, 0.0f, 0.0f));
+  const std::vector<Ray> rays = {
+      Ray(BoundVec3(-13.0, -13.0, -13.0), UnitVec3(1.0, 1.0, 1.0)),
+      Ray(BoundVec3(-15.0, 0.5, 0.5), UnitVec3(1.0, 0.0, 0.0)),
+      Ray(BoundVec3(2.0, -15.0, 1.0), UnitVec3(0.0, 1.0, 0.0)),
+      Ray(BoundVec3(-12.0, 3.0, -11.0), UnitVec3(1.0, -0.25, 1.0))};
+  for (const Ray &ray : rays) {
+    const BasicRay<float> float_ray(
+        BasicBoundVec3<float>(ray.origin().x(), ray.origin().y(),
+                              ray.origin().z()),
+        BasicUnitVec3<float>(ray.direction().x(), ray.direction().y(),
+                             ray.direction().z()));
+    const auto expected = walkSphericalVolume(ray, grid, /*max_t=*/1.0);
+    const auto actual =
+        walkSphericalVolume(float_ray, float_grid, /*max_t=*/1.0);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(actual[i].radial, expected[i].radial);
+      EXPECT_EQ(actual[i].polar, expected[i].polar);
+      EXPECT_EQ(actual[i].azimuthal, expected[i].azimuthal);
+      EXPECT_NEAR(actual[i].enter_t, expected[i].enter_t, 1e-4);
+      EXPECT_NEAR(actual[i].exit_t, expected[i].exit_t, 1e-4);
+    }
+  }
+}
+
+// Statistics are only collected if SVR_ENABLE_STATISTICS is defined. Every
+// iteration of the traversal either visits the voxel it exits, or remains in
+// the same voxel.
+TEST(TraversalStatistics, CountsStepsOfSingleRay) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = M_PI / 2.0, .azimuthal = M_PI / 2.0};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 1, 1,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  svr::resetTraversalStatistics();
+  const auto voxels = walkSphericalVolume(
+      Ray(BoundVec3(15.0, 15.0, 15.0), UnitVec3(-1.0, -1.0, -1.0)), grid,
+      /*max_t=*/1.0);
+  const svr::TraversalStatistics statistics = svr::threadTraversalStatistics();
+  if (!svr::traversalStatisticsEnabled()) {
+    EXPECT_EQ(statistics.num_rays, 0);
+    EXPECT_EQ(statistics.num_iterations, 0);
+    EXPECT_EQ(statistics.setup_nanoseconds, 0);
+    return;
+  }
+  EXPECT_EQ(statistics.num_rays, 1);
+  EXPECT_EQ(statistics.num_iterations,
+            voxels.size() + statistics.num_no_progress_steps);
+  // The ray exits through the polar and azimuthal bounds of the first octant.
+  EXPECT_EQ(statistics.num_polar_exits + statistics.num_azimuthal_exits, 1);
+  EXPECT_EQ(statistics.num_radial_steps + statistics.num_polar_steps +
+                statistics.num_azimuthal_steps +
+                statistics.num_radial_polar_steps +
+                statistics.num_radial_azimuthal_steps +
+                statistics.num_polar_azimuthal_steps +
+                statistics.num_radial_polar_azimuthal_steps,
+            statistics.num_iterations);
+  EXPECT_GT(statistics.setup_nanoseconds + statistics.stepping_nanoseconds, 0);
+}
+
+TEST(TraversalStatistics, AggregatesAcrossThreads) {
+  const svr::SphereBound max_bound = {
+      .radial = 10.0, .polar = TAU, .azimuthal = TAU};
+  const svr::SphericalVoxelGrid grid(MIN_BOUND, max_bound, 4, 8, 4,
+                                     BoundVec3(0.0, 0.0, 0.0));
+  std::vector<Ray> rays;
+  for (int i = -12; i <= 12; ++i) {
+    for (int j = -12; j <= 12; ++j) {
+      rays.emplace_back(BoundVec3(i, j, -15.0), UnitVec3(0.1, -0.2, 1.0));
+    }
+  }
+  svr::ThreadPool pool(3);
+  svr::resetTraversalStatistics();
+  const auto batch = svr::walkSphericalVolumeBatch(rays.data(), rays.size(),
+                                                   grid, /*max_t=*/1.0, pool);
+  const svr::TraversalStatistics statistics = svr::traversalStatistics();
+  if (!svr::traversalStatisticsEnabled()) {
+    EXPECT_EQ(statistics.num_rays, 0);
+    EXPECT_EQ(statistics.num_iterations, 0);
+    return;
+  }
+  std::size_t num_rays = 0;
+  for (std::size_t i = 0; i < rays.size(); ++i) {
+    num_rays += batch.offsets[i + 1] != batch.offsets[i];
+  }
+  EXPECT_EQ(statistics.num_rays, num_rays);
+  EXPECT_EQ(statistics.num_iterations,
+            batch.voxels.size() + statistics.num_no_progress_steps);
+  // A full sphere has no polar or azimuthal bounds to exit through.
+  EXPECT_EQ(statistics.num_polar_exits, 0);
+  EXPECT_EQ(statistics.num_azimuthal_exits, 0);
+  svr::resetTraversalStatistics();
+  EXPECT_EQ(svr::traversalStatistics().num_iterations, 0);
+}
+
 }  // namespace
@@ -0,0 +1,213 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace svr {
+
+namespace {
+
+constexpr std::uint64_t LOWER_32_BITS_MASK = 0xFFFFFFFFull;
+
+inline std::uint64_t packRange(std::uint64_t begin,
+                               std::uint64_t end) noexcept {
+  return (begin << 32) | end;
+}
+
+inline std::uint64_t rangeBegin(std::uint64_t packed) noexcept {
+  return packed >> 32;
+}
+
+inline std::uint64_t rangeEnd(std::uint64_t packed) noexcept {
+  return packed & LOWER_32_BITS_MASK;
+}
+
+// A job of a pool that the calling thread is running as one of its workers,
+// and the job that it is nested within, if any.
+struct WorkerFrame {
+  const ThreadPool *pool;
+  std::size_t worker_id;
+  const WorkerFrame *outer;
+};
+
+// The innermost job that the calling thread is running.
+thread_local const WorkerFrame *current_worker_frame = nullptr;
+
+// Marks the calling thread as a worker of the job of pool for its lifetime.
+class WorkerScope {
+ public:
+  WorkerScope(const ThreadPool *pool, std::size_t worker_id) noexcept
+      : frame_{pool, worker_id, current_worker_frame} {
+    current_worker_frame = &this->frame_;
+  }
+
+  ~WorkerScope() { current_worker_frame = this->frame_.outer; }
+
+  WorkerScope(const WorkerScope &) = delete;
+  WorkerScope &operator=(const WorkerScope &) = delete;
+
+ private:
+  const WorkerFrame frame_;
+};
+
+// Returns the innermost job of pool that the calling thread is running, or
+// nullptr if it is not a worker of pool.
+const WorkerFrame *findWorkerFrame(const ThreadPool *pool) noexcept {
+  const WorkerFrame *frame = current_worker_frame;
+  while (frame != nullptr && frame->pool != pool) frame = frame->outer;
+  return frame;
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  this->ranges_.reset(new WorkRange[num_threads]);
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    this->ranges_[i].packed.store(0, std::memory_order_relaxed);
+  }
+  this->workers_.reserve(num_threads - 1);
+  for (std::size_t id = 1; id < num_threads; ++id) {
+    this->workers_.emplace_back(&ThreadPool::workerLoop, this, id);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->shutdown_ = true;
+  }
+  this->job_ready_.notify_all();
+  for (auto &worker : this->workers_) worker.join();
+}
+
+ThreadPool &ThreadPool::global() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::parallelFor(std::size_t n, std::size_t grain,
+                             const RangeFunction &fn,
+                             std::size_t max_workers) {
+  if (n == 0) return;
+  grain = std::max<std::size_t>(grain, 1);
+  // A call from within a job of this pool would wait forever upon the job it
+  // is nested within, whose worker holds submit_mutex_, so its chunks are
+  // instead run inline by the calling worker.
+  if (const WorkerFrame *const frame = findWorkerFrame(this)) {
+    for (std::size_t begin = 0; begin < n;) {
+      const std::size_t end = n - begin > grain ? begin + grain : n;
+      fn(begin, end, frame->worker_id);
+      begin = end;
+    }
+    return;
+  }
+  std::lock_guard<std::mutex> submit_lock(this->submit_mutex_);
+  // Chunk indices must fit within 32 bits to be packed into a WorkRange.
+  const std::size_t max_chunks = LOWER_32_BITS_MASK;
+  if ((n + grain - 1) / grain > max_chunks) {
+    grain = (n + max_chunks - 1) / max_chunks;
+  }
+  const std::size_t num_chunks = (n + grain - 1) / grain;
+  std::size_t num_workers =
+      max_workers == 0 ? this->numThreads()
+                       : std::min(max_workers, this->numThreads());
+  num_workers = std::min(num_workers, num_chunks);
+
+  for (std::size_t id = 0; id < this->numThreads(); ++id) {
+    const std::uint64_t begin =
+        id < num_workers ? num_chunks * id / num_workers : 0;
+    const std::uint64_t end =
+        id < num_workers ? num_chunks * (id + 1) / num_workers : 0;
+    this->ranges_[id].packed.store(packRange(begin, end),
+                                   std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->fn_ = &fn;
+    this->n_ = n;
+    this->grain_ = grain;
+    this->active_workers_ = num_workers;
+    this->pending_workers_ = num_workers - 1;
+    ++this->generation_;
+  }
+  if (num_workers > 1) this->job_ready_.notify_all();
+
+  this->runWorker(/*worker_id=*/0);
+
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->job_done_.wait(lock, [this] { return this->pending_workers_ == 0; });
+  this->fn_ = nullptr;
+}
+
+void ThreadPool::workerLoop(std::size_t worker_id) {
+  std::uint64_t seen_generation = 0;
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  while (true) {
+    this->job_ready_.wait(lock, [&] {
+      return this->shutdown_ || this->generation_ != seen_generation;
+    });
+    if (this->shutdown_) return;
+    seen_generation = this->generation_;
+    if (worker_id >= this->active_workers_) continue;
+    lock.unlock();
+    this->runWorker(worker_id);
+    lock.lock();
+    if (--this->pending_workers_ == 0) this->job_done_.notify_one();
+  }
+}
+
+void ThreadPool::runWorker(std::size_t worker_id) {
+  const WorkerScope scope(this, worker_id);
+  std::atomic<std::uint64_t> &range = this->ranges_[worker_id].packed;
+  do {
+    std::uint64_t packed = range.load(std::memory_order_acquire);
+    while (rangeBegin(packed) < rangeEnd(packed)) {
+      const std::uint64_t chunk = rangeBegin(packed);
+      if (!range.compare_exchange_weak(packed,
+                                       packRange(chunk + 1, rangeEnd(packed)),
+                                       std::memory_order_acq_rel)) {
+        continue;
+      }
+      const std::size_t begin = chunk * this->grain_;
+      const std::size_t end = std::min(begin + this->grain_, this->n_);
+      (*this->fn_)(begin, end, worker_id);
+      packed = range.load(std::memory_order_acquire);
+    }
+  } while (this->steal(worker_id));
+}
+
+bool ThreadPool::steal(std::size_t thief_id) {
+  while (true) {
+    std::size_t victim_id = 0;
+    std::uint64_t victim_packed = 0;
+    std::uint64_t most_remaining = 0;
+    for (std::size_t id = 0; id < this->active_workers_; ++id) {
+      if (id == thief_id) continue;
+      const std::uint64_t packed =
+          this->ranges_[id].packed.load(std::memory_order_acquire);
+      const std::uint64_t begin = rangeBegin(packed);
+      const std::uint64_t end = rangeEnd(packed);
+      if (begin < end && end - begin > most_remaining) {
+        most_remaining = end - begin;
+        victim_id = id;
+        victim_packed = packed;
+      }
+    }
+    if (most_remaining == 0) return false;
+
+    const std::uint64_t end = rangeEnd(victim_packed);
+    const std::uint64_t split = end - (most_remaining + 1) / 2;
+    if (this->ranges_[victim_id].packed.compare_exchange_strong(
+            victim_packed, packRange(rangeBegin(victim_packed), split),
+            std::memory_order_acq_rel)) {
+      this->ranges_[thief_id].packed.store(packRange(split, end),
+                                           std::memory_order_release);
+      return true;
+    }
+  }
+}
+
+}  // namespace svr
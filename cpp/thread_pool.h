@@ -0,0 +1,103 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_THREAD_POOL_H
+#define SPHERICAL_VOLUME_RENDERING_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace svr {
+
+// A fixed-size pool of worker threads used to run batched traversals. Work is
+// submitted as a range [0, n) that is split into chunks of size grain. Each
+// participating worker begins with a contiguous share of the chunks. Once a
+// worker's share is exhausted, it steals half of the remaining chunks from the
+// worker with the most work left. This balances batches where the cost per
+// item varies greatly, e.g. rays that clip the edge of the sphere versus rays
+// that pass through its center.
+//
+// The thread calling parallelFor() participates as worker 0, so a pool of
+// size N spawns N - 1 background threads. Concurrent calls on the same pool
+// are serialized. A call nested within fn on the same pool, e.g. a batch
+// traversal within a parallelFor() on ThreadPool::global(), runs its chunks
+// inline on the calling worker, since the other workers are busy with the
+// outer call.
+class ThreadPool {
+ public:
+  // The function called for each chunk [begin, end) on worker worker_id, where
+  // 0 <= worker_id < numThreads().
+  using RangeFunction = std::function<void(
+      std::size_t begin, std::size_t end, std::size_t worker_id)>;
+
+  // Creates a pool with num_threads workers. If num_threads is 0, uses
+  // std::thread::hardware_concurrency().
+  explicit ThreadPool(std::size_t num_threads = 0);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  inline std::size_t numThreads() const noexcept {
+    return this->workers_.size() + 1;
+  }
+
+  // Calls fn for each chunk of [0, n) and blocks until all chunks have been
+  // processed. At most max_workers workers participate; if max_workers is 0,
+  // all workers of the pool participate. If called from within fn of this
+  // pool, every chunk is processed by the calling worker, with its worker_id.
+  void parallelFor(std::size_t n, std::size_t grain, const RangeFunction &fn,
+                   std::size_t max_workers = 0);
+
+  // Returns a lazily constructed pool shared by the batch traversal API. It
+  // uses std::thread::hardware_concurrency() workers.
+  static ThreadPool &global();
+
+ private:
+  // The chunks [begin, end) remaining for a worker, packed into a single word
+  // as (begin << 32 | end) so that it can be updated with one atomic
+  // compare-and-swap. Padded to a cache line to avoid false sharing between
+  // workers.
+  struct WorkRange {
+    std::atomic<std::uint64_t> packed;
+    char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  void workerLoop(std::size_t worker_id);
+
+  // Processes the chunks of worker_id, then steals from other workers until no
+  // chunks remain in the current job.
+  void runWorker(std::size_t worker_id);
+
+  // Attempts to steal half of the chunks from the worker with the most
+  // remaining. Returns false if there is nothing left to steal.
+  bool steal(std::size_t thief_id);
+
+  std::vector<std::thread> workers_;
+  std::unique_ptr<WorkRange[]> ranges_;
+
+  // Serializes calls to parallelFor().
+  std::mutex submit_mutex_;
+
+  // Guards the job state below and is used to signal the workers.
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable job_done_;
+  std::uint64_t generation_ = 0;
+  std::size_t active_workers_ = 0;
+  std::size_t pending_workers_ = 0;
+  bool shutdown_ = false;
+
+  // The current job.
+  const RangeFunction *fn_ = nullptr;
+  std::size_t n_ = 0;
+  std::size_t grain_ = 1;
+};
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_THREAD_POOL_H
@@ -0,0 +1,113 @@
+#include "traversal_statistics.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+namespace svr {
+
+namespace {
+
+// The counts of every live thread, and the sum of the counts of the threads
+// that have since exited.
+struct StatisticsRegistry {
+  std::mutex mutex;
+  std::vector<internal::ThreadStatistics *> threads;
+  std::uint64_t exited_counts[internal::NUM_STATISTICS] = {};
+};
+
+// Never destroyed, since threads may exit after static destruction begins.
+StatisticsRegistry &registry() noexcept {
+  static StatisticsRegistry *const registry = new StatisticsRegistry();
+  return *registry;
+}
+
+TraversalStatistics toTraversalStatistics(
+    const std::uint64_t (&counts)[internal::NUM_STATISTICS]) noexcept {
+  using namespace internal;
+  return {.num_rays = counts[NUM_RAYS],
+          .num_iterations = counts[NUM_ITERATIONS],
+          .num_radial_steps = counts[NUM_RADIAL_STEPS],
+          .num_polar_steps = counts[NUM_POLAR_STEPS],
+          .num_azimuthal_steps = counts[NUM_AZIMUTHAL_STEPS],
+          .num_radial_polar_steps = counts[NUM_RADIAL_POLAR_STEPS],
+          .num_radial_azimuthal_steps = counts[NUM_RADIAL_AZIMUTHAL_STEPS],
+          .num_polar_azimuthal_steps = counts[NUM_POLAR_AZIMUTHAL_STEPS],
+          .num_radial_polar_azimuthal_steps =
+              counts[NUM_RADIAL_POLAR_AZIMUTHAL_STEPS],
+          .num_no_progress_steps = counts[NUM_NO_PROGRESS_STEPS],
+          .num_angular_perturbations = counts[NUM_ANGULAR_PERTURBATIONS],
+          .num_polar_exits = counts[NUM_POLAR_EXITS],
+          .num_azimuthal_exits = counts[NUM_AZIMUTHAL_EXITS],
+          .num_entry_hints = counts[NUM_ENTRY_HINTS],
+          .setup_nanoseconds = counts[SETUP_NANOSECONDS],
+          .stepping_nanoseconds = counts[STEPPING_NANOSECONDS]};
+}
+
+void addCounts(const internal::ThreadStatistics &statistics,
+               std::uint64_t (&counts)[internal::NUM_STATISTICS]) noexcept {
+  for (std::size_t i = 0; i < internal::NUM_STATISTICS; ++i) {
+    counts[i] += statistics.counts[i].load(std::memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+namespace internal {
+
+ThreadStatistics::ThreadStatistics() noexcept {
+  for (std::atomic<std::uint64_t> &count : this->counts) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  StatisticsRegistry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.threads.push_back(this);
+}
+
+ThreadStatistics::~ThreadStatistics() {
+  StatisticsRegistry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  addCounts(*this, r.exited_counts);
+  r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+}
+
+}  // namespace internal
+
+bool traversalStatisticsEnabled() noexcept {
+#ifdef SVR_ENABLE_STATISTICS
+  return true;
+#else
+  return false;
+#endif
+}
+
+TraversalStatistics traversalStatistics() noexcept {
+  StatisticsRegistry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::uint64_t counts[internal::NUM_STATISTICS];
+  std::copy(std::begin(r.exited_counts), std::end(r.exited_counts), counts);
+  for (const internal::ThreadStatistics *statistics : r.threads) {
+    addCounts(*statistics, counts);
+  }
+  return toTraversalStatistics(counts);
+}
+
+TraversalStatistics threadTraversalStatistics() noexcept {
+  std::uint64_t counts[internal::NUM_STATISTICS] = {};
+  addCounts(internal::threadStatistics(), counts);
+  return toTraversalStatistics(counts);
+}
+
+void resetTraversalStatistics() noexcept {
+  StatisticsRegistry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::fill(std::begin(r.exited_counts), std::end(r.exited_counts), 0);
+  for (internal::ThreadStatistics *statistics : r.threads) {
+    for (std::atomic<std::uint64_t> &count : statistics->counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+}  // namespace svr
@@ -0,0 +1,170 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_TRAVERSAL_STATISTICS_H
+#define SPHERICAL_VOLUME_RENDERING_TRAVERSAL_STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "host_device.h"
+
+// Traversal statistics are collected only if SVR_ENABLE_STATISTICS is defined,
+// e.g. with -DSVR_ENABLE_STATISTICS. Otherwise, the counters and timers below
+// are empty, and compile away entirely. The definition must be consistent
+// across all translation units, including traversal_statistics.cpp.
+
+namespace svr {
+
+// The counts collected over the traversals of one or more rays.
+struct TraversalStatistics {
+  // The number of rays that intersect the grid, and so are traversed.
+  std::uint64_t num_rays;
+
+  // The number of iterations of the traversal's main loop, i.e. the number of
+  // steps taken over all rays.
+  std::uint64_t num_iterations;
+
+  // The number of steps of each type returned by minimumIntersection(), i.e.
+  // the boundaries crossed by the step.
+  std::uint64_t num_radial_steps;
+  std::uint64_t num_polar_steps;
+  std::uint64_t num_azimuthal_steps;
+  std::uint64_t num_radial_polar_steps;
+  std::uint64_t num_radial_azimuthal_steps;
+  std::uint64_t num_polar_azimuthal_steps;
+  std::uint64_t num_radial_polar_azimuthal_steps;
+
+  // The number of steps after which the ray remains in the same voxel.
+  std::uint64_t num_no_progress_steps;
+
+  // The number of polar and azimuthal hits for which the ray intersects both
+  // voxel boundaries at once, and so is perturbed to find the next voxel.
+  std::uint64_t num_angular_perturbations;
+
+  // The number of rays that exit a sectored grid through its polar or
+  // azimuthal bounds.
+  std::uint64_t num_polar_exits;
+  std::uint64_t num_azimuthal_exits;
+
+  // The number of polar and azimuthal voxel IDs of entrance voxels confirmed
+  // from an EntryVoxel hint, each of which skips the search for its voxel.
+  std::uint64_t num_entry_hints;
+
+  // The time spent initializing each ray's traversal, and stepping through
+  // its voxels, in nanoseconds. For a packet traversal, these are the times
+  // for the packet as a whole.
+  std::uint64_t setup_nanoseconds;
+  std::uint64_t stepping_nanoseconds;
+};
+
+// Returns true if statistics are collected, i.e. SVR_ENABLE_STATISTICS is
+// defined.
+bool traversalStatisticsEnabled() noexcept;
+
+// Returns the statistics collected by all threads since the last call to
+// resetTraversalStatistics(). The counts of threads that are still traversing
+// rays may be partially updated.
+TraversalStatistics traversalStatistics() noexcept;
+
+// Returns the statistics collected by the calling thread since the last call
+// to resetTraversalStatistics(). For example, the statistics of a single ray
+// are those collected by its traversal following a reset.
+TraversalStatistics threadTraversalStatistics() noexcept;
+
+// Resets the statistics of all threads to zero. Must not be called while
+// other threads are traversing rays.
+void resetTraversalStatistics() noexcept;
+
+namespace internal {
+
+// The index of each count of TraversalStatistics. The steps are in the order
+// of VoxelIntersectionType.
+enum Statistic {
+  NUM_RAYS = 0,
+  NUM_ITERATIONS,
+  NUM_RADIAL_STEPS,
+  NUM_POLAR_STEPS,
+  NUM_AZIMUTHAL_STEPS,
+  NUM_RADIAL_POLAR_STEPS,
+  NUM_RADIAL_AZIMUTHAL_STEPS,
+  NUM_POLAR_AZIMUTHAL_STEPS,
+  NUM_RADIAL_POLAR_AZIMUTHAL_STEPS,
+  NUM_NO_PROGRESS_STEPS,
+  NUM_ANGULAR_PERTURBATIONS,
+  NUM_POLAR_EXITS,
+  NUM_AZIMUTHAL_EXITS,
+  NUM_ENTRY_HINTS,
+  SETUP_NANOSECONDS,
+  STEPPING_NANOSECONDS,
+  NUM_STATISTICS
+};
+
+// The counts of a single thread. Only the owning thread writes the counts,
+// so they are updated with relaxed loads and stores rather than atomic
+// read-modify-writes; they are atomic only so that traversalStatistics() may
+// read them from another thread.
+struct ThreadStatistics {
+  ThreadStatistics() noexcept;
+  ~ThreadStatistics();
+
+  std::atomic<std::uint64_t> counts[NUM_STATISTICS];
+};
+
+// Returns the counts of the calling thread.
+inline ThreadStatistics &threadStatistics() noexcept {
+  static thread_local ThreadStatistics statistics;
+  return statistics;
+}
+
+// Adds n to the given statistic of the calling thread. Statistics are not
+// collected by traversals on the GPU.
+SVR_HOST_DEVICE inline void countStatistic(Statistic statistic,
+                                           std::uint64_t n = 1) noexcept {
+#if defined(SVR_ENABLE_STATISTICS) && !defined(SVR_DEVICE_CODE)
+  std::atomic<std::uint64_t> &count = threadStatistics().counts[statistic];
+  count.store(count.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+#else
+  static_cast<void>(statistic);
+  static_cast<void>(n);
+#endif
+}
+
+// Measures the time between successive laps, e.g. the setup and stepping of a
+// traversal. The timer begins upon construction.
+class StatisticsTimer {
+ public:
+#ifdef SVR_ENABLE_STATISTICS
+  SVR_HOST_DEVICE inline StatisticsTimer() noexcept {
+#ifndef SVR_DEVICE_CODE
+    this->start_ = std::chrono::steady_clock::now();
+#endif
+  }
+
+  // Adds the time since the previous lap to the given statistic, and begins
+  // the next lap. On the GPU, this has no effect.
+  SVR_HOST_DEVICE inline void lap(Statistic statistic) noexcept {
+#ifndef SVR_DEVICE_CODE
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    countStatistic(statistic,
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       now - this->start_)
+                       .count());
+    this->start_ = now;
+#else
+    static_cast<void>(statistic);
+#endif
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+#else
+  SVR_HOST_DEVICE inline void lap(Statistic) noexcept {}
+#endif
+};
+
+}  // namespace internal
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_TRAVERSAL_STATISTICS_H
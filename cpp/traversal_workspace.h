@@ -0,0 +1,77 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_TRAVERSALWORKSPACE_H
+#define SPHERICAL_VOLUME_RENDERING_TRAVERSALWORKSPACE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "spherical_voxel_grid.h"
+
+namespace svr {
+
+// The buffers used by traversals that return voxels. Reusing one workspace
+// across many calls to svr::walkSphericalVolume() avoids allocating a voxel
+// vector on each call; once the buffer has grown to the size required by a
+// grid, no further allocations occur. A workspace must not be shared by
+// concurrent traversals, so one workspace should be used per thread.
+class TraversalWorkspace {
+ public:
+  TraversalWorkspace() = default;
+
+  // Reserves the buffers for traversals of the given grid.
+  inline explicit TraversalWorkspace(const SphericalVoxelGrid &grid) {
+    this->reserve(grid);
+  }
+
+  inline void reserve(const SphericalVoxelGrid &grid) {
+    this->voxels_.reserve(grid.numRadialSections() + grid.numPolarSections() +
+                          grid.numAzimuthalSections());
+  }
+
+  // The voxels traversed by the most recent call to svr::walkSphericalVolume()
+  // that returns voxels using this workspace.
+  inline std::vector<SphericalVoxel> &voxels() noexcept {
+    return this->voxels_;
+  }
+
+ private:
+  std::vector<SphericalVoxel> voxels_;
+};
+
+// The entrance voxels of a batch of rays, kept from one batch to the next as
+// the hints of svr::walkSphericalVolumeBatch(). For an animation, the rays of
+// each frame are given in the same order, e.g. that of the pixels, so that ray
+// i of a frame is hinted by ray i of the previous frame. After a cut, clear()
+// the hints, since the previous entrance voxels would no longer be near.
+class EntryVoxelHints {
+ public:
+  EntryVoxelHints() = default;
+
+  // Discards the hints, and holds num_rays entries without a hint.
+  inline void reset(std::size_t num_rays) {
+    this->entry_voxels_.assign(num_rays, EntryVoxel());
+  }
+
+  inline void clear() noexcept { this->entry_voxels_.clear(); }
+
+  inline std::size_t size() const noexcept {
+    return this->entry_voxels_.size();
+  }
+
+  // The entrance voxel of ray i of the most recent batch, or EntryVoxel() if
+  // it did not intersect the grid.
+  inline EntryVoxel &operator[](std::size_t i) noexcept {
+    return this->entry_voxels_[i];
+  }
+  inline const EntryVoxel &operator[](std::size_t i) const noexcept {
+    return this->entry_voxels_[i];
+  }
+
+  inline EntryVoxel *data() noexcept { return this->entry_voxels_.data(); }
+
+ private:
+  std::vector<EntryVoxel> entry_voxels_;
+};
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_TRAVERSALWORKSPACE_H
@@ -6,53 +6,61 @@
 #include <cmath>
 #include <numeric>
 
+#include "host_device.h"
+
 // The indices for Vec3. For example, Vec3[0] returns the x-direction.
 enum DirectionIndex { X_DIRECTION = 0, Y_DIRECTION = 1, Z_DIRECTION = 2 };
 
-// Represents a Euclidean vector in 3-dimensional space.
+// Represents a Euclidean vector in 3-dimensional space with components of the
+// floating point type T. Vec3 is the double precision vector used by default.
 // Assumes vectors take the form of:
 //      [x]
 //      [y]
 //      [z]
-struct Vec3 {
+template <class T>
+struct BasicVec3 {
  public:
-  constexpr inline Vec3(const double x, const double y, const double z) noexcept
+  using value_type = T;
+
+  SVR_HOST_DEVICE constexpr inline BasicVec3(const T x, const T y,
+                                             const T z) noexcept
       : e_{x, y, z} {}
 
-  constexpr inline Vec3() : e_{0.0, 0.0, 0.0} {}
+  SVR_HOST_DEVICE constexpr inline BasicVec3() : e_{T(0), T(0), T(0)} {}
 
-  constexpr inline double x() const noexcept { return this->e_[0]; }
+  SVR_HOST_DEVICE constexpr inline T x() const noexcept { return this->e_[0]; }
 
-  constexpr inline double y() const noexcept { return this->e_[1]; }
+  SVR_HOST_DEVICE constexpr inline T y() const noexcept { return this->e_[1]; }
 
-  constexpr inline double z() const noexcept { return this->e_[2]; }
+  SVR_HOST_DEVICE constexpr inline T z() const noexcept { return this->e_[2]; }
 
-  inline double &x() noexcept { return this->e_[0]; }
+  SVR_HOST_DEVICE inline T &x() noexcept { return this->e_[0]; }
 
-  inline double &y() noexcept { return this->e_[1]; }
+  SVR_HOST_DEVICE inline T &y() noexcept { return this->e_[1]; }
 
-  inline double &z() noexcept { return this->e_[2]; }
+  SVR_HOST_DEVICE inline T &z() noexcept { return this->e_[2]; }
 
-  inline double length() const noexcept {
+  SVR_HOST_DEVICE inline T length() const noexcept {
     return std::sqrt(this->e_[0] * this->e_[0] + this->e_[1] * this->e_[1] +
                      this->e_[2] * this->e_[2]);
   }
 
-  constexpr inline double squared_length() const noexcept {
+  SVR_HOST_DEVICE constexpr inline T squared_length() const noexcept {
     return e_[0] * e_[0] + e_[1] * e_[1] + e_[2] * e_[2];
   }
 
-  inline bool operator==(const Vec3 &other) const noexcept {
+  SVR_HOST_DEVICE inline bool operator==(
+      const BasicVec3 &other) const noexcept {
     return this->x() == other.x() && this->y() == other.y() &&
            this->z() == other.z();
   }
 
-  inline double operator[](const std::size_t index) const noexcept {
+  SVR_HOST_DEVICE inline T operator[](const std::size_t index) const noexcept {
     return e_[index];
   }
 
  private:
-  double e_[3];
+  T e_[3];
 };
 
 // A 3-dimensional free vector, which has no initial point. It has two main
@@ -63,156 +71,218 @@ struct Vec3 {
 //                  negligible or (b) non-existent. See: Langr, J. "Modern C++
 //                  Programming with Test-Driven Development: Code Better, Sleep
 //                  Better" [5.10]
-struct FreeVec3 : Vec3 {
-  constexpr inline explicit FreeVec3(const Vec3 &vec3) noexcept
-      : Vec3(vec3.x(), vec3.y(), vec3.z()) {}
+template <class T>
+struct BasicFreeVec3 : BasicVec3<T> {
+  SVR_HOST_DEVICE constexpr inline explicit BasicFreeVec3(
+      const BasicVec3<T> &vec3) noexcept
+      : BasicVec3<T>(vec3.x(), vec3.y(), vec3.z()) {}
 
-  constexpr inline FreeVec3() noexcept : Vec3() {}
+  SVR_HOST_DEVICE constexpr inline BasicFreeVec3() noexcept : BasicVec3<T>() {}
 
-  constexpr inline explicit FreeVec3(double x, double y, double z)
-      : Vec3(x, y, z) {}
+  SVR_HOST_DEVICE constexpr inline explicit BasicFreeVec3(T x, T y, T z)
+      : BasicVec3<T>(x, y, z) {}
 
-  constexpr inline double dot(const Vec3 &other) const noexcept {
+  SVR_HOST_DEVICE constexpr inline T dot(
+      const BasicVec3<T> &other) const noexcept {
     return this->x() * other.x() + this->y() * other.y() +
            this->z() * other.z();
   }
 
-  inline FreeVec3 &operator+=(const FreeVec3 &other) noexcept {
+  SVR_HOST_DEVICE constexpr inline BasicFreeVec3 cross(
+      const BasicVec3<T> &other) const noexcept {
+    return BasicFreeVec3(this->y() * other.z() - this->z() * other.y(),
+                         this->z() * other.x() - this->x() * other.z(),
+                         this->x() * other.y() - this->y() * other.x());
+  }
+
+  SVR_HOST_DEVICE inline BasicFreeVec3 &operator+=(
+      const BasicFreeVec3 &other) noexcept {
     this->x() += other.x();
     this->y() += other.y();
     this->z() += other.z();
     return *this;
   }
 
-  inline FreeVec3 &operator-=(const FreeVec3 &other) noexcept {
+  SVR_HOST_DEVICE inline BasicFreeVec3 &operator-=(
+      const BasicFreeVec3 &other) noexcept {
     this->x() -= other.x();
     this->y() -= other.y();
     this->z() -= other.z();
     return *this;
   }
 
-  inline FreeVec3 &operator*=(const double scalar) noexcept {
+  SVR_HOST_DEVICE inline BasicFreeVec3 &operator*=(const T scalar) noexcept {
     this->x() *= scalar;
     this->y() *= scalar;
     this->z() *= scalar;
     return *this;
   }
 
-  inline FreeVec3 &operator/=(const double scalar) noexcept {
+  SVR_HOST_DEVICE inline BasicFreeVec3 &operator/=(const T scalar) noexcept {
     this->x() /= scalar;
     this->y() /= scalar;
     this->z() /= scalar;
     return *this;
   }
 
-  inline bool operator==(const FreeVec3 &other) const noexcept {
+  SVR_HOST_DEVICE inline bool operator==(
+      const BasicFreeVec3 &other) const noexcept {
     return this->x() == other.x() && this->y() == other.y() &&
            this->z() == other.z();
   }
 };
 
-inline FreeVec3 operator+(const FreeVec3 &v) noexcept { return v; }
+// The scalar operands below are not used for template argument deduction, so
+// that, for example, a single precision vector may be scaled by 2.0.
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator+(
+    const BasicFreeVec3<T> &v) noexcept {
+  return v;
+}
 
-inline FreeVec3 operator-(const FreeVec3 &v) noexcept {
-  return FreeVec3(-v.x(), -v.y(), -v.z());
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator-(
+    const BasicFreeVec3<T> &v) noexcept {
+  return BasicFreeVec3<T>(-v.x(), -v.y(), -v.z());
 }
 
-inline FreeVec3 operator+(FreeVec3 v1, const FreeVec3 &v2) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator+(
+    BasicFreeVec3<T> v1, const BasicFreeVec3<T> &v2) noexcept {
   return v1 += v2;
 }
 
-inline FreeVec3 operator-(FreeVec3 v1, const FreeVec3 &v2) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator-(
+    BasicFreeVec3<T> v1, const BasicFreeVec3<T> &v2) noexcept {
   return v1 -= v2;
 }
 
-inline FreeVec3 operator*(FreeVec3 v, const double scalar) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator*(
+    BasicFreeVec3<T> v,
+    const typename BasicVec3<T>::value_type scalar) noexcept {
   return v *= scalar;
 }
 
-inline FreeVec3 operator/(FreeVec3 v, const double scalar) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator/(
+    BasicFreeVec3<T> v,
+    const typename BasicVec3<T>::value_type scalar) noexcept {
   return v /= scalar;
 }
 
 // A 3-dimensional bounded vector has a fixed start and end point. It represents
 // a fixed point in space, relative to some frame of reference.
-struct BoundVec3 : Vec3 {
-  constexpr inline explicit BoundVec3(const Vec3 &vec3) noexcept
-      : Vec3(vec3.x(), vec3.y(), vec3.z()) {}
+template <class T>
+struct BasicBoundVec3 : BasicVec3<T> {
+  SVR_HOST_DEVICE constexpr inline explicit BasicBoundVec3(
+      const BasicVec3<T> &vec3) noexcept
+      : BasicVec3<T>(vec3.x(), vec3.y(), vec3.z()) {}
 
-  constexpr inline BoundVec3() : Vec3() {}
+  SVR_HOST_DEVICE constexpr inline BasicBoundVec3() : BasicVec3<T>() {}
 
-  constexpr inline explicit BoundVec3(double x, double y, double z) noexcept
-      : Vec3(x, y, z) {}
+  SVR_HOST_DEVICE constexpr inline explicit BasicBoundVec3(T x, T y,
+                                                           T z) noexcept
+      : BasicVec3<T>(x, y, z) {}
 
-  constexpr inline double dot(const Vec3 &other) const noexcept {
+  SVR_HOST_DEVICE constexpr inline T dot(
+      const BasicVec3<T> &other) const noexcept {
     return this->x() * other.x() + this->y() * other.y() +
            this->z() * other.z();
   }
 
-  inline BoundVec3 &operator+=(const FreeVec3 &other) noexcept {
+  SVR_HOST_DEVICE inline BasicBoundVec3 &operator+=(
+      const BasicFreeVec3<T> &other) noexcept {
     this->x() += other.x();
     this->y() += other.y();
     this->z() += other.z();
     return *this;
   }
 
-  inline BoundVec3 &operator-=(const FreeVec3 &other) noexcept {
+  SVR_HOST_DEVICE inline BasicBoundVec3 &operator-=(
+      const BasicFreeVec3<T> &other) noexcept {
     return *this += (-other);
   }
 
-  inline bool operator==(const BoundVec3 &other) const noexcept {
+  SVR_HOST_DEVICE inline bool operator==(
+      const BasicBoundVec3 &other) const noexcept {
     return this->x() == other.x() && this->y() == other.y() &&
            this->z() == other.z();
   }
 };
 
-inline FreeVec3 operator-(const BoundVec3 &v1, const BoundVec3 &v2) noexcept {
-  return FreeVec3(v1.x() - v2.x(), v1.y() - v2.y(), v1.z() - v2.z());
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator-(
+    const BasicBoundVec3<T> &v1, const BasicBoundVec3<T> &v2) noexcept {
+  return BasicFreeVec3<T>(v1.x() - v2.x(), v1.y() - v2.y(), v1.z() - v2.z());
 }
 
-inline BoundVec3 operator+(BoundVec3 v1, const FreeVec3 &v2) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicBoundVec3<T> operator+(
+    BasicBoundVec3<T> v1, const BasicFreeVec3<T> &v2) noexcept {
   return v1 += v2;
 }
 
-inline BoundVec3 operator-(BoundVec3 v1, const FreeVec3 &v2) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicBoundVec3<T> operator-(
+    BasicBoundVec3<T> v1, const BasicFreeVec3<T> &v2) noexcept {
   return v1 -= v2;
 }
 
 // Represents a 3-dimensional unit vector, an abstraction over free vectors that
 // guarantees a length of 1. To prevent its length from changing, UnitVec3 does
 // not allow for mutations.
-struct UnitVec3 {
-  inline explicit UnitVec3(double x, double y, double z) noexcept
-      : UnitVec3(FreeVec3(x, y, z)) {}
+template <class T>
+struct BasicUnitVec3 {
+  SVR_HOST_DEVICE inline explicit BasicUnitVec3(T x, T y, T z) noexcept
+      : BasicUnitVec3(BasicFreeVec3<T>(x, y, z)) {}
 
-  inline explicit UnitVec3(const Vec3 &vec3) noexcept
-      : UnitVec3(FreeVec3(vec3)) {}
+  SVR_HOST_DEVICE inline explicit BasicUnitVec3(
+      const BasicVec3<T> &vec3) noexcept
+      : BasicUnitVec3(BasicFreeVec3<T>(vec3)) {}
 
-  inline explicit UnitVec3(const FreeVec3 &free_vec3) noexcept
+  SVR_HOST_DEVICE inline explicit BasicUnitVec3(
+      const BasicFreeVec3<T> &free_vec3) noexcept
       : inner_(free_vec3 / free_vec3.length()) {}
 
-  inline double x() const noexcept { return this->to_free().x(); }
+  SVR_HOST_DEVICE inline T x() const noexcept { return this->to_free().x(); }
 
-  inline double y() const noexcept { return this->to_free().y(); }
+  SVR_HOST_DEVICE inline T y() const noexcept { return this->to_free().y(); }
 
-  inline double z() const noexcept { return this->to_free().z(); }
+  SVR_HOST_DEVICE inline T z() const noexcept { return this->to_free().z(); }
 
-  inline const FreeVec3 &to_free() const noexcept { return inner_; }
+  SVR_HOST_DEVICE inline const BasicFreeVec3<T> &to_free() const noexcept {
+    return inner_;
+  }
 
-  inline double operator[](const std::size_t index) const noexcept {
+  SVR_HOST_DEVICE inline T operator[](const std::size_t index) const noexcept {
     return this->to_free()[index];
   }
 
  private:
-  const FreeVec3 inner_;
+  const BasicFreeVec3<T> inner_;
 };
 
-inline FreeVec3 operator*(const UnitVec3 &v, const double scalar) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator*(
+    const BasicUnitVec3<T> &v,
+    const typename BasicVec3<T>::value_type scalar) noexcept {
   return v.to_free() * scalar;
 }
 
-inline FreeVec3 operator/(const UnitVec3 &v, const double scalar) noexcept {
+template <class T>
+SVR_HOST_DEVICE inline BasicFreeVec3<T> operator/(
+    const BasicUnitVec3<T> &v,
+    const typename BasicVec3<T>::value_type scalar) noexcept {
   return v.to_free() / scalar;
 }
 
+// The double precision vectors used throughout the traversal, unless a single
+// precision traversal is requested.
+using Vec3 = BasicVec3<double>;
+using FreeVec3 = BasicFreeVec3<double>;
+using BoundVec3 = BasicBoundVec3<double>;
+using UnitVec3 = BasicUnitVec3<double>;
+
 #endif  // SPHERICAL_VOLUME_RENDERING_VEC3_H
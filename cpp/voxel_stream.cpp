@@ -0,0 +1,322 @@
+#include "voxel_stream.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace svr {
+
+namespace {
+
+static_assert(sizeof(std::size_t) == sizeof(std::uint64_t),
+              "The offsets of a voxel stream are mapped as std::size_t.");
+static_assert(sizeof(VoxelStreamHeader) == 128,
+              "The voxel stream header must match voxel_stream.py.");
+static_assert(sizeof(VoxelStreamChunk) == 40,
+              "The voxel stream chunk must match voxel_stream.py.");
+
+// The alignment of each array of a voxel stream.
+constexpr std::size_t VOXEL_STREAM_ALIGNMENT = 8;
+
+inline std::size_t aligned(std::size_t size) noexcept {
+  return (size + VOXEL_STREAM_ALIGNMENT - 1) & ~(VOXEL_STREAM_ALIGNMENT - 1);
+}
+
+// The offsets of each array of a chunk from the beginning of the chunk, and
+// the size of the chunk. See voxel_stream.h for the layout.
+struct ChunkLayout {
+  std::size_t offsets;
+  std::size_t enter_times;
+  std::size_t index_offsets;
+  std::size_t exit_offsets;
+  std::size_t indices;
+  std::size_t steps;
+  std::size_t size;
+};
+
+ChunkLayout chunkLayout(const VoxelStreamChunk &chunk,
+                        CompactVoxelEncoding encoding) noexcept {
+  const bool steps = encoding == CompactVoxelEncoding::STEPS;
+  ChunkLayout layout;
+  layout.offsets = 0;
+  layout.enter_times =
+      layout.offsets + aligned((chunk.num_rays + 1) * sizeof(std::uint64_t));
+  layout.index_offsets =
+      layout.enter_times + aligned(chunk.num_rays * sizeof(double));
+  layout.exit_offsets =
+      layout.index_offsets +
+      (steps ? aligned((chunk.num_rays + 1) * sizeof(std::uint64_t)) : 0);
+  layout.indices =
+      layout.exit_offsets + aligned(chunk.num_voxels * sizeof(float));
+  layout.steps =
+      layout.indices + aligned(chunk.num_indices * sizeof(std::uint32_t));
+  layout.size = layout.steps + (steps ? aligned(chunk.num_voxels) : 0);
+  return layout;
+}
+
+// Returns true if the offsets of num_rays rays begin at 0, never decrease, and
+// end at num_values, so that the values of every ray are within the array.
+bool isValidOffsets(const std::size_t *offsets, std::size_t num_rays,
+                    std::size_t num_values) noexcept {
+  if (offsets[0] != 0 || offsets[num_rays] != num_values) return false;
+  for (std::size_t i = 0; i < num_rays; ++i) {
+    if (offsets[i] > offsets[i + 1]) return false;
+  }
+  return true;
+}
+
+// Returns true if the arrays of the batch have the sizes of its encoding, and
+// its offsets are valid, so that the chunk written matches chunkLayout().
+bool isConsistentBatch(const CompactVoxelBatch &batch) noexcept {
+  if (batch.offsets.empty()) return false;
+  const std::size_t num_rays = batch.numRays();
+  const std::size_t num_voxels = batch.exit_offsets.size();
+  if (batch.enter_times.size() != num_rays ||
+      !isValidOffsets(batch.offsets.data(), num_rays, num_voxels)) {
+    return false;
+  }
+  if (batch.encoding == CompactVoxelEncoding::PACKED) {
+    return batch.indices.size() == num_voxels;
+  }
+  return batch.steps.size() == num_voxels &&
+         batch.index_offsets.size() == num_rays + 1 &&
+         isValidOffsets(batch.index_offsets.data(), num_rays,
+                        batch.indices.size());
+}
+
+}  // namespace
+
+VoxelStreamWriter::VoxelStreamWriter(const std::string &path,
+                                     const SphericalVoxelGrid &grid,
+                                     CompactVoxelEncoding encoding)
+    : file_(std::fopen(path.c_str(), "wb")), grid_(grid), encoding_(encoding) {
+  // The header is written by close(); until then, the zeroed header marks the
+  // stream as unreadable.
+  const VoxelStreamHeader header = {};
+  if (this->file_ != nullptr && !this->writeArray(&header, sizeof(header))) {
+    std::fclose(this->file_);
+    this->file_ = nullptr;
+  }
+}
+
+VoxelStreamWriter::~VoxelStreamWriter() {
+  if (this->isOpen()) this->close();
+}
+
+bool VoxelStreamWriter::write(const Ray *rays, std::size_t num_rays,
+                              double max_t, ThreadPool &pool,
+                              std::size_t num_threads) {
+  if (!this->isOpen()) return false;
+  return this->write(walkSphericalVolumeCompactBatch(
+      rays, num_rays, this->grid_, max_t, this->encoding_, pool, num_threads));
+}
+
+bool VoxelStreamWriter::write(const double *ray_origins,
+                              const double *ray_directions,
+                              std::size_t num_rays, double max_t,
+                              std::size_t num_threads) {
+  std::vector<Ray> rays;
+  rays.reserve(num_rays);
+  for (std::size_t i = 0; i < num_rays; ++i) {
+    const double *origin = ray_origins + 3 * i;
+    const double *direction = ray_directions + 3 * i;
+    rays.emplace_back(BoundVec3(origin[0], origin[1], origin[2]),
+                      UnitVec3(direction[0], direction[1], direction[2]));
+  }
+  return this->write(rays.data(), num_rays, max_t, ThreadPool::global(),
+                     num_threads);
+}
+
+bool VoxelStreamWriter::write(const CompactVoxelBatch &batch) {
+  if (!this->isOpen() || batch.encoding != this->encoding_ ||
+      !(batch.codec == CompactVoxelCodec(this->grid_)) ||
+      !isConsistentBatch(batch)) {
+    return false;
+  }
+  const VoxelStreamChunk chunk = {.first_ray = this->num_rays_,
+                                  .num_rays = batch.numRays(),
+                                  .num_voxels = batch.exit_offsets.size(),
+                                  .num_indices = batch.indices.size(),
+                                  .file_offset = this->file_offset_};
+  const bool steps = this->encoding_ == CompactVoxelEncoding::STEPS;
+  const bool written =
+      this->writeArray(batch.offsets.data(),
+                       batch.offsets.size() * sizeof(std::size_t)) &&
+      this->writeArray(batch.enter_times.data(),
+                       batch.enter_times.size() * sizeof(double)) &&
+      (!steps ||
+       this->writeArray(batch.index_offsets.data(),
+                        batch.index_offsets.size() * sizeof(std::size_t))) &&
+      this->writeArray(batch.exit_offsets.data(),
+                       batch.exit_offsets.size() * sizeof(float)) &&
+      this->writeArray(batch.indices.data(),
+                       batch.indices.size() * sizeof(std::uint32_t)) &&
+      (!steps || this->writeArray(batch.steps.data(), batch.steps.size()));
+  if (!written) {
+    std::fclose(this->file_);
+    this->file_ = nullptr;
+    return false;
+  }
+  this->chunks_.push_back(chunk);
+  this->num_rays_ += chunk.num_rays;
+  this->num_voxels_ += chunk.num_voxels;
+  return true;
+}
+
+bool VoxelStreamWriter::close() {
+  if (!this->isOpen()) return false;
+  VoxelStreamHeader header = {};
+  std::memcpy(header.magic, VOXEL_STREAM_MAGIC, sizeof(header.magic));
+  header.version = VOXEL_STREAM_VERSION;
+  header.encoding = static_cast<std::uint32_t>(this->encoding_);
+  header.num_radial_sections = this->grid_.numRadialSections();
+  header.num_polar_sections = this->grid_.numPolarSections();
+  header.num_azimuthal_sections = this->grid_.numAzimuthalSections();
+  header.num_rays = this->num_rays_;
+  header.num_voxels = this->num_voxels_;
+  header.num_chunks = this->chunks_.size();
+  header.chunk_table_offset = this->file_offset_;
+  const bool written =
+      this->writeArray(this->chunks_.data(),
+                       this->chunks_.size() * sizeof(VoxelStreamChunk)) &&
+      std::fseek(this->file_, 0, SEEK_SET) == 0 &&
+      std::fwrite(&header, sizeof(header), 1, this->file_) == 1;
+  const bool closed = std::fclose(this->file_) == 0;
+  this->file_ = nullptr;
+  return written && closed;
+}
+
+bool VoxelStreamWriter::writeArray(const void *data, std::size_t size) {
+  static const char padding[VOXEL_STREAM_ALIGNMENT] = {};
+  const std::size_t padding_size = aligned(size) - size;
+  if ((size != 0 && std::fwrite(data, 1, size, this->file_) != size) ||
+      (padding_size != 0 &&
+       std::fwrite(padding, 1, padding_size, this->file_) != padding_size)) {
+    return false;
+  }
+  this->file_offset_ += size + padding_size;
+  return true;
+}
+
+VoxelStreamReader::VoxelStreamReader(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat status;
+  if (::fstat(fd, &status) != 0 ||
+      static_cast<std::size_t>(status.st_size) < sizeof(VoxelStreamHeader)) {
+    ::close(fd);
+    return;
+  }
+  const std::size_t size = status.st_size;
+  void *data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping remains valid once the file is closed.
+  ::close(fd);
+  if (data == MAP_FAILED) return;
+  this->data_ = static_cast<const char *>(data);
+  this->size_ = size;
+
+  // Validates the header and the chunk index, so that the views of chunks
+  // are within the file. The counts of each chunk are bounded by the file size
+  // before its layout is computed, so that the layout cannot overflow. The
+  // offsets of each chunk are then validated, so that decoding any ray reads
+  // only within its chunk.
+  const VoxelStreamHeader &header = this->header();
+  bool valid =
+      std::memcmp(header.magic, VOXEL_STREAM_MAGIC, sizeof(header.magic)) ==
+          0 &&
+      header.version == VOXEL_STREAM_VERSION &&
+      header.encoding <=
+          static_cast<std::uint32_t>(CompactVoxelEncoding::STEPS) &&
+      header.chunk_table_offset <= size &&
+      header.chunk_table_offset % VOXEL_STREAM_ALIGNMENT == 0 &&
+      header.num_chunks <= (size - header.chunk_table_offset) /
+                               sizeof(VoxelStreamChunk);
+  if (valid) {
+    const bool steps = this->encoding() == CompactVoxelEncoding::STEPS;
+    this->chunk_table_ = reinterpret_cast<const VoxelStreamChunk *>(
+        this->data_ + header.chunk_table_offset);
+    std::uint64_t first_ray = 0;
+    for (std::size_t i = 0; valid && i < header.num_chunks; ++i) {
+      const VoxelStreamChunk &chunk = this->chunk_table_[i];
+      valid = chunk.first_ray == first_ray && chunk.num_rays < size &&
+              chunk.num_voxels < size &&
+              (steps ? chunk.num_indices <= chunk.num_voxels
+                     : chunk.num_indices == chunk.num_voxels) &&
+              chunk.file_offset <= header.chunk_table_offset &&
+              chunk.file_offset % VOXEL_STREAM_ALIGNMENT == 0 &&
+              chunkLayout(chunk, this->encoding()).size <=
+                  header.chunk_table_offset - chunk.file_offset;
+      if (valid) {
+        const CompactVoxelView view = this->chunk(i);
+        valid = isValidOffsets(view.offsets, chunk.num_rays,
+                               chunk.num_voxels) &&
+                (!steps || isValidOffsets(view.index_offsets, chunk.num_rays,
+                                          chunk.num_indices));
+      }
+      first_ray += chunk.num_rays;
+    }
+    valid = valid && first_ray == header.num_rays;
+  }
+  if (!valid) {
+    ::munmap(const_cast<char *>(this->data_), this->size_);
+    this->data_ = nullptr;
+    this->chunk_table_ = nullptr;
+  }
+}
+
+VoxelStreamReader::~VoxelStreamReader() {
+  if (this->data_ != nullptr) {
+    ::munmap(const_cast<char *>(this->data_), this->size_);
+  }
+}
+
+std::size_t VoxelStreamReader::chunkOfRay(std::size_t ray) const noexcept {
+  const VoxelStreamChunk *const end = this->chunk_table_ + this->numChunks();
+  const VoxelStreamChunk *const next = std::upper_bound(
+      this->chunk_table_, end, ray,
+      [](std::size_t id, const VoxelStreamChunk &chunk) {
+        return id < chunk.first_ray;
+      });
+  return (next - this->chunk_table_) - 1;
+}
+
+CompactVoxelView VoxelStreamReader::chunk(std::size_t chunk) const noexcept {
+  const VoxelStreamHeader &header = this->header();
+  const VoxelStreamChunk &info = this->chunk_table_[chunk];
+  const CompactVoxelEncoding encoding = this->encoding();
+  const bool steps = encoding == CompactVoxelEncoding::STEPS;
+  const ChunkLayout layout = chunkLayout(info, encoding);
+  const char *const data = this->data_ + info.file_offset;
+  return {.encoding = encoding,
+          .codec = CompactVoxelCodec(header.num_radial_sections,
+                                     header.num_polar_sections,
+                                     header.num_azimuthal_sections),
+          .num_rays = info.num_rays,
+          .offsets = reinterpret_cast<const std::size_t *>(data +
+                                                           layout.offsets),
+          .enter_times =
+              reinterpret_cast<const double *>(data + layout.enter_times),
+          .exit_offsets =
+              reinterpret_cast<const float *>(data + layout.exit_offsets),
+          .indices =
+              reinterpret_cast<const std::uint32_t *>(data + layout.indices),
+          .steps = steps ? reinterpret_cast<const std::uint8_t *>(
+                               data + layout.steps)
+                         : nullptr,
+          .index_offsets = steps ? reinterpret_cast<const std::size_t *>(
+                                       data + layout.index_offsets)
+                                 : nullptr};
+}
+
+void VoxelStreamReader::decodeRay(std::size_t ray,
+                                  std::vector<SphericalVoxel> &voxels) const {
+  const std::size_t chunk = this->chunkOfRay(ray);
+  decodeCompactVoxels(this->chunk(chunk),
+                      ray - this->chunkInfo(chunk).first_ray, voxels);
+}
+
+}  // namespace svr
@@ -0,0 +1,194 @@
+#ifndef SPHERICAL_VOLUME_RENDERING_VOXEL_STREAM_H
+#define SPHERICAL_VOLUME_RENDERING_VOXEL_STREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "compact_voxel.h"
+#include "ray.h"
+#include "spherical_voxel_grid.h"
+#include "thread_pool.h"
+
+// A file of the voxels traversed by a set of rays that is too large to hold in
+// memory. The file is written in chunks of consecutive rays, each a
+// CompactVoxelBatch, by VoxelStreamWriter, and is memory-mapped by
+// VoxelStreamReader so that the voxels of any ray are read without copying or
+// retracing the file as a whole.
+//
+// The values are in the byte order of the machine that wrote the stream, as
+// with writeSphericalVoxelGrid(). A reader of the other byte order rejects the
+// stream, since its version does not match. Every array is aligned to 8 bytes,
+// so that each array may also be mapped with np.memmap. See voxel_stream.py.
+//   VoxelStreamHeader, at offset 0.
+//   The chunks, each at the offset given by its VoxelStreamChunk. A chunk of
+//   n rays with m voxels and k packed IDs holds, in order, each padded to 8
+//   bytes:
+//     offsets:       uint64[n + 1], relative to the chunk.
+//     enter_times:   float64[n].
+//     index_offsets: uint64[n + 1], for STEPS only.
+//     exit_offsets:  float32[m].
+//     indices:       uint32[k].
+//     steps:         uint8[m], for STEPS only.
+//   The index of the chunks, VoxelStreamChunk[num_chunks], at
+//   header.chunk_table_offset. The chunks are in ray order, so the chunk of a
+//   given ray is found by binary search.
+
+namespace svr {
+
+// The first 8 bytes of a voxel stream, and its version.
+constexpr char VOXEL_STREAM_MAGIC[8] = {'S', 'V', 'R', 'V', 'O', 'X', 'E', 'L'};
+constexpr std::uint32_t VOXEL_STREAM_VERSION = 1;
+
+struct VoxelStreamHeader {
+  char magic[8];
+  std::uint32_t version;
+  // A CompactVoxelEncoding.
+  std::uint32_t encoding;
+  std::uint64_t num_radial_sections;
+  std::uint64_t num_polar_sections;
+  std::uint64_t num_azimuthal_sections;
+  std::uint64_t num_rays;
+  std::uint64_t num_voxels;
+  std::uint64_t num_chunks;
+  std::uint64_t chunk_table_offset;
+  std::uint64_t reserved[7];
+};
+
+struct VoxelStreamChunk {
+  std::uint64_t first_ray;
+  std::uint64_t num_rays;
+  std::uint64_t num_voxels;
+  std::uint64_t num_indices;
+  // The offset of the chunk from the beginning of the file.
+  std::uint64_t file_offset;
+};
+
+// Writes a voxel stream, one chunk per call to write(). Only the chunk being
+// written is held in memory. The header and chunk index are written by close(),
+// so a stream that is not closed cannot be read.
+class VoxelStreamWriter {
+ public:
+  // Creates the file at path, which is truncated if it exists, for the voxels
+  // of rays traversed through grid, which must outlive the writer.
+  // CompactVoxelCodec(grid).isValid() must hold. Check isOpen() for whether
+  // the file was created.
+  VoxelStreamWriter(const std::string &path, const SphericalVoxelGrid &grid,
+                    CompactVoxelEncoding encoding);
+
+  // Closes the stream if it has not been closed.
+  ~VoxelStreamWriter();
+
+  VoxelStreamWriter(const VoxelStreamWriter &) = delete;
+  VoxelStreamWriter &operator=(const VoxelStreamWriter &) = delete;
+
+  inline bool isOpen() const noexcept { return this->file_ != nullptr; }
+
+  // The number of rays written, which is the ID of the next ray written.
+  inline std::size_t numRays() const noexcept { return this->num_rays_; }
+
+  inline const SphericalVoxelGrid &grid() const noexcept { return this->grid_; }
+
+  inline CompactVoxelEncoding encoding() const noexcept {
+    return this->encoding_;
+  }
+
+  // Traverses the rays through the grid with
+  // walkSphericalVolumeCompactBatch(), and appends them as a single chunk.
+  // Returns false if the chunk could not be written, in which case the stream
+  // is closed and is not readable.
+  bool write(const Ray *rays, std::size_t num_rays, double max_t,
+             ThreadPool &pool = ThreadPool::global(),
+             std::size_t num_threads = 0);
+
+  // Simplified parameters to Cythonize write(). The rays are given as with
+  // walkSphericalVolumeBatch().
+  bool write(const double *ray_origins, const double *ray_directions,
+             std::size_t num_rays, double max_t, std::size_t num_threads);
+
+  // Appends the batch as a single chunk. Returns false, leaving the stream
+  // open and unchanged, if the batch was not encoded for the grid and encoding
+  // of this stream, e.g. a PACKED batch given to a STEPS stream, or if its
+  // arrays are not of the sizes of its encoding. Otherwise, returns false as
+  // above if the chunk could not be written.
+  bool write(const CompactVoxelBatch &batch);
+
+  // Writes the chunk index and header, and closes the file. Returns false if
+  // either could not be written, or the stream is already closed.
+  bool close();
+
+ private:
+  bool writeArray(const void *data, std::size_t size);
+
+  std::FILE *file_;
+  const SphericalVoxelGrid &grid_;
+  const CompactVoxelEncoding encoding_;
+  std::size_t num_rays_ = 0;
+  std::size_t num_voxels_ = 0;
+  std::uint64_t file_offset_ = 0;
+  std::vector<VoxelStreamChunk> chunks_;
+};
+
+// Memory-maps a voxel stream written by VoxelStreamWriter. The voxels are
+// decoded from the mapped file on demand; apart from the offsets of each
+// chunk, which are validated when the stream is opened, pages that are not
+// read are never loaded from disk.
+class VoxelStreamReader {
+ public:
+  // Maps the file at path. Check isOpen() for whether the file could be
+  // mapped and is a valid, closed voxel stream, i.e. its header, chunk index,
+  // and the offsets of every chunk are consistent with the size of the file.
+  explicit VoxelStreamReader(const std::string &path);
+
+  ~VoxelStreamReader();
+
+  VoxelStreamReader(const VoxelStreamReader &) = delete;
+  VoxelStreamReader &operator=(const VoxelStreamReader &) = delete;
+
+  inline bool isOpen() const noexcept { return this->data_ != nullptr; }
+
+  inline CompactVoxelEncoding encoding() const noexcept {
+    return static_cast<CompactVoxelEncoding>(this->header().encoding);
+  }
+
+  inline std::size_t numRays() const noexcept {
+    return this->header().num_rays;
+  }
+
+  inline std::size_t numVoxels() const noexcept {
+    return this->header().num_voxels;
+  }
+
+  inline std::size_t numChunks() const noexcept {
+    return this->header().num_chunks;
+  }
+
+  inline const VoxelStreamChunk &chunkInfo(std::size_t chunk) const noexcept {
+    return this->chunk_table_[chunk];
+  }
+
+  // Returns the index of the chunk holding the given ray, where
+  // ray < numRays().
+  std::size_t chunkOfRay(std::size_t ray) const noexcept;
+
+  // Returns a view of the given chunk, whose arrays point into the mapped
+  // file. Ray i of the view is ray chunkInfo(chunk).first_ray + i.
+  CompactVoxelView chunk(std::size_t chunk) const noexcept;
+
+  // Decodes the voxels of the given ray, which are appended to voxels.
+  void decodeRay(std::size_t ray, std::vector<SphericalVoxel> &voxels) const;
+
+ private:
+  inline const VoxelStreamHeader &header() const noexcept {
+    return *reinterpret_cast<const VoxelStreamHeader *>(this->data_);
+  }
+
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+  const VoxelStreamChunk *chunk_table_ = nullptr;
+};
+
+}  // namespace svr
+
+#endif  // SPHERICAL_VOLUME_RENDERING_VOXEL_STREAM_H